@@ -0,0 +1,336 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "Atmosphere.hpp"
+
+
+
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <glm.hpp>
+#include <iostream>
+#include <vector>
+
+
+
+namespace finalPractice
+{
+	// Distances are in kilometers and scattering coefficients per kilometer
+	static const float     groundRadius       = 6360.f;
+	static const float     topRadius          = 6420.f;
+	static const float     viewerAltitude     = .2f;
+	static const glm::vec3 rayleighScattering = glm::vec3(5.802e-3f, 13.558e-3f, 33.1e-3f);
+	static const float     rayleighHeight     = 8.f;								// Altitude where the Rayleigh density falls to 1/e
+	static const float     mieScattering      = 3.996e-3f;
+	static const float     mieExtinction      = 4.440e-3f;
+	static const float     mieHeight          = 1.2f;
+	static const glm::vec3 ozoneAbsorption    = glm::vec3(.650e-3f, 1.881e-3f, .085e-3f);
+	static const float     ozoneCenter        = 25.f;								// Altitude of the peak of the ozone layer
+	static const float     ozoneHalfWidth     = 15.f;
+
+	static const unsigned  transmittanceSteps = 128;
+	static const unsigned  scatteringSteps    = 40;
+
+	static const float     pi = 3.14159265358979f;
+
+	// Header at the start of a cache file, followed by the transmittance, Rayleigh and Mie tables
+	struct Header
+	{
+		char	 magic[4];
+		uint32_t sizes[5];
+		float	 constants[16];															// The cache is only valid for the constants it was computed with
+	};
+
+	static const char magic[4] = { 'A', 'T', 'M', '1' };
+
+
+
+	// Density of every absorbing or scattering particle at an altitude, times its extinction coefficient
+	static glm::vec3 getExtinction(float altitude)
+	{
+		float rayleighDensity = std::exp(-altitude / rayleighHeight);
+		float mieDensity      = std::exp(-altitude / mieHeight);
+		float ozoneDensity    = std::max(1.f - std::abs(altitude - ozoneCenter) / ozoneHalfWidth, 0.f);
+
+		return rayleighScattering * rayleighDensity + glm::vec3(mieExtinction * mieDensity) + ozoneAbsorption * ozoneDensity;
+	}
+
+	// Distance from a point at radius r to the top of the atmosphere along a ray with the cosine mu of its zenith angle
+	static float getDistanceToTop(float r, float mu)
+	{
+		return -r * mu + std::sqrt(std::max(r * r * (mu * mu - 1.f) + topRadius * topRadius, 0.f));
+	}
+
+	// Distance from a point at radius r to the ground along a ray that hits it
+	static float getDistanceToGround(float r, float mu)
+	{
+		return -r * mu - std::sqrt(std::max(r * r * (mu * mu - 1.f) + groundRadius * groundRadius, 0.f));
+	}
+
+	static bool hitsGround(float r, float mu)
+	{
+		return mu < 0.f && r * r * (mu * mu - 1.f) + groundRadius * groundRadius >= 0.f;
+	}
+
+	// Radius and zenith cosine of the ray of a texel of the transmittance table (the mapping of Bruneton's model,
+	// which puts more texels near the horizon); x and y are in [0, 1] from the first to the last texel center
+	static void getTransmittanceRay(float x, float y, float & r, float & mu)
+	{
+		float horizon = std::sqrt(topRadius * topRadius - groundRadius * groundRadius);
+		float rho     = horizon * y;
+
+		r = std::sqrt(rho * rho + groundRadius * groundRadius);
+
+		float minDistance = topRadius - r;
+		float maxDistance = rho + horizon;
+		float distance    = minDistance + x * (maxDistance - minDistance);
+
+		mu = distance == 0.f ? 1.f : std::min(std::max((horizon * horizon - rho * rho - distance * distance) / (2.f * r * distance), -1.f), 1.f);
+	}
+
+	// Inverse of getTransmittanceRay
+	static void getTransmittanceCoordinates(float r, float mu, float & x, float & y)
+	{
+		float horizon = std::sqrt(topRadius * topRadius - groundRadius * groundRadius);
+		float rho     = std::sqrt(std::max(r * r - groundRadius * groundRadius, 0.f));
+
+		float minDistance = topRadius - r;
+		float maxDistance = rho + horizon;
+
+		x = (getDistanceToTop(r, mu) - minDistance) / (maxDistance - minDistance);
+		y = rho / horizon;
+	}
+
+	// Bilinear lookup in the transmittance table being computed
+	static glm::vec3 lookupTransmittance(const std::vector< glm::vec3 > & table, float r, float mu)
+	{
+		float x, y;
+
+		getTransmittanceCoordinates(r, mu, x, y);
+
+		float column = std::min(std::max(x, 0.f), 1.f) * float(Atmosphere::transmittanceWidth  - 1);
+		float row    = std::min(std::max(y, 0.f), 1.f) * float(Atmosphere::transmittanceHeight - 1);
+
+		unsigned left   = std::min(unsigned(column), Atmosphere::transmittanceWidth  - 2);
+		unsigned bottom = std::min(unsigned(row   ), Atmosphere::transmittanceHeight - 2);
+
+		float fx = column - float(left);
+		float fy = row    - float(bottom);
+
+		auto texel = [&] (unsigned i, unsigned j) { return table[size_t(j) * Atmosphere::transmittanceWidth + i]; };
+
+		return glm::mix(glm::mix(texel(left, bottom    ), texel(left + 1, bottom    ), fx),
+						glm::mix(texel(left, bottom + 1), texel(left + 1, bottom + 1), fx), fy);
+	}
+
+	// Elevation of a texel of the scattering tables, with more texels near the horizon (where the sky changes the most)
+	static float getElevation(float unit)
+	{
+		float x = unit * 2.f - 1.f;
+
+		return (x < 0.f ? -1.f : 1.f) * x * x * pi * .5f;
+	}
+
+	static RgbaHalf toHalf(const glm::vec3 & color)
+	{
+		return RgbaHalf{ { half_float::half(color.r), half_float::half(color.g), half_float::half(color.b), half_float::half(1.f) } };
+	}
+
+
+
+	Atmosphere::Atmosphere() :
+		transmittance(transmittanceWidth, transmittanceHeight				, ColorBuffer< RgbaHalf >::UNINITIALIZED),
+		rayleigh	 (scatteringWidth	, scatteringHeight * scatteringDepth, ColorBuffer< RgbaHalf >::UNINITIALIZED),
+		mie			 (scatteringWidth	, scatteringHeight * scatteringDepth, ColorBuffer< RgbaHalf >::UNINITIALIZED)
+	{
+	}
+
+
+
+	std::unique_ptr< Atmosphere > Atmosphere::load(const std::string& cachePath)
+	{
+		std::unique_ptr< Atmosphere > atmosphere(new Atmosphere());
+
+		Header expected;
+
+		std::memset(&expected, 0, sizeof(expected));
+		std::memcpy(expected.magic, magic, sizeof(magic));
+
+		const uint32_t sizes[] = { transmittanceWidth, transmittanceHeight, scatteringWidth, scatteringHeight, scatteringDepth };
+		const float    constants[] =
+		{
+			groundRadius, topRadius, viewerAltitude, rayleighScattering.r, rayleighScattering.g, rayleighScattering.b, rayleighHeight,
+			mieScattering, mieExtinction, mieHeight, ozoneAbsorption.r, ozoneAbsorption.g, ozoneAbsorption.b, ozoneCenter, ozoneHalfWidth,
+			float(transmittanceSteps * 1000 + scatteringSteps)
+		};
+
+		std::memcpy(expected.sizes    , sizes    , sizeof(sizes    ));
+		std::memcpy(expected.constants, constants, sizeof(constants));
+
+		ColorBuffer< RgbaHalf > * tables[] = { &atmosphere->transmittance, &atmosphere->rayleigh, &atmosphere->mie };
+
+		size_t tablesSize = 0;
+
+		for (ColorBuffer< RgbaHalf > * table : tables)
+			tablesSize += size_t(table->getWidth()) * table->getHeight() * sizeof(RgbaHalf);
+
+		{
+			MappedFile file(cachePath);
+
+			if (file.isOk() && file.getSize() == sizeof(Header) + tablesSize && std::memcmp(file.getData(), &expected, sizeof(Header)) == 0)
+			{
+				const uint8_t * data = file.getData() + sizeof(Header);
+
+				for (ColorBuffer< RgbaHalf > * table : tables)
+				{
+					size_t size = size_t(table->getWidth()) * table->getHeight() * sizeof(RgbaHalf);
+
+					std::memcpy(table->colors(), data, size);
+
+					data += size;
+				}
+
+				return atmosphere;
+			}
+		}
+
+		atmosphere->compute();
+
+		std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+
+		if (not file) // ERROR condition
+		{
+			std::cerr << "Couldn't write the atmosphere cache " << cachePath << std::endl;
+			return atmosphere;
+		}
+
+		file.write(reinterpret_cast< const char * >(&expected), sizeof(expected));
+
+		for (ColorBuffer< RgbaHalf > * table : tables)
+			file.write(reinterpret_cast< const char * >(table->colors()), std::streamsize(size_t(table->getWidth()) * table->getHeight() * sizeof(RgbaHalf)));
+
+		return atmosphere;
+	}
+
+
+
+	void Atmosphere::configureShader(GLuint shaderID) const
+	{
+		glUniform1f(glGetUniformLocation(shaderID, "ground_radius"), groundRadius);
+		glUniform1f(glGetUniformLocation(shaderID, "top_radius"   ), topRadius);
+		glUniform1f(glGetUniformLocation(shaderID, "viewer_radius"), groundRadius + viewerAltitude);
+	}
+
+
+
+	void Atmosphere::compute()
+	{
+		ThreadPool & pool = ThreadPool::getShared();
+
+		std::vector< std::future< void > > jobs;
+
+		// Transmittance: optical depth to the top of the atmosphere integrated with the trapezoidal rule, a row per job
+		std::vector< glm::vec3 > transmittanceTable(size_t(transmittanceWidth) * transmittanceHeight);
+
+		for (unsigned row = 0; row < transmittanceHeight; ++row)
+		{
+			jobs.push_back(pool.submit([row, &transmittanceTable] ()
+			{
+				for (unsigned column = 0; column < transmittanceWidth; ++column)
+				{
+					float r, mu;
+
+					getTransmittanceRay(float(column) / float(transmittanceWidth - 1), float(row) / float(transmittanceHeight - 1), r, mu);
+
+					float     step  = getDistanceToTop(r, mu) / float(transmittanceSteps);
+					glm::vec3 depth = glm::vec3(0.f);
+
+					for (unsigned i = 0; i <= transmittanceSteps; ++i)
+					{
+						float distance = float(i) * step;
+						float radius   = std::sqrt(distance * distance + 2.f * r * mu * distance + r * r);
+						float weight   = i == 0 || i == transmittanceSteps ? .5f : 1.f;
+
+						depth += getExtinction(radius - groundRadius) * (weight * step);
+					}
+
+					transmittanceTable[size_t(row) * transmittanceWidth + column] = glm::exp(-depth);
+				}
+			}));
+		}
+
+		for (std::future< void > & job : jobs)
+			job.get();
+
+		jobs.clear();
+
+		// Single scattering towards a viewer near the ground, marching the view ray, a sun elevation per job
+		for (unsigned slice = 0; slice < scatteringDepth; ++slice)
+		{
+			jobs.push_back(pool.submit([this, slice, &transmittanceTable] ()
+			{
+				float     sunElevation = getElevation((float(slice) + .5f) / float(scatteringDepth));
+				glm::vec3 sun(std::cos(sunElevation), std::sin(sunElevation), 0.f);
+				glm::vec3 viewer(0.f, groundRadius + viewerAltitude, 0.f);
+
+				for (unsigned row = 0; row < scatteringHeight; ++row)
+				{
+					float azimuth = (float(row) + .5f) / float(scatteringHeight) * pi;
+
+					for (unsigned column = 0; column < scatteringWidth; ++column)
+					{
+						float	  elevation = getElevation((float(column) + .5f) / float(scatteringWidth));
+						glm::vec3 view(std::cos(elevation) * std::cos(azimuth), std::sin(elevation), std::cos(elevation) * std::sin(azimuth));
+
+						float length = hitsGround(viewer.y, view.y) ? getDistanceToGround(viewer.y, view.y) : getDistanceToTop(viewer.y, view.y);
+						float step   = length / float(scatteringSteps);
+
+						glm::vec3 depth			  = glm::vec3(0.f);
+						glm::vec3 rayleighDensity = glm::vec3(0.f);
+						glm::vec3 mieDensity	  = glm::vec3(0.f);
+
+						for (unsigned i = 0; i < scatteringSteps; ++i)
+						{
+							glm::vec3 point    = viewer + view * ((float(i) + .5f) * step);
+							float     radius   = glm::length(point);
+							float     altitude = radius - groundRadius;
+							glm::vec3 extinction = getExtinction(altitude);
+
+							// Transmittance from the viewer to the middle of the step, and from there to the sun
+							glm::vec3 toViewer = glm::exp(-(depth + extinction * (.5f * step)));
+							float     sunMu    = glm::dot(point, sun) / radius;
+							glm::vec3 toSun    = hitsGround(radius, sunMu) ? glm::vec3(0.f) : lookupTransmittance(transmittanceTable, radius, sunMu);
+
+							rayleighDensity += toViewer * toSun * (std::exp(-altitude / rayleighHeight) * step);
+							mieDensity      += toViewer * toSun * (std::exp(-altitude / mieHeight	  ) * step);
+
+							depth += extinction * step;
+						}
+
+						size_t index = (size_t(slice) * scatteringHeight + row) * scatteringWidth + column;
+
+						rayleigh.get(unsigned(index)) = toHalf(rayleighDensity * rayleighScattering);
+						mie		.get(unsigned(index)) = toHalf(mieDensity		 * mieScattering	 );
+					}
+				}
+			}));
+		}
+
+		for (size_t i = 0; i < transmittanceTable.size(); ++i)
+			transmittance.get(unsigned(i)) = toHalf(transmittanceTable[i]);
+
+		for (std::future< void > & job : jobs)
+			job.get();
+	}
+}
@@ -0,0 +1,120 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef ATMOSPHERE_HEADER
+#define ATMOSPHERE_HEADER
+
+
+
+#include "Color.hpp"
+#include "ColorBuffer.hpp"
+
+
+
+#include <glad/glad.h>
+#include <memory>
+#include <string>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// Atmosphere holds the lookup tables of a physically based sky (Rayleigh and Mie scattering and ozone
+	/// absorption of an Earth-like atmosphere). They are precomputed on the CPU, split across the shared thread
+	/// pool, and cached in a file so the next runs only read them:
+	/// - Transmittance: the fraction of light that crosses the atmosphere from a point to its top, by altitude
+	///   and zenith angle of the ray.
+	/// - Single scattering: the Rayleigh and Mie light scattered towards a viewer near the ground, by elevation
+	///   of the view, azimuth between the view and the sun, and elevation of the sun. The phase functions are
+	///   applied by the shader, so the halo around the sun stays sharp.
+	/// The tables cover every elevation of the sun, so the time of day changes without computing them again.
+	/// </summary>
+	class Atmosphere
+	{
+		public:
+
+			static const unsigned transmittanceWidth  = 256;	///< Zenith angles of the transmittance table.
+			static const unsigned transmittanceHeight =  64;	///< Altitudes of the transmittance table.
+			static const unsigned scatteringWidth     =  64;	///< View elevations of the scattering tables.
+			static const unsigned scatteringHeight    =  32;	///< Azimuths between the view and the sun of the scattering tables.
+			static const unsigned scatteringDepth     =  32;	///< Sun elevations of the scattering tables.
+
+		private:
+
+			ColorBuffer< RgbaHalf > transmittance;				///< Transmittance to the top of the atmosphere (RGB).
+			ColorBuffer< RgbaHalf >		 rayleigh;				///< Rayleigh single scattering without its phase function, a slice per sun elevation (RGB).
+			ColorBuffer< RgbaHalf >			  mie;				///< Mie single scattering without its phase function, a slice per sun elevation (RGB).
+
+		private:
+
+			/// <summary>
+			/// Allocates the tables without computing them.
+			/// </summary>
+			Atmosphere();
+
+			// Delete the copy constructor and copy assignment operator to prevent copying
+			Atmosphere(const Atmosphere&) = delete;
+			Atmosphere& operator = (const Atmosphere&) = delete;
+
+		public:
+
+			/// <summary>
+			/// Reads the tables from their cache file, or computes them and writes the cache when it doesn't
+			/// exist or was computed with other sizes or constants.
+			/// </summary>
+			///
+			/// <param name="cachePath">The file path of the cache.</param>
+			///
+			/// <returns>The atmosphere with its tables.</returns>
+			static std::unique_ptr< Atmosphere > load(const std::string& cachePath);
+
+		public:
+
+			/// <summary>
+			/// Returns the transmittance table.
+			/// </summary>
+			///
+			/// <returns>The table, with transmittanceWidth x transmittanceHeight texels.</returns>
+			const ColorBuffer< RgbaHalf > & getTransmittance() const { return transmittance; }
+
+			/// <summary>
+			/// Returns the Rayleigh single scattering table.
+			/// </summary>
+			///
+			/// <returns>The table, with scatteringDepth slices of scatteringWidth x scatteringHeight texels one after the other.</returns>
+			const ColorBuffer< RgbaHalf > & getRayleigh() const { return rayleigh; }
+
+			/// <summary>
+			/// Returns the Mie single scattering table.
+			/// </summary>
+			///
+			/// <returns>The table, with scatteringDepth slices of scatteringWidth x scatteringHeight texels one after the other.</returns>
+			const ColorBuffer< RgbaHalf > & getMie() const { return mie; }
+
+			/// <summary>
+			/// Sets the uniforms the shader needs to address the tables (the shader must be in use).
+			/// </summary>
+			///
+			/// <param name="shaderID">The ID of the shader program.</param>
+			void configureShader(GLuint shaderID) const;
+
+		private:
+
+			/// <summary>
+			/// Computes the transmittance table, and then the scattering tables that read it.
+			/// </summary>
+			void compute();
+	};
+}
+
+
+
+#endif
@@ -10,6 +10,7 @@
 
 
 #include <cstdint>
+#include <half.hpp>
 
 
 
@@ -33,4 +34,37 @@ namespace finalPractice
 		uint32_t         value;			  ///< The entire color value as a 32-bit unsigned integer.
 		uint8_t  components[4];			  ///< An array of 4 unsigned 8-bit integers representing the individual color components: RED, GREEN, BLUE, and ALPHA.
 	};
+
+	/// <summary>
+	/// The Rgb888 struct represents an opaque color using the RGB format with 8 bits per channel
+	/// (3 bytes per pixel, without padding).
+	/// </summary>
+	struct Rgb888
+	{
+		enum { RED, GREEN, BLUE };		  ///< Enumerates the component indices for RGB.
+
+		uint8_t  components[3];			  ///< An array of 3 unsigned 8-bit integers representing the RED, GREEN and BLUE components.
+	};
+
+	/// <summary>
+	/// The RgbaHalf struct represents a color using the RGBA format with a half precision float per channel.
+	/// It is used for linear (not sRGB encoded) colors and for values outside of the [0, 1] range.
+	/// </summary>
+	struct RgbaHalf
+	{
+		enum { RED, GREEN, BLUE, ALPHA }; ///< Enumerates the component indices for RGBA.
+
+		half_float::half components[4];	  ///< An array of 4 half precision floats representing the RED, GREEN, BLUE, and ALPHA components.
+	};
+
+	/// <summary>
+	/// The NormalXz88 struct represents a unit normal that points up (like those of a height map) by its X and Z
+	/// components as signed normalized bytes. The Y component is reconstructed from them.
+	/// </summary>
+	struct NormalXz88
+	{
+		enum { X, Z };					  ///< Enumerates the component indices.
+
+		int8_t   components[2];			  ///< An array of 2 signed 8-bit integers representing the X and Z components (-127 to 127).
+	};
 }
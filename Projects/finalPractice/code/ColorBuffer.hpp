@@ -9,7 +9,13 @@
 
 
 
-#include <vector>
+#include "Color.hpp"
+#include "PixelConversion.hpp"
+
+
+
+#include <cstddef>
+#include <memory>
 
 
 
@@ -18,7 +24,9 @@ namespace finalPractice
 	/// <summary>
 	/// The ColorBuffer class represents a 2D array of colors stored in a flat buffer.
 	/// It allows for efficient storage and access to a grid of colors, typically used in image processing
-	/// or rendering contexts.
+	/// or rendering contexts. The buffer can be allocated without initializing it, or adopt a block of pixels
+	/// allocated by someone else (like a decoder) together with the function that frees it, so images don't
+	/// have to be copied into it.
 	/// </summary>
 	/// 
 	/// <typeparam name="COLOR">The type of color used in the buffer, such as Rgba8888 or Monochrome8.</typeparam>
@@ -29,29 +37,75 @@ namespace finalPractice
 
 			using Color = COLOR;		 ///< Type alias for the color used in the buffer.
 
+			using Deleter = void (*)(Color *); ///< Function that frees the block of colors of the buffer.
+
+			/// <summary>
+			/// How the colors of a new buffer are initialized.
+			/// </summary>
+			enum Initialization { ZEROED, UNINITIALIZED };
+
 		private:
 
 			unsigned  width;			 ///< The width of the color buffer (in pixels).
 			unsigned height;             ///< The height of the color buffer (in pixels).
 			
-			std::vector< Color > buffer; ///< A 1D vector storing all colors in the buffer.
+			std::unique_ptr< Color, Deleter > buffer; ///< A 1D block storing all colors in the buffer.
 
 		public:
 
 			/// <summary>
-			/// Constructs a ColorBuffer with the specified width and height, initializing all pixels to default color values.
+			/// Constructs a ColorBuffer with the specified width and height, initializing all pixels to default color values
+			/// unless UNINITIALIZED is given (for buffers that are going to be completely overwritten).
+			/// </summary>
+			/// 
+			/// <param name="width">The width of the color buffer (in pixels).</param>
+			/// <param name="height">The height of the color buffer (in pixels).</param>
+			/// <param name="initialization">Whether the colors are zeroed or left uninitialized.</param>
+			ColorBuffer(unsigned width, unsigned height, Initialization initialization = ZEROED) :
+				width (width ),
+				height(height),
+				buffer(initialization == ZEROED ? new Color[size_t(width) * height]() : new Color[size_t(width) * height], deleteArray)
+			{
+			}
+
+			/// <summary>
+			/// Constructs a ColorBuffer that adopts a block of colors allocated elsewhere, without copying it.
 			/// </summary>
 			/// 
 			/// <param name="width">The width of the color buffer (in pixels).</param>
 			/// <param name="height">The height of the color buffer (in pixels).</param>
-			ColorBuffer(unsigned width, unsigned height) : width(width), height(height), buffer(width* height) {}
+			/// <param name="colors">The block of width * height colors, owned by the buffer from now on.</param>
+			/// <param name="release">The function that frees the block when the buffer is destroyed.</param>
+			ColorBuffer(unsigned width, unsigned height, Color * colors, Deleter release) : width(width), height(height), buffer(colors, release) {}
+
+			// Moving a buffer hands its block of colors over to the new one
+			ColorBuffer(ColorBuffer&&) = default;
+			ColorBuffer& operator = (ColorBuffer&&) = default;
+
+		private:
+
+			// Delete the copy constructor and copy assignment operator to prevent copying
+			ColorBuffer(const ColorBuffer&) = delete;
+			ColorBuffer& operator = (const ColorBuffer&) = delete;
+
+			/// <summary>
+			/// Frees a block of colors allocated by the buffer itself.
+			/// </summary>
+			/// 
+			/// <param name="colors">The block of colors.</param>
+			static void deleteArray(Color * colors)
+			{
+				delete [] colors;
+			}
+
+		public:
 
 			/// <summary>
 			/// Gets the width of the color buffer.
 			/// </summary>
 			/// 
 			/// <return>The width of the buffer in pixels.</return>
-			unsigned getWidth()
+			unsigned getWidth() const
 			{
 				return width;
 			}
@@ -61,7 +115,7 @@ namespace finalPractice
 			/// </summary>
 			/// 
 			/// <return>The height of the buffer in pixels.</return>
-			unsigned getHeight()
+			unsigned getHeight() const
 			{
 				return height;
 			}
@@ -73,7 +127,7 @@ namespace finalPractice
 			/// <return>A pointer to the first element of the color buffer.</return>
 			Color * colors()
 			{
-				return buffer.data();
+				return buffer.get();
 			}
 
 			/// <summary>
@@ -83,7 +137,7 @@ namespace finalPractice
 			/// <return>A constant pointer to the first element of the color buffer.</return>
 			const Color * colors() const
 			{
-				return buffer.data();
+				return buffer.get();
 			}
 
 			/// <summary>
@@ -95,7 +149,7 @@ namespace finalPractice
 			/// <return>The color at the specified offset.</return>
 			Color & get(unsigned offset)
 			{
-				return buffer[offset];
+				return buffer.get()[offset];
 			}
 
 			/// <summary>
@@ -107,7 +161,7 @@ namespace finalPractice
 			/// <return>The color at the specified offset.</return>
 			const Color & get(unsigned offset) const
 			{
-				return buffer[offset];
+				return buffer.get()[offset];
 			}
 
 			/// <summary>
@@ -118,7 +172,63 @@ namespace finalPractice
 			/// <param name="color">The color to set at the specified offset.</param>
 			void set(unsigned offset, const Color & color)
 			{
-				buffer[offset] = color;
+				buffer.get()[offset] = color;
+			}
+
+		public:
+
+			/// <summary>
+			/// Converts the buffer to another color format with the vectorized kernels of PixelConversion
+			/// (RGBA to RGB, luminance or half float, RGB to RGBA and half float to RGBA).
+			/// </summary>
+			/// 
+			/// <typeparam name="TARGET_COLOR">The color format of the converted buffer.</typeparam>
+			/// 
+			/// <return>A new buffer of the same size with the converted colors.</return>
+			template< typename TARGET_COLOR >
+			ColorBuffer< TARGET_COLOR > convert() const
+			{
+				ColorBuffer< TARGET_COLOR > target(width, height, ColorBuffer< TARGET_COLOR >::UNINITIALIZED);
+
+				PixelConversion::convert(colors(), target.colors(), size_t(width) * height);
+
+				return target;
+			}
+
+			/// <summary>
+			/// Multiplies the color components of every pixel by its alpha (Rgba8888 buffers only).
+			/// </summary>
+			void premultiplyAlpha()
+			{
+				PixelConversion::premultiplyAlpha(colors(), size_t(width) * height);
+			}
+
+			/// <summary>
+			/// Decodes the sRGB colors of the buffer to linear light (Rgba8888 buffers only).
+			/// </summary>
+			/// 
+			/// <return>A new buffer of the same size with the linear colors as half floats.</return>
+			ColorBuffer< RgbaHalf > toLinear() const
+			{
+				ColorBuffer< RgbaHalf > target(width, height, ColorBuffer< RgbaHalf >::UNINITIALIZED);
+
+				PixelConversion::srgbToLinear(colors(), target.colors(), size_t(width) * height);
+
+				return target;
+			}
+
+			/// <summary>
+			/// Encodes the linear colors of the buffer to sRGB (RgbaHalf buffers only).
+			/// </summary>
+			/// 
+			/// <return>A new buffer of the same size with the sRGB colors.</return>
+			ColorBuffer< Rgba8888 > toSrgb() const
+			{
+				ColorBuffer< Rgba8888 > target(width, height, ColorBuffer< Rgba8888 >::UNINITIALIZED);
+
+				PixelConversion::linearToSrgb(colors(), target.colors(), size_t(width) * height);
+
+				return target;
 			}
 	};
 }
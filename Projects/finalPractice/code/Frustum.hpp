@@ -0,0 +1,149 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef FRUSTUM_HEADER
+#define FRUSTUM_HEADER
+
+
+
+#include "Camera.hpp"
+
+
+
+#include <cmath>
+#include <glm.hpp>
+#include <gtc/matrix_access.hpp>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// The Frustum class holds the six planes of the view volume of a camera, extracted from its
+	/// view-projection matrix (Gribb and Hartmann), and tests bounding volumes against them so the
+	/// objects outside the view can be skipped before any draw call.
+	/// </summary>
+	class Frustum
+	{
+		private:
+
+			/// <summary>
+			/// Enum representing the planes of the frustum.
+			/// </summary>
+			enum
+			{
+				PLANE_LEFT,										///< Left plane.
+				PLANE_RIGHT,									///< Right plane.
+				PLANE_BOTTOM,									///< Bottom plane.
+				PLANE_TOP,										///< Top plane.
+				PLANE_NEAR,										///< Near plane.
+				PLANE_FAR,										///< Far plane.
+				PLANE_COUNT										///< Total number of planes.
+			};
+
+		private:
+
+			glm::vec4 planes[PLANE_COUNT];						///< Planes (normal pointing inwards and distance) in world space.
+
+		public:
+
+			/// <summary>
+			/// Extracts the planes of the frustum from a view-projection matrix.
+			/// </summary>
+			///
+			/// <param name="viewProjectionMatrix">The projection matrix multiplied by the view matrix.</param>
+			Frustum(const glm::mat4 & viewProjectionMatrix)
+			{
+				glm::vec4 rowX = glm::row(viewProjectionMatrix, 0);
+				glm::vec4 rowY = glm::row(viewProjectionMatrix, 1);
+				glm::vec4 rowZ = glm::row(viewProjectionMatrix, 2);
+				glm::vec4 rowW = glm::row(viewProjectionMatrix, 3);
+
+				planes[PLANE_LEFT  ] = rowW + rowX;
+				planes[PLANE_RIGHT ] = rowW - rowX;
+				planes[PLANE_BOTTOM] = rowW + rowY;
+				planes[PLANE_TOP   ] = rowW - rowY;
+				planes[PLANE_NEAR  ] = rowW + rowZ;
+				planes[PLANE_FAR   ] = rowW - rowZ;
+
+				// Normalize the planes so the distances are in world units
+				for (glm::vec4 & plane : planes)
+					plane /= glm::length(glm::vec3(plane));
+			}
+
+			/// <summary>
+			/// Extracts the planes of the frustum from the projection and view matrices of a camera.
+			/// </summary>
+			///
+			/// <param name="camera">The camera whose view volume is used.</param>
+			Frustum(const Camera & camera) : Frustum(camera.getProjectionMatrix() * camera.getTransformMatrixInverse())
+			{
+			}
+
+		public:
+
+			/// <summary>
+			/// Tests a bounding sphere against the frustum.
+			/// </summary>
+			///
+			/// <param name="center">Center of the sphere in world space.</param>
+			/// <param name="radius">Radius of the sphere.</param>
+			///
+			/// <return>Returns false when the sphere is completely outside the frustum.</return>
+			bool isVisible(const glm::vec3 & center, float radius) const
+			{
+				for (const glm::vec4 & plane : planes)
+				{
+					if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+						return false;
+				}
+
+				return true;
+			}
+
+			/// <summary>
+			/// Tests a transformed axis-aligned bounding box against the frustum (conservatively, using the
+			/// world space box that encloses it).
+			/// </summary>
+			///
+			/// <param name="boxMin">Smallest corner of the box in model space.</param>
+			/// <param name="boxMax">Largest corner of the box in model space.</param>
+			/// <param name="modelMatrix">Transform from the model to the world space.</param>
+			///
+			/// <return>Returns false when the box is completely outside the frustum.</return>
+			bool isVisible(const glm::vec3 & boxMin, const glm::vec3 & boxMax, const glm::mat4 & modelMatrix) const
+			{
+				glm::vec3 center  = glm::vec3(modelMatrix * glm::vec4((boxMin + boxMax) * .5f, 1.f));
+				glm::vec3 extents = (boxMax - boxMin) * .5f;
+
+				// Half size of the world space box (Arvo)
+				glm::vec3 worldExtents
+				(
+					std::abs(modelMatrix[0][0]) * extents.x + std::abs(modelMatrix[1][0]) * extents.y + std::abs(modelMatrix[2][0]) * extents.z,
+					std::abs(modelMatrix[0][1]) * extents.x + std::abs(modelMatrix[1][1]) * extents.y + std::abs(modelMatrix[2][1]) * extents.z,
+					std::abs(modelMatrix[0][2]) * extents.x + std::abs(modelMatrix[1][2]) * extents.y + std::abs(modelMatrix[2][2]) * extents.z
+				);
+
+				for (const glm::vec4 & plane : planes)
+				{
+					float radius = glm::dot(glm::abs(glm::vec3(plane)), worldExtents);
+
+					if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+						return false;
+				}
+
+				return true;
+			}
+	};
+}
+
+
+
+#endif
@@ -0,0 +1,291 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "HeightField.hpp"
+
+
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+
+
+namespace finalPractice
+{
+	// Node of the quadtree waiting to be tested against a ray
+	struct QuadtreeNode
+	{
+		unsigned level;
+		unsigned x;
+		unsigned z;
+	};
+
+
+
+	// Clips the interval of a ray to the slab between two planes of an axis
+	static bool clipSlab(float origin, float direction, float low, float high, float& tNear, float& tFar)
+	{
+		if (direction == 0.f)
+			return origin >= low && origin <= high;
+
+		float t0 = (low  - origin) / direction;
+		float t1 = (high - origin) / direction;
+
+		if (t0 > t1)
+			std::swap(t0, t1);
+
+		tNear = std::max(tNear, t0);
+		tFar  = std::min(tFar , t1);
+
+		return tNear <= tFar;
+	}
+
+
+
+	HeightField::HeightField(ColorBuffer< Monochrome8 >&& _samples, const glm::vec3& boundsMin, const glm::vec3& boundsMax) :
+		samples(std::move(_samples))
+	{
+		glm::vec2 extent(boundsMax.x - boundsMin.x, boundsMax.z - boundsMin.z);
+
+		// The center of sample i is at the texture coordinate (i + 0.5) / size, as in the texture
+		gridScale    = glm::vec2(float(samples.getWidth()), float(samples.getHeight())) / extent;
+		gridOffset   = glm::vec2(boundsMin.x, boundsMin.z) + .5f / gridScale;
+		heightOffset = boundsMin.y;
+		heightScale  = (boundsMax.y - boundsMin.y) / 255.f;
+
+		buildQuadtree();
+	}
+
+
+
+	float HeightField::getHeight(float x, float z) const
+	{
+		return heightOffset + heightScale * getFilteredSample((x - gridOffset.x) * gridScale.x, (z - gridOffset.y) * gridScale.y);
+	}
+
+	void HeightField::getHeights(const glm::vec2 * positions, float * heights, size_t count) const
+	{
+		for (size_t i = 0; i < count; ++i)
+			heights[i] = heightOffset + heightScale * getFilteredSample((positions[i].x - gridOffset.x) * gridScale.x, (positions[i].y - gridOffset.y) * gridScale.y);
+	}
+
+	bool HeightField::intersectRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) const
+	{
+		if (levels.empty() || heightScale <= 0.f)
+			return false;
+
+		// Sample coordinates keep the distances along the ray, only the unit of every axis changes
+		glm::vec3 gridOrigin((origin.x - gridOffset.x) * gridScale.x, (origin.y - heightOffset) / heightScale, (origin.z - gridOffset.y) * gridScale.y);
+		glm::vec3 gridDirection(direction.x * gridScale.x, direction.y / heightScale, direction.z * gridScale.y);
+
+		const Level & cells = levels.front();
+
+		float nearest = maxDistance;
+		bool  hit     = false;
+
+		std::vector< QuadtreeNode > stack{ QuadtreeNode{ unsigned(levels.size() - 1), 0, 0 } };
+
+		while (not stack.empty())
+		{
+			QuadtreeNode node = stack.back();
+
+			stack.pop_back();
+
+			const Level & level = levels[node.level];
+			const Range & range = level.ranges[size_t(node.z) * level.width + node.x];
+
+			// Cells covered by the node
+			unsigned x0 = node.x << node.level;
+			unsigned z0 = node.z << node.level;
+			unsigned x1 = std::min((node.x + 1) << node.level, cells.width);
+			unsigned z1 = std::min((node.z + 1) << node.level, cells.depth);
+
+			float tNear = 0.f;
+			float tFar  = nearest;
+
+			if (not clipSlab(gridOrigin.x, gridDirection.x, float(x0)       , float(x1)       , tNear, tFar) ||
+				not clipSlab(gridOrigin.z, gridDirection.z, float(z0)       , float(z1)       , tNear, tFar) ||
+				not clipSlab(gridOrigin.y, gridDirection.y, float(range.min), float(range.max), tNear, tFar))
+				continue;
+
+			if (node.level == 0)
+			{
+				float t;
+
+				if (intersectCell(node.x, node.z, gridOrigin, gridDirection, tNear, tFar, t) && t <= nearest)
+				{
+					nearest = t;
+					hit     = true;
+				}
+
+				continue;
+			}
+
+			// Push the children so that the one the ray reaches first is tested first
+			const Level & children = levels[node.level - 1];
+
+			unsigned firstX = gridDirection.x < 0.f ? 1 : 0;
+			unsigned firstZ = gridDirection.z < 0.f ? 1 : 0;
+
+			for (int i = 3; i >= 0; --i)
+			{
+				unsigned x = node.x * 2 + ((unsigned(i) & 1) ^ firstX);
+				unsigned z = node.z * 2 + ((unsigned(i) >> 1) ^ firstZ);
+
+				if (x < children.width && z < children.depth)
+					stack.push_back(QuadtreeNode{ node.level - 1, x, z });
+			}
+		}
+
+		if (hit)
+			distance = nearest;
+
+		return hit;
+	}
+
+
+
+	void HeightField::buildQuadtree()
+	{
+		unsigned width = samples.getWidth ();
+		unsigned depth = samples.getHeight();
+
+		// A single row or column of samples has no cells
+		if (width < 2 || depth < 2)
+			return;
+
+		Level cells{ width - 1, depth - 1, {} };
+
+		cells.ranges.resize(size_t(cells.width) * cells.depth);
+
+		for (unsigned z = 0; z < cells.depth; ++z)
+		{
+			for (unsigned x = 0; x < cells.width; ++x)
+			{
+				uint8_t corners[4] =
+				{
+					samples.get( z      * width + x), samples.get( z      * width + x + 1),
+					samples.get((z + 1) * width + x), samples.get((z + 1) * width + x + 1),
+				};
+
+				cells.ranges[size_t(z) * cells.width + x] = Range{ *std::min_element(corners, corners + 4), *std::max_element(corners, corners + 4) };
+			}
+		}
+
+		levels.push_back(std::move(cells));
+
+		// Every level merges 2x2 nodes of the previous one, up to a single root
+		while (levels.back().width > 1 || levels.back().depth > 1)
+		{
+			const Level & previous = levels.back();
+
+			Level level{ (previous.width + 1) / 2, (previous.depth + 1) / 2, {} };
+
+			level.ranges.resize(size_t(level.width) * level.depth, Range{ 255, 0 });
+
+			for (unsigned z = 0; z < previous.depth; ++z)
+			{
+				for (unsigned x = 0; x < previous.width; ++x)
+				{
+					const Range & child  = previous.ranges[size_t(z) * previous.width + x];
+					Range       & parent = level.ranges[size_t(z / 2) * level.width + x / 2];
+
+					parent.min = std::min(parent.min, child.min);
+					parent.max = std::max(parent.max, child.max);
+				}
+			}
+
+			levels.push_back(std::move(level));
+		}
+	}
+
+	float HeightField::getFilteredSample(float x, float z) const
+	{
+		unsigned width = samples.getWidth ();
+		unsigned depth = samples.getHeight();
+
+		x = std::min(std::max(x, 0.f), float(width - 1));
+		z = std::min(std::max(z, 0.f), float(depth - 1));
+
+		unsigned x0 = unsigned(x);
+		unsigned z0 = unsigned(z);
+		unsigned x1 = std::min(x0 + 1, width - 1);
+		unsigned z1 = std::min(z0 + 1, depth - 1);
+
+		float fx = x - float(x0);
+		float fz = z - float(z0);
+
+		float top    = getSample(x0, z0) + (getSample(x1, z0) - getSample(x0, z0)) * fx;
+		float bottom = getSample(x0, z1) + (getSample(x1, z1) - getSample(x0, z1)) * fx;
+
+		return top + (bottom - top) * fz;
+	}
+
+	bool HeightField::intersectCell(unsigned x, unsigned z, const glm::vec3& origin, const glm::vec3& direction, float tNear, float tFar, float& t) const
+	{
+		float h00 = getSample(x    , z    );
+		float h10 = getSample(x + 1, z    );
+		float h01 = getSample(x    , z + 1);
+		float h11 = getSample(x + 1, z + 1);
+
+		// Along the ray the bilinear patch is a quadratic function of t: f(t) = y(t) - h(t) = a t^2 + b t + c
+		float slopeX = h10 - h00;
+		float slopeZ = h01 - h00;
+		float twist  = h00 - h10 - h01 + h11;
+
+		float ax = origin.x - float(x);
+		float az = origin.z - float(z);
+
+		float a = -twist * direction.x * direction.z;
+		float b = direction.y - slopeX * direction.x - slopeZ * direction.z - twist * (ax * direction.z + az * direction.x);
+		float c = origin.y - h00 - slopeX * ax - slopeZ * az - twist * ax * az;
+
+		// The ray enters the cell below the surface
+		if (a * tNear * tNear + b * tNear + c <= 0.f)
+		{
+			t = tNear;
+			return true;
+		}
+
+		float roots[2];
+		int   rootCount = 0;
+
+		if (std::abs(a) < 1e-6f)
+		{
+			if (b != 0.f)
+				roots[rootCount++] = -c / b;
+		}
+		else
+		{
+			float discriminant = b * b - 4.f * a * c;
+
+			if (discriminant < 0.f)
+				return false;
+
+			// Numerically stable form of the two roots
+			float q = -.5f * (b + std::copysign(std::sqrt(discriminant), b));
+
+			roots[rootCount++] = q / a;
+
+			if (q != 0.f)
+				roots[rootCount++] = c / q;
+		}
+
+		bool found = false;
+
+		for (int i = 0; i < rootCount; ++i)
+		{
+			if (roots[i] >= tNear && roots[i] <= tFar && (not found || roots[i] < t))
+			{
+				t     = roots[i];
+				found = true;
+			}
+		}
+
+		return found;
+	}
+}
@@ -0,0 +1,173 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef HEIGHTFIELD_HEADER
+#define HEIGHTFIELD_HEADER
+
+
+
+#include "Color.hpp"
+#include "ColorBuffer.hpp"
+
+
+
+#include <cstddef>
+#include <glm.hpp>
+#include <vector>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// HeightField keeps a CPU copy of a height map (one byte per sample, as in the texture) to answer height
+	/// queries and ray intersections in the model space of the terrain. Heights are filtered bilinearly between
+	/// the texel centers exactly as the vertex shader samples them, and rays are traced through a min/max
+	/// quadtree of the cells between samples, so only the few cells near the ray are tested.
+	/// </summary>
+	class HeightField
+	{
+		private:
+
+			/// <summary>
+			/// Lowest and highest sample of a node of the quadtree.
+			/// </summary>
+			struct Range
+			{
+				uint8_t min;										///< Lowest sample under the node.
+				uint8_t max;										///< Highest sample under the node.
+			};
+
+			/// <summary>
+			/// A level of the quadtree (the first one has a node per cell, each next one a node per 2x2 nodes).
+			/// </summary>
+			struct Level
+			{
+				unsigned			  width;						///< Number of node columns.
+				unsigned			  depth;						///< Number of node rows.
+				std::vector< Range > ranges;						///< Range of every node, row by row.
+			};
+
+			ColorBuffer< Monochrome8 > samples;					///< The samples of the height map, row by row.
+			std::vector< Level >		levels;					///< Levels of the quadtree, the cells first.
+
+			glm::vec2			 gridOffset;						///< Subtracted from model x and z before scaling them to sample coordinates.
+			glm::vec2			  gridScale;						///< Samples per model unit along x and z.
+			float			   heightOffset;						///< Height of a sample of 0 in model units.
+			float				heightScale;						///< Model units per sample step (the height range divided by 255).
+
+		public:
+
+			/// <summary>
+			/// Builds the quadtree of a height map that covers a box of the model space of the terrain.
+			/// </summary>
+			///
+			/// <param name="_samples">The samples of the height map (adopted).</param>
+			/// <param name="boundsMin">Corner of the terrain where the texture coordinates are 0 (y is the height of a 0 sample).</param>
+			/// <param name="boundsMax">Corner of the terrain where the texture coordinates are 1 (y is the height of a 255 sample).</param>
+			HeightField(ColorBuffer< Monochrome8 >&& _samples, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+		private:
+
+			// Delete the copy constructor and copy assignment operator to prevent copying
+			HeightField(const HeightField&) = delete;
+			HeightField& operator = (const HeightField&) = delete;
+
+		public:
+
+			/// <summary>
+			/// Returns the samples of the height map.
+			/// </summary>
+			///
+			/// <returns>The samples, row by row.</returns>
+			const ColorBuffer< Monochrome8 > & getSamples() const { return samples; }
+
+			/// <summary>
+			/// Returns the height of the terrain at a point (bilinearly filtered, clamped at the edges).
+			/// </summary>
+			///
+			/// <param name="x">X coordinate of the point in model space.</param>
+			/// <param name="z">Z coordinate of the point in model space.</param>
+			///
+			/// <returns>The height of the terrain in model space.</returns>
+			float getHeight(float x, float z) const;
+
+			/// <summary>
+			/// Returns the height of the terrain at many points at once.
+			/// </summary>
+			///
+			/// <param name="positions">X and z coordinates of the points in model space.</param>
+			/// <param name="heights">Receives the height of the terrain at every point.</param>
+			/// <param name="count">Number of points.</param>
+			void getHeights(const glm::vec2 * positions, float * heights, size_t count) const;
+
+			/// <summary>
+			/// Finds the first point where a ray hits the terrain (the surface between the first and the last
+			/// sample centers).
+			/// </summary>
+			///
+			/// <param name="origin">Origin of the ray in model space.</param>
+			/// <param name="direction">Direction of the ray in model space (its length is the unit of the distance).</param>
+			/// <param name="maxDistance">Farthest distance to search.</param>
+			/// <param name="distance">Receives the distance to the hit along the ray.</param>
+			///
+			/// <returns>True if the ray hits the terrain within maxDistance, false otherwise.</returns>
+			bool intersectRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) const;
+
+		private:
+
+			/// <summary>
+			/// Builds every level of the quadtree from the samples.
+			/// </summary>
+			void buildQuadtree();
+
+			/// <summary>
+			/// Returns the sample at a column and row.
+			/// </summary>
+			///
+			/// <param name="x">Column of the sample.</param>
+			/// <param name="z">Row of the sample.</param>
+			///
+			/// <returns>The sample value (0 - 255).</returns>
+			float getSample(unsigned x, unsigned z) const
+			{
+				return float(samples.get(z * samples.getWidth() + x));
+			}
+
+			/// <summary>
+			/// Returns the bilinearly filtered sample at a point in sample coordinates.
+			/// </summary>
+			///
+			/// <param name="x">Column of the point (sample centers are at whole numbers).</param>
+			/// <param name="z">Row of the point.</param>
+			///
+			/// <returns>The filtered sample value (0 - 255).</returns>
+			float getFilteredSample(float x, float z) const;
+
+			/// <summary>
+			/// Intersects a ray in sample coordinates with the bilinear patch of a cell.
+			/// </summary>
+			///
+			/// <param name="x">Column of the cell.</param>
+			/// <param name="z">Row of the cell.</param>
+			/// <param name="origin">Origin of the ray in sample coordinates (y in sample values).</param>
+			/// <param name="direction">Direction of the ray in sample coordinates.</param>
+			/// <param name="tNear">Distance where the ray enters the cell.</param>
+			/// <param name="tFar">Distance where the ray leaves the cell.</param>
+			/// <param name="t">Receives the distance to the hit.</param>
+			///
+			/// <returns>True if the ray hits the patch between tNear and tFar, false otherwise.</returns>
+			bool intersectCell(unsigned x, unsigned z, const glm::vec3& origin, const glm::vec3& direction, float tNear, float tFar, float& t) const;
+	};
+}
+
+
+
+#endif
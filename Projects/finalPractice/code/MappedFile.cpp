@@ -0,0 +1,101 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "MappedFile.hpp"
+
+
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+
+
+namespace finalPractice
+{
+#ifdef _WIN32
+
+	MappedFile::MappedFile(const std::string& filePath) :
+		data(nullptr),
+		size(0),
+		fileHandle(INVALID_HANDLE_VALUE),
+		mappingHandle(nullptr)
+	{
+		fileHandle = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+		if (fileHandle == INVALID_HANDLE_VALUE)
+			return;
+
+		LARGE_INTEGER fileSize;
+
+		if (not GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+			return;
+
+		mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+		if (not mappingHandle)
+			return;
+
+		data = static_cast< const uint8_t * >(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+		size = data ? size_t(fileSize.QuadPart) : 0;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (data)
+			UnmapViewOfFile(data);
+
+		if (mappingHandle)
+			CloseHandle(mappingHandle);
+
+		if (fileHandle != INVALID_HANDLE_VALUE)
+			CloseHandle(fileHandle);
+	}
+
+#else
+
+	MappedFile::MappedFile(const std::string& filePath) :
+		data(nullptr),
+		size(0),
+		fileHandle(nullptr),
+		mappingHandle(nullptr)
+	{
+		int fileDescriptor = open(filePath.c_str(), O_RDONLY);
+
+		if (fileDescriptor < 0)
+			return;
+
+		struct stat fileStatus;
+
+		if (fstat(fileDescriptor, &fileStatus) == 0 && fileStatus.st_size > 0)
+		{
+			void * region = mmap(nullptr, size_t(fileStatus.st_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+
+			if (region != MAP_FAILED)
+			{
+				data = static_cast< const uint8_t * >(region);
+				size = size_t(fileStatus.st_size);
+			}
+		}
+
+		close(fileDescriptor);											// The mapping stays valid once the descriptor is closed
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (data)
+			munmap(const_cast< uint8_t * >(data), size);
+	}
+
+#endif
+}
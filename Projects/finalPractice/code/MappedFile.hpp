@@ -0,0 +1,86 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef MAPPEDFILE_HEADER
+#define MAPPEDFILE_HEADER
+
+
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// MappedFile maps a whole file into memory for read-only access, so its contents can be handed
+	/// directly to OpenGL without being read into an intermediate buffer first.
+	/// The mapping is released when the object is destroyed.
+	/// </summary>
+	class MappedFile
+	{
+		private:
+
+			const uint8_t *		 data;							///< Start of the mapped region (nullptr if the file couldn't be mapped).
+			size_t				 size;							///< Size of the mapped region in bytes.
+
+			void *		   fileHandle;							///< Handle of the opened file (platform specific).
+			void *		mappingHandle;							///< Handle of the file mapping object (Windows only).
+
+		public:
+
+			/// <summary>
+			/// Opens and maps the given file.
+			/// </summary>
+			///
+			/// <param name="filePath">The path of the file to be mapped.</param>
+			MappedFile(const std::string& filePath);
+
+			/// <summary>
+			/// Destructor that unmaps the file and closes its handles.
+			/// </summary>
+			~MappedFile();
+
+		private:
+
+			// Delete the copy constructor and copy assignment operator to prevent copying
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator = (const MappedFile&) = delete;
+
+		public:
+
+			/// <summary>
+			/// Checks whether the file has been successfully mapped.
+			/// </summary>
+			///
+			/// <returns>True if the file is mapped, false otherwise.</returns>
+			bool isOk() const { return data != nullptr; }
+
+			/// <summary>
+			/// Returns a pointer to the start of the mapped file.
+			/// </summary>
+			///
+			/// <returns>A pointer to the first byte of the file.</returns>
+			const uint8_t * getData() const { return data; }
+
+			/// <summary>
+			/// Returns the size of the mapped file.
+			/// </summary>
+			///
+			/// <returns>The size of the file in bytes.</returns>
+			size_t getSize() const { return size; }
+	};
+}
+
+
+
+#endif
@@ -0,0 +1,61 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "MaterialSet.hpp"
+
+
+
+#include <cassert>
+
+
+
+namespace finalPractice
+{
+	const MaterialSet * MaterialSet::boundSet = nullptr;
+
+
+
+	MaterialSet::MaterialSet(const std::vector< std::string >& texturePaths)
+	{
+		texture.setID(texture.createTextureArray(texturePaths));
+		assert(texture.isOk());
+
+		for (size_t i = 0; i < texturePaths.size(); ++i)
+			layers[texturePaths[i]] = GLint(i);
+	}
+
+	MaterialSet::~MaterialSet()
+	{
+		if (boundSet == this)
+			boundSet = nullptr;
+	}
+
+
+
+	GLint MaterialSet::getLayer(const std::string& texturePath) const
+	{
+		auto layer = layers.find(texturePath);
+
+		return layer != layers.end() ? layer->second : -1;
+	}
+
+	void MaterialSet::bind()
+	{
+		// A reloaded array has a new ID, so it is bound again even if the set was the last one bound
+		bool reloaded = texture.makeResident();
+
+		if (boundSet == this && not reloaded)
+			return;
+
+		glActiveTexture(GL_TEXTURE0 + textureUnit);
+
+		texture.bind();
+
+		glActiveTexture(GL_TEXTURE0);
+
+		boundSet = this;
+	}
+}
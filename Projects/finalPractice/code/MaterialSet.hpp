@@ -0,0 +1,94 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef MATERIALSET_HEADER
+#define MATERIALSET_HEADER
+
+
+
+#include "Texture.hpp"
+
+
+
+#include <glad/glad.h>
+#include <map>
+#include <string>
+#include <vector>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// MaterialSet packs the albedo maps of several meshes into the layers of a single 2D array texture, so
+	/// the meshes sharing the set are drawn one after the other without binding another texture. The array
+	/// is kept bound to its own texture unit and is only bound again when another set has replaced it.
+	/// </summary>
+	class MaterialSet
+	{
+		public:
+
+			static const GLint textureUnit = 1;					///< Texture unit reserved for the material sets (unit 0 is used by the single textures).
+
+		private:
+
+			static const MaterialSet * boundSet;					///< Material set currently bound to the texture unit (nullptr if none).
+
+			Texture						  texture;				///< Array texture with one layer per albedo map.
+			std::map< std::string, GLint > layers;				///< Layer of every albedo map, by file path.
+
+		public:
+
+			/// <summary>
+			/// Packs the given albedo maps into the layers of an array texture.
+			/// </summary>
+			///
+			/// <param name="texturePaths">The file paths of the albedo maps.</param>
+			MaterialSet(const std::vector< std::string >& texturePaths);
+
+			/// <summary>
+			/// Destructor that forgets the set if it is the one bound.
+			/// </summary>
+			~MaterialSet();
+
+		private:
+
+			// Delete the copy constructor and copy assignment operator to prevent copying
+			MaterialSet(const MaterialSet&) = delete;
+			MaterialSet& operator = (const MaterialSet&) = delete;
+
+		public:
+
+			/// <summary>
+			/// Checks whether the array texture has been successfully created.
+			/// </summary>
+			///
+			/// <returns>True if the texture is loaded, false otherwise.</returns>
+			bool isOk() const { return texture.isOk(); }
+
+			/// <summary>
+			/// Returns the layer an albedo map was packed into.
+			/// </summary>
+			///
+			/// <param name="texturePath">The file path of the albedo map.</param>
+			///
+			/// <returns>The index of the layer, or -1 if the map isn't part of the set.</returns>
+			GLint getLayer(const std::string& texturePath) const;
+
+			/// <summary>
+			/// Binds the array texture to its texture unit unless it is bound already (texture unit 0 stays active).
+			/// </summary>
+			void bind();
+	};
+}
+
+
+
+#endif
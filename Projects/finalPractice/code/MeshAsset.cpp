@@ -0,0 +1,452 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "MeshAsset.hpp"
+
+
+
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <gtc/type_ptr.hpp>
+#include <iostream>
+
+
+
+namespace finalPractice
+{
+	const float MeshAsset::maxPixelError = 1.f;
+
+	std::map< MeshCache::Key, std::weak_ptr< MeshAsset > > MeshCache::assets;
+	std::map< MeshCache::Key, std::shared_future< std::shared_ptr< MeshAsset::Staging > > > MeshCache::pending;
+
+
+
+	MeshAsset::MeshAsset(const std::string& meshFilePath, const MeshData::ImportSettings& settings) :
+		MeshAsset(*load(meshFilePath, settings), settings)
+	{
+	}
+
+	MeshAsset::MeshAsset(const Staging& staging, const MeshData::ImportSettings& settings) :
+		vaoID(0),
+		numIndex(0),
+		indexType(GL_UNSIGNED_INT),
+		quantized(settings.quantized),
+		lodErrors(1, 0.f),
+		boundsMin(0.f),
+		boundsMax(0.f),
+		boundsCenter(0.f),
+		boundsRadius(0.f),
+		hasTextureUVs(false),
+		hasNormals(false),
+		meshIsLoaded(false)
+	{
+		glGenBuffers(VBO_COUNT, vboIDs);
+		glGenVertexArrays(1, &vaoID);
+
+		if (not staging.loaded)
+			return;
+
+		hasTextureUVs = staging.hasTextureUVs;
+		hasNormals    = staging.hasNormals;
+		ranges        = staging.ranges;
+		transforms    = staging.transforms;
+
+		dequantization = staging.dequantization;
+		lodErrors      = staging.lodErrors;
+
+		setBounds(staging.boundsMin, staging.boundsMax);
+
+		upload(staging.vertices, staging.vertexCount, staging.indices, staging.indexCount, staging.indexType);
+	}
+
+	MeshAsset::~MeshAsset()
+	{
+		glDeleteVertexArrays(1, &vaoID);
+		glDeleteBuffers(VBO_COUNT, vboIDs);
+	}
+
+
+
+	std::shared_ptr< MeshAsset::Staging > MeshAsset::load(const std::string& meshFilePath, const MeshData::ImportSettings& settings)
+	{
+		auto staging = std::make_shared< Staging >();
+
+		staging->loaded = false;
+
+		// Use the cooked file when there is one, it needs no parsing at all
+		if (loadCooked(meshFilePath, settings, *staging))
+		{
+			staging->loaded = true;
+			return staging;
+		}
+
+		MeshData mesh;
+
+		if (not mesh.importMesh(meshFilePath, settings))
+			return staging;
+
+		staging->hasTextureUVs  = mesh.hasTextureUVs;
+		staging->hasNormals     = mesh.hasNormals;
+		staging->ranges         = mesh.ranges;
+		staging->transforms     = mesh.transforms;
+		staging->dequantization = mesh.dequantization;
+		staging->lodErrors      = mesh.lodErrors;
+		staging->boundsMin      = mesh.boundsMin;
+		staging->boundsMax      = mesh.boundsMax;
+
+		staging->vertexData = mesh.packVertices(settings.quantized);
+		staging->indexData  = mesh.packIndices();
+
+		staging->vertices    = staging->vertexData.data();
+		staging->vertexCount = mesh.vertices.size();
+		staging->indices     = staging->indexData.data();
+		staging->indexCount  = mesh.indices.size();
+		staging->indexType   = mesh.indexType;
+		staging->loaded      = true;
+
+		return staging;
+	}
+
+
+
+	bool MeshAsset::isOk() const
+	{
+		return meshIsLoaded;
+	}
+
+	void MeshAsset::bind() const
+	{
+		glBindVertexArray(vaoID);
+	}
+
+	GLsizei MeshAsset::getNumIndex() const
+	{
+		return numIndex;
+	}
+
+	unsigned MeshAsset::getLodCount() const
+	{
+		return unsigned(lodErrors.size());
+	}
+
+	unsigned MeshAsset::selectLod(const glm::mat4& modelViewMatrix, float fovDegrees, float viewportHeight) const
+	{
+		if (lodErrors.size() < 2)
+			return 0;
+
+		// Largest scale of the transform, applied to the radius and to the errors
+		float scale = std::max({ glm::length(glm::vec3(modelViewMatrix[0])), glm::length(glm::vec3(modelViewMatrix[1])), glm::length(glm::vec3(modelViewMatrix[2])) });
+
+		glm::vec3 center   = glm::vec3(modelViewMatrix * glm::vec4(boundsCenter, 1.f));
+		float     distance = glm::length(center) - boundsRadius * scale;
+
+		if (distance <= 0.f)
+			return 0;													// The camera is inside the bounds
+
+		// Pixels covered by one unit at the distance of the mesh
+		float pixelsPerUnit = viewportHeight / (2.f * distance * std::tan(glm::radians(fovDegrees) * .5f));
+
+		for (unsigned lod = unsigned(lodErrors.size()) - 1; lod > 0; --lod)
+		{
+			if (lodErrors[lod] * scale * pixelsPerUnit <= maxPixelError)
+				return lod;
+		}
+
+		return 0;
+	}
+
+	bool MeshAsset::isVisible(const Frustum& frustum, const glm::mat4& modelMatrix) const
+	{
+		return frustum.isVisible(boundsMin, boundsMax, modelMatrix);
+	}
+
+	void MeshAsset::draw(GLint meshMatrixID, GLsizei instanceCount, unsigned lod) const
+	{
+		size_t indexSize = MeshData::getIndexSize(indexType);
+
+		uint32_t currentTransform = uint32_t(transforms.size());	// No transform set yet
+
+		for (const MeshData::DrawRange & range : ranges)
+		{
+			if (range.lod != lod)
+				continue;
+
+			// Consecutive ranges of the same sub-mesh share their transform, upload it only when it changes
+			if (range.transform != currentTransform)
+			{
+				currentTransform = range.transform;
+
+				glUniformMatrix4fv(meshMatrixID, 1, GL_FALSE, glm::value_ptr(transforms[currentTransform]));
+			}
+
+			const void * firstIndex = reinterpret_cast< const void * >(range.firstIndex * indexSize);
+
+			if (instanceCount == 1)
+				glDrawElementsBaseVertex(GL_TRIANGLES, GLsizei(range.indexCount), indexType, firstIndex, range.baseVertex);
+			else
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, GLsizei(range.indexCount), indexType, firstIndex, instanceCount, range.baseVertex);
+		}
+	}
+
+	void MeshAsset::setDequantization(GLint positionOffsetID, GLint positionScaleID, GLint uvTransformID) const
+	{
+		glUniform3fv(positionOffsetID, 1, glm::value_ptr(dequantization.positionOffset));
+		glUniform3fv(positionScaleID , 1, glm::value_ptr(dequantization.positionScale ));
+		glUniform4f (uvTransformID, dequantization.uvOffset.x, dequantization.uvOffset.y, dequantization.uvScale.x, dequantization.uvScale.y);
+	}
+
+	void MeshAsset::setupVertexAttributes() const
+	{
+		using Vertex          = MeshData::Vertex;
+		using QuantizedVertex = MeshData::QuantizedVertex;
+
+		glBindBuffer(GL_ARRAY_BUFFER, vboIDs[VBO_VERTICES]);
+
+		// Quantized attributes are normalized integers, the shader rescales them with the dequantization uniforms
+		if (quantized)
+		{
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), (const void *)offsetof(QuantizedVertex, position));
+
+			if (hasTextureUVs)
+			{
+				glEnableVertexAttribArray(1);
+				glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), (const void *)offsetof(QuantizedVertex, textureUV));
+			}
+
+			if (hasNormals)
+			{
+				glEnableVertexAttribArray(2);
+				glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), (const void *)offsetof(QuantizedVertex, normal));
+			}
+
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboIDs[EBO_INDEX]);
+
+			return;
+		}
+
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void *)offsetof(Vertex, position));
+
+		if (hasTextureUVs)
+		{
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void *)offsetof(Vertex, textureUV));
+		}
+
+		if (hasNormals)
+		{
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void *)offsetof(Vertex, normal));
+		}
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboIDs[EBO_INDEX]);
+	}
+
+
+
+	bool MeshAsset::loadCooked(const std::string& meshFilePath, const MeshData::ImportSettings& settings, Staging& staging)
+	{
+		std::string cookedFilePath = MeshData::getCookedPath(meshFilePath);
+
+		// Ignore a cooked file older than its source, it has to be cooked again
+		std::error_code sourceError, cookedError;
+
+		auto sourceTime = std::filesystem::last_write_time(meshFilePath,   sourceError);
+		auto cookedTime = std::filesystem::last_write_time(cookedFilePath, cookedError);
+
+		if (cookedError)
+			return false;
+
+		if (not sourceError && sourceTime > cookedTime)
+		{
+			std::cerr << "Cooked mesh " << cookedFilePath << " is out of date, importing the source instead" << std::endl;
+			return false;
+		}
+
+		auto mappedFile = std::make_unique< MappedFile >(cookedFilePath);
+
+		const MappedFile & file = *mappedFile;
+
+		if (not file.isOk() || file.getSize() < sizeof(MeshData::CookedHeader))
+			return false;
+
+		MeshData::CookedHeader header;
+
+		std::memcpy(&header, file.getData(), sizeof(header));
+
+		bool valid =
+			std::memcmp(header.magic, MeshData::cookedMagic, sizeof(header.magic)) == 0 &&
+			header.version      == MeshData::cookedVersion                          &&
+			header.importFlags  == settings.importFlags                             &&
+			MeshData::getIndexSize(header.indexType) <= MeshData::getIndexSize(settings.maxIndexType) &&
+			header.vertexStride == MeshData::getVertexStride(settings.quantized)    &&
+			((header.attributes & MeshData::QUANTIZED      ) != 0) == settings.quantized    &&
+			((header.attributes & MeshData::OVERDRAW_SORTED) != 0) == settings.sortOverdraw &&
+			header.rangeOffset  + uint64_t(header.rangeCount ) * sizeof(MeshData::DrawRange)                 <= file.getSize() &&
+			header.transformOffset + uint64_t(header.transformCount) * sizeof(glm::mat4)                     <= file.getSize() &&
+			header.lodOffset       + uint64_t(header.lodCount      ) * sizeof(float)                         <= file.getSize() &&
+			header.maxLodCount  == settings.lodCount                                && header.lodCount > 0 &&
+			header.vertexOffset + uint64_t(header.vertexCount) * header.vertexStride                         <= file.getSize() &&
+			header.indexOffset  + uint64_t(header.indexCount ) * MeshData::getIndexSize(header.indexType) <= file.getSize();
+
+		if (not valid) // ERROR condition
+		{
+			std::cerr << "Cooked mesh " << cookedFilePath << " is invalid or was cooked with other settings" << std::endl;
+			return false;
+		}
+
+		staging.hasTextureUVs = (header.attributes & MeshData::HAS_TEXTURE_UVS) != 0;
+		staging.hasNormals    = (header.attributes & MeshData::HAS_NORMALS    ) != 0;
+
+		staging.dequantization = header.dequantization;
+
+		auto rangeBlock = reinterpret_cast< const MeshData::DrawRange * >(file.getData() + header.rangeOffset);
+
+		staging.ranges.assign(rangeBlock, rangeBlock + header.rangeCount);
+
+		auto transformBlock = reinterpret_cast< const glm::mat4 * >(file.getData() + header.transformOffset);
+
+		staging.transforms.assign(transformBlock, transformBlock + header.transformCount);
+
+		auto lodBlock = reinterpret_cast< const float * >(file.getData() + header.lodOffset);
+
+		staging.lodErrors.assign(lodBlock, lodBlock + header.lodCount);
+
+		// A foreign index type would reach glDrawElementsBaseVertex as it is
+		if (header.indexType != GL_UNSIGNED_BYTE && header.indexType != GL_UNSIGNED_SHORT && header.indexType != GL_UNSIGNED_INT) // ERROR condition
+		{
+			std::cerr << "Cooked mesh " << cookedFilePath << " is invalid or was cooked with other settings" << std::endl;
+			return false;
+		}
+
+		for (const MeshData::DrawRange & range : staging.ranges)
+		{
+			if (range.transform >= header.transformCount || range.lod >= header.lodCount) // ERROR condition
+			{
+				std::cerr << "Cooked mesh " << cookedFilePath << " references a missing transform or level of detail" << std::endl;
+				return false;
+			}
+
+			// The draw would read past the end of the element buffer
+			if (uint64_t(range.firstIndex) + range.indexCount > header.indexCount) // ERROR condition
+			{
+				std::cerr << "Cooked mesh " << cookedFilePath << " is invalid or was cooked with other settings" << std::endl;
+				return false;
+			}
+		}
+
+		staging.boundsMin = header.boundsMin;
+		staging.boundsMax = header.boundsMax;
+
+		// The mapped blocks will be handed to OpenGL as they are, without any intermediate copy
+		staging.vertices    = file.getData() + header.vertexOffset;
+		staging.vertexCount = header.vertexCount;
+		staging.indices     = file.getData() + header.indexOffset;
+		staging.indexCount  = header.indexCount;
+		staging.indexType   = header.indexType;
+		staging.cookedFile  = std::move(mappedFile);
+
+		return true;
+	}
+
+	void MeshAsset::upload(const void * vertices, size_t numVertex, const void * index, size_t indexCount, GLenum _indexType)
+	{
+		glBindVertexArray(vaoID);
+
+		// MESH VERTICES
+		glBindBuffer(GL_ARRAY_BUFFER, vboIDs[VBO_VERTICES]);
+		glBufferData(GL_ARRAY_BUFFER, numVertex * MeshData::getVertexStride(quantized), vertices, GL_STATIC_DRAW);
+
+		// MESH INDEXES
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboIDs[EBO_INDEX]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * MeshData::getIndexSize(_indexType), index, GL_STATIC_DRAW);
+
+		// Describe the vertex layout in the VAO of the mesh
+		setupVertexAttributes();
+
+		glBindVertexArray(0);
+
+		numIndex     = GLsizei(indexCount);
+		indexType    = _indexType;
+		meshIsLoaded = true;
+	}
+
+	void MeshAsset::setBounds(const glm::vec3& _boundsMin, const glm::vec3& _boundsMax)
+	{
+		boundsMin    = _boundsMin;
+		boundsMax    = _boundsMax;
+		boundsCenter = (boundsMin + boundsMax) * .5f;
+		boundsRadius = glm::length(boundsMax - boundsMin) * .5f;
+	}
+
+
+
+	std::shared_ptr< MeshAsset > MeshCache::acquire(const std::string& meshFilePath, const MeshData::ImportSettings& settings)
+	{
+		Key key = makeKey(meshFilePath, settings);
+
+		// Reuse the asset if some placement is still holding it
+		auto & entry = assets[key];
+		auto   asset = entry.lock();
+
+		if (not asset)
+		{
+			auto prefetched = pending.find(key);
+
+			// Only the upload is left when the mesh was prefetched (get waits for the worker if it hasn't finished)
+			if (prefetched != pending.end())
+			{
+				asset = std::make_shared< MeshAsset >(*prefetched->second.get(), settings);
+				pending.erase(prefetched);
+			}
+			else
+				asset = std::make_shared< MeshAsset >(meshFilePath, settings);
+
+			entry = asset;
+		}
+
+		// Forget the entries whose assets have already been released
+		for (auto i = assets.begin(); i != assets.end(); )
+		{
+			if (i->second.expired())
+				i = assets.erase(i);
+			else
+				++i;
+		}
+
+		return asset;
+	}
+
+	void MeshCache::prefetch(const std::string& meshFilePath, const MeshData::ImportSettings& settings)
+	{
+		Key key = makeKey(meshFilePath, settings);
+
+		auto alive = assets.find(key);
+
+		// Nothing to do if the mesh is alive or already being loaded
+		if ((alive != assets.end() && not alive->second.expired()) || pending.count(key) > 0)
+			return;
+
+		pending[key] = ThreadPool::getShared().submit([meshFilePath, settings] () { return MeshAsset::load(meshFilePath, settings); }).share();
+	}
+
+	MeshCache::Key MeshCache::makeKey(const std::string& meshFilePath, const MeshData::ImportSettings& settings)
+	{
+		std::error_code error;
+
+		auto canonicalPath = std::filesystem::weakly_canonical(meshFilePath, error);
+
+		return Key(error ? meshFilePath : canonicalPath.string(), settings);
+	}
+}
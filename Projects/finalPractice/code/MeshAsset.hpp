@@ -0,0 +1,313 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef MESHASSET_HEADER
+#define MESHASSET_HEADER
+
+
+
+#include "Frustum.hpp"
+#include "MappedFile.hpp"
+#include "MeshData.hpp"
+
+
+
+#include <cstddef>
+#include <future>
+#include <glad/glad.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// MeshAsset owns the GPU buffers (VBOs, EBO and VAO) of a mesh imported from a file.
+	/// It is shared between every MeshLoader that places the same mesh in the scene.
+	/// </summary>
+	class MeshAsset
+	{
+		public:
+
+			static const float maxPixelError;					///< Largest error on screen (in pixels) accepted when picking a level of detail.
+
+			/// <summary>
+			/// CPU side of a loaded mesh: everything read, parsed and packed from the files without any GL call,
+			/// so it can be built on a worker thread and uploaded later by the thread that owns the GL context.
+			/// </summary>
+			struct Staging
+			{
+				bool							   loaded;		///< Flag indicating whether the mesh was successfully loaded.
+				bool					    hasTextureUVs;		///< Flag indicating whether the mesh has texture coordinates.
+				bool					       hasNormals;		///< Flag indicating whether the mesh has normals.
+
+				std::vector< MeshData::DrawRange > ranges;		///< Ranges of the index buffer drawn by each call.
+				std::vector< glm::mat4 >       transforms;		///< Local transforms of the sub-meshes referenced by the ranges.
+				MeshData::Dequantization   dequantization;		///< Bounds needed by the shaders to read quantized vertices.
+				std::vector< float >		    lodErrors;		///< Geometric error of every level of detail.
+				glm::vec3						boundsMin;		///< Smallest corner of the bounding box of the mesh.
+				glm::vec3						boundsMax;		///< Largest corner of the bounding box of the mesh.
+
+				std::unique_ptr< MappedFile > cookedFile;		///< Cooked file the blocks point into (cooked meshes only).
+				std::vector< uint8_t >		   vertexData;		///< Packed vertices (imported meshes only).
+				std::vector< uint8_t >			indexData;		///< Packed indices (imported meshes only).
+
+				const void *					 vertices;		///< Interleaved vertices to upload.
+				size_t						  vertexCount;		///< Number of vertices.
+				const void *					  indices;		///< Packed indices to upload.
+				size_t						   indexCount;		///< Number of indices.
+				GLenum						    indexType;		///< Type of the packed indices.
+			};
+
+		private:
+
+			/// <summary>
+			/// Enum representing the different VBO types.
+			/// </summary>
+			enum
+			{
+				VBO_VERTICES,									///< Interleaved vertex data VBO (coordinates, texture UVs and normals, float or quantized)
+				EBO_INDEX,										///< Element Index Buffer Object
+				VBO_COUNT										///< Total number of VBOs
+			};
+
+		private:
+
+			GLuint  vboIDs[VBO_COUNT];							///< IDs for the vertex buffer objects.
+			GLuint				vaoID;							///< ID for the vertex array object.
+
+			GLsizei			 numIndex;							///< Number of indices for rendering.
+			GLenum			indexType;							///< Type of the indices (8, 16 or 32 bits depending on the vertex count).
+
+			std::vector< MeshData::DrawRange > ranges;			///< Ranges of the index buffer drawn by each call.
+			std::vector< glm::mat4 >       transforms;			///< Local transforms of the sub-meshes referenced by the ranges.
+
+			bool			quantized;							///< Flag indicating whether the vertices use the quantized layout.
+			MeshData::Dequantization dequantization;			///< Bounds needed by the shaders to read quantized vertices.
+
+			std::vector< float >    lodErrors;					///< Geometric error of every level of detail (0 for the full resolution one).
+			glm::vec3			    boundsMin;					///< Smallest corner of the bounding box of the mesh.
+			glm::vec3			    boundsMax;					///< Largest corner of the bounding box of the mesh.
+			glm::vec3			 boundsCenter;					///< Center of the bounding sphere of the mesh.
+			float				 boundsRadius;					///< Radius of the bounding sphere of the mesh.
+
+			bool		hasTextureUVs;							///< Flag indicating whether the mesh has texture coordinates.
+			bool		   hasNormals;							///< Flag indicating whether the mesh has normals.
+			bool		 meshIsLoaded;							///< Flag indicating whether the mesh was successfully imported.
+
+		public:
+
+			/// <summary>
+			/// Loads the mesh and uploads its vertex data to the GPU. If an up to date cooked file exists next to the
+			/// source it is memory mapped and uploaded directly; otherwise the source is imported with Assimp.
+			/// </summary>
+			///
+			/// <param name="meshFilePath">The file path to the mesh to be loaded.</param>
+			/// <param name="settings">The settings used to import the mesh.</param>
+			MeshAsset(const std::string& meshFilePath, const MeshData::ImportSettings& settings);
+
+			/// <summary>
+			/// Uploads a mesh already loaded by load() to the GPU.
+			/// </summary>
+			///
+			/// <param name="staging">The CPU side of the mesh.</param>
+			/// <param name="settings">The settings the mesh was loaded with.</param>
+			MeshAsset(const Staging& staging, const MeshData::ImportSettings& settings);
+
+			/// <summary>
+			/// Destructor that cleans up OpenGL resources.
+			/// </summary>
+			~MeshAsset();
+
+		private:
+
+			// Delete the copy constructor and copy assignment operator to prevent copying
+			MeshAsset(const MeshAsset&) = delete;
+			MeshAsset& operator = (const MeshAsset&) = delete;
+
+		public:
+
+			/// <summary>
+			/// Reads the mesh without any GL call: maps and validates the cooked file when there is an up to date
+			/// one, otherwise imports the source with Assimp and packs its vertices and indices. It can run on any thread.
+			/// </summary>
+			///
+			/// <param name="meshFilePath">The file path to the mesh to be loaded.</param>
+			/// <param name="settings">The settings used to import the mesh.</param>
+			///
+			/// <returns>The CPU side of the mesh (not loaded if both the cooked file and the source failed).</returns>
+			static std::shared_ptr< Staging > load(const std::string& meshFilePath, const MeshData::ImportSettings& settings);
+
+		public:
+
+			/// <summary>
+			/// Checks whether the mesh has been successfully imported.
+			/// </summary>
+			///
+			/// <returns>True if the mesh is loaded, false otherwise.</returns>
+			bool	isOk() const;
+
+			/// <summary>
+			/// Binds the vertex array object of the mesh.
+			/// </summary>
+			void	bind() const;
+
+			/// <summary>
+			/// Gets the number of indices to draw.
+			/// </summary>
+			///
+			/// <returns>The number of indices of the mesh.</returns>
+			GLsizei getNumIndex() const;
+
+			/// <summary>
+			/// Gets the number of levels of detail of the mesh.
+			/// </summary>
+			///
+			/// <returns>The number of levels of detail (1 when the mesh has only the full resolution one).</returns>
+			unsigned getLodCount() const;
+
+			/// <summary>
+			/// Picks the coarsest level of detail whose geometric error projects to less than maxPixelError pixels
+			/// on screen, from the distance to the bounding sphere of the mesh and the field of view of the camera.
+			/// </summary>
+			///
+			/// <param name="modelViewMatrix">Transform from the mesh to the camera space.</param>
+			/// <param name="fovDegrees">Vertical field of view of the camera in degrees.</param>
+			/// <param name="viewportHeight">Height of the viewport in pixels.</param>
+			///
+			/// <returns>The level of detail to draw.</returns>
+			unsigned selectLod(const glm::mat4& modelViewMatrix, float fovDegrees, float viewportHeight) const;
+
+			/// <summary>
+			/// Tests the bounding box of the mesh, placed with a model matrix, against the view frustum.
+			/// </summary>
+			///
+			/// <param name="frustum">The view frustum of the camera.</param>
+			/// <param name="modelMatrix">Transform from the mesh to the world space.</param>
+			///
+			/// <returns>False when the mesh is completely outside the frustum.</returns>
+			bool	 isVisible(const Frustum& frustum, const glm::mat4& modelMatrix) const;
+
+			/// <summary>
+			/// Draws every range of a level of detail with the vertex array object currently bound, setting the
+			/// local transform of each sub-mesh before its ranges are drawn.
+			/// </summary>
+			///
+			/// <param name="meshMatrixID">Location of the mat4 uniform that receives the local transform of the sub-mesh.</param>
+			/// <param name="instanceCount">Number of instances to draw (1 draws without instancing).</param>
+			/// <param name="lod">Level of detail to draw.</param>
+			void	draw(GLint meshMatrixID, GLsizei instanceCount = 1, unsigned lod = 0) const;
+
+			/// <summary>
+			/// Sets the uniforms that turn the quantized attributes back into mesh coordinates (quantized meshes only).
+			/// </summary>
+			///
+			/// <param name="positionOffsetID">Location of the vec3 uniform that receives the center of the bounds.</param>
+			/// <param name="positionScaleID">Location of the vec3 uniform that receives half the size of the bounds.</param>
+			/// <param name="uvTransformID">Location of the vec4 uniform that receives the UV offset (xy) and scale (zw).</param>
+			void	setDequantization(GLint positionOffsetID, GLint positionScaleID, GLint uvTransformID) const;
+
+			/// <summary>
+			/// Points the attributes 0 (coordinates), 1 (texture UVs), 2 (normals) and the index buffer of the
+			/// currently bound vertex array object to the buffers of this mesh, with the float or the quantized layout.
+			/// Used to build additional VAOs (e.g. for instancing) that reuse the same GPU buffers.
+			/// </summary>
+			void	setupVertexAttributes() const;
+
+		private:
+
+			/// <summary>
+			/// Maps and validates a cooked mesh file, leaving its vertex and index blocks in the mapped memory so
+			/// they are uploaded without any intermediate copy.
+			/// </summary>
+			///
+			/// <param name="meshFilePath">The file path to the source mesh (used to find and validate the cooked file).</param>
+			/// <param name="settings">The settings the cooked file must have been imported with.</param>
+			/// <param name="staging">Receives the mapped file and the mesh description.</param>
+			///
+			/// <returns>True if the cooked file was valid, false otherwise.</returns>
+			static bool loadCooked(const std::string& meshFilePath, const MeshData::ImportSettings& settings, Staging& staging);
+
+			/// <summary>
+			/// Uploads the interleaved vertices and the packed indices of the mesh to its buffers.
+			/// </summary>
+			///
+			/// <param name="vertices">Pointer to the interleaved vertex data (with the layout selected by quantized).</param>
+			/// <param name="numVertex">Number of vertices.</param>
+			/// <param name="index">Pointer to the packed index data.</param>
+			/// <param name="indexCount">Number of indices.</param>
+			/// <param name="indexType">Type of the packed indices.</param>
+			void	upload(const void * vertices, size_t numVertex, const void * index, size_t indexCount, GLenum indexType);
+
+			/// <summary>
+			/// Stores the bounding box of the mesh and computes its bounding sphere.
+			/// </summary>
+			///
+			/// <param name="_boundsMin">Smallest corner of the bounding box.</param>
+			/// <param name="_boundsMax">Largest corner of the bounding box.</param>
+			void	setBounds(const glm::vec3& _boundsMin, const glm::vec3& _boundsMax);
+	};
+
+	/// <summary>
+	/// MeshCache keeps track of the meshes already imported so each file is parsed and uploaded only once.
+	/// Assets are reference counted: the cache holds weak references and an asset is released when the
+	/// last MeshLoader using it is destroyed.
+	/// </summary>
+	class MeshCache
+	{
+		private:
+
+			using Key = std::pair< std::string, MeshData::ImportSettings >; ///< Canonical file path plus import settings.
+
+			static std::map< Key, std::weak_ptr< MeshAsset > > assets; ///< Meshes currently alive.
+			static std::map< Key, std::shared_future< std::shared_ptr< MeshAsset::Staging > > > pending; ///< Meshes being loaded by the thread pool.
+
+		public:
+
+			/// <summary>
+			/// Returns the shared asset for the given file, importing it if no one is using it yet.
+			/// </summary>
+			///
+			/// <param name="meshFilePath">The file path to the mesh to be loaded.</param>
+			/// <param name="settings">The settings used to import the mesh.</param>
+			///
+			/// <returns>A shared pointer to the mesh asset.</returns>
+			static std::shared_ptr< MeshAsset > acquire(const std::string& meshFilePath, const MeshData::ImportSettings& settings = MeshData::ImportSettings());
+
+			/// <summary>
+			/// Starts loading a mesh on the shared thread pool, so a later acquire of the same file and settings only
+			/// has to upload it. Must be called from the thread that calls acquire.
+			/// </summary>
+			///
+			/// <param name="meshFilePath">The file path to the mesh to be loaded.</param>
+			/// <param name="settings">The settings used to import the mesh.</param>
+			static void prefetch(const std::string& meshFilePath, const MeshData::ImportSettings& settings = MeshData::ImportSettings());
+
+		private:
+
+			/// <summary>
+			/// Builds the cache key of a mesh, resolving its path so different spellings of the same file match.
+			/// </summary>
+			///
+			/// <param name="meshFilePath">The file path to the mesh.</param>
+			/// <param name="settings">The settings used to import the mesh.</param>
+			///
+			/// <returns>The key identifying the mesh inside the cache.</returns>
+			static Key makeKey(const std::string& meshFilePath, const MeshData::ImportSettings& settings);
+	};
+}
+
+
+
+#endif
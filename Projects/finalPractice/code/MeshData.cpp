@@ -0,0 +1,532 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "MeshData.hpp"
+
+
+
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+
+
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <gtc/type_ptr.hpp>
+#include <iostream>
+#include <tuple>
+
+
+
+namespace finalPractice
+{
+	const unsigned MeshData::defaultImportFlags = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType;
+
+	const char     MeshData::cookedMagic[4] = { 'M', 'E', 'S', 'H' };
+	const uint32_t MeshData::cookedVersion  = 6;
+
+
+
+	MeshData::ImportSettings::ImportSettings(unsigned _importFlags, GLenum _maxIndexType, bool _quantized, bool _sortOverdraw, unsigned _lodCount) :
+		importFlags (_importFlags),
+		maxIndexType(_maxIndexType),
+		quantized   (_quantized),
+		sortOverdraw(_sortOverdraw),
+		lodCount    (_lodCount)
+	{}
+
+	bool MeshData::ImportSettings::operator < (const ImportSettings& other) const
+	{
+		return std::tie(importFlags, maxIndexType, quantized, sortOverdraw, lodCount) < std::tie(other.importFlags, other.maxIndexType, other.quantized, other.sortOverdraw, other.lodCount);
+	}
+
+	bool MeshData::ImportSettings::operator == (const ImportSettings& other) const
+	{
+		return std::tie(importFlags, maxIndexType, quantized, sortOverdraw, lodCount) == std::tie(other.importFlags, other.maxIndexType, other.quantized, other.sortOverdraw, other.lodCount);
+	}
+
+
+
+	MeshData::MeshData() :
+		indexType(GL_UNSIGNED_INT),
+		dequantization{ glm::vec3(0.f), glm::vec3(1.f), glm::vec2(0.f), glm::vec2(1.f) },
+		lodErrors(1, 0.f),
+		boundsMin(0.f),
+		boundsMax(0.f),
+		hasTextureUVs(false),
+		hasNormals(false)
+	{}
+
+
+
+	bool MeshData::importMesh(const std::string& meshFilePath, const ImportSettings& settings)
+	{
+		Assimp::Importer importer;
+
+		auto scene = importer.ReadFile(meshFilePath, settings.importFlags);
+
+		if (not scene || scene->mNumMeshes == 0) // ERROR condition
+		{
+			std::cerr << "Couldn't load mesh " << meshFilePath << ": " << importer.GetErrorString() << std::endl;
+			return false;
+		}
+
+		// Place every mesh referenced by the node hierarchy
+		std::vector< std::pair< unsigned, glm::mat4 > > placements;
+
+		collectPlacements(scene->mRootNode, glm::mat4(1), placements);
+
+		// MESH VERTICES AND INDEXES (each mesh is appended once, however many nodes reference it)
+		std::vector< DrawRange > meshRanges(scene->mNumMeshes, DrawRange{ 0, 0, 0, 0, 0 });
+
+		for (unsigned i = 0; i < scene->mNumMeshes; ++i)
+		{
+			hasTextureUVs |= scene->mMeshes[i]->HasTextureCoords(0);
+			hasNormals    |= scene->mMeshes[i]->HasNormals();
+		}
+
+		if (not hasTextureUVs) // ERROR condition
+			std::cerr << "Mesh doesn't have UV coordinates" << std::endl;
+
+		if (not hasNormals)    // ERROR condition
+			std::cerr << "Mesh doesn't have normals" << std::endl;
+
+		for (unsigned meshIndex = 0; meshIndex < scene->mNumMeshes; ++meshIndex)
+		{
+			auto mesh = scene->mMeshes[meshIndex];
+
+			if (mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE)	// Points and lines are not rendered
+				continue;
+
+			bool meshHasTextureUVs = mesh->HasTextureCoords(0);
+			bool meshHasNormals    = mesh->HasNormals();
+
+			DrawRange & range = meshRanges[meshIndex];
+
+			range.firstIndex = uint32_t(indices .size());
+			range.indexCount = mesh->mNumFaces * 3;
+			range.baseVertex = int32_t (vertices.size());
+
+			// Coordinates, texture UVs and normals interleaved
+			for (unsigned i = 0; i < mesh->mNumVertices; ++i)
+			{
+				Vertex vertex;
+
+				vertex.position  = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+				vertex.textureUV = meshHasTextureUVs ? glm::vec2(mesh->mTextureCoords[0][i].x, 1.f - mesh->mTextureCoords[0][i].y) : glm::vec2(0.f);
+				vertex.normal    = meshHasNormals    ? glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z)       : glm::vec3(0.f);
+
+				vertices.push_back(vertex);
+			}
+
+			// Indices relative to the first vertex of the mesh
+			for (unsigned i = 0; i < mesh->mNumFaces; ++i)
+			{
+				auto& face = mesh->mFaces[i];
+
+				assert(face.mNumIndices == 3);
+
+				indices.push_back(face.mIndices[0]);
+				indices.push_back(face.mIndices[1]);
+				indices.push_back(face.mIndices[2]);
+			}
+		}
+
+		// Transforms are relative to the first placement, so a single mesh file renders as it always did
+		glm::mat4 reference = placements.empty() ? glm::mat4(1) : glm::inverse(placements.front().second);
+
+		for (auto & placement : placements)
+		{
+			DrawRange range = meshRanges[placement.first];
+
+			if (range.indexCount == 0)
+				continue;
+
+			range.transform = uint32_t(transforms.size());
+
+			transforms.push_back(reference * placement.second);
+			ranges    .push_back(range);
+		}
+
+		if (ranges.empty()) // ERROR condition
+		{
+			std::cerr << "Mesh " << meshFilePath << " doesn't have any triangle" << std::endl;
+			return false;
+		}
+
+		// Reorder triangles and vertices before splitting, chunks keep the optimized order
+		MeshOptimizer::optimize(*this, settings.sortOverdraw);
+
+		MeshSimplifier::generateLods(*this, settings.lodCount);
+
+		selectIndexType(settings.maxIndexType);
+
+		computeDequantization();
+		computeBounds();
+
+		return true;
+	}
+
+	bool MeshData::saveCooked(const std::string& cookedFilePath, const ImportSettings& settings) const
+	{
+		static const uint64_t alignment = 16;							// Keeps every block aligned inside the mapped file
+
+		auto align = [](uint64_t offset) { return (offset + alignment - 1) & ~(alignment - 1); };
+
+		std::vector< uint8_t > vertexData = packVertices(settings.quantized);
+		std::vector< uint8_t > indexData  = packIndices();
+
+		CookedHeader header = {};										// Zeroes the padding written to the file too
+
+		std::memcpy(header.magic, cookedMagic, sizeof(header.magic));
+
+		header.version      = cookedVersion;
+		header.importFlags  = settings.importFlags;
+		header.maxIndexType = settings.maxIndexType;
+		header.attributes   = (hasTextureUVs ? HAS_TEXTURE_UVS : 0) | (hasNormals ? HAS_NORMALS : 0) | (settings.quantized ? QUANTIZED : 0)
+		                    | (settings.sortOverdraw ? OVERDRAW_SORTED : 0);
+		header.vertexCount  = uint32_t(vertices.size());
+		header.vertexStride = uint32_t(getVertexStride(settings.quantized));
+		header.indexCount   = uint32_t(indices.size());
+		header.indexType    = indexType;
+		header.rangeCount      = uint32_t(ranges    .size());
+		header.transformCount  = uint32_t(transforms.size());
+		header.maxLodCount     = settings.lodCount;
+		header.lodCount        = uint32_t(lodErrors.size());
+		header.dequantization  = dequantization;
+		header.boundsMin       = boundsMin;
+		header.boundsMax       = boundsMax;
+		header.rangeOffset     = align(sizeof(CookedHeader));
+		header.transformOffset = align(header.rangeOffset     + ranges    .size() * sizeof(DrawRange));
+		header.lodOffset       = align(header.transformOffset + transforms.size() * sizeof(glm::mat4));
+		header.vertexOffset    = align(header.lodOffset       + lodErrors .size() * sizeof(float));
+		header.indexOffset     = align(header.vertexOffset    + vertexData.size());
+
+		std::ofstream file(cookedFilePath, std::ios::binary | std::ios::trunc);
+
+		if (not file)
+		{
+			std::cerr << "Couldn't write cooked mesh " << cookedFilePath << std::endl;
+			return false;
+		}
+
+		// Writes a block padded up to the given offset
+		auto writeBlock = [&file](const void * block, size_t blockSize, uint64_t offset)
+		{
+			static const char padding[alignment] = {};
+
+			file.write(padding, std::streamsize(offset - uint64_t(file.tellp())));
+			file.write(reinterpret_cast< const char * >(block), std::streamsize(blockSize));
+		};
+
+		file.write(reinterpret_cast< const char * >(&header), sizeof(header));
+
+		writeBlock(ranges    .data(), ranges    .size() * sizeof(DrawRange), header.rangeOffset    );
+		writeBlock(transforms.data(), transforms.size() * sizeof(glm::mat4), header.transformOffset);
+		writeBlock(lodErrors .data(), lodErrors .size() * sizeof(float)    , header.lodOffset      );
+		writeBlock(vertexData.data(), vertexData.size()                    , header.vertexOffset   );
+		writeBlock(indexData .data(), indexData .size()                    , header.indexOffset    );
+
+		return bool(file);
+	}
+
+	void MeshData::selectIndexType(GLenum maxIndexType)
+	{
+		static const GLenum indexTypes[] = { GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_UNSIGNED_INT };
+
+		uint64_t capacity = getIndexCapacity(maxIndexType);
+
+		// Split the mesh into chunks if a range has more vertices than the widest allowed type can address
+		if (getLargestRange() > capacity)
+		{
+			std::vector< Vertex >    chunkVertices;
+			std::vector< GLuint >    chunkIndices;
+			std::vector< DrawRange > chunkRanges;
+
+			chunkVertices.reserve(vertices.size());
+			chunkIndices .reserve(indices .size());
+
+			std::vector< int64_t > remap(vertices.size(), -1);		// Position of each source vertex inside the current chunk
+			std::vector< GLuint >  chunkSources;					// Source vertices of the current chunk
+
+			auto closeChunk = [&]()
+			{
+				if (chunkSources.empty())
+					return;
+
+				DrawRange & range = chunkRanges.back();
+
+				range.indexCount = uint32_t(chunkIndices.size()) - range.firstIndex;
+
+				for (GLuint source : chunkSources)
+				{
+					chunkVertices.push_back(vertices[source]);
+					remap[source] = -1;
+				}
+
+				chunkSources.clear();
+			};
+
+			for (const DrawRange & source : ranges)
+			{
+				closeChunk();										// Chunks never mix ranges with different transforms
+
+				for (uint32_t i = 0; i < source.indexCount; i += 3)
+				{
+					const GLuint * triangle = &indices[source.firstIndex + i];
+
+					// Count the vertices of the triangle that aren't in the chunk yet
+					size_t newVertices = 0;
+
+					for (int corner = 0; corner < 3; ++corner)
+						newVertices += remap[source.baseVertex + triangle[corner]] < 0 ? 1 : 0;
+
+					if (chunkSources.empty() || chunkSources.size() + newVertices > capacity)
+					{
+						closeChunk();
+
+						chunkRanges.push_back(DrawRange{ uint32_t(chunkIndices.size()), 0, int32_t(chunkVertices.size()), source.transform, source.lod });
+					}
+
+					for (int corner = 0; corner < 3; ++corner)
+					{
+						GLuint vertex = source.baseVertex + triangle[corner];
+
+						if (remap[vertex] < 0)
+						{
+							remap[vertex] = int64_t(chunkSources.size());
+							chunkSources.push_back(vertex);
+						}
+
+						chunkIndices.push_back(GLuint(remap[vertex]));
+					}
+				}
+			}
+
+			closeChunk();
+
+			vertices.swap(chunkVertices);
+			indices .swap(chunkIndices );
+			ranges  .swap(chunkRanges  );
+		}
+
+		// Pick the narrowest type able to address the largest range
+		uint64_t largestRange = getLargestRange();
+
+		for (GLenum type : indexTypes)
+		{
+			indexType = type;
+
+			if (largestRange <= getIndexCapacity(type) || type == maxIndexType)
+				break;
+		}
+	}
+
+	uint64_t MeshData::getLargestRange() const
+	{
+		uint64_t largestRange = 0;
+
+		for (const DrawRange & range : ranges)
+		{
+			for (uint32_t i = 0; i < range.indexCount; ++i)
+				largestRange = std::max< uint64_t >(largestRange, uint64_t(indices[range.firstIndex + i]) + 1);
+		}
+
+		return largestRange;
+	}
+
+	std::vector< uint8_t > MeshData::packIndices() const
+	{
+		std::vector< uint8_t > indexData(indices.size() * getIndexSize(indexType));
+
+		switch (indexType)
+		{
+			case GL_UNSIGNED_BYTE:
+			{
+				for (size_t i = 0; i < indices.size(); ++i)
+					indexData[i] = uint8_t(indices[i]);
+				break;
+			}
+			case GL_UNSIGNED_SHORT:
+			{
+				auto packed = reinterpret_cast< uint16_t * >(indexData.data());
+
+				for (size_t i = 0; i < indices.size(); ++i)
+					packed[i] = uint16_t(indices[i]);
+				break;
+			}
+			default:
+			{
+				std::memcpy(indexData.data(), indices.data(), indexData.size());
+				break;
+			}
+		}
+
+		return indexData;
+	}
+
+
+
+	std::vector< uint8_t > MeshData::packVertices(bool quantized) const
+	{
+		std::vector< uint8_t > vertexData(vertices.size() * getVertexStride(quantized));
+
+		if (not quantized)
+		{
+			std::memcpy(vertexData.data(), vertices.data(), vertexData.size());
+			return vertexData;
+		}
+
+		auto toSnorm16 = [](float value) { return int16_t (std::lround(std::clamp(value, -1.f, 1.f) * 32767.f)); };
+		auto toUnorm16 = [](float value) { return uint16_t(std::lround(std::clamp(value,  0.f, 1.f) * 65535.f)); };
+
+		// Divides by the size of the bounds, leaving flat axes at zero
+		auto normalize = [](float value, float offset, float scale) { return scale > 0.f ? (value - offset) / scale : 0.f; };
+
+		auto packed = reinterpret_cast< QuantizedVertex * >(vertexData.data());
+
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			const Vertex & vertex = vertices[i];
+
+			for (int axis = 0; axis < 3; ++axis)
+				packed[i].position[axis] = toSnorm16(normalize(vertex.position[axis], dequantization.positionOffset[axis], dequantization.positionScale[axis]));
+
+			packed[i].position[3] = 0;
+
+			for (int axis = 0; axis < 2; ++axis)
+				packed[i].textureUV[axis] = toUnorm16(normalize(vertex.textureUV[axis], dequantization.uvOffset[axis], dequantization.uvScale[axis]));
+
+			// Octahedral encoding: project the normal onto the octahedron and fold the lower half over the upper one
+			glm::vec3 normal = vertex.normal;
+			float     length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+
+			glm::vec2 encoded = length > 0.f ? glm::vec2(normal.x, normal.y) / length : glm::vec2(0.f);
+
+			if (length > 0.f && normal.z < 0.f)
+			{
+				glm::vec2 sign(encoded.x >= 0.f ? 1.f : -1.f, encoded.y >= 0.f ? 1.f : -1.f);
+
+				encoded = (1.f - glm::abs(glm::vec2(encoded.y, encoded.x))) * sign;
+			}
+
+			packed[i].normal[0] = toSnorm16(encoded.x);
+			packed[i].normal[1] = toSnorm16(encoded.y);
+		}
+
+		return vertexData;
+	}
+
+	void MeshData::computeDequantization()
+	{
+		glm::vec3 positionMin(0.f), positionMax(0.f);
+		glm::vec2       uvMin(0.f),       uvMax(0.f);
+
+		if (not vertices.empty())
+		{
+			positionMin = positionMax = vertices.front().position;
+			uvMin       = uvMax       = vertices.front().textureUV;
+		}
+
+		for (const Vertex & vertex : vertices)
+		{
+			positionMin = glm::min(positionMin, vertex.position );
+			positionMax = glm::max(positionMax, vertex.position );
+			uvMin       = glm::min(uvMin      , vertex.textureUV);
+			uvMax       = glm::max(uvMax      , vertex.textureUV);
+		}
+
+		dequantization.positionOffset = (positionMin + positionMax) * .5f;
+		dequantization.positionScale  = (positionMax - positionMin) * .5f;
+		dequantization.uvOffset       = uvMin;
+		dequantization.uvScale        = uvMax - uvMin;
+	}
+
+
+
+	void MeshData::computeBounds()
+	{
+		bool empty = true;
+
+		for (const DrawRange & range : ranges)
+		{
+			if (range.lod != 0)
+				continue;												// Simplified levels stay inside the full resolution one
+
+			const glm::mat4 & transform = transforms[range.transform];
+
+			for (uint32_t i = 0; i < range.indexCount; ++i)
+			{
+				glm::vec3 position = glm::vec3(transform * glm::vec4(vertices[range.baseVertex + indices[range.firstIndex + i]].position, 1.f));
+
+				boundsMin = empty ? position : glm::min(boundsMin, position);
+				boundsMax = empty ? position : glm::max(boundsMax, position);
+				empty     = false;
+			}
+		}
+	}
+
+
+
+	size_t MeshData::getIndexSize(GLenum indexType)
+	{
+		switch (indexType)
+		{
+			case GL_UNSIGNED_BYTE : return sizeof(GLubyte );
+			case GL_UNSIGNED_SHORT: return sizeof(GLushort);
+			default:                return sizeof(GLuint  );
+		}
+	}
+
+	uint64_t MeshData::getIndexCapacity(GLenum indexType)
+	{
+		return uint64_t(1) << (8 * getIndexSize(indexType));
+	}
+
+	size_t MeshData::getVertexStride(bool quantized)
+	{
+		return quantized ? sizeof(QuantizedVertex) : sizeof(Vertex);
+	}
+
+	std::string MeshData::getCookedPath(const std::string& meshFilePath)
+	{
+		size_t extension = meshFilePath.find_last_of('.');
+		size_t separator = meshFilePath.find_last_of("/\\");
+
+		if (extension == std::string::npos || (separator != std::string::npos && extension < separator))
+			return meshFilePath + ".mesh";
+
+		return meshFilePath.substr(0, extension) + ".mesh";
+	}
+
+	void MeshData::collectPlacements(const aiNode * node, const glm::mat4& parentTransform, std::vector< std::pair< unsigned, glm::mat4 > >& placements)
+	{
+		// Assimp matrices are row major, glm ones are column major
+		glm::mat4 transform = parentTransform * glm::transpose(glm::make_mat4(&node->mTransformation.a1));
+
+		for (unsigned i = 0; i < node->mNumMeshes; ++i)
+			placements.emplace_back(node->mMeshes[i], transform);
+
+		for (unsigned i = 0; i < node->mNumChildren; ++i)
+			collectPlacements(node->mChildren[i], transform, placements);
+	}
+
+	bool MeshData::cook(const std::string& meshFilePath, const ImportSettings& settings)
+	{
+		MeshData mesh;
+
+		if (not mesh.importMesh(meshFilePath, settings))
+			return false;
+
+		return mesh.saveCooked(getCookedPath(meshFilePath), settings);
+	}
+}
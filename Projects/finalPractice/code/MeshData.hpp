@@ -0,0 +1,308 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef MESHDATA_HEADER
+#define MESHDATA_HEADER
+
+
+
+#include <cstdint>
+#include <glad/glad.h>
+#include <glm.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+
+struct aiNode;
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// MeshData is the CPU side copy of a mesh, already laid out the way it is uploaded to the GPU
+	/// (one interleaved vertex buffer, one index buffer and the ranges of indices to draw).
+	/// Every sub-mesh of the imported file is packed in the same buffers, each one drawn as a range with its local transform.
+	/// It is filled by importing a mesh file with Assimp and can be saved as a cooked binary file
+	/// that MeshAsset maps and uploads without any parsing.
+	/// </summary>
+	class MeshData
+	{
+		public:
+
+			static const unsigned defaultImportFlags;			///< Assimp flags used when none are specified.
+
+			/// <summary>
+			/// Settings used to import a mesh. Meshes imported with different settings are different assets.
+			/// </summary>
+			struct ImportSettings
+			{
+				unsigned		importFlags;					///< Assimp post-processing flags.
+				GLenum		   maxIndexType;					///< Widest index type allowed (GL_UNSIGNED_BYTE, _SHORT or _INT).
+				bool			  quantized;					///< Whether the vertices are uploaded with the quantized layout (QuantizedVertex).
+				bool		   sortOverdraw;					///< Whether clusters of triangles are sorted to reduce overdraw.
+				unsigned		   lodCount;					///< Number of simplified levels of detail generated after the full resolution one.
+
+				/// <summary>
+				/// Creates the import settings.
+				/// </summary>
+				///
+				/// <param name="importFlags">Assimp post-processing flags.</param>
+				/// <param name="maxIndexType">Widest index type allowed. Meshes with more vertices than it can address are split into chunks.</param>
+				/// <param name="quantized">Whether the vertices are uploaded with the quantized layout (half the size of the float one).</param>
+				/// <param name="sortOverdraw">Whether clusters of triangles are sorted to reduce overdraw (after the vertex cache optimization).</param>
+				/// <param name="lodCount">Number of simplified levels of detail, each one with about half the triangles of the previous one.</param>
+				ImportSettings(unsigned importFlags = defaultImportFlags, GLenum maxIndexType = GL_UNSIGNED_INT, bool quantized = false, bool sortOverdraw = false, unsigned lodCount = 0);
+
+				bool operator <  (const ImportSettings& other) const;
+				bool operator == (const ImportSettings& other) const;
+			};
+
+			/// <summary>
+			/// Interleaved vertex layout shared by imported and cooked meshes.
+			/// </summary>
+			struct Vertex
+			{
+				glm::vec3			 position;					///< Vertex coordinates (attribute 0).
+				glm::vec2		    textureUV;					///< Texture coordinates (attribute 1).
+				glm::vec3			   normal;					///< Vertex normal (attribute 2).
+			};
+
+			/// <summary>
+			/// Quantized interleaved vertex layout (16 bytes instead of 32). The shaders rebuild the attributes
+			/// with the values of Dequantization.
+			/// </summary>
+			struct QuantizedVertex
+			{
+				int16_t		  position[4];					///< Coordinates relative to the mesh bounds as snorm16 (attribute 0, w is padding).
+				uint16_t	 textureUV[2];					///< Texture coordinates relative to the UV bounds as unorm16 (attribute 1).
+				int16_t			normal[2];					///< Octahedral encoded normal as snorm16 (attribute 2).
+			};
+
+			/// <summary>
+			/// Values that turn the quantized attributes back into mesh coordinates and texture coordinates.
+			/// </summary>
+			struct Dequantization
+			{
+				glm::vec3	 positionOffset;					///< Center of the mesh bounds.
+				glm::vec3	  positionScale;					///< Half the size of the mesh bounds.
+				glm::vec2		   uvOffset;					///< Smallest texture coordinates of the mesh.
+				glm::vec2			uvScale;					///< Size of the texture coordinate bounds.
+			};
+
+			/// <summary>
+			/// Range of the index buffer drawn with a single call. Its indices are relative to baseVertex,
+			/// which lets every sub-mesh use narrow indices and meshes with more vertices than the index type
+			/// can address be drawn in chunks. The simplified levels of detail are ranges of their own that
+			/// reuse the vertices of the full resolution one.
+			/// </summary>
+			struct DrawRange
+			{
+				uint32_t		 firstIndex;					///< Position of the first index of the range.
+				uint32_t		 indexCount;					///< Number of indices of the range.
+				int32_t			 baseVertex;					///< Value added to every index of the range.
+				uint32_t		  transform;					///< Position of the local transform of the range in MeshData::transforms.
+				uint32_t			    lod;					///< Level of detail the range belongs to (0 is the full resolution).
+			};
+
+			/// <summary>
+			/// Header at the start of a cooked mesh file. The range, vertex and index blocks follow at the given offsets.
+			/// </summary>
+			struct CookedHeader
+			{
+				char			   magic[4];					///< File identifier ("MESH").
+				uint32_t			version;					///< Version of the cooked format.
+				uint32_t		importFlags;					///< Assimp flags used to import the source mesh.
+				uint32_t	   maxIndexType;					///< Widest index type the mesh was allowed to use.
+				uint32_t		 attributes;					///< Bit mask of the attributes present in the source mesh.
+				uint32_t		vertexCount;					///< Number of vertices.
+				uint32_t	   vertexStride;					///< Size of a vertex in bytes.
+				uint32_t		 indexCount;					///< Number of indices.
+				uint32_t		  indexType;					///< Type of the indices (GL_UNSIGNED_BYTE, _SHORT or _INT).
+				uint32_t		 rangeCount;					///< Number of draw ranges.
+				uint32_t	 transformCount;					///< Number of local transforms.
+				uint32_t	    maxLodCount;					///< Number of levels of detail requested when the mesh was imported.
+				uint32_t		   lodCount;					///< Number of levels of detail generated (including the full resolution one).
+				Dequantization dequantization;					///< Bounds used by the quantized layout.
+				glm::vec3		  boundsMin;					///< Smallest corner of the mesh bounds.
+				glm::vec3		  boundsMax;					///< Largest corner of the mesh bounds.
+				uint64_t		rangeOffset;					///< Offset of the range block from the start of the file.
+				uint64_t	transformOffset;					///< Offset of the transform block from the start of the file.
+				uint64_t		  lodOffset;					///< Offset of the level of detail error block from the start of the file.
+				uint64_t	   vertexOffset;					///< Offset of the vertex block from the start of the file.
+				uint64_t		indexOffset;					///< Offset of the index block from the start of the file.
+			};
+
+			/// <summary>
+			/// Bits of CookedHeader::attributes.
+			/// </summary>
+			enum
+			{
+				HAS_TEXTURE_UVS = 1 << 0,						///< The mesh has texture coordinates.
+				HAS_NORMALS     = 1 << 1,						///< The mesh has normals.
+				QUANTIZED       = 1 << 2,						///< The vertices use the quantized layout.
+				OVERDRAW_SORTED = 1 << 3,						///< The triangles were sorted to reduce overdraw.
+			};
+
+			static const char     cookedMagic[4];				///< Expected value of CookedHeader::magic.
+			static const uint32_t  cookedVersion;				///< Current version of the cooked format.
+
+		public:
+
+			std::vector< Vertex >     vertices;				///< Interleaved vertex data.
+			std::vector< GLuint >      indices;				///< Triangle list indices (relative to the base vertex of their range).
+			std::vector< DrawRange >    ranges;				///< Ranges of the index buffer to draw.
+			std::vector< glm::mat4 > transforms;				///< Local transforms of the sub-meshes (relative to the first one).
+
+			GLenum			  indexType;						///< Narrowest index type able to address every range.
+			Dequantization dequantization;						///< Bounds of the mesh used by the quantized layout.
+
+			std::vector< float >     lodErrors;				///< Geometric error of every level of detail (0 for the full resolution one).
+			glm::vec3				 boundsMin;				///< Smallest corner of the bounds of the placed sub-meshes.
+			glm::vec3				 boundsMax;				///< Largest corner of the bounds of the placed sub-meshes.
+
+			bool	  hasTextureUVs;							///< Flag indicating whether the mesh has texture coordinates.
+			bool		 hasNormals;							///< Flag indicating whether the mesh has normals.
+
+		public:
+
+			/// <summary>
+			/// Creates an empty mesh.
+			/// </summary>
+			MeshData();
+
+			/// <summary>
+			/// Imports every mesh of a file with Assimp, walking its node hierarchy to place each sub-mesh with its
+			/// local transform, interleaves the vertex data, optimizes the triangle and vertex order and selects the index type.
+			/// </summary>
+			///
+			/// <param name="meshFilePath">The file path to the mesh to be loaded.</param>
+			/// <param name="settings">The settings used to import the mesh.</param>
+			///
+			/// <returns>True if the mesh was imported, false otherwise.</returns>
+			bool importMesh(const std::string& meshFilePath, const ImportSettings& settings);
+
+			/// <summary>
+			/// Writes the mesh as a cooked binary file.
+			/// </summary>
+			///
+			/// <param name="cookedFilePath">The path of the cooked file to be written.</param>
+			/// <param name="settings">The settings the mesh was imported with (stored to validate the file).</param>
+			///
+			/// <returns>True if the file was written, false otherwise.</returns>
+			bool saveCooked(const std::string& cookedFilePath, const ImportSettings& settings) const;
+
+			/// <summary>
+			/// Picks the narrowest index type for the mesh. If the mesh has more vertices than maxIndexType can
+			/// address, it is split into chunks (each with its own vertices) that fit in that type.
+			/// </summary>
+			///
+			/// <param name="maxIndexType">Widest index type allowed.</param>
+			void selectIndexType(GLenum maxIndexType);
+
+			/// <summary>
+			/// Packs the indices with the selected index type, ready to be uploaded.
+			/// </summary>
+			///
+			/// <returns>The bytes of the packed index buffer.</returns>
+			std::vector< uint8_t > packIndices() const;
+
+			/// <summary>
+			/// Packs the vertices with the float or the quantized layout, ready to be uploaded.
+			/// </summary>
+			///
+			/// <param name="quantized">Whether the quantized layout is used.</param>
+			///
+			/// <returns>The bytes of the packed vertex buffer.</returns>
+			std::vector< uint8_t > packVertices(bool quantized) const;
+
+			/// <summary>
+			/// Returns the number of vertices addressed by the largest range.
+			/// </summary>
+			///
+			/// <returns>The largest local index plus one.</returns>
+			uint64_t getLargestRange() const;
+
+			/// <summary>
+			/// Computes the bounds of the coordinates and texture coordinates used by the quantized layout.
+			/// </summary>
+			void computeDequantization();
+
+			/// <summary>
+			/// Computes the bounds of the mesh with every sub-mesh placed with its local transform.
+			/// </summary>
+			void computeBounds();
+
+		public:
+
+			/// <summary>
+			/// Returns the size in bytes of an index type.
+			/// </summary>
+			///
+			/// <param name="indexType">GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.</param>
+			///
+			/// <returns>The size of one index in bytes.</returns>
+			static size_t getIndexSize(GLenum indexType);
+
+			/// <summary>
+			/// Returns the number of distinct vertices an index type can address.
+			/// </summary>
+			///
+			/// <param name="indexType">GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.</param>
+			///
+			/// <returns>The number of vertices addressable by the index type.</returns>
+			static uint64_t getIndexCapacity(GLenum indexType);
+
+			/// <summary>
+			/// Returns the size in bytes of a vertex.
+			/// </summary>
+			///
+			/// <param name="quantized">Whether the quantized layout is used.</param>
+			///
+			/// <returns>The size of one vertex in bytes.</returns>
+			static size_t getVertexStride(bool quantized);
+
+			/// <summary>
+			/// Returns the path of the cooked file that corresponds to a source mesh file.
+			/// </summary>
+			///
+			/// <param name="meshFilePath">The file path to the source mesh.</param>
+			///
+			/// <returns>The source path with its extension replaced by ".mesh".</returns>
+			static std::string getCookedPath(const std::string& meshFilePath);
+
+			/// <summary>
+			/// Offline cook step: imports a source mesh and writes its cooked file next to it.
+			/// </summary>
+			///
+			/// <param name="meshFilePath">The file path to the source mesh.</param>
+			/// <param name="settings">The settings used to import the mesh.</param>
+			///
+			/// <returns>True if the cooked file was written, false otherwise.</returns>
+			static bool cook(const std::string& meshFilePath, const ImportSettings& settings);
+
+		private:
+
+			/// <summary>
+			/// Collects the meshes referenced by a node and its children together with their global transforms.
+			/// </summary>
+			///
+			/// <param name="node">The node to walk.</param>
+			/// <param name="parentTransform">Global transform of the parent node.</param>
+			/// <param name="placements">Receives the mesh index and global transform of every placement found.</param>
+			static void collectPlacements(const aiNode * node, const glm::mat4& parentTransform, std::vector< std::pair< unsigned, glm::mat4 > >& placements);
+	};
+}
+
+
+
+#endif
@@ -9,13 +9,9 @@
 
 
 
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
+#include <cassert>
 #include <gtc/matrix_transform.hpp>
 #include <gtc/type_ptr.hpp>
-#include <iostream>
-#include <vector>
 
 
 
@@ -38,19 +34,38 @@ namespace finalPractice
         ""
         "uniform vec3 material_color;"
         ""
-        "uniform mat4 model_view_matrix;"
         "uniform mat4 projection_matrix;"
+        "uniform mat4 mesh_matrix;"
+        "\n#ifdef INSTANCED\n"
+        "uniform mat4 view_matrix;"
+        "layout (location = 3) in mat4 instance_model_matrix;"
+        "\n#else\n"
+        "uniform mat4 model_view_matrix;"
         "uniform mat4 normal_matrix;"
+        "\n#endif\n"
         ""
+        "\n#ifdef QUANTIZED\n"
+        "layout (location = 0) in vec3 quantized_coordinates;"
+        "layout (location = 2) in vec2 quantized_normal;"
+        "\n#else\n"
         "layout (location = 0) in vec3 vertex_coordinates;"
         "layout (location = 2) in vec3 vertex_normal;"
+        "\n#endif\n"
         ""
         "out vec3 front_color;"
         ""
         "void main()"
         "{"
-        "    vec4 normal   = normal_matrix * vec4(vertex_normal, 0.0);"
-        "    vec4 position = model_view_matrix * vec4(vertex_coordinates, 1.0);"
+        "\n#ifdef QUANTIZED\n"
+        "    vec3 vertex_coordinates = dequantize_position(quantized_coordinates);"
+        "    vec3 vertex_normal      = decode_normal(quantized_normal);"
+        "\n#endif\n"
+        "\n#ifdef INSTANCED\n"
+        "    mat4 model_view_matrix = view_matrix * instance_model_matrix;"
+        "    mat4 normal_matrix     = model_view_matrix;"
+        "\n#endif\n"
+        "    vec4 normal   = normal_matrix * mesh_matrix * vec4(vertex_normal, 0.0);"
+        "    vec4 position = model_view_matrix * mesh_matrix * vec4(vertex_coordinates, 1.0);"
         ""
         "    vec4  light_direction = light.position - position;"
         "    float light_intensity = diffuse_intensity * max(dot(normalize(normal.xyz), normalize(light_direction.xyz)), 0.0);"
@@ -89,20 +104,41 @@ namespace finalPractice
         "uniform float ambient_intensity;"
         "uniform float diffuse_intensity;"
         ""
-        "uniform mat4 model_view_matrix;"
         "uniform mat4 projection_matrix;"
+        "uniform mat4 mesh_matrix;"
+        "\n#ifdef INSTANCED\n"
+        "uniform mat4 view_matrix;"
+        "layout (location = 3) in mat4 instance_model_matrix;"
+        "\n#else\n"
+        "uniform mat4 model_view_matrix;"
         "uniform mat4 normal_matrix;"
+        "\n#endif\n"
         ""
+        "\n#ifdef QUANTIZED\n"
+        "layout (location = 0) in vec3 quantized_coordinates;"
+        "layout (location = 1) in vec2 quantized_texture_uv;"
+        "layout (location = 2) in vec2 quantized_normal;"
+        "\n#else\n"
         "layout (location = 0) in vec3 vertex_coordinates;"
         "layout (location = 1) in vec2 vertex_texture_uv;"
         "layout (location = 2) in vec3 vertex_normal;"
+        "\n#endif\n"
         ""
         "out vec2 texture_uv;"
         ""
         "void main()"
         "{"
-        "    vec4 normal   = normal_matrix * vec4(vertex_normal, 0.0);"
-        "    vec4 position = model_view_matrix * vec4(vertex_coordinates, 1.0);"
+        "\n#ifdef QUANTIZED\n"
+        "    vec3 vertex_coordinates = dequantize_position(quantized_coordinates);"
+        "    vec2 vertex_texture_uv  = dequantize_uv(quantized_texture_uv);"
+        "    vec3 vertex_normal      = decode_normal(quantized_normal);"
+        "\n#endif\n"
+        "\n#ifdef INSTANCED\n"
+        "    mat4 model_view_matrix = view_matrix * instance_model_matrix;"
+        "    mat4 normal_matrix     = model_view_matrix;"
+        "\n#endif\n"
+        "    vec4 normal   = normal_matrix * mesh_matrix * vec4(vertex_normal, 0.0);"
+        "    vec4 position = model_view_matrix * mesh_matrix * vec4(vertex_coordinates, 1.0);"
         ""
         "    vec4  light_direction = light.position - position;"
         "    float light_intensity = diffuse_intensity * max(dot(normalize(normal.xyz), normalize(light_direction.xyz)), 0.0);"
@@ -111,12 +147,44 @@ namespace finalPractice
         "    texture_uv  = vertex_texture_uv;"
         "}";
 
+    // Vertex shader code inserted in the vertex shaders that read quantized vertices
+    const std::string MeshLoader::quantizationShaderCode =
+
+        "uniform vec3 position_offset;"
+        "uniform vec3 position_scale;"
+        "uniform vec4 uv_transform;"                                                    // Offset in xy, scale in zw
+        ""
+        "vec3 dequantize_position(vec3 coordinates)"
+        "{"
+        "    return position_offset + position_scale * coordinates;"
+        "}"
+        ""
+        "vec2 dequantize_uv(vec2 texture_uv)"
+        "{"
+        "    return uv_transform.xy + uv_transform.zw * texture_uv;"
+        "}"
+        ""
+        "vec3 decode_normal(vec2 octahedral)"
+        "{"
+        "    vec3  normal = vec3(octahedral, 1.0 - abs(octahedral.x) - abs(octahedral.y));"
+        "    float fold   = max(-normal.z, 0.0);"
+        ""
+        "    normal.xy += mix(vec2(fold), vec2(-fold), greaterThanEqual(normal.xy, vec2(0.0)));"
+        ""
+        "    return normalize(normal);"
+        "}\n";
+
     // Fragment shader code to define color with textures
     const std::string MeshLoader::fragmentShaderCodeTexture =
 
         "#version 330\n"
         ""
+        "\n#ifdef TEXTURE_ARRAY\n"
+        "uniform sampler2DArray sampler;"
+        "uniform float    texture_layer;"
+        "\n#else\n"
         "uniform sampler2D      sampler;"
+        "\n#endif\n"
         "uniform float     transparency;"
         ""
         "in  vec2     texture_uv;"
@@ -124,62 +192,138 @@ namespace finalPractice
         ""
         "void main()"
         "{"
+        "\n#ifdef TEXTURE_ARRAY\n"
+        "    vec4 texColor = texture(sampler, vec3(texture_uv, texture_layer));"
+        "\n#else\n"
         "    vec4 texColor = texture(sampler, texture_uv);"
+        "\n#endif\n"
         "    fragment_color = vec4(texColor.rgb, texColor.a * transparency);"
         "}";
 
 
 
     // MeshLoader constructor for mesh without texture
-    MeshLoader::MeshLoader(const std::string& meshFilePath, float _transparency) :
-        shader(vertexShaderCode, fragmentShaderCode),
-        angle(0),
-        posY (0),
+    MeshLoader::MeshLoader(const std::string& meshFilePath, float _transparency, bool _instanced, const MeshData::ImportSettings& settings) :
+        shader(acquireShader(false, _instanced, settings.quantized)),
+        mesh  (MeshCache::acquire(meshFilePath, settings)),
+        instanced(_instanced),
+        instanceVaoID(0),
+        instanceVboID(0),
+        instancesChanged(false),
+        viewportHeight(576.f),
         moveDown(false),
-        transparency(_transparency)
+        transparency(_transparency),
+        angle(0),
+        posY (0)
     {
-        shader.use();
+        shader->use();
 
-        modelViewMatrixID  = glGetUniformLocation(shader.getID(), "model_view_matrix");
-        projectionMatrixID = glGetUniformLocation(shader.getID(), "projection_matrix");
-        normalMatrixID     = glGetUniformLocation(shader.getID(), "normal_matrix"    );
+        modelViewMatrixID  = glGetUniformLocation(shader->getID(), "model_view_matrix");
+        projectionMatrixID = glGetUniformLocation(shader->getID(), "projection_matrix");
+        normalMatrixID     = glGetUniformLocation(shader->getID(), "normal_matrix"    );
+        viewMatrixID       = glGetUniformLocation(shader->getID(), "view_matrix"      );
+        meshMatrixID       = glGetUniformLocation(shader->getID(), "mesh_matrix"      );
+        positionOffsetID   = glGetUniformLocation(shader->getID(), "position_offset"  );
+        positionScaleID    = glGetUniformLocation(shader->getID(), "position_scale"   );
+        uvTransformID      = glGetUniformLocation(shader->getID(), "uv_transform"     );
 
         needTexture = false;                                                            // Indicates that the mesh doesn't need a texture
-        
-        loadMesh(meshFilePath);                                                         // Load the mesh
 
-        lighting.configureLight(shader.getID());                                        // Sets the lighting that will affect the mesh
+        configureMaterial(shader->getID());                                             // Sets a color (RGB) for the mesh
+
+        lighting.configureLight(shader->getID());                                       // Sets the lighting that will affect the mesh
+
+        if (instanced)
+            createInstanceBuffers();
     }
 
     // MeshLoader constructor for mesh with texture
-    MeshLoader::MeshLoader(const std::string& meshFilePath, const std::string& texturePath, float _transparency) :
-        shader(vertexShaderCodeTexture, fragmentShaderCodeTexture),
-        angle(0),
-        posY (.1f),
+    MeshLoader::MeshLoader(const std::string& meshFilePath, const std::string& texturePath, float _transparency, bool _instanced, const MeshData::ImportSettings& settings) :
+        shader(acquireShader(true, _instanced, settings.quantized)),
+        mesh  (MeshCache::acquire(meshFilePath, settings)),
+        instanced(_instanced),
+        instanceVaoID(0),
+        instanceVboID(0),
+        instancesChanged(false),
+        viewportHeight(576.f),
         moveDown(false),
-        transparency(_transparency)
+        transparency(_transparency),
+        angle(0),
+        posY (.1f)
     {
-        shader.use();
+        shader->use();
 
-        modelViewMatrixID  = glGetUniformLocation(shader.getID(), "model_view_matrix");
-        projectionMatrixID = glGetUniformLocation(shader.getID(), "projection_matrix");
-        normalMatrixID     = glGetUniformLocation(shader.getID(), "normal_matrix"    );
+        modelViewMatrixID  = glGetUniformLocation(shader->getID(), "model_view_matrix");
+        projectionMatrixID = glGetUniformLocation(shader->getID(), "projection_matrix");
+        normalMatrixID     = glGetUniformLocation(shader->getID(), "normal_matrix"    );
+        viewMatrixID       = glGetUniformLocation(shader->getID(), "view_matrix"      );
+        meshMatrixID       = glGetUniformLocation(shader->getID(), "mesh_matrix"      );
+        positionOffsetID   = glGetUniformLocation(shader->getID(), "position_offset"  );
+        positionScaleID    = glGetUniformLocation(shader->getID(), "position_scale"   );
+        uvTransformID      = glGetUniformLocation(shader->getID(), "uv_transform"     );
 
         needTexture = true;                                                             // Indicates that the mesh needs a texture
 
-        loadMesh(meshFilePath);                                                         // Load the mesh
-
         // Sets the texture (albedo) for the mesh
         texture.setID(texture.createTexture2D< Rgba8888 >(texturePath, Texture::TypeTexture2D::ALBEDO));
         assert(texture.isOk());
 
-        lighting.configureLight(shader.getID());                                        // Sets the lighting that will affect the mesh
+        lighting.configureLight(shader->getID());                                       // Sets the lighting that will affect the mesh
+
+        if (instanced)
+            createInstanceBuffers();
     }
 
+    // MeshLoader constructor for mesh with its texture in a material set
+    MeshLoader::MeshLoader(const std::string& meshFilePath, std::shared_ptr< MaterialSet > _materials, const std::string& texturePath, float _transparency, bool _instanced, const MeshData::ImportSettings& settings) :
+        shader(acquireShader(true, _instanced, settings.quantized, true)),
+        mesh  (MeshCache::acquire(meshFilePath, settings)),
+        materials(_materials),
+        instanced(_instanced),
+        instanceVaoID(0),
+        instanceVboID(0),
+        instancesChanged(false),
+        viewportHeight(576.f),
+        moveDown(false),
+        transparency(_transparency),
+        angle(0),
+        posY (.1f)
+    {
+        shader->use();
+
+        modelViewMatrixID  = glGetUniformLocation(shader->getID(), "model_view_matrix");
+        projectionMatrixID = glGetUniformLocation(shader->getID(), "projection_matrix");
+        normalMatrixID     = glGetUniformLocation(shader->getID(), "normal_matrix"    );
+        viewMatrixID       = glGetUniformLocation(shader->getID(), "view_matrix"      );
+        meshMatrixID       = glGetUniformLocation(shader->getID(), "mesh_matrix"      );
+        positionOffsetID   = glGetUniformLocation(shader->getID(), "position_offset"  );
+        positionScaleID    = glGetUniformLocation(shader->getID(), "position_scale"   );
+        uvTransformID      = glGetUniformLocation(shader->getID(), "uv_transform"     );
+        textureLayerID     = glGetUniformLocation(shader->getID(), "texture_layer"    );
+
+        needTexture = true;                                                             // Indicates that the mesh needs a texture
+
+        // The albedo is a layer of the array texture of the set, which is sampled from its own texture unit
+        textureLayer = materials->getLayer(texturePath);
+        assert(materials->isOk() && textureLayer >= 0);
+
+        glUniform1i(glGetUniformLocation(shader->getID(), "sampler"), MaterialSet::textureUnit);
+
+        lighting.configureLight(shader->getID());                                       // Sets the lighting that will affect the mesh
+
+        if (instanced)
+            createInstanceBuffers();
+    }
+
+
+
     MeshLoader::~MeshLoader()
     {
-        glDeleteVertexArrays(1, &vaoID);
-        glDeleteBuffers(VBO_COUNT, vboIDs);
+        if (instanced)
+        {
+            glDeleteVertexArrays(1, &instanceVaoID);
+            glDeleteBuffers     (1, &instanceVboID);
+        }
     }
 
 
@@ -189,8 +333,19 @@ namespace finalPractice
         crystalAnimation(); // Crystal animation (Used in Scene.cpp by the crystal mesh)
     }
     
-    void MeshLoader::render(const Camera & camera, glm::vec3 tanslateVector, float angle, glm::vec3 rotateVector, glm::vec3 scaleVector)
+    void MeshLoader::render(const Camera & camera, const Frustum & frustum, glm::vec3 tanslateVector, float angle, glm::vec3 rotateVector, glm::vec3 scaleVector)
     {
+        glm::mat4 modelMatrix(1);
+
+        // Sets the mesh's transform values
+        modelMatrix = glm::translate(modelMatrix,      tanslateVector);
+        modelMatrix = glm::rotate   (modelMatrix, angle, rotateVector);
+        modelMatrix = glm::scale    (modelMatrix,         scaleVector);
+
+        // Skip the mesh before any GL call when it is out of view
+        if (not mesh->isVisible(frustum, modelMatrix))
+            return;
+
         if (transparency < 1.f)
         {
             glDepthMask(GL_FALSE);
@@ -198,27 +353,22 @@ namespace finalPractice
             glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         }
 
-        shader.use();
-
-        glm::mat4 modelViewMatrix(1);
-
-        // Sets the mesh's transform values
-        modelViewMatrix = glm::translate(modelViewMatrix,      tanslateVector);
-        modelViewMatrix = glm::rotate   (modelViewMatrix, angle, rotateVector);
-        modelViewMatrix = glm::scale    (modelViewMatrix,         scaleVector);
+        shader->use();
 
-        modelViewMatrix = camera.getTransformMatrixInverse() * modelViewMatrix;
+        glm::mat4 modelViewMatrix = camera.getTransformMatrixInverse() * modelMatrix;
 
         glUniformMatrix4fv(modelViewMatrixID , 1, GL_FALSE, glm::value_ptr(modelViewMatrix));
         glUniformMatrix4fv(projectionMatrixID, 1, GL_FALSE, glm::value_ptr(camera.getProjectionMatrix()));
 
         if (needTexture)
-            texture.bind();
+            bindTexture();
+
+        glUniform1f(glGetUniformLocation(shader->getID(), "transparency"), transparency);
 
-        glUniform1f(glGetUniformLocation(shader.getID(), "transparency"), transparency);
+        mesh->setDequantization(positionOffsetID, positionScaleID, uvTransformID);
 
-        glBindVertexArray(vaoID);
-        glDrawElements(GL_TRIANGLES, numIndex, GL_UNSIGNED_SHORT, 0);
+        mesh->bind();
+        mesh->draw(meshMatrixID, 1, mesh->selectLod(modelViewMatrix, camera.getFov(), viewportHeight));
         
         if(transparency < 1.f)
         {
@@ -227,11 +377,120 @@ namespace finalPractice
         }
     }
 
+    void MeshLoader::addInstance(glm::vec3 tanslateVector, float angle, glm::vec3 rotateVector, glm::vec3 scaleVector)
+    {
+        assert(instanced);
+
+        glm::mat4 modelMatrix(1);
+
+        // Sets the placement's transform values
+        modelMatrix = glm::translate(modelMatrix,      tanslateVector);
+        modelMatrix = glm::rotate   (modelMatrix, angle, rotateVector);
+        modelMatrix = glm::scale    (modelMatrix,         scaleVector);
+
+        instances.push_back(modelMatrix);
+
+        instancesChanged = true;
+    }
+
+    void MeshLoader::clearInstances()
+    {
+        instances.clear();
+
+        instancesChanged = true;
+    }
+
+    void MeshLoader::render(const Camera & camera, const Frustum & frustum)
+    {
+        assert(instanced);
+
+        // Select the level of detail of every placement (the culled ones get the level count)
+        const glm::mat4 & viewMatrix = camera.getTransformMatrixInverse();
+        const unsigned    culled     = mesh->getLodCount();
+
+        size_t visibleCount = 0;
+
+        instanceLods.resize(instances.size());
+
+        for (size_t i = 0; i < instances.size(); ++i)
+        {
+            unsigned lod = mesh->isVisible(frustum, instances[i])
+                ? mesh->selectLod(viewMatrix * instances[i], camera.getFov(), viewportHeight)
+                : culled;
+
+            if (lod != instanceLods[i])
+            {
+                instanceLods[i]  = lod;
+                instancesChanged = true;
+            }
+
+            visibleCount += lod != culled ? 1 : 0;
+        }
+
+        // Skip the mesh before any GL call when every placement is out of view
+        if (visibleCount == 0)
+            return;
+
+        if (transparency < 1.f)
+        {
+            glDepthMask(GL_FALSE);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+
+        shader->use();
+
+        glUniformMatrix4fv(viewMatrixID      , 1, GL_FALSE, glm::value_ptr(viewMatrix));
+        glUniformMatrix4fv(projectionMatrixID, 1, GL_FALSE, glm::value_ptr(camera.getProjectionMatrix()));
+
+        if (needTexture)
+            bindTexture();
+
+        glUniform1f(glGetUniformLocation(shader->getID(), "transparency"), transparency);
+
+        mesh->setDequantization(positionOffsetID, positionScaleID, uvTransformID);
+
+        glBindVertexArray(instanceVaoID);
+
+        // Upload the placements only when they (or their levels of detail) have changed since the last frame
+        if (instancesChanged)
+        {
+            uploadInstances();
+
+            instancesChanged = false;
+        }
+
+        // One instanced draw call per level of detail in use (the culled placements are not uploaded)
+        size_t firstInstance = 0;
+
+        for (unsigned lod = 0; lod < culled; ++lod)
+        {
+            if (lodInstanceCounts[lod] == 0)
+                continue;
+
+            setInstanceAttributes(firstInstance);
+
+            mesh->draw(meshMatrixID, lodInstanceCounts[lod], lod);
+
+            firstInstance += lodInstanceCounts[lod];
+        }
+
+        glBindVertexArray(0);
+
+        if (transparency < 1.f)
+        {
+            glDisable(GL_BLEND);
+            glDepthMask(GL_TRUE);
+        }
+    }
+
     void MeshLoader::resize(int width, int height)
     {
         glm::mat4 projectionMatrix = glm::perspective(20.f, GLfloat(width) / height, 1.f, 5000.f);
 
         glUniformMatrix4fv(projectionMatrixID, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+
+        viewportHeight = float(height);
     }
 
     float MeshLoader::getAngle()
@@ -246,106 +505,107 @@ namespace finalPractice
 
 
 
-    void MeshLoader::loadMesh(const std::string & meshFilePath)
+    std::shared_ptr< Shader > MeshLoader::acquireShader(bool textured, bool instanced, bool quantized, bool layered)
     {
-        Assimp::Importer importer;
-
-        shader.use();
+        static std::weak_ptr< Shader > shaders[2][2][2][2];                             // [textured][instanced][quantized][layered] programs
 
-        auto scene = importer.ReadFile
-        (
-            meshFilePath,
-            aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType
-        );
+        auto shader = shaders[textured][instanced][quantized][layered].lock();
 
-        if (scene && scene->mNumMeshes > 0)
+        if (not shader)
         {
-            auto mesh = scene->mMeshes[0];
+            std::string defines = instanced ? "#define INSTANCED\n" : "";
 
-            glGenBuffers(VBO_COUNT, vboIDs);
-            glGenVertexArrays(1, &vaoID);
+            if (quantized)
+                defines += "#define QUANTIZED\n" + quantizationShaderCode;
 
-            glBindVertexArray(vaoID);
+            shader = textured
+                ? std::make_shared< Shader >(addDefines(vertexShaderCodeTexture, defines), addDefines(fragmentShaderCodeTexture, layered ? "#define TEXTURE_ARRAY\n" : ""))
+                : std::make_shared< Shader >(addDefines(vertexShaderCode,        defines), fragmentShaderCode);
 
-            static_assert(sizeof(aiVector3D) == sizeof(glm::fvec3), "aiVector3D should composed of three floats");
+            shaders[textured][instanced][quantized][layered] = shader;
+        }
 
-            // MESH VERTEX COORDINATES
-            size_t numVertex = mesh->mNumVertices;
-            glBindBuffer(GL_ARRAY_BUFFER, vboIDs[VBO_COORDINATES]);
-            glBufferData(GL_ARRAY_BUFFER, numVertex * sizeof(aiVector3D), mesh->mVertices, GL_STATIC_DRAW);
+        return shader;
+    }
 
-            glEnableVertexAttribArray(0);
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    void MeshLoader::bindTexture()
+    {
+        if (materials)
+        {
+            // The array stays bound while the meshes of the same set are drawn, only the layer changes
+            materials->bind();
 
-            // MESH VERTEX COLORS
-            if (not mesh->HasTextureCoords(0)) // ERROR condition
-                std::cerr << "Mesh doesn't have UV coordinates" << std::endl;
-            else if (not needTexture)          // If the mesh don't need texture, sets a color (RGB)
-            {
-                configureMaterial(shader.getID());
-            }
-            else                               // If the mesh needs a texture
-            {
-                // Sets the mesh color based on its texture coordinates
-                std::vector< glm::vec2 > textureCoords(mesh->mNumVertices);
-
-                for (unsigned i = 0; i < mesh->mNumVertices; ++i)
-                {
-                    textureCoords[i] = glm::vec2
-                    (
-                        mesh->mTextureCoords[0][i].x,
-                        1.f - mesh->mTextureCoords[0][i].y
-                    );
-                }
-
-                glBindBuffer(GL_ARRAY_BUFFER, vboIDs[VBO_COLORS]);
-                glBufferData(GL_ARRAY_BUFFER, textureCoords.size() * sizeof(glm::vec2), textureCoords.data(), GL_STATIC_DRAW);
-
-                glEnableVertexAttribArray(1);
-                glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-            }
+            glUniform1f(textureLayerID, float(textureLayer));
+        }
+        else
+            texture.bind();
+    }
 
-            // MESH VERTEX NORMALS
-            if (not mesh->HasNormals()) // ERROR condition
-                std::cerr << "Mesh doesn't have normals" << std::endl;
-            else
-            {
-                // Sets the mesh normals
-                std::vector< glm::vec3 > normals(numVertex);
+    std::string MeshLoader::addDefines(const std::string & shaderCode, const std::string & defines)
+    {
+        size_t versionEnd = shaderCode.find('\n') + 1;                                 // The #version line must stay first
 
-                for (unsigned i = 0; i < numVertex; ++i)
-                    normals[i] = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+        return shaderCode.substr(0, versionEnd) + defines + shaderCode.substr(versionEnd);
+    }
 
-                glBindBuffer(GL_ARRAY_BUFFER, vboIDs[VBO_NORMALS]);
-                glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), normals.data(), GL_STATIC_DRAW);
+    void MeshLoader::createInstanceBuffers()
+    {
+        glGenVertexArrays(1, &instanceVaoID);
+        glGenBuffers     (1, &instanceVboID);
 
-                glEnableVertexAttribArray(2);
-                glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-            }
+        glBindVertexArray(instanceVaoID);
 
-            // MESH INDEXES
-            numIndex = mesh->mNumFaces * 3;
+        // Reuse the vertex and index buffers of the shared mesh
+        mesh->setupVertexAttributes();
 
-            std::vector< GLshort > index(numIndex);
+        // A mat4 attribute takes four consecutive locations (3 to 6), one per column
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVboID);
 
-            auto vertexIndex = index.begin();
+        for (GLuint column = 0; column < 4; ++column)
+        {
+            glEnableVertexAttribArray(3 + column);
+            glVertexAttribDivisor    (3 + column, 1);
+        }
 
-            for (unsigned i = 0; i < mesh->mNumFaces; ++i)
-            {
-                auto& face = mesh->mFaces[i];
+        setInstanceAttributes(0);
 
-                assert(face.mNumIndices == 3);
+        glBindVertexArray(0);
+    }
 
-                *vertexIndex++ = face.mIndices[0];
-                *vertexIndex++ = face.mIndices[1];
-                *vertexIndex++ = face.mIndices[2];
-            }
+    void MeshLoader::setInstanceAttributes(size_t firstInstance)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVboID);
+
+        for (GLuint column = 0; column < 4; ++column)
+        {
+            size_t offset = firstInstance * sizeof(glm::mat4) + column * sizeof(glm::vec4);
 
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboIDs[EBO_INDEX]);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, index.size() * sizeof(GLshort), index.data(), GL_STATIC_DRAW);
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (const void *)offset);
         }
     }
 
+    void MeshLoader::uploadInstances()
+    {
+        // Counting sort of the placements by level of detail (the culled ones end up last)
+        lodInstanceCounts.assign(mesh->getLodCount() + 1, 0);
+
+        for (unsigned lod : instanceLods)
+            ++lodInstanceCounts[lod];
+
+        std::vector< size_t > lodOffsets(lodInstanceCounts.size(), 0);
+
+        for (size_t lod = 1; lod < lodOffsets.size(); ++lod)
+            lodOffsets[lod] = lodOffsets[lod - 1] + lodInstanceCounts[lod - 1];
+
+        std::vector< glm::mat4 > sortedInstances(instances.size());
+
+        for (size_t i = 0; i < instances.size(); ++i)
+            sortedInstances[lodOffsets[instanceLods[i]]++] = instances[i];
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVboID);
+        glBufferData(GL_ARRAY_BUFFER, (sortedInstances.size() - lodInstanceCounts.back()) * sizeof(glm::mat4), sortedInstances.data(), GL_DYNAMIC_DRAW);
+    }
+
     void MeshLoader::configureMaterial(GLuint shaderID)
     {
         GLint materialColor = glGetUniformLocation(shaderID, "material_color");
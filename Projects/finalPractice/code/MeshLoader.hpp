@@ -15,7 +15,10 @@
 
 
 #include "Camera.hpp"
+#include "Frustum.hpp"
 #include "Lighting.hpp"
+#include "MaterialSet.hpp"
+#include "MeshAsset.hpp"
 #include "Shader.hpp"
 #include "Texture.hpp"
 
@@ -23,7 +26,9 @@
 
 #include <glad/glad.h>
 #include <glm.hpp>
+#include <memory>
 #include <string>
+#include <vector>
 
 
 
@@ -35,42 +40,44 @@ namespace finalPractice
 	/// </summary>
 	class MeshLoader
 	{
-		private:
-
-			/// <summary>
-			/// Enum representing the different VBO types.
-			/// </summary>
-			enum
-			{
-				VBO_COORDINATES,								///< Vertex coordinates VBO
-				VBO_COLORS,										///< Vertex colors VBO
-				VBO_NORMALS,									///< Vertex normals VBO
-				EBO_INDEX,										///< Element Index Buffer Object
-				VBO_COUNT										///< Total number of VBOs
-			};
-
 		private:
 
 			static const std::string          vertexShaderCode; ///< Vertex shader code for non-textured rendering.
 			static const std::string        fragmentShaderCode; ///< Fragment shader code for non-textured rendering.
 			static const std::string   vertexShaderCodeTexture; ///< Vertex shader code for textured rendering.
 			static const std::string fragmentShaderCodeTexture; ///< Fragment shader code for textured rendering.
+			static const std::string    quantizationShaderCode; ///< Vertex shader functions that read quantized vertices.
 
-			Shader			   shader;							///< Shader used for rendering the mesh.
+			std::shared_ptr< Shader >     shader;				///< Shader used for rendering the mesh (shared by every mesh of the same kind).
+			std::shared_ptr< MeshAsset >    mesh;				///< GPU buffers of the mesh (shared by every placement of the same file).
 			Lighting		 lighting;							///< Lighting setup for the scene.
 			Texture           texture;							///< Texture used for the mesh (if any).
+			std::shared_ptr< MaterialSet > materials;			///< Array texture holding the albedo of the mesh (nullptr when it has its own texture).
+			GLint		 textureLayer;							///< Layer of the albedo in the array texture of the material set.
 			//Texture     textureNormal;
 
 		private:
 
-			GLuint  vboIDs[VBO_COUNT];							///< IDs for the vertex buffer objects.
-			GLuint				vaoID;							///< ID for the vertex array object.
-
-			GLsizei			 numIndex;							///< Number of indices for rendering.
-
 			GLint   modelViewMatrixID;							///< ID for the model-view matrix uniform.
 			GLint  projectionMatrixID;							///< ID for the projection matrix uniform.
 			GLint      normalMatrixID;							///< ID for the normal matrix uniform.
+			GLint        viewMatrixID;							///< ID for the view matrix uniform (instanced rendering only).
+			GLint        meshMatrixID;							///< ID for the local transform uniform of the sub-meshes.
+			GLint    positionOffsetID;							///< ID for the center of the mesh bounds uniform (quantized meshes only).
+			GLint     positionScaleID;							///< ID for the half size of the mesh bounds uniform (quantized meshes only).
+			GLint       uvTransformID;							///< ID for the UV offset and scale uniform (quantized meshes only).
+			GLint      textureLayerID;							///< ID for the array texture layer uniform (material set meshes only).
+
+			bool			instanced;							///< Flag indicating whether the placements are drawn in a single instanced call.
+			GLuint		instanceVaoID;							///< VAO combining the shared mesh buffers with the per-instance transforms.
+			GLuint		instanceVboID;							///< VBO holding one model matrix per placement.
+			bool	 instancesChanged;							///< Flag indicating whether the instance VBO must be uploaded again.
+
+			std::vector< glm::mat4 > instances;					///< Model matrix of every placement of the mesh.
+			std::vector< unsigned >  instanceLods;				///< Level of detail of every placement in the last frame (the level count when it is culled).
+			std::vector< GLsizei >   lodInstanceCounts;			///< Number of placements uploaded for every level of detail (grouped by level).
+
+			float	   viewportHeight;							///< Height of the viewport in pixels (used to select the level of detail).
 
 			bool		  needTexture;							///< Flag indicating whether the mesh requires a texture.
 			bool			 moveDown;							///< Flag for animating movement downwards.
@@ -85,7 +92,9 @@ namespace finalPractice
 			/// </summary>
 			/// 
 			/// <param name="meshFilePath">The file path to the mesh to be loaded.</param>
-			MeshLoader(const std::string& meshFilePath, float _transparency);
+			/// <param name="_instanced">Whether every placement is drawn with a single instanced call.</param>
+			/// <param name="settings">The settings used to import the mesh (e.g. the quantized vertex layout).</param>
+			MeshLoader(const std::string& meshFilePath, float _transparency, bool _instanced = false, const MeshData::ImportSettings& settings = MeshData::ImportSettings());
 
 			/// <summary>
 			/// Constructor that loads the mesh and applies a texture from a file path.
@@ -93,10 +102,24 @@ namespace finalPractice
 			/// 
 			/// <param name="meshFilePath">The file path to the mesh to be loaded.</param>
 			/// <param name="textureAlbedoPath">The file path to the texture (albedo).</param>
-			MeshLoader(const std::string& meshFilePath, const std::string& textureAlbedoPath, float _transparency);
+			/// <param name="_instanced">Whether every placement is drawn with a single instanced call.</param>
+			/// <param name="settings">The settings used to import the mesh (e.g. the quantized vertex layout).</param>
+			MeshLoader(const std::string& meshFilePath, const std::string& textureAlbedoPath, float _transparency, bool _instanced = false, const MeshData::ImportSettings& settings = MeshData::ImportSettings());
+
+			/// <summary>
+			/// Constructor that loads the mesh and takes its albedo from a layer of a material set, so it is drawn
+			/// without binding a texture of its own.
+			/// </summary>
+			/// 
+			/// <param name="meshFilePath">The file path to the mesh to be loaded.</param>
+			/// <param name="_materials">The material set the albedo was packed into.</param>
+			/// <param name="textureAlbedoPath">The file path to the texture (albedo), which selects the layer.</param>
+			/// <param name="_instanced">Whether every placement is drawn with a single instanced call.</param>
+			/// <param name="settings">The settings used to import the mesh (e.g. the quantized vertex layout).</param>
+			MeshLoader(const std::string& meshFilePath, std::shared_ptr< MaterialSet > _materials, const std::string& textureAlbedoPath, float _transparency, bool _instanced = false, const MeshData::ImportSettings& settings = MeshData::ImportSettings());
 
 			/// <summary>
-			/// Destructor that cleans up OpenGL resources.
+			/// Destructor that cleans up the OpenGL resources used for instancing.
 			/// </summary>
 			~MeshLoader();
 
@@ -108,15 +131,41 @@ namespace finalPractice
 			void  update();
 
 			/// <summary>
-			/// Renders the mesh with the specified transformations and camera.
+			/// Renders the mesh with the specified transformations and camera (nothing is done when the mesh
+			/// is outside the view frustum).
 			/// </summary>
 			/// 
 			/// <param name="camera">The camera used to calculate the view matrix.</param>
+			/// <param name="frustum">The view frustum of the camera.</param>
 			/// <param name="translateVector">The translation vector for the mesh.</param>
 			/// <param name="angle">The rotation angle for the mesh.</param>
 			/// <param name="rotateVector">The axis of rotation for the mesh.</param>
 			/// <param name="scaleVector">The scaling vector for the mesh.</param>
-			void  render(const Camera& camera, glm::vec3 tanslateVector, float angle, glm::vec3 rotateVector, glm::vec3 scaleVector);
+			void  render(const Camera& camera, const Frustum& frustum, glm::vec3 tanslateVector, float angle, glm::vec3 rotateVector, glm::vec3 scaleVector);
+
+			/// <summary>
+			/// Adds a placement of the mesh to be drawn by the instanced render (instanced meshes only).
+			/// </summary>
+			/// 
+			/// <param name="translateVector">The translation vector for the placement.</param>
+			/// <param name="angle">The rotation angle for the placement.</param>
+			/// <param name="rotateVector">The axis of rotation for the placement.</param>
+			/// <param name="scaleVector">The scaling vector for the placement.</param>
+			void  addInstance(glm::vec3 tanslateVector, float angle, glm::vec3 rotateVector, glm::vec3 scaleVector);
+
+			/// <summary>
+			/// Removes every placement added with addInstance.
+			/// </summary>
+			void  clearInstances();
+
+			/// <summary>
+			/// Renders the visible placements of the mesh with an instanced draw call per level of detail
+			/// (instanced meshes only).
+			/// </summary>
+			/// 
+			/// <param name="camera">The camera used to calculate the view matrix.</param>
+			/// <param name="frustum">The view frustum of the camera.</param>
+			void  render(const Camera& camera, const Frustum& frustum);
 
 			/// <summary>
 			/// Resizes the viewport and updates the projection matrix.
@@ -145,11 +194,49 @@ namespace finalPractice
 		private:
 
 			/// <summary>
-			/// Loads the mesh from a file and sets up the vertex buffers.
+			/// Returns the shader program shared by every mesh of the same kind, compiling it on first use.
 			/// </summary>
 			/// 
-			/// <param name="meshFilePath">The file path to the mesh to be loaded.</param>
-			void loadMesh(const std::string& meshFilePath);
+			/// <param name="textured">Whether the shader samples an albedo texture.</param>
+			/// <param name="instanced">Whether the shader reads the model matrix from the instance attributes.</param>
+			/// <param name="quantized">Whether the shader reads quantized vertices.</param>
+			/// <param name="layered">Whether the albedo is sampled from a layer of an array texture.</param>
+			/// 
+			/// <returns>A shared pointer to the shader program.</returns>
+			static std::shared_ptr< Shader > acquireShader(bool textured, bool instanced, bool quantized, bool layered = false);
+
+			/// <summary>
+			/// Binds the albedo of the mesh (its own texture or the array texture of its material set).
+			/// </summary>
+			void bindTexture();
+
+			/// <summary>
+			/// Inserts preprocessor definitions right after the #version line of a shader.
+			/// </summary>
+			/// 
+			/// <param name="shaderCode">The source code of the shader.</param>
+			/// <param name="defines">The #define lines to insert.</param>
+			/// 
+			/// <returns>The shader source code with the definitions.</returns>
+			static std::string addDefines(const std::string& shaderCode, const std::string& defines);
+
+			/// <summary>
+			/// Builds the VAO used by the instanced render (shared mesh buffers plus the instance VBO).
+			/// </summary>
+			void createInstanceBuffers();
+
+			/// <summary>
+			/// Points the per-instance attributes of the instance VAO at a placement of the instance VBO, so the
+			/// next instanced draw starts from it (OpenGL 3.3 has no base instance).
+			/// </summary>
+			/// 
+			/// <param name="firstInstance">Index of the first placement to draw.</param>
+			void setInstanceAttributes(size_t firstInstance);
+
+			/// <summary>
+			/// Uploads the visible placements grouped by level of detail (instanced meshes only).
+			/// </summary>
+			void uploadInstances();
 
 			/// <summary>
 			/// Sets a color for the mesh (Used on non-textured meshes).
@@ -0,0 +1,409 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "MeshOptimizer.hpp"
+
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <set>
+#include <vector>
+
+
+
+namespace finalPractice
+{
+	const size_t MeshOptimizer::cacheSize         = 32;
+	const size_t MeshOptimizer::fifoCacheSize     = 16;
+	const float  MeshOptimizer::overdrawThreshold = 1.05f;
+
+
+
+	/// <summary>
+	/// Forsyth's vertex score: vertices recently used and vertices with few triangles left score higher.
+	/// </summary>
+	static float scoreVertex(int cachePosition, uint32_t remainingTriangles)
+	{
+		if (remainingTriangles == 0)
+			return -1.f;												// No triangle left to draw with this vertex
+
+		float score = 0.f;
+
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+				score = .75f;											// Used by the last triangle, fixed score to avoid strips
+			else
+				score = std::pow(1.f - float(cachePosition - 3) / float(MeshOptimizer::cacheSize - 3), 1.5f);
+		}
+
+		// Finish vertices with few triangles left, or they would have to be transformed again later
+		return score + 2.f / std::sqrt(float(remainingTriangles));
+	}
+
+
+
+	void MeshOptimizer::optimize(MeshData& mesh, bool sortOverdraw)
+	{
+		std::set< uint32_t > optimizedRanges;							// Placements of the same sub-mesh share their indices
+
+		double missesBefore = 0, missesAfter = 0, verticesBefore = 0, verticesAfter = 0, triangles = 0;
+
+		for (const MeshData::DrawRange & range : mesh.ranges)
+		{
+			if (range.indexCount == 0 || not optimizedRanges.insert(range.firstIndex).second)
+				continue;
+
+			GLuint           * indices  = &mesh.indices [range.firstIndex];
+			MeshData::Vertex * vertices = &mesh.vertices[range.baseVertex];
+
+			size_t indexCount  = range.indexCount;
+			size_t vertexCount = size_t(*std::max_element(indices, indices + indexCount)) + 1;
+
+			Statistics before = analyze(indices, indexCount, vertexCount);
+
+			optimizeVertexCache(indices, indexCount, vertexCount);
+
+			if (sortOverdraw)
+				optimizeOverdraw(indices, indexCount, vertices, vertexCount);
+
+			optimizeVertexFetch(indices, indexCount, vertices, vertexCount);
+
+			Statistics after = analyze(indices, indexCount, vertexCount);
+
+			// Weight the statistics of every range by its size to report them for the whole mesh
+			double rangeTriangles = double(indexCount / 3);
+
+			missesBefore   += before.acmr * rangeTriangles;
+			missesAfter    += after .acmr * rangeTriangles;
+			verticesBefore += before.acmr * rangeTriangles / before.atvr;
+			verticesAfter  += after .acmr * rangeTriangles / after .atvr;
+			triangles      += rangeTriangles;
+		}
+
+		if (triangles > 0)
+		{
+			std::cout << "Mesh optimized: ACMR " << missesBefore / triangles      << " -> " << missesAfter / triangles
+					  <<                ", ATVR " << missesBefore / verticesBefore << " -> " << missesAfter / verticesAfter << std::endl;
+		}
+	}
+
+	void MeshOptimizer::optimizeVertexCache(GLuint * indices, size_t indexCount, size_t vertexCount)
+	{
+		size_t triangleCount = indexCount / 3;
+
+		if (triangleCount == 0)
+			return;
+
+		// Triangles of every vertex, packed in a single array
+		std::vector< uint32_t > triangleOffsets(vertexCount + 1, 0);
+		std::vector< uint32_t > vertexTriangles(triangleCount * 3);
+		std::vector< uint32_t > remainingTriangles(vertexCount, 0);
+
+		for (size_t i = 0; i < triangleCount * 3; ++i)
+			++triangleOffsets[indices[i] + 1];
+
+		std::partial_sum(triangleOffsets.begin(), triangleOffsets.end(), triangleOffsets.begin());
+
+		for (size_t i = 0; i < triangleCount * 3; ++i)
+		{
+			GLuint vertex = indices[i];
+
+			vertexTriangles[triangleOffsets[vertex] + remainingTriangles[vertex]++] = uint32_t(i / 3);
+		}
+
+		// Initial scores, with an empty cache
+		std::vector< int   > cachePositions(vertexCount, -1);
+		std::vector< float > vertexScores  (vertexCount);
+
+		for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+			vertexScores[vertex] = scoreVertex(-1, remainingTriangles[vertex]);
+
+		std::vector< float > triangleScores(triangleCount);
+		std::vector< bool  > triangleAdded (triangleCount, false);
+
+		for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+		{
+			const GLuint * corners = &indices[triangle * 3];
+
+			triangleScores[triangle] = vertexScores[corners[0]] + vertexScores[corners[1]] + vertexScores[corners[2]];
+		}
+
+		std::vector< GLuint   > output;
+		std::vector< uint32_t > cache, nextCache;
+
+		output   .reserve(triangleCount * 3);
+		cache    .reserve(cacheSize + 3);
+		nextCache.reserve(cacheSize + 3);
+
+		size_t bestTriangle = size_t(std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+		size_t cursor       = 0;										// Next triangle to try when the cache offers none
+
+		while (true)
+		{
+			const GLuint * corners = &indices[bestTriangle * 3];
+
+			triangleAdded[bestTriangle] = true;
+
+			output.insert(output.end(), corners, corners + 3);
+
+			// Remove the triangle from the lists of its vertices
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				GLuint     vertex = corners[corner];
+				uint32_t * first  = &vertexTriangles[triangleOffsets[vertex]];
+				uint32_t * last   = first + remainingTriangles[vertex];
+
+				std::iter_swap(std::find(first, last, uint32_t(bestTriangle)), last - 1);
+
+				--remainingTriangles[vertex];
+			}
+
+			// The vertices of the triangle move to the front of the cache, the others keep their order
+			nextCache.clear();
+
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				if (std::find(nextCache.begin(), nextCache.end(), corners[corner]) == nextCache.end())
+					nextCache.push_back(corners[corner]);
+			}
+
+			for (uint32_t vertex : cache)
+			{
+				if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+					nextCache.push_back(vertex);
+			}
+
+			// Update the vertices in the cache and the ones pushed out of it
+			for (size_t i = 0; i < nextCache.size(); ++i)
+			{
+				uint32_t vertex = nextCache[i];
+
+				cachePositions[vertex] = i < cacheSize ? int(i) : -1;
+				vertexScores  [vertex] = scoreVertex(cachePositions[vertex], remainingTriangles[vertex]);
+			}
+
+			// Rescore their triangles and pick the best one
+			float bestScore = -1.f;
+
+			bestTriangle = triangleCount;
+
+			for (uint32_t vertex : nextCache)
+			{
+				for (uint32_t i = 0; i < remainingTriangles[vertex]; ++i)
+				{
+					uint32_t       triangle = vertexTriangles[triangleOffsets[vertex] + i];
+					const GLuint * others   = &indices[triangle * 3];
+
+					triangleScores[triangle] = vertexScores[others[0]] + vertexScores[others[1]] + vertexScores[others[2]];
+
+					if (triangleScores[triangle] > bestScore)
+					{
+						bestScore    = triangleScores[triangle];
+						bestTriangle = triangle;
+					}
+				}
+			}
+
+			if (nextCache.size() > cacheSize)
+				nextCache.resize(cacheSize);
+
+			cache.swap(nextCache);
+
+			// The cache has no triangle left, continue with the next one in the original order
+			if (bestTriangle == triangleCount)
+			{
+				while (cursor < triangleCount && triangleAdded[cursor])
+					++cursor;
+
+				if (cursor == triangleCount)
+					break;
+
+				bestTriangle = cursor;
+			}
+		}
+
+		std::copy(output.begin(), output.end(), indices);
+	}
+
+	void MeshOptimizer::optimizeOverdraw(GLuint * indices, size_t indexCount, const MeshData::Vertex * vertices, size_t vertexCount)
+	{
+		size_t triangleCount = indexCount / 3;
+
+		if (triangleCount < 2)
+			return;
+
+		// Split into clusters that start with an empty cache. A cluster ends as soon as its ACMR is close to
+		// the one of the whole mesh, so drawing the clusters in any order keeps most of the cache reuse
+		float meshACMR = analyze(indices, indexCount, vertexCount).acmr;
+
+		std::vector< uint32_t > cacheTimes(vertexCount, 0);
+		std::vector< size_t >   clusterStarts(1, 0);
+
+		uint32_t time = uint32_t(fifoCacheSize) + 1;
+		size_t   clusterMisses = 0, clusterTriangles = 0;
+
+		for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+		{
+			size_t misses = 0;
+
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				GLuint vertex = indices[triangle * 3 + corner];
+
+				if (time - cacheTimes[vertex] > fifoCacheSize)
+				{
+					cacheTimes[vertex] = time++;
+					++misses;
+				}
+			}
+
+			clusterMisses    += misses;
+			clusterTriangles += 1;
+
+			if (triangle + 1 < triangleCount && clusterMisses <= overdrawThreshold * meshACMR * clusterTriangles)
+			{
+				clusterStarts.push_back(triangle + 1);
+
+				clusterMisses    = 0;
+				clusterTriangles = 0;
+
+				time += uint32_t(fifoCacheSize) + 1;					// Flush the cache, any cluster may follow this one
+			}
+		}
+
+		size_t clusterCount = clusterStarts.size();
+
+		if (clusterCount < 2)
+			return;
+
+		clusterStarts.push_back(triangleCount);
+
+		// Area weighted centroid and normal of every cluster and of the whole mesh
+		std::vector< glm::vec3 > clusterCentroids(clusterCount, glm::vec3(0.f));
+		std::vector< glm::vec3 > clusterNormals  (clusterCount, glm::vec3(0.f));
+
+		glm::vec3 meshCentroid(0.f);
+		float     meshArea = 0.f;
+
+		for (size_t cluster = 0; cluster < clusterCount; ++cluster)
+		{
+			float clusterArea = 0.f;
+
+			for (size_t triangle = clusterStarts[cluster]; triangle < clusterStarts[cluster + 1]; ++triangle)
+			{
+				const glm::vec3 & a = vertices[indices[triangle * 3 + 0]].position;
+				const glm::vec3 & b = vertices[indices[triangle * 3 + 1]].position;
+				const glm::vec3 & c = vertices[indices[triangle * 3 + 2]].position;
+
+				glm::vec3 normal = glm::cross(b - a, c - a);			// Its length is twice the area of the triangle
+				float     area   = glm::length(normal);
+
+				clusterCentroids[cluster] += (a + b + c) * (area / 3.f);
+				clusterNormals  [cluster] += normal;
+				clusterArea               += area;
+			}
+
+			meshCentroid += clusterCentroids[cluster];
+			meshArea     += clusterArea;
+
+			clusterCentroids[cluster] /= clusterArea > 0.f ? clusterArea : 1.f;
+		}
+
+		meshCentroid /= meshArea > 0.f ? meshArea : 1.f;
+
+		// Clusters that face away from the center are on the outside of the mesh and likely to occlude the others
+		std::vector< float >  sortKeys    (clusterCount);
+		std::vector< size_t > clusterOrder(clusterCount);
+
+		for (size_t cluster = 0; cluster < clusterCount; ++cluster)
+		{
+			float normalLength = glm::length(clusterNormals[cluster]);
+
+			sortKeys[cluster] = normalLength > 0.f ? glm::dot(clusterCentroids[cluster] - meshCentroid, clusterNormals[cluster] / normalLength) : 0.f;
+		}
+
+		std::iota(clusterOrder.begin(), clusterOrder.end(), size_t(0));
+		std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&sortKeys](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+		std::vector< GLuint > output;
+
+		output.reserve(triangleCount * 3);
+
+		for (size_t cluster : clusterOrder)
+			output.insert(output.end(), indices + clusterStarts[cluster] * 3, indices + clusterStarts[cluster + 1] * 3);
+
+		std::copy(output.begin(), output.end(), indices);
+	}
+
+	void MeshOptimizer::optimizeVertexFetch(GLuint * indices, size_t indexCount, MeshData::Vertex * vertices, size_t vertexCount)
+	{
+		std::vector< int64_t > remap(vertexCount, -1);
+
+		GLuint nextVertex = 0;
+
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			GLuint vertex = indices[i];
+
+			if (remap[vertex] < 0)
+				remap[vertex] = nextVertex++;
+
+			indices[i] = GLuint(remap[vertex]);
+		}
+
+		for (int64_t & position : remap)
+		{
+			if (position < 0)
+				position = nextVertex++;								// Unused vertices go last
+		}
+
+		std::vector< MeshData::Vertex > reordered(vertexCount);
+
+		for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+			reordered[size_t(remap[vertex])] = vertices[vertex];
+
+		std::copy(reordered.begin(), reordered.end(), vertices);
+	}
+
+	MeshOptimizer::Statistics MeshOptimizer::analyze(const GLuint * indices, size_t indexCount, size_t vertexCount)
+	{
+		std::vector< uint32_t > cacheTimes(vertexCount, 0);
+		std::vector< bool     > referenced(vertexCount, false);
+
+		uint32_t time = uint32_t(fifoCacheSize) + 1;
+		size_t   misses = 0, referencedCount = 0;
+
+		for (size_t i = 0; i < indexCount; ++i)
+		{
+			GLuint vertex = indices[i];
+
+			// A vertex stays in the FIFO cache until fifoCacheSize other vertices have been transformed
+			if (time - cacheTimes[vertex] > fifoCacheSize)
+			{
+				cacheTimes[vertex] = time++;
+				++misses;
+			}
+
+			if (not referenced[vertex])
+			{
+				referenced[vertex] = true;
+				++referencedCount;
+			}
+		}
+
+		Statistics statistics;
+
+		statistics.acmr = indexCount      > 0 ? float(misses) / float(indexCount / 3) : 0.f;
+		statistics.atvr = referencedCount > 0 ? float(misses) / float(referencedCount) : 0.f;
+
+		return statistics;
+	}
+}
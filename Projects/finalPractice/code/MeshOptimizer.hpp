@@ -0,0 +1,108 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef MESHOPTIMIZER_HEADER
+#define MESHOPTIMIZER_HEADER
+
+
+
+#include "MeshData.hpp"
+
+
+
+#include <cstddef>
+#include <glad/glad.h>
+#include <glm.hpp>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// MeshOptimizer reorders the triangles and vertices of an imported mesh so the GPU works less to draw it:
+	/// triangles are sorted for post-transform vertex cache reuse (Forsyth's linear-speed algorithm),
+	/// clusters of triangles can be sorted to reduce overdraw, and vertices are sorted in the order they are
+	/// first used to improve fetch locality.
+	/// </summary>
+	class MeshOptimizer
+	{
+		public:
+
+			static const size_t		   cacheSize;				///< Size of the simulated vertex cache used to score the vertices.
+			static const size_t	  fifoCacheSize;				///< Size of the FIFO cache used to measure ACMR and ATVR.
+			static const float	overdrawThreshold;				///< How much worse than the whole mesh the ACMR of a cluster may be.
+
+			/// <summary>
+			/// Vertex cache statistics of an index buffer.
+			/// </summary>
+			struct Statistics
+			{
+				float				   acmr;					///< Average cache miss ratio (transformed vertices per triangle, 0.5 - 3).
+				float				   atvr;					///< Average transformed to vertex ratio (transformed vertices per vertex, 1 is ideal).
+			};
+
+		public:
+
+			/// <summary>
+			/// Optimizes every range of the mesh and reports the statistics before and after the optimization.
+			/// Ranges that share their indices (placements of the same sub-mesh) are optimized only once.
+			/// </summary>
+			///
+			/// <param name="mesh">The imported mesh (before its index type is selected).</param>
+			/// <param name="sortOverdraw">Whether clusters of triangles are sorted to reduce overdraw.</param>
+			static void optimize(MeshData& mesh, bool sortOverdraw);
+
+			/// <summary>
+			/// Reorders the triangles of an index list for post-transform vertex cache reuse.
+			/// </summary>
+			///
+			/// <param name="indices">The triangle list indices, reordered in place.</param>
+			/// <param name="indexCount">Number of indices.</param>
+			/// <param name="vertexCount">Number of vertices addressed by the indices.</param>
+			static void optimizeVertexCache(GLuint * indices, size_t indexCount, size_t vertexCount);
+
+			/// <summary>
+			/// Splits a cache optimized index list into clusters and sorts them so the triangles facing outwards
+			/// are drawn first, which lets the depth test reject the ones behind them.
+			/// </summary>
+			///
+			/// <param name="indices">The triangle list indices, reordered in place.</param>
+			/// <param name="indexCount">Number of indices.</param>
+			/// <param name="vertices">The vertices addressed by the indices.</param>
+			/// <param name="vertexCount">Number of vertices addressed by the indices.</param>
+			static void optimizeOverdraw(GLuint * indices, size_t indexCount, const MeshData::Vertex * vertices, size_t vertexCount);
+
+			/// <summary>
+			/// Reorders the vertices in the order the indices first use them and remaps the indices.
+			/// Unused vertices are moved to the end.
+			/// </summary>
+			///
+			/// <param name="indices">The triangle list indices, remapped in place.</param>
+			/// <param name="indexCount">Number of indices.</param>
+			/// <param name="vertices">The vertices addressed by the indices, reordered in place.</param>
+			/// <param name="vertexCount">Number of vertices addressed by the indices.</param>
+			static void optimizeVertexFetch(GLuint * indices, size_t indexCount, MeshData::Vertex * vertices, size_t vertexCount);
+
+			/// <summary>
+			/// Simulates a FIFO vertex cache to measure how many vertices the index list transforms.
+			/// </summary>
+			///
+			/// <param name="indices">The triangle list indices.</param>
+			/// <param name="indexCount">Number of indices.</param>
+			/// <param name="vertexCount">Number of vertices addressed by the indices.</param>
+			///
+			/// <returns>The ACMR and ATVR of the index list.</returns>
+			static Statistics analyze(const GLuint * indices, size_t indexCount, size_t vertexCount);
+	};
+}
+
+
+
+#endif
@@ -0,0 +1,483 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "MeshSimplifier.hpp"
+
+
+
+#include "MeshOptimizer.hpp"
+
+
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <set>
+#include <utility>
+
+
+
+namespace finalPractice
+{
+	const float MeshSimplifier::lodReduction = .5f;
+	const float MeshSimplifier::minReduction = .1f;
+
+
+
+	MeshSimplifier::MeshSimplifier(const GLuint * _indices, size_t indexCount, const MeshData::Vertex * _vertices, size_t _vertexCount) :
+		vertices(_vertices),
+		vertexCount(_vertexCount),
+		indices(_indices, _indices + indexCount),
+		maxCost(0)
+	{
+		// Weld the vertices by position, the first one of every position identifies it
+		std::vector< GLuint > order(vertexCount);
+
+		std::iota(order.begin(), order.end(), GLuint(0));
+
+		auto byPosition = [this](GLuint a, GLuint b)
+		{
+			const glm::vec3 & pa = vertices[a].position;
+			const glm::vec3 & pb = vertices[b].position;
+
+			return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+		};
+
+		std::sort(order.begin(), order.end(), byPosition);
+
+		positionIDs.resize(vertexCount);
+
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			bool samePosition = i > 0 && vertices[order[i]].position == vertices[order[i - 1]].position;
+
+			positionIDs[order[i]] = samePosition ? positionIDs[order[i - 1]] : order[i];
+		}
+
+		// Positions used by more than one vertex are on an attribute seam
+		std::vector< bool >     referenced(vertexCount, false);
+		std::vector< uint32_t > vertexCounts(vertexCount, 0);
+
+		for (GLuint vertex : indices)
+		{
+			if (not referenced[vertex])
+			{
+				referenced[vertex] = true;
+				++vertexCounts[positionIDs[vertex]];
+			}
+		}
+
+		kinds.resize(vertexCount);
+
+		for (size_t position = 0; position < vertexCount; ++position)
+			kinds[position] = vertexCounts[position] > 1 ? SEAM : MANIFOLD;
+
+		removeDegenerateTriangles();								// Triangles with a repeated position have no area to keep
+
+		// Edges without an opposite edge are on an open border, their positions are locked
+		std::vector< uint64_t > edges;
+
+		edges.reserve(indices.size());
+
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				uint64_t a = positionIDs[indices[i + corner]];
+				uint64_t b = positionIDs[indices[i + (corner + 1) % 3]];
+
+				edges.push_back(a << 32 | b);
+			}
+		}
+
+		std::sort(edges.begin(), edges.end());
+
+		for (uint64_t edge : edges)
+		{
+			uint64_t a = edge >> 32, b = edge & 0xffffffff;
+
+			if (not std::binary_search(edges.begin(), edges.end(), b << 32 | a))
+			{
+				kinds[a] = LOCKED;
+				kinds[b] = LOCKED;
+			}
+		}
+
+		// Quadric of every position, from the planes of the triangles around it
+		quadrics.assign(vertexCount, Quadric{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 });
+
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			glm::dvec3 p0(vertices[indices[i + 0]].position);
+			glm::dvec3 p1(vertices[indices[i + 1]].position);
+			glm::dvec3 p2(vertices[indices[i + 2]].position);
+
+			glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+			double     length = glm::length(normal);
+
+			if (length <= 0.0)
+				continue;
+
+			normal /= length;
+
+			for (int corner = 0; corner < 3; ++corner)
+				addPlane(quadrics[positionIDs[indices[i + corner]]], normal, -glm::dot(normal, p0), length * .5);
+		}
+	}
+
+
+
+	float MeshSimplifier::simplify(size_t targetIndexCount)
+	{
+		struct Collapse
+		{
+			GLuint		 from;									///< Position that is removed.
+			GLuint		   to;									///< Position it collapses onto.
+			double		 cost;									///< Error of the collapse.
+		};
+
+		std::vector< uint32_t > triangleOffsets;
+		std::vector< uint32_t > positionTriangles;
+		std::vector< Collapse > collapses;
+		std::vector< bool >     touched;
+
+		// Every pass collapses a set of independent edges, then removes the degenerate triangles
+		while (indices.size() > targetIndexCount)
+		{
+			size_t triangleCount = indices.size() / 3;
+
+			// Triangles around every position, packed in a single array
+			triangleOffsets.assign(vertexCount + 1, 0);
+			positionTriangles.resize(indices.size());
+
+			for (GLuint vertex : indices)
+				++triangleOffsets[positionIDs[vertex] + 1];
+
+			std::partial_sum(triangleOffsets.begin(), triangleOffsets.end(), triangleOffsets.begin());
+
+			std::vector< uint32_t > filled(triangleOffsets.begin(), triangleOffsets.end() - 1);
+
+			for (size_t i = 0; i < indices.size(); ++i)
+				positionTriangles[filled[positionIDs[indices[i]]]++] = uint32_t(i / 3);
+
+			// Both directions of every edge whose origin may move, cheapest first
+			collapses.clear();
+
+			for (size_t triangle = 0; triangle < triangleCount; ++triangle)
+			{
+				for (int corner = 0; corner < 3; ++corner)
+				{
+					GLuint a = positionIDs[indices[triangle * 3 + corner]];
+					GLuint b = positionIDs[indices[triangle * 3 + (corner + 1) % 3]];
+
+					if (kinds[a] != LOCKED) collapses.push_back(Collapse{ a, b, 0.0 });
+					if (kinds[b] != LOCKED) collapses.push_back(Collapse{ b, a, 0.0 });
+				}
+			}
+
+			auto byEdge = [](const Collapse & x, const Collapse & y) { return x.from != y.from ? x.from < y.from : x.to < y.to; };
+			auto sameEdge = [](const Collapse & x, const Collapse & y) { return x.from == y.from && x.to == y.to; };
+
+			std::sort(collapses.begin(), collapses.end(), byEdge);
+			collapses.erase(std::unique(collapses.begin(), collapses.end(), sameEdge), collapses.end());
+
+			for (Collapse & collapse : collapses)
+			{
+				Quadric quadric = quadrics[collapse.from];
+
+				addQuadric(quadric, quadrics[collapse.to]);
+
+				collapse.cost = evaluate(quadric, glm::dvec3(vertices[collapse.to].position));
+			}
+
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse & x, const Collapse & y) { return x.cost < y.cost; });
+
+			touched.assign(vertexCount, false);
+
+			size_t indexCount = indices.size();
+			size_t collapsed  = 0;
+
+			std::vector< std::pair< GLuint, GLuint > > vertexMap;	// Vertex of the removed position -> vertex of the kept one
+
+			for (const Collapse & collapse : collapses)
+			{
+				if (indexCount <= targetIndexCount)
+					break;
+
+				if (touched[collapse.from] || touched[collapse.to])
+					continue;
+
+				// A seam only collapses along itself, or its attributes would be torn apart
+				if (kinds[collapse.from] == SEAM && kinds[collapse.to] == MANIFOLD)
+					continue;
+
+				const uint32_t * first = positionTriangles.data() + triangleOffsets[collapse.from    ];
+				const uint32_t * last  = positionTriangles.data() + triangleOffsets[collapse.from + 1];
+
+				// Every vertex of the removed position needs a vertex of the kept position in a shared triangle
+				vertexMap.clear();
+
+				bool valid = true;
+
+				for (const uint32_t * triangle = first; triangle != last && valid; ++triangle)
+				{
+					const GLuint * corners = &indices[*triangle * 3];
+
+					GLuint fromVertex = 0, toVertex = 0;
+					bool   hasTo      = false;
+
+					for (int corner = 0; corner < 3; ++corner)
+					{
+						if (positionIDs[corners[corner]] == collapse.from) fromVertex = corners[corner];
+						if (positionIDs[corners[corner]] == collapse.to  ) { toVertex = corners[corner]; hasTo = true; }
+					}
+
+					auto mapped = std::find_if(vertexMap.begin(), vertexMap.end(), [fromVertex](const std::pair< GLuint, GLuint > & entry) { return entry.first == fromVertex; });
+
+					if (mapped == vertexMap.end())
+						vertexMap.emplace_back(fromVertex, hasTo ? toVertex : GLuint(-1));
+					else if (hasTo)
+					{
+						if (mapped->second == GLuint(-1))
+							mapped->second = toVertex;
+						else if (mapped->second != toVertex)
+							valid = false;
+					}
+				}
+
+				for (const auto & entry : vertexMap)
+					valid = valid && entry.second != GLuint(-1);
+
+				// Reject collapses that flip, or turn by more than ~75 degrees, a triangle that survives them
+				glm::vec3 target = vertices[collapse.to].position;
+
+				for (const uint32_t * triangle = first; triangle != last && valid; ++triangle)
+				{
+					const GLuint * corners = &indices[*triangle * 3];
+
+					glm::vec3 before[3], after[3];
+					bool      degenerate = false;
+
+					for (int corner = 0; corner < 3; ++corner)
+					{
+						GLuint position = positionIDs[corners[corner]];
+
+						before[corner] = vertices[corners[corner]].position;
+						after [corner] = position == collapse.from ? target : before[corner];
+						degenerate     = degenerate || position == collapse.to;
+					}
+
+					if (degenerate)
+						continue;
+
+					glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+					glm::vec3 normalAfter  = glm::cross(after [1] - after [0], after [2] - after [0]);
+
+					valid = glm::dot(normalBefore, normalAfter) > .25f * glm::length(normalBefore) * glm::length(normalAfter);
+				}
+
+				if (not valid)
+					continue;
+
+				// Move the triangles onto the kept position, the ones along the edge become degenerate
+				for (const uint32_t * triangle = first; triangle != last; ++triangle)
+				{
+					GLuint * corners    = &indices[*triangle * 3];
+					bool     degenerate = false;
+
+					for (int corner = 0; corner < 3; ++corner)
+					{
+						GLuint position = positionIDs[corners[corner]];
+
+						if (position == collapse.from)
+						{
+							GLuint vertex = corners[corner];
+
+							corners[corner] = std::find_if(vertexMap.begin(), vertexMap.end(), [vertex](const std::pair< GLuint, GLuint > & entry) { return entry.first == vertex; })->second;
+						}
+
+						degenerate = degenerate || position == collapse.to;
+						touched[positionIDs[corners[corner]]] = true;
+					}
+
+					if (degenerate)
+						indexCount -= 3;
+				}
+
+				touched[collapse.from] = true;
+
+				addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+
+				maxCost = std::max(maxCost, collapse.cost);
+
+				++collapsed;
+			}
+
+			removeDegenerateTriangles();
+
+			if (collapsed == 0)
+				break;
+		}
+
+		return float(std::sqrt(maxCost));
+	}
+
+
+
+	void MeshSimplifier::generateLods(MeshData& mesh, unsigned lodCount)
+	{
+		if (lodCount == 0)
+			return;
+
+		std::vector< uint32_t >                              spanFirsts;	// First index of every full resolution index list
+		std::vector< std::vector< std::vector< GLuint > > > spanLods;		// Simplified lists of every one of them
+
+		std::vector< size_t > levelIndexCounts(lodCount + 1, 0);
+		std::vector< float  > levelErrors     (lodCount + 1, 0.f);
+
+		// Placements of the same sub-mesh share their index list, simplify it only once
+		std::set< uint32_t > simplified;
+
+		for (const MeshData::DrawRange & range : mesh.ranges)
+		{
+			if (range.lod != 0 || range.indexCount == 0 || not simplified.insert(range.firstIndex).second)
+				continue;
+
+			const GLuint           * indices  = &mesh.indices [range.firstIndex];
+			const MeshData::Vertex * vertices = &mesh.vertices[range.baseVertex];
+
+			size_t vertexCount = size_t(*std::max_element(indices, indices + range.indexCount)) + 1;
+
+			MeshSimplifier simplifier(indices, range.indexCount, vertices, vertexCount);
+
+			spanFirsts.push_back(range.firstIndex);
+			spanLods  .emplace_back();
+
+			levelIndexCounts[0] += range.indexCount;
+
+			size_t previousCount = range.indexCount;
+
+			for (unsigned lod = 1; lod <= lodCount; ++lod)
+			{
+				// Small parts keep a few triangles instead of vanishing
+				size_t targetCount = std::max(size_t(previousCount * lodReduction) / 3 * 3, std::min< size_t >(previousCount, 12));
+				float  error       = simplifier.simplify(targetCount);
+
+				std::vector< GLuint > lodIndices = simplifier.getIndices();
+
+				MeshOptimizer::optimizeVertexCache(lodIndices.data(), lodIndices.size(), vertexCount);
+
+				previousCount          = lodIndices.size();
+				levelIndexCounts[lod] += lodIndices.size();
+				levelErrors     [lod]  = std::max(levelErrors[lod], error);
+
+				spanLods.back().push_back(std::move(lodIndices));
+			}
+		}
+
+		// The chain ends at the first level that barely removes any triangle
+		unsigned levels = 0;
+
+		while (levels < lodCount && levelIndexCounts[levels + 1] <= (1.f - minReduction) * levelIndexCounts[levels])
+			++levels;
+
+		mesh.lodErrors.assign(levelErrors.begin(), levelErrors.begin() + levels + 1);
+
+		// Append the lists to the index buffer
+		std::vector< uint32_t > lodFirsts(spanFirsts.size() * levels);
+
+		for (size_t span = 0; span < spanFirsts.size(); ++span)
+		{
+			for (unsigned lod = 1; lod <= levels; ++lod)
+			{
+				lodFirsts[span * levels + lod - 1] = uint32_t(mesh.indices.size());
+
+				mesh.indices.insert(mesh.indices.end(), spanLods[span][lod - 1].begin(), spanLods[span][lod - 1].end());
+			}
+		}
+
+		// Add a range per level to every placement
+		size_t fullRangeCount = mesh.ranges.size();
+
+		for (size_t i = 0; i < fullRangeCount; ++i)
+		{
+			MeshData::DrawRange range = mesh.ranges[i];
+
+			size_t span = size_t(std::find(spanFirsts.begin(), spanFirsts.end(), range.firstIndex) - spanFirsts.begin());
+
+			if (range.lod != 0 || span == spanFirsts.size())
+				continue;
+
+			for (unsigned lod = 1; lod <= levels; ++lod)
+			{
+				range.firstIndex = lodFirsts[span * levels + lod - 1];
+				range.indexCount = uint32_t(spanLods[span][lod - 1].size());
+				range.lod        = lod;
+
+				if (range.indexCount > 0)
+					mesh.ranges.push_back(range);
+			}
+		}
+	}
+
+
+
+	void MeshSimplifier::removeDegenerateTriangles()
+	{
+		size_t kept = 0;
+
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			GLuint p0 = positionIDs[indices[i]], p1 = positionIDs[indices[i + 1]], p2 = positionIDs[indices[i + 2]];
+
+			if (p0 == p1 || p1 == p2 || p2 == p0)
+				continue;
+
+			std::copy(indices.begin() + i, indices.begin() + i + 3, indices.begin() + kept);
+			kept += 3;
+		}
+
+		indices.resize(kept);
+	}
+
+	void MeshSimplifier::addPlane(Quadric& quadric, const glm::dvec3& normal, double distance, double area)
+	{
+		quadric.a00 += area * normal.x * normal.x;
+		quadric.a01 += area * normal.x * normal.y;
+		quadric.a02 += area * normal.x * normal.z;
+		quadric.a11 += area * normal.y * normal.y;
+		quadric.a12 += area * normal.y * normal.z;
+		quadric.a22 += area * normal.z * normal.z;
+		quadric.b0  += area * normal.x * distance;
+		quadric.b1  += area * normal.y * distance;
+		quadric.b2  += area * normal.z * distance;
+		quadric.c   += area * distance * distance;
+
+		quadric.weight += area;
+	}
+
+	void MeshSimplifier::addQuadric(Quadric& quadric, const Quadric& other)
+	{
+		quadric.a00 += other.a00;  quadric.a01 += other.a01;  quadric.a02 += other.a02;
+		quadric.a11 += other.a11;  quadric.a12 += other.a12;  quadric.a22 += other.a22;
+		quadric.b0  += other.b0;   quadric.b1  += other.b1;   quadric.b2  += other.b2;
+		quadric.c   += other.c;
+
+		quadric.weight += other.weight;
+	}
+
+	double MeshSimplifier::evaluate(const Quadric& quadric, const glm::dvec3& point)
+	{
+		const double x = point.x, y = point.y, z = point.z;
+
+		double error =
+			quadric.a00 * x * x + 2.0 * quadric.a01 * x * y + 2.0 * quadric.a02 * x * z +
+			quadric.a11 * y * y + 2.0 * quadric.a12 * y * z + quadric.a22 * z * z +
+			2.0 * (quadric.b0 * x + quadric.b1 * y + quadric.b2 * z) + quadric.c;
+
+		return quadric.weight > 0.0 ? std::max(error, 0.0) / quadric.weight : 0.0;
+	}
+}
@@ -0,0 +1,147 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef MESHSIMPLIFIER_HEADER
+#define MESHSIMPLIFIER_HEADER
+
+
+
+#include "MeshData.hpp"
+
+
+
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+#include <glm.hpp>
+#include <vector>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// MeshSimplifier reduces the triangles of an index list with quadric error metrics edge collapses
+	/// (Garland and Heckbert). Vertices are collapsed onto one of their neighbours instead of a new position,
+	/// so every simplified index list reuses the vertex buffer of the full resolution mesh.
+	/// Vertices on open borders are kept and vertices on attribute seams only collapse along the seam.
+	/// </summary>
+	class MeshSimplifier
+	{
+		public:
+
+			static const float	 lodReduction;					///< Fraction of the triangles kept by each level of detail.
+			static const float	 minReduction;					///< A level that removes fewer triangles than this fraction ends the chain.
+
+		private:
+
+			/// <summary>
+			/// Kind of a position, deciding how it can be collapsed.
+			/// </summary>
+			enum Kind : uint8_t
+			{
+				MANIFOLD,										///< A single vertex uses the position, it can collapse onto any neighbour.
+				SEAM,											///< Several vertices (with different attributes) share the position.
+				LOCKED											///< The position is on an open border and never moves.
+			};
+
+			/// <summary>
+			/// Sum of the squared distances to a set of planes, weighted by the area of their triangles.
+			/// </summary>
+			struct Quadric
+			{
+				double a00, a01, a02, a11, a12, a22;			///< Symmetric 3x3 matrix (sum of n * n^T).
+				double b0, b1, b2;								///< Sum of d * n.
+				double c;										///< Sum of d * d.
+				double weight;									///< Sum of the areas of the planes.
+			};
+
+		private:
+
+			const MeshData::Vertex *   vertices;				///< Vertices addressed by the indices.
+			size_t				    vertexCount;				///< Number of vertices addressed by the indices.
+
+			std::vector< GLuint >       indices;				///< Current triangle list.
+			std::vector< GLuint >   positionIDs;				///< First vertex with the same position as each vertex.
+			std::vector< Kind >           kinds;				///< Kind of every position (indexed by position ID).
+			std::vector< Quadric >     quadrics;				///< Accumulated quadric of every position (indexed by position ID).
+
+			double					  maxCost;					///< Highest cost of the collapses done so far.
+
+		public:
+
+			/// <summary>
+			/// Prepares the simplification of an index list: welds the vertices by position, finds the borders
+			/// and the seams and accumulates the quadric of every position.
+			/// </summary>
+			///
+			/// <param name="indices">The triangle list indices.</param>
+			/// <param name="indexCount">Number of indices.</param>
+			/// <param name="vertices">The vertices addressed by the indices.</param>
+			/// <param name="vertexCount">Number of vertices addressed by the indices.</param>
+			MeshSimplifier(const GLuint * indices, size_t indexCount, const MeshData::Vertex * vertices, size_t vertexCount);
+
+		public:
+
+			/// <summary>
+			/// Collapses edges, cheapest first, until the index list has at most targetIndexCount indices or
+			/// no collapse is possible. Successive calls keep simplifying the same list.
+			/// </summary>
+			///
+			/// <param name="targetIndexCount">Number of indices to reach.</param>
+			///
+			/// <returns>The geometric error of the simplified list (root mean square distance to the original surface).</returns>
+			float simplify(size_t targetIndexCount);
+
+			/// <summary>
+			/// Returns the current simplified index list.
+			/// </summary>
+			///
+			/// <returns>The triangle list indices.</returns>
+			const std::vector< GLuint > & getIndices() const { return indices; }
+
+		public:
+
+			/// <summary>
+			/// Appends to the mesh a chain of levels of detail for every full resolution range, each one with about
+			/// lodReduction of the triangles of the previous one, and records the error of every level.
+			/// </summary>
+			///
+			/// <param name="mesh">The imported mesh (before its index type is selected).</param>
+			/// <param name="lodCount">Number of simplified levels to generate.</param>
+			static void generateLods(MeshData& mesh, unsigned lodCount);
+
+		private:
+
+			/// <summary>
+			/// Removes the triangles with two corners on the same position.
+			/// </summary>
+			void removeDegenerateTriangles();
+
+			/// <summary>
+			/// Adds the plane of a triangle to a quadric.
+			/// </summary>
+			static void addPlane(Quadric& quadric, const glm::dvec3& normal, double distance, double area);
+
+			/// <summary>
+			/// Adds a quadric to another one.
+			/// </summary>
+			static void addQuadric(Quadric& quadric, const Quadric& other);
+
+			/// <summary>
+			/// Evaluates the mean squared distance from a point to the planes of a quadric.
+			/// </summary>
+			static double evaluate(const Quadric& quadric, const glm::dvec3& point);
+	};
+}
+
+
+
+#endif
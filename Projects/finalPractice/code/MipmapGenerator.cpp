@@ -0,0 +1,341 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "MipmapGenerator.hpp"
+
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MIPMAPGENERATOR_SSE
+#include <xmmintrin.h>
+#endif
+
+
+
+namespace finalPractice
+{
+	static const float kaiserRadius = 2.f;											// Radius of the Kaiser filter in texels of the next level
+	static const float kaiserAlpha  = 4.f;											// Shape of the Kaiser window
+
+	static const unsigned linearToSrgbSize = 16384;									// Entries of the table that encodes linear values back to sRGB
+
+	// Texel of a level being filtered, with its four components as floats
+	struct alignas(16) Texel
+	{
+		float components[4];
+	};
+
+	// Texel of the previous level and weight it contributes with
+	struct Tap
+	{
+		unsigned index;
+		float	 weight;
+	};
+
+	// Taps of every texel of the next level along one axis (the taps of texel i are [starts[i], starts[i + 1]))
+	struct Kernel
+	{
+		std::vector< unsigned > starts;
+		std::vector< Tap	  > taps;
+	};
+
+
+
+	#ifdef MIPMAPGENERATOR_SSE
+
+	// Four components processed at once in an SSE register
+	using Lanes = __m128;
+
+	static inline Lanes zeroLanes  ()										{ return _mm_setzero_ps(); }
+	static inline Lanes loadLanes  (const float * source)					{ return _mm_load_ps(source); }
+	static inline void  storeLanes (float * target, Lanes value)			{ _mm_store_ps(target, value); }
+	static inline Lanes multiplyAdd(Lanes sum, Lanes value, float weight)	{ return _mm_add_ps(sum, _mm_mul_ps(value, _mm_set1_ps(weight))); }
+
+	#else
+
+	// Four components processed one after the other when SSE isn't available
+	struct Lanes
+	{
+		float components[4];
+	};
+
+	static inline Lanes zeroLanes  ()										{ return Lanes{ { 0.f, 0.f, 0.f, 0.f } }; }
+	static inline Lanes loadLanes  (const float * source)					{ return Lanes{ { source[0], source[1], source[2], source[3] } }; }
+	static inline void  storeLanes (float * target, Lanes value)			{ std::copy_n(value.components, 4, target); }
+
+	static inline Lanes multiplyAdd(Lanes sum, Lanes value, float weight)
+	{
+		for (int i = 0; i < 4; ++i)
+			sum.components[i] += value.components[i] * weight;
+
+		return sum;
+	}
+
+	#endif
+
+
+
+	// Modified Bessel function of the first kind and order 0 (the series converges quickly for the arguments used)
+	static float besselI0(float x)
+	{
+		float sum  = 1.f;
+		float term = 1.f;
+
+		for (int k = 1; k < 16; ++k)
+		{
+			term *= (x * 0.5f / float(k)) * (x * 0.5f / float(k));
+			sum  += term;
+		}
+
+		return sum;
+	}
+
+	// Kaiser windowed sinc, with the distance in texels of the next level
+	static float kaiserWeight(float distance)
+	{
+		if (std::abs(distance) >= kaiserRadius)
+			return 0.f;
+
+		const float pi = 3.14159265358979f;
+
+		float sinc   = distance == 0.f ? 1.f : std::sin(pi * distance) / (pi * distance);
+		float ratio  = distance / kaiserRadius;
+		float window = besselI0(kaiserAlpha * std::sqrt(1.f - ratio * ratio)) / besselI0(kaiserAlpha);
+
+		return sinc * window;
+	}
+
+	// Computes the taps that reduce an axis of sourceSize texels to targetSize texels (clamped at the borders)
+	static Kernel computeKernel(unsigned sourceSize, unsigned targetSize, MipmapGenerator::Filter filter)
+	{
+		Kernel kernel;
+
+		float scale = float(sourceSize) / float(targetSize);
+
+		// When enlarging, the filter keeps the width of a source texel so it interpolates between them
+		float support = std::max(scale, 1.f);
+
+		for (unsigned i = 0; i < targetSize; ++i)
+		{
+			kernel.starts.push_back(unsigned(kernel.taps.size()));
+
+			// Texel k of the previous level covers [k, k + 1) and texel i of the next one [i * scale, (i + 1) * scale)
+			float center = (float(i) + 0.5f) * scale;
+			float radius = filter == MipmapGenerator::BOX ? support * 0.5f : kaiserRadius * support;
+
+			int first = int(std::floor(center - radius));
+			int last  = int(std::ceil (center + radius));
+
+			float total = 0.f;
+
+			for (int k = first; k < last; ++k)
+			{
+				float weight;
+
+				if (filter == MipmapGenerator::BOX)
+					weight = std::max(std::min(center + radius, float(k + 1)) - std::max(center - radius, float(k)), 0.f);
+				else
+					weight = kaiserWeight((float(k) + 0.5f - center) / support);
+
+				if (weight == 0.f)
+					continue;
+
+				unsigned index = unsigned(std::min(std::max(k, 0), int(sourceSize) - 1));
+
+				kernel.taps.push_back(Tap{ index, weight });
+
+				total += weight;
+			}
+
+			// Normalize the weights so that flat areas keep their value
+			for (size_t t = kernel.starts.back(); t < kernel.taps.size(); ++t)
+				kernel.taps[t].weight /= total;
+		}
+
+		kernel.starts.push_back(unsigned(kernel.taps.size()));
+
+		return kernel;
+	}
+
+	// Reduces a level with a vertical pass followed by an horizontal one
+	static std::vector< Texel > reduce(const std::vector< Texel >& source, unsigned width, unsigned height, unsigned targetWidth, unsigned targetHeight, MipmapGenerator::Filter filter)
+	{
+		Kernel horizontal = computeKernel(width , targetWidth , filter);
+		Kernel vertical   = computeKernel(height, targetHeight, filter);
+
+		// Vertical pass: every row of the next level is a weighted sum of whole rows of the previous one
+		std::vector< Texel > columns(size_t(width) * targetHeight);
+
+		for (unsigned y = 0; y < targetHeight; ++y)
+		{
+			Texel * row = &columns[size_t(y) * width];
+
+			for (unsigned t = vertical.starts[y]; t < vertical.starts[y + 1]; ++t)
+			{
+				const Texel * sourceRow = &source[size_t(vertical.taps[t].index) * width];
+				float		  weight    = vertical.taps[t].weight;
+				bool		  first     = t == vertical.starts[y];
+
+				for (unsigned x = 0; x < width; ++x)
+				{
+					Lanes sum = first ? zeroLanes() : loadLanes(row[x].components);
+
+					storeLanes(row[x].components, multiplyAdd(sum, loadLanes(sourceRow[x].components), weight));
+				}
+			}
+		}
+
+		// Horizontal pass
+		std::vector< Texel > target(size_t(targetWidth) * targetHeight);
+
+		for (unsigned y = 0; y < targetHeight; ++y)
+		{
+			const Texel * row       = &columns[size_t(y) * width];
+			Texel		* targetRow = &target [size_t(y) * targetWidth];
+
+			for (unsigned x = 0; x < targetWidth; ++x)
+			{
+				Lanes sum = zeroLanes();
+
+				for (unsigned t = horizontal.starts[x]; t < horizontal.starts[x + 1]; ++t)
+					sum = multiplyAdd(sum, loadLanes(row[horizontal.taps[t].index].components), horizontal.taps[t].weight);
+
+				storeLanes(targetRow[x].components, sum);
+			}
+		}
+
+		return target;
+	}
+
+	// Decodes an sRGB component to linear light
+	static float srgbToLinear(float value)
+	{
+		return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	// Encodes a linear component to sRGB
+	static float linearToSrgb(float value)
+	{
+		return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+	}
+
+	// Converts the texels of an image to floats, decoding the RGB components to linear light if requested
+	static std::vector< Texel > toTexels(const Rgba8888 * colors, size_t count, bool gammaCorrect)
+	{
+		static const std::vector< float > decodeTable = []()
+		{
+			std::vector< float > table(256);
+
+			for (unsigned i = 0; i < 256; ++i)
+				table[i] = srgbToLinear(float(i) / 255.f);
+
+			return table;
+		}();
+
+		std::vector< Texel > texels(count);
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			for (int c = 0; c < 4; ++c)
+			{
+				uint8_t component = colors[i].components[c];
+
+				texels[i].components[c] = gammaCorrect && c != Rgba8888::ALPHA ? decodeTable[component] : float(component) / 255.f;
+			}
+		}
+
+		return texels;
+	}
+
+	// Converts filtered texels back to 8 bits per component (the Kaiser filter can overshoot, so they are clamped)
+	static ColorBuffer< Rgba8888 > toColors(const std::vector< Texel >& texels, unsigned width, unsigned height, bool gammaCorrect)
+	{
+		static const std::vector< uint8_t > encodeTable = []()
+		{
+			std::vector< uint8_t > table(linearToSrgbSize);
+
+			for (unsigned i = 0; i < linearToSrgbSize; ++i)
+				table[i] = uint8_t(linearToSrgb(float(i) / float(linearToSrgbSize - 1)) * 255.f + 0.5f);
+
+			return table;
+		}();
+
+		ColorBuffer< Rgba8888 > image(width, height, ColorBuffer< Rgba8888 >::UNINITIALIZED);
+
+		for (size_t i = 0; i < texels.size(); ++i)
+		{
+			Rgba8888 color;
+
+			for (int c = 0; c < 4; ++c)
+			{
+				float value = std::min(std::max(texels[i].components[c], 0.f), 1.f);
+
+				if (gammaCorrect && c != Rgba8888::ALPHA)
+					color.components[c] = encodeTable[unsigned(value * float(linearToSrgbSize - 1) + 0.5f)];
+				else
+					color.components[c] = uint8_t(value * 255.f + 0.5f);
+			}
+
+			image.set(unsigned(i), color);
+		}
+
+		return image;
+	}
+
+
+
+	std::vector< ColorBuffer< Rgba8888 > > MipmapGenerator::generate(const Rgba8888 * colors, unsigned width, unsigned height, Filter filter, bool gammaCorrect)
+	{
+		std::vector< ColorBuffer< Rgba8888 > > levels;
+
+		if (width == 0 || height == 0)
+			return levels;
+
+		// Every level is reduced from the float version of the previous one, so rounding errors don't accumulate
+		std::vector< Texel > texels = toTexels(colors, size_t(width) * height, gammaCorrect);
+
+		while (width > 1 || height > 1)
+		{
+			unsigned targetWidth  = std::max(width  / 2, 1u);
+			unsigned targetHeight = std::max(height / 2, 1u);
+
+			texels = reduce(texels, width, height, targetWidth, targetHeight, filter);
+
+			width  = targetWidth;
+			height = targetHeight;
+
+			levels.push_back(toColors(texels, width, height, gammaCorrect));
+		}
+
+		return levels;
+	}
+
+	ColorBuffer< Rgba8888 > MipmapGenerator::resize(const Rgba8888 * colors, unsigned width, unsigned height, unsigned targetWidth, unsigned targetHeight, Filter filter, bool gammaCorrect)
+	{
+		std::vector< Texel > texels = toTexels(colors, size_t(width) * height, gammaCorrect);
+
+		return toColors(reduce(texels, width, height, targetWidth, targetHeight, filter), targetWidth, targetHeight, gammaCorrect);
+	}
+
+	unsigned MipmapGenerator::getLevelCount(unsigned width, unsigned height)
+	{
+		unsigned count = 1;
+
+		while (width > 1 || height > 1)
+		{
+			width  = std::max(width  / 2, 1u);
+			height = std::max(height / 2, 1u);
+
+			++count;
+		}
+
+		return count;
+	}
+}
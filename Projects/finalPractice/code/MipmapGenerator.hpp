@@ -0,0 +1,105 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef MIPMAPGENERATOR_HEADER
+#define MIPMAPGENERATOR_HEADER
+
+
+
+#include "Color.hpp"
+#include "ColorBuffer.hpp"
+
+
+
+#include <vector>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// MipmapGenerator builds the mip chain of an image on the CPU, so textures are uploaded with all their
+	/// levels instead of calling glGenerateMipmap after the first one. Every level is filtered from the float
+	/// version of the previous one with a separable filter (SSE when the compiler targets it), optionally in
+	/// linear light so that the sRGB colors don't darken as they are averaged.
+	/// </summary>
+	class MipmapGenerator
+	{
+		public:
+
+			/// <summary>
+			/// Filters used to reduce a level to the next one.
+			/// </summary>
+			enum Filter
+			{
+				BOX,											///< Average of the texels each texel of the next level covers.
+				KAISER											///< Kaiser windowed sinc, sharper than the box without its aliasing.
+			};
+
+		public:
+
+			/// <summary>
+			/// Generates the levels that follow an image in its mip chain, down to 1x1.
+			/// </summary>
+			///
+			/// <param name="colors">The texels of the image, row by row.</param>
+			/// <param name="width">Width of the image in pixels.</param>
+			/// <param name="height">Height of the image in pixels.</param>
+			/// <param name="filter">The filter used to reduce every level.</param>
+			/// <param name="gammaCorrect">True to filter the RGB components in linear light (the alpha is always linear).</param>
+			///
+			/// <returns>The levels after the image itself, each half the size of the previous one.</returns>
+			static std::vector< ColorBuffer< Rgba8888 > > generate(const Rgba8888 * colors, unsigned width, unsigned height, Filter filter, bool gammaCorrect);
+
+			/// <summary>
+			/// Generates the levels that follow an image in its mip chain, down to 1x1.
+			/// </summary>
+			///
+			/// <param name="image">The image.</param>
+			/// <param name="filter">The filter used to reduce every level.</param>
+			/// <param name="gammaCorrect">True to filter the RGB components in linear light (the alpha is always linear).</param>
+			///
+			/// <returns>The levels after the image itself, each half the size of the previous one.</returns>
+			static std::vector< ColorBuffer< Rgba8888 > > generate(const ColorBuffer< Rgba8888 >& image, Filter filter, bool gammaCorrect)
+			{
+				return generate(image.colors(), image.getWidth(), image.getHeight(), filter, gammaCorrect);
+			}
+
+			/// <summary>
+			/// Resamples an image to another size with the same filters used for the mip chain (when enlarging,
+			/// the filter interpolates between the texels instead).
+			/// </summary>
+			///
+			/// <param name="colors">The texels of the image, row by row.</param>
+			/// <param name="width">Width of the image in pixels.</param>
+			/// <param name="height">Height of the image in pixels.</param>
+			/// <param name="targetWidth">Width of the resampled image in pixels.</param>
+			/// <param name="targetHeight">Height of the resampled image in pixels.</param>
+			/// <param name="filter">The filter used to resample the image.</param>
+			/// <param name="gammaCorrect">True to filter the RGB components in linear light (the alpha is always linear).</param>
+			///
+			/// <returns>The resampled image.</returns>
+			static ColorBuffer< Rgba8888 > resize(const Rgba8888 * colors, unsigned width, unsigned height, unsigned targetWidth, unsigned targetHeight, Filter filter, bool gammaCorrect);
+
+			/// <summary>
+			/// Returns the number of levels of a complete mip chain.
+			/// </summary>
+			///
+			/// <param name="width">Width of the first level in pixels.</param>
+			/// <param name="height">Height of the first level in pixels.</param>
+			///
+			/// <returns>The number of levels down to 1x1, including the first one.</returns>
+			static unsigned getLevelCount(unsigned width, unsigned height);
+	};
+}
+
+
+
+#endif
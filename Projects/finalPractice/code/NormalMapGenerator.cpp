@@ -0,0 +1,246 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "NormalMapGenerator.hpp"
+
+
+
+#include "MappedFile.hpp"
+
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NORMALMAPGENERATOR_SSE2
+#include <emmintrin.h>
+#endif
+
+
+
+namespace finalPractice
+{
+	const char NormalMapGenerator::magic[4] = { 'N', 'R', 'M', '1' };
+
+
+
+	// Normal of a texel from its Sobel gradient, with the scales that turn the gradient into slopes
+	static inline NormalXz88 computeNormal(int gradientX, int gradientZ, float scaleX, float scaleZ)
+	{
+		float x = -float(gradientX) * scaleX;
+		float z = -float(gradientZ) * scaleZ;
+
+		float inverseLength = 1.f / std::sqrt(x * x + z * z + 1.f);
+
+		// Rounded to nearest even, like the SSE2 conversion
+		return NormalXz88{ { int8_t(std::nearbyint(x * inverseLength * 127.f)), int8_t(std::nearbyint(z * inverseLength * 127.f)) } };
+	}
+
+	// Computes the normals of the texels [first, last) of a row from the rows above and below it (already clamped)
+	static void computeRow(const uint8_t * above, const uint8_t * row, const uint8_t * below, unsigned width, unsigned first, unsigned last, float scaleX, float scaleZ, NormalXz88 * target)
+	{
+		for (unsigned x = first; x < last; ++x)
+		{
+			unsigned left  = x > 0         ? x - 1 : 0;
+			unsigned right = x + 1 < width ? x + 1 : width - 1;
+
+			int gradientX = (above[right] - above[left]) + 2 * (row[right] - row[left]) + (below[right] - below[left]);
+			int gradientZ = (below[left] + 2 * below[x] + below[right]) - (above[left] + 2 * above[x] + above[right]);
+
+			target[x] = computeNormal(gradientX, gradientZ, scaleX, scaleZ);
+		}
+	}
+
+
+
+	#ifdef NORMALMAPGENERATOR_SSE2
+
+	// Loads 8 samples widened to 16 bits
+	static inline __m128i loadSamples(const uint8_t * samples)
+	{
+		return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast< const __m128i * >(samples)), _mm_setzero_si128());
+	}
+
+	// Converts the components of a gradient to 4 normal components (scaled to 127 and rounded) in 32-bit lanes
+	static inline void quantizeNormals(__m128 x, __m128 z, __m128i & quantizedX, __m128i & quantizedZ)
+	{
+		__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(z, z)), _mm_set1_ps(1.f)));
+		__m128 scale  = _mm_div_ps(_mm_set1_ps(127.f), length);
+
+		quantizedX = _mm_cvtps_epi32(_mm_mul_ps(x, scale));
+		quantizedZ = _mm_cvtps_epi32(_mm_mul_ps(z, scale));
+	}
+
+	// Computes the normals of the texels [first, first + 8) of a row, whose neighbors are all inside the row
+	static inline void computeEight(const uint8_t * above, const uint8_t * row, const uint8_t * below, unsigned first, __m128 scaleX, __m128 scaleZ, NormalXz88 * target)
+	{
+		__m128i aboveLeft   = loadSamples(above + first - 1);
+		__m128i aboveCenter = loadSamples(above + first    );
+		__m128i aboveRight  = loadSamples(above + first + 1);
+		__m128i rowLeft     = loadSamples(row   + first - 1);
+		__m128i rowRight    = loadSamples(row   + first + 1);
+		__m128i belowLeft   = loadSamples(below + first - 1);
+		__m128i belowCenter = loadSamples(below + first    );
+		__m128i belowRight  = loadSamples(below + first + 1);
+
+		// The gradients fit in 16 bits (4 * 255 at most)
+		__m128i gradientX = _mm_add_epi16(_mm_add_epi16(_mm_sub_epi16(aboveRight, aboveLeft), _mm_slli_epi16(_mm_sub_epi16(rowRight, rowLeft), 1)), _mm_sub_epi16(belowRight, belowLeft));
+		__m128i gradientZ = _mm_sub_epi16
+		(
+			_mm_add_epi16(_mm_add_epi16(belowLeft, _mm_slli_epi16(belowCenter, 1)), belowRight),
+			_mm_add_epi16(_mm_add_epi16(aboveLeft, _mm_slli_epi16(aboveCenter, 1)), aboveRight)
+		);
+
+		// Sign extend every half to 32-bit lanes and convert them to floats
+		auto toFloats = [](__m128i halves) { return _mm_cvtepi32_ps(_mm_srai_epi32(halves, 16)); };
+
+		__m128 negativeScaleX = _mm_sub_ps(_mm_setzero_ps(), scaleX);
+		__m128 negativeScaleZ = _mm_sub_ps(_mm_setzero_ps(), scaleZ);
+
+		__m128i lowX, lowZ, highX, highZ;
+
+		quantizeNormals
+		(
+			_mm_mul_ps(toFloats(_mm_unpacklo_epi16(gradientX, gradientX)), negativeScaleX),
+			_mm_mul_ps(toFloats(_mm_unpacklo_epi16(gradientZ, gradientZ)), negativeScaleZ),
+			lowX, lowZ
+		);
+
+		quantizeNormals
+		(
+			_mm_mul_ps(toFloats(_mm_unpackhi_epi16(gradientX, gradientX)), negativeScaleX),
+			_mm_mul_ps(toFloats(_mm_unpackhi_epi16(gradientZ, gradientZ)), negativeScaleZ),
+			highX, highZ
+		);
+
+		// Pack to signed bytes and interleave the X and Z components of every texel
+		__m128i bytesX = _mm_packs_epi16(_mm_packs_epi32(lowX, highX), _mm_setzero_si128());
+		__m128i bytesZ = _mm_packs_epi16(_mm_packs_epi32(lowZ, highZ), _mm_setzero_si128());
+
+		_mm_storeu_si128(reinterpret_cast< __m128i * >(target + first), _mm_unpacklo_epi8(bytesX, bytesZ));
+	}
+
+	#endif
+
+
+
+	ColorBuffer< NormalXz88 > NormalMapGenerator::generate(const ColorBuffer< Monochrome8 >& heights, glm::vec2 texelSize, float heightStep)
+	{
+		static_assert(sizeof(NormalXz88) == 2, "NormalXz88 must be tightly packed");
+
+		unsigned width  = heights.getWidth ();
+		unsigned height = heights.getHeight();
+
+		ColorBuffer< NormalXz88 > normals(width, height, ColorBuffer< NormalXz88 >::UNINITIALIZED);
+
+		// The Sobel gradient is 8 times the slope in sample values per texel
+		float scaleX = heightStep / (8.f * texelSize.x);
+		float scaleZ = heightStep / (8.f * texelSize.y);
+
+		for (unsigned z = 0; z < height; ++z)
+		{
+			const uint8_t * above = heights.colors() + size_t(z > 0 ? z - 1 : 0) * width;
+			const uint8_t * row   = heights.colors() + size_t(z) * width;
+			const uint8_t * below = heights.colors() + size_t(z + 1 < height ? z + 1 : height - 1) * width;
+
+			NormalXz88 * target = normals.colors() + size_t(z) * width;
+
+			unsigned x = 0;
+
+			#ifdef NORMALMAPGENERATOR_SSE2
+
+			// The first and last columns are clamped, so the vectorized texels start at 1 and end before the last one
+			if (width > 9)
+			{
+				computeRow(above, row, below, width, 0, 1, scaleX, scaleZ, target);
+
+				for (x = 1; x + 8 < width; x += 8)
+					computeEight(above, row, below, x, _mm_set1_ps(scaleX), _mm_set1_ps(scaleZ), target);
+			}
+
+			#endif
+
+			computeRow(above, row, below, width, x, width, scaleX, scaleZ, target);
+		}
+
+		return normals;
+	}
+
+	ColorBuffer< NormalXz88 > NormalMapGenerator::load(const std::string& heightMapPath, const ColorBuffer< Monochrome8 >& heights, glm::vec2 texelSize, float heightStep)
+	{
+		std::string cachedPath = getCachedPath(heightMapPath);
+
+		Header expected;
+
+		std::memcpy(expected.magic, magic, sizeof(magic));
+
+		expected.width      = heights.getWidth ();
+		expected.height     = heights.getHeight();
+		expected.texelWidth = texelSize.x;
+		expected.texelDepth = texelSize.y;
+		expected.heightStep = heightStep;
+
+		size_t dataSize = size_t(expected.width) * expected.height * sizeof(NormalXz88);
+
+		std::error_code sourceError, cachedError;
+
+		auto sourceTime = std::filesystem::last_write_time(heightMapPath, sourceError);
+		auto cachedTime = std::filesystem::last_write_time(cachedPath,    cachedError);
+
+		// A cached file older than its height map has to be generated again
+		if (not cachedError && (sourceError || sourceTime <= cachedTime))
+		{
+			MappedFile file(cachedPath);
+
+			Header header;
+
+			if (file.isOk() && file.getSize() == sizeof(Header) + dataSize)
+			{
+				std::memcpy(&header, file.getData(), sizeof(header));
+
+				if (std::memcmp(&header, &expected, sizeof(Header)) == 0)
+				{
+					ColorBuffer< NormalXz88 > normals(expected.width, expected.height, ColorBuffer< NormalXz88 >::UNINITIALIZED);
+
+					std::memcpy(normals.colors(), file.getData() + sizeof(Header), dataSize);
+
+					return normals;
+				}
+			}
+		}
+
+		ColorBuffer< NormalXz88 > normals = generate(heights, texelSize, heightStep);
+
+		std::ofstream file(cachedPath, std::ios::binary | std::ios::trunc);
+
+		if (not file) // ERROR condition
+		{
+			std::cerr << "Couldn't write cached normal map " << cachedPath << std::endl;
+			return normals;
+		}
+
+		file.write(reinterpret_cast< const char * >(&expected), sizeof(expected));
+		file.write(reinterpret_cast< const char * >(normals.colors()), std::streamsize(dataSize));
+
+		return normals;
+	}
+
+	std::string NormalMapGenerator::getCachedPath(const std::string& heightMapPath)
+	{
+		size_t extension = heightMapPath.find_last_of('.');
+		size_t separator = heightMapPath.find_last_of("/\\");
+
+		if (extension == std::string::npos || (separator != std::string::npos && extension < separator))
+			return heightMapPath + ".nrm";
+
+		return heightMapPath.substr(0, extension) + ".nrm";
+	}
+}
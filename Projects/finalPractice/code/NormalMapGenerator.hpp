@@ -0,0 +1,95 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef NORMALMAPGENERATOR_HEADER
+#define NORMALMAPGENERATOR_HEADER
+
+
+
+#include "Color.hpp"
+#include "ColorBuffer.hpp"
+
+
+
+#include <cstdint>
+#include <glm.hpp>
+#include <string>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// NormalMapGenerator computes the normal map of a height map on the CPU with the Sobel operator
+	/// (8 texels per iteration with SSE2 when the compiler targets it), so the terrain shader reads a normal
+	/// instead of sampling the height map around every vertex. The normals only depend on the height map and
+	/// on the size of its texels, so they are cached in a file next to the height map (same name with the
+	/// ".nrm" extension) and generated again when the height map changes.
+	/// </summary>
+	class NormalMapGenerator
+	{
+		private:
+
+			/// <summary>
+			/// Header at the start of a cached file, followed by the normals row by row.
+			/// </summary>
+			struct Header
+			{
+				char	   magic[4];								///< Identifier of the file ("NRM1").
+				uint32_t	  width;								///< Width of the normal map in texels.
+				uint32_t	 height;								///< Height of the normal map in texels.
+				float	 texelWidth;								///< Size of a texel along x the normals were computed with.
+				float	 texelDepth;								///< Size of a texel along z the normals were computed with.
+				float	 heightStep;								///< Height of a step of the samples the normals were computed with.
+			};
+
+			static const char magic[4];								///< Identifier at the start of a cached file.
+
+		public:
+
+			/// <summary>
+			/// Computes the normal of every texel of a height map from the Sobel gradient of its 3x3 neighborhood
+			/// (the height map is clamped at its edges).
+			/// </summary>
+			///
+			/// <param name="heights">The samples of the height map, row by row.</param>
+			/// <param name="texelSize">Distance between two samples along x and z.</param>
+			/// <param name="heightStep">Height difference between two consecutive sample values.</param>
+			///
+			/// <returns>The normals, with the same size as the height map.</returns>
+			static ColorBuffer< NormalXz88 > generate(const ColorBuffer< Monochrome8 >& heights, glm::vec2 texelSize, float heightStep);
+
+			/// <summary>
+			/// Reads the normal map cached next to a height map, or generates it and writes the cache when it
+			/// doesn't exist, is older than the height map or was computed with other sizes.
+			/// </summary>
+			///
+			/// <param name="heightMapPath">The file path of the height map.</param>
+			/// <param name="heights">The samples of the height map, row by row.</param>
+			/// <param name="texelSize">Distance between two samples along x and z.</param>
+			/// <param name="heightStep">Height difference between two consecutive sample values.</param>
+			///
+			/// <returns>The normals, with the same size as the height map.</returns>
+			static ColorBuffer< NormalXz88 > load(const std::string& heightMapPath, const ColorBuffer< Monochrome8 >& heights, glm::vec2 texelSize, float heightStep);
+
+			/// <summary>
+			/// Returns the path of the cached normal map of a height map.
+			/// </summary>
+			///
+			/// <param name="heightMapPath">The file path of the height map.</param>
+			///
+			/// <returns>The same path with the ".nrm" extension.</returns>
+			static std::string getCachedPath(const std::string& heightMapPath);
+	};
+}
+
+
+
+#endif
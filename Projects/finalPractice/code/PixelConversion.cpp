@@ -0,0 +1,676 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "PixelConversion.hpp"
+
+
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if !defined(PIXELCONVERSION_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define PIXELCONVERSION_SSE2
+#include <emmintrin.h>
+#endif
+
+#if !defined(PIXELCONVERSION_NO_SIMD) && defined(__AVX2__) && (defined(__F16C__) || defined(_MSC_VER))
+#define PIXELCONVERSION_AVX2
+#include <immintrin.h>
+#endif
+
+
+
+namespace finalPractice
+{
+	static_assert(sizeof(Rgb888  ) == 3, "Rgb888 must be tightly packed");
+	static_assert(sizeof(RgbaHalf) == 8, "RgbaHalf must be tightly packed");
+
+	static const unsigned srgbEncodeSize = 16384;									// Entries of the table that encodes linear values to sRGB
+
+	// Luminance weights in 8-bit fixed point (0.2126, 0.7152 and 0.0722 scaled to add up to 256)
+	static const int lumaRed   =  54;
+	static const int lumaGreen = 183;
+	static const int lumaBlue  =  19;
+
+	// Linear value of every sRGB component
+	static const float * getSrgbDecodeTable()
+	{
+		static const struct Table
+		{
+			float values[256];
+
+			Table()
+			{
+				for (unsigned i = 0; i < 256; ++i)
+				{
+					float value = float(i) / 255.f;
+
+					values[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+				}
+			}
+		}
+		table;
+
+		return table.values;
+	}
+
+	// sRGB component of srgbEncodeSize linear values evenly spread over [0, 1]
+	static const uint8_t * getSrgbEncodeTable()
+	{
+		static const struct Table
+		{
+			uint8_t values[srgbEncodeSize];
+
+			Table()
+			{
+				for (unsigned i = 0; i < srgbEncodeSize; ++i)
+				{
+					float value   = float(i) / float(srgbEncodeSize - 1);
+					float encoded = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+
+					values[i] = uint8_t(encoded * 255.f + 0.5f);
+				}
+			}
+		}
+		table;
+
+		return table.values;
+	}
+
+	// Clamps a value to [0, 1], turning NaN into 0 like the SSE min and max do
+	static inline float saturate(float value)
+	{
+		return value > 0.f ? (value < 1.f ? value : 1.f) : 0.f;
+	}
+
+
+
+	#ifdef PIXELCONVERSION_SSE2
+
+	// Converts the half floats in the low 16 bits of every lane to floats (denormals, infinities and NaN included)
+	static inline __m128 halfToFloat(__m128i halves)
+	{
+		const __m128i noSign      = _mm_set1_epi32(0x7fff);
+		const __m128  magic       = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+		const __m128i maxFinite   = _mm_set1_epi32(0x7bff);
+		const __m128i infNanBits  = _mm_set1_epi32(255 << 23);
+
+		__m128i exponentMantissa = _mm_and_si128(halves, noSign);
+		__m128i sign             = _mm_slli_epi32(_mm_xor_si128(halves, exponentMantissa), 16);
+
+		// Moving the bits into place and scaling by 2^112 rebiases the exponent (and normalizes denormals)
+		__m128 scaled   = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(exponentMantissa, 13)), magic);
+		__m128i infNan  = _mm_and_si128(_mm_cmpgt_epi32(exponentMantissa, maxFinite), infNanBits);
+
+		return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infNan)));
+	}
+
+	// Converts floats to half floats rounded to nearest even, returned sign extended in every lane so they can be packed
+	static inline __m128i floatToHalf(__m128 values)
+	{
+		const __m128i signMask       = _mm_set1_epi32(int(0x80000000u));
+		const __m128i halfOverflow   = _mm_set1_epi32((127 + 16) << 23);
+		const __m128i nanBit         = _mm_set1_epi32(0x200);
+		const __m128i infinity       = _mm_set1_epi32(0x7c00);
+		const __m128i minNormal      = _mm_set1_epi32((127 - 14) << 23);
+		const __m128i subnormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+		const __m128i normalBias     = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+
+		__m128  sign     = _mm_and_ps(values, _mm_castsi128_ps(signMask));
+		__m128  absolute = _mm_xor_ps(values, sign);
+		__m128i bits     = _mm_castps_si128(absolute);
+
+		__m128i isNan       = _mm_castps_si128(_mm_cmpunord_ps(absolute, absolute));
+		__m128i isRegular   = _mm_cmpgt_epi32(halfOverflow, bits);
+		__m128i isSubnormal = _mm_cmpgt_epi32(minNormal, bits);
+		__m128i infOrNan    = _mm_or_si128(_mm_and_si128(isNan, nanBit), infinity);
+
+		// Subnormal results: the float addition aligns and rounds the mantissa
+		__m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absolute, _mm_castsi128_ps(subnormalMagic))), subnormalMagic);
+
+		// Normal results: rebias the exponent and round the mantissa to nearest even
+		__m128i mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(bits, 31 - 13), 31);
+		__m128i normal      = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(bits, normalBias), mantissaOdd), 13);
+
+		__m128i finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+		__m128i joined = _mm_or_si128(_mm_and_si128(isRegular, finite), _mm_andnot_si128(isRegular, infOrNan));
+
+		return _mm_or_si128(joined, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+	}
+
+	// Clamps to [0, 1], scales and rounds floats to integers
+	static inline __m128i quantize(__m128 values, float scale)
+	{
+		__m128 clamped = _mm_min_ps(_mm_max_ps(values, _mm_setzero_ps()), _mm_set1_ps(1.f));
+
+		return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, _mm_set1_ps(scale)), _mm_set1_ps(0.5f)));
+	}
+
+	// Luminance of 4 RGBA pixels, one per 32-bit lane
+	static inline __m128i luminance(__m128i pixels)
+	{
+		const __m128i weights = _mm_set_epi16(0, lumaBlue, lumaGreen, lumaRed, 0, lumaBlue, lumaGreen, lumaRed);
+
+		__m128i low  = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, _mm_setzero_si128()), weights);
+		__m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, _mm_setzero_si128()), weights);
+
+		// Every pixel left two partial sums (red and green, blue): add them
+		__m128 redGreen = _mm_shuffle_ps(_mm_castsi128_ps(low), _mm_castsi128_ps(high), _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 blue     = _mm_shuffle_ps(_mm_castsi128_ps(low), _mm_castsi128_ps(high), _MM_SHUFFLE(3, 1, 3, 1));
+
+		__m128i sum = _mm_add_epi32(_mm_castps_si128(redGreen), _mm_castps_si128(blue));
+
+		return _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8);
+	}
+
+	// Premultiplies 2 RGBA pixels unpacked to 16-bit components
+	static inline __m128i premultiply(__m128i components)
+	{
+		const __m128i colorMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+		const __m128i alphaOne  = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+
+		// The alpha of every pixel multiplies its colors and 255 its alpha, which leaves it unchanged
+		__m128i alpha  = _mm_shufflehi_epi16(_mm_shufflelo_epi16(components, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		__m128i factor = _mm_or_si128(_mm_and_si128(alpha, colorMask), alphaOne);
+
+		// x / 255 rounded to nearest as (t + (t >> 8)) >> 8 with t = x + 128
+		__m128i product = _mm_add_epi16(_mm_mullo_epi16(components, factor), _mm_set1_epi16(128));
+
+		return _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+	}
+
+	#endif
+
+
+
+	void PixelConversion::convert(const Rgba8888 * source, Rgb888 * target, size_t count)
+	{
+		size_t i = 0;
+
+		#ifdef PIXELCONVERSION_SSE2
+
+		// 16 pixels per iteration: 64 bytes in, 48 bytes out
+		const __m128i rgbMask      = _mm_set1_epi32(0x00ffffff);
+		const __m128i lowPixelMask = _mm_set1_epi64x(0x0000000000ffffffll);
+		const __m128i highPixelMask = _mm_set1_epi64x(0x00ffffff00000000ll);
+
+		auto compact = [&](__m128i pixels)
+		{
+			// Every 64-bit half keeps its 6 bytes of color at its bottom, then the upper half is moved next to the lower one
+			__m128i colors = _mm_and_si128(pixels, rgbMask);
+			__m128i halves = _mm_or_si128(_mm_and_si128(colors, lowPixelMask), _mm_srli_epi64(_mm_and_si128(colors, highPixelMask), 8));
+
+			return _mm_or_si128(_mm_move_epi64(halves), _mm_srli_si128(_mm_unpackhi_epi64(_mm_setzero_si128(), halves), 2));
+		};
+
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i * input  = reinterpret_cast< const __m128i * >(source + i);
+			__m128i		  * output = reinterpret_cast< __m128i * >(target + i);
+
+			__m128i c0 = compact(_mm_loadu_si128(input + 0));
+			__m128i c1 = compact(_mm_loadu_si128(input + 1));
+			__m128i c2 = compact(_mm_loadu_si128(input + 2));
+			__m128i c3 = compact(_mm_loadu_si128(input + 3));
+
+			_mm_storeu_si128(output + 0, _mm_or_si128(c0, _mm_slli_si128(c1, 12)));
+			_mm_storeu_si128(output + 1, _mm_or_si128(_mm_srli_si128(c1, 4), _mm_slli_si128(c2, 8)));
+			_mm_storeu_si128(output + 2, _mm_or_si128(_mm_srli_si128(c2, 8), _mm_slli_si128(c3, 4)));
+		}
+
+		#endif
+
+		for (; i < count; ++i)
+		{
+			target[i].components[Rgb888::RED  ] = source[i].components[Rgba8888::RED  ];
+			target[i].components[Rgb888::GREEN] = source[i].components[Rgba8888::GREEN];
+			target[i].components[Rgb888::BLUE ] = source[i].components[Rgba8888::BLUE ];
+		}
+	}
+
+	void PixelConversion::convert(const Rgb888 * source, Rgba8888 * target, size_t count)
+	{
+		size_t i = 0;
+
+		#ifdef PIXELCONVERSION_SSE2
+
+		// 16 pixels per iteration: 48 bytes in, 64 bytes out
+		const __m128i lowBytesMask  = _mm_set_epi32(0, 0, 0x0000ffff, -1);
+		const __m128i highBytesMask = _mm_set_epi32(0x0000ffff, -1, 0, 0);
+		const __m128i lowPixelMask  = _mm_set1_epi64x(0x0000000000ffffffll);
+		const __m128i highPixelMask = _mm_set1_epi64x(0x00ffffff00000000ll);
+		const __m128i opaque        = _mm_set1_epi32(int(0xff000000u));
+
+		auto expand = [&](__m128i colors)
+		{
+			// The 12 bytes of 4 pixels are split in two halves of 6 bytes, then every half in two pixels
+			__m128i halves = _mm_or_si128(_mm_and_si128(colors, lowBytesMask), _mm_and_si128(_mm_slli_si128(colors, 2), highBytesMask));
+			__m128i pixels = _mm_or_si128(_mm_and_si128(halves, lowPixelMask), _mm_and_si128(_mm_slli_epi64(halves, 8), highPixelMask));
+
+			return _mm_or_si128(pixels, opaque);
+		};
+
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i * input  = reinterpret_cast< const __m128i * >(source + i);
+			__m128i		  * output = reinterpret_cast< __m128i * >(target + i);
+
+			__m128i s0 = _mm_loadu_si128(input + 0);
+			__m128i s1 = _mm_loadu_si128(input + 1);
+			__m128i s2 = _mm_loadu_si128(input + 2);
+
+			_mm_storeu_si128(output + 0, expand(s0));
+			_mm_storeu_si128(output + 1, expand(_mm_or_si128(_mm_srli_si128(s0, 12), _mm_slli_si128(s1, 4))));
+			_mm_storeu_si128(output + 2, expand(_mm_or_si128(_mm_srli_si128(s1,  8), _mm_slli_si128(s2, 8))));
+			_mm_storeu_si128(output + 3, expand(_mm_srli_si128(s2, 4)));
+		}
+
+		#endif
+
+		for (; i < count; ++i)
+		{
+			target[i].components[Rgba8888::RED  ] = source[i].components[Rgb888::RED  ];
+			target[i].components[Rgba8888::GREEN] = source[i].components[Rgb888::GREEN];
+			target[i].components[Rgba8888::BLUE ] = source[i].components[Rgb888::BLUE ];
+			target[i].components[Rgba8888::ALPHA] = 255;
+		}
+	}
+
+	void PixelConversion::convert(const Rgba8888 * source, Monochrome8 * target, size_t count)
+	{
+		size_t i = 0;
+
+		#ifdef PIXELCONVERSION_AVX2
+
+		const __m256i weights = _mm256_set_epi16(0, lumaBlue, lumaGreen, lumaRed, 0, lumaBlue, lumaGreen, lumaRed, 0, lumaBlue, lumaGreen, lumaRed, 0, lumaBlue, lumaGreen, lumaRed);
+
+		auto luminance8 = [&](__m256i pixels)
+		{
+			__m256i low  = _mm256_madd_epi16(_mm256_unpacklo_epi8(pixels, _mm256_setzero_si256()), weights);
+			__m256i high = _mm256_madd_epi16(_mm256_unpackhi_epi8(pixels, _mm256_setzero_si256()), weights);
+
+			__m256 redGreen = _mm256_shuffle_ps(_mm256_castsi256_ps(low), _mm256_castsi256_ps(high), _MM_SHUFFLE(2, 0, 2, 0));
+			__m256 blue     = _mm256_shuffle_ps(_mm256_castsi256_ps(low), _mm256_castsi256_ps(high), _MM_SHUFFLE(3, 1, 3, 1));
+
+			__m256i sum = _mm256_add_epi32(_mm256_castps_si256(redGreen), _mm256_castps_si256(blue));
+
+			return _mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(128)), 8);
+		};
+
+		// 16 pixels per iteration (the packs work inside 128-bit lanes, so the results are permuted back in order)
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m256i * input = reinterpret_cast< const __m256i * >(source + i);
+
+			__m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(luminance8(_mm256_loadu_si256(input)), luminance8(_mm256_loadu_si256(input + 1))), _MM_SHUFFLE(3, 1, 2, 0));
+			__m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), _MM_SHUFFLE(3, 1, 2, 0));
+
+			_mm_storeu_si128(reinterpret_cast< __m128i * >(target + i), _mm256_castsi256_si128(bytes));
+		}
+
+		#endif
+
+		#ifdef PIXELCONVERSION_SSE2
+
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m128i * input = reinterpret_cast< const __m128i * >(source + i);
+
+			__m128i low  = _mm_packs_epi32(luminance(_mm_loadu_si128(input + 0)), luminance(_mm_loadu_si128(input + 1)));
+			__m128i high = _mm_packs_epi32(luminance(_mm_loadu_si128(input + 2)), luminance(_mm_loadu_si128(input + 3)));
+
+			_mm_storeu_si128(reinterpret_cast< __m128i * >(target + i), _mm_packus_epi16(low, high));
+		}
+
+		#endif
+
+		for (; i < count; ++i)
+		{
+			const uint8_t * color = source[i].components;
+
+			target[i] = Monochrome8((lumaRed * color[Rgba8888::RED] + lumaGreen * color[Rgba8888::GREEN] + lumaBlue * color[Rgba8888::BLUE] + 128) >> 8);
+		}
+	}
+
+	void PixelConversion::convert(const Rgba8888 * source, RgbaHalf * target, size_t count)
+	{
+		size_t i = 0;
+
+		#ifdef PIXELCONVERSION_AVX2
+
+		// 2 pixels (8 components) per iteration with the F16C conversion
+		for (; i + 2 <= count; i += 2)
+		{
+			__m256i components = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast< const __m128i * >(source + i)));
+			__m256  values     = _mm256_mul_ps(_mm256_cvtepi32_ps(components), _mm256_set1_ps(1.f / 255.f));
+
+			_mm_storeu_si128(reinterpret_cast< __m128i * >(target + i), _mm256_cvtps_ph(values, _MM_FROUND_TO_NEAREST_INT));
+		}
+
+		#endif
+
+		#ifdef PIXELCONVERSION_SSE2
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast< const __m128i * >(source + i));
+			__m128i low    = _mm_unpacklo_epi8(pixels, _mm_setzero_si128());
+			__m128i high   = _mm_unpackhi_epi8(pixels, _mm_setzero_si128());
+
+			auto toHalf = [](__m128i components)
+			{
+				return floatToHalf(_mm_mul_ps(_mm_cvtepi32_ps(components), _mm_set1_ps(1.f / 255.f)));
+			};
+
+			__m128i * output = reinterpret_cast< __m128i * >(target + i);
+
+			_mm_storeu_si128(output + 0, _mm_packs_epi32(toHalf(_mm_unpacklo_epi16(low , _mm_setzero_si128())), toHalf(_mm_unpackhi_epi16(low , _mm_setzero_si128()))));
+			_mm_storeu_si128(output + 1, _mm_packs_epi32(toHalf(_mm_unpacklo_epi16(high, _mm_setzero_si128())), toHalf(_mm_unpackhi_epi16(high, _mm_setzero_si128()))));
+		}
+
+		#endif
+
+		for (; i < count; ++i)
+			for (int c = 0; c < 4; ++c)
+				target[i].components[c] = half_float::half(float(source[i].components[c]) * (1.f / 255.f));
+	}
+
+	void PixelConversion::convert(const RgbaHalf * source, Rgba8888 * target, size_t count)
+	{
+		size_t i = 0;
+
+		#ifdef PIXELCONVERSION_AVX2
+
+		// 2 pixels (8 components) per iteration with the F16C conversion
+		for (; i + 2 <= count; i += 2)
+		{
+			__m256 values  = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast< const __m128i * >(source + i)));
+			__m256 clamped = _mm256_min_ps(_mm256_max_ps(values, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+
+			__m256i components = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(clamped, _mm256_set1_ps(255.f)), _mm256_set1_ps(0.5f)));
+			__m128i words      = _mm_packs_epi32(_mm256_castsi256_si128(components), _mm256_extracti128_si256(components, 1));
+
+			_mm_storel_epi64(reinterpret_cast< __m128i * >(target + i), _mm_packus_epi16(words, words));
+		}
+
+		#endif
+
+		#ifdef PIXELCONVERSION_SSE2
+
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128i * input = reinterpret_cast< const __m128i * >(source + i);
+
+			auto toComponents = [](__m128i halves)
+			{
+				__m128i low  = quantize(halfToFloat(_mm_unpacklo_epi16(halves, _mm_setzero_si128())), 255.f);
+				__m128i high = quantize(halfToFloat(_mm_unpackhi_epi16(halves, _mm_setzero_si128())), 255.f);
+
+				return _mm_packs_epi32(low, high);
+			};
+
+			__m128i words0 = toComponents(_mm_loadu_si128(input + 0));
+			__m128i words1 = toComponents(_mm_loadu_si128(input + 1));
+
+			_mm_storeu_si128(reinterpret_cast< __m128i * >(target + i), _mm_packus_epi16(words0, words1));
+		}
+
+		#endif
+
+		for (; i < count; ++i)
+			for (int c = 0; c < 4; ++c)
+				target[i].components[c] = uint8_t(saturate(float(source[i].components[c])) * 255.f + 0.5f);
+	}
+
+	void PixelConversion::premultiplyAlpha(Rgba8888 * colors, size_t count)
+	{
+		size_t i = 0;
+
+		#ifdef PIXELCONVERSION_AVX2
+
+		const __m256i colorMask = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1);
+		const __m256i alphaOne  = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+
+		auto premultiply4 = [&](__m256i components)
+		{
+			__m256i alpha   = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(components, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+			__m256i factor  = _mm256_or_si256(_mm256_and_si256(alpha, colorMask), alphaOne);
+			__m256i product = _mm256_add_epi16(_mm256_mullo_epi16(components, factor), _mm256_set1_epi16(128));
+
+			return _mm256_srli_epi16(_mm256_add_epi16(product, _mm256_srli_epi16(product, 8)), 8);
+		};
+
+		// 8 pixels per iteration (unpack and pack work inside 128-bit lanes, so the order is preserved)
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i * pixels = reinterpret_cast< __m256i * >(colors + i);
+			__m256i   loaded = _mm256_loadu_si256(pixels);
+
+			__m256i low  = premultiply4(_mm256_unpacklo_epi8(loaded, _mm256_setzero_si256()));
+			__m256i high = premultiply4(_mm256_unpackhi_epi8(loaded, _mm256_setzero_si256()));
+
+			_mm256_storeu_si256(pixels, _mm256_packus_epi16(low, high));
+		}
+
+		#endif
+
+		#ifdef PIXELCONVERSION_SSE2
+
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i * pixels = reinterpret_cast< __m128i * >(colors + i);
+			__m128i   loaded = _mm_loadu_si128(pixels);
+
+			__m128i low  = premultiply(_mm_unpacklo_epi8(loaded, _mm_setzero_si128()));
+			__m128i high = premultiply(_mm_unpackhi_epi8(loaded, _mm_setzero_si128()));
+
+			_mm_storeu_si128(pixels, _mm_packus_epi16(low, high));
+		}
+
+		#endif
+
+		for (; i < count; ++i)
+		{
+			unsigned alpha = colors[i].components[Rgba8888::ALPHA];
+
+			for (int c = 0; c < 3; ++c)
+			{
+				unsigned product = colors[i].components[c] * alpha + 128;
+
+				colors[i].components[c] = uint8_t((product + (product >> 8)) >> 8);
+			}
+		}
+	}
+
+	void PixelConversion::srgbToLinear(const Rgba8888 * source, RgbaHalf * target, size_t count)
+	{
+		const float * decode = getSrgbDecodeTable();
+
+		size_t i = 0;
+
+		#ifdef PIXELCONVERSION_AVX2
+
+		// 2 pixels per iteration: the colors are gathered from the table and the alphas normalized
+		for (; i + 2 <= count; i += 2)
+		{
+			__m256i components = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast< const __m128i * >(source + i)));
+			__m256  colors     = _mm256_i32gather_ps(decode, components, 4);
+			__m256  alphas     = _mm256_mul_ps(_mm256_cvtepi32_ps(components), _mm256_set1_ps(1.f / 255.f));
+
+			_mm_storeu_si128(reinterpret_cast< __m128i * >(target + i), _mm256_cvtps_ph(_mm256_blend_ps(colors, alphas, 0x88), _MM_FROUND_TO_NEAREST_INT));
+		}
+
+		#endif
+
+		#ifdef PIXELCONVERSION_SSE2
+
+		// 2 pixels per iteration: the table is read one component at a time, the half conversion is vectorized
+		for (; i + 2 <= count; i += 2)
+		{
+			auto decodePixel = [decode](const Rgba8888& color)
+			{
+				const uint8_t * c = color.components;
+
+				return floatToHalf(_mm_set_ps(float(c[Rgba8888::ALPHA]) * (1.f / 255.f), decode[c[Rgba8888::BLUE]], decode[c[Rgba8888::GREEN]], decode[c[Rgba8888::RED]]));
+			};
+
+			_mm_storeu_si128(reinterpret_cast< __m128i * >(target + i), _mm_packs_epi32(decodePixel(source[i]), decodePixel(source[i + 1])));
+		}
+
+		#endif
+
+		for (; i < count; ++i)
+		{
+			for (int c = 0; c < 3; ++c)
+				target[i].components[c] = half_float::half(decode[source[i].components[c]]);
+
+			target[i].components[Rgba8888::ALPHA] = half_float::half(float(source[i].components[Rgba8888::ALPHA]) * (1.f / 255.f));
+		}
+	}
+
+	void PixelConversion::linearToSrgb(const RgbaHalf * source, Rgba8888 * target, size_t count)
+	{
+		const uint8_t * encode = getSrgbEncodeTable();
+
+		size_t i = 0;
+
+		#ifdef PIXELCONVERSION_SSE2
+
+		// 2 pixels per iteration: the half conversion and quantization are vectorized, the table is read one component at a time
+		for (; i + 2 <= count; i += 2)
+		{
+			__m128i halves = _mm_loadu_si128(reinterpret_cast< const __m128i * >(source + i));
+
+			alignas(16) int32_t indices[8];
+			alignas(16) int32_t alphas [8];
+
+			__m128 low  = halfToFloat(_mm_unpacklo_epi16(halves, _mm_setzero_si128()));
+			__m128 high = halfToFloat(_mm_unpackhi_epi16(halves, _mm_setzero_si128()));
+
+			_mm_store_si128(reinterpret_cast< __m128i * >(indices + 0), quantize(low , float(srgbEncodeSize - 1)));
+			_mm_store_si128(reinterpret_cast< __m128i * >(indices + 4), quantize(high, float(srgbEncodeSize - 1)));
+			_mm_store_si128(reinterpret_cast< __m128i * >(alphas  + 0), quantize(low , 255.f));
+			_mm_store_si128(reinterpret_cast< __m128i * >(alphas  + 4), quantize(high, 255.f));
+
+			for (int p = 0; p < 2; ++p)
+			{
+				for (int c = 0; c < 3; ++c)
+					target[i + p].components[c] = encode[indices[p * 4 + c]];
+
+				target[i + p].components[Rgba8888::ALPHA] = uint8_t(alphas[p * 4 + Rgba8888::ALPHA]);
+			}
+		}
+
+		#endif
+
+		for (; i < count; ++i)
+		{
+			for (int c = 0; c < 3; ++c)
+				target[i].components[c] = encode[unsigned(saturate(float(source[i].components[c])) * float(srgbEncodeSize - 1) + 0.5f)];
+
+			target[i].components[Rgba8888::ALPHA] = uint8_t(saturate(float(source[i].components[Rgba8888::ALPHA])) * 255.f + 0.5f);
+		}
+	}
+
+
+
+	// Converts pixels all at once and then one at a time, which only runs the scalar loop, and compares the results
+	template< typename SOURCE, typename TARGET >
+	static bool matchesScalar(void (*kernel)(const SOURCE *, TARGET *, size_t), const std::vector< SOURCE > & source, size_t first, size_t count)
+	{
+		std::vector< TARGET > vectorized(count + 1);
+		std::vector< TARGET >	  scalar(count + 1);
+
+		kernel(source.data() + first, vectorized.data(), count);
+
+		for (size_t i = 0; i < count; ++i)
+			kernel(source.data() + first + i, scalar.data() + i, 1);
+
+		return std::memcmp(vectorized.data(), scalar.data(), count * sizeof(TARGET)) == 0;
+	}
+
+	static bool matchesScalarInPlace(const std::vector< Rgba8888 > & source, size_t first, size_t count)
+	{
+		std::vector< Rgba8888 > vectorized(source.begin() + first, source.begin() + first + count);
+		std::vector< Rgba8888 >		scalar(vectorized);
+
+		PixelConversion::premultiplyAlpha(vectorized.data(), count);
+
+		for (size_t i = 0; i < count; ++i)
+			PixelConversion::premultiplyAlpha(scalar.data() + i, 1);
+
+		return std::memcmp(vectorized.data(), scalar.data(), count * sizeof(Rgba8888)) == 0;
+	}
+
+	bool PixelConversion::verify()
+	{
+		const size_t poolSize = 1100;
+
+		// Deterministic pseudo-random pixels, with the half floats a little outside [0, 1] to exercise the clamps
+		std::vector< Rgba8888 > rgba (poolSize);
+		std::vector< Rgb888	  > rgb	 (poolSize);
+		std::vector< RgbaHalf > halfs(poolSize);
+
+		uint32_t seed = 12345;
+
+		auto next = [&seed]() { seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+
+		for (size_t i = 0; i < poolSize; ++i)
+		{
+			for (int c = 0; c < 4; ++c)
+			{
+				rgba [i].components[c] = uint8_t(next());
+				halfs[i].components[c] = half_float::half(float(next() % 6001) / 4000.f - .25f);
+			}
+
+			for (int c = 0; c < 3; ++c)
+				rgb[i].components[c] = uint8_t(next());
+		}
+
+		const char * names[] = { "RGBA to RGB", "RGB to RGBA", "RGBA to luminance", "RGBA to half", "half to RGBA", "premultiplyAlpha", "srgbToLinear", "linearToSrgb" };
+		bool		 failed[8] = {};
+
+		const size_t longCounts[] = { 127, 128, 129, 1021 };
+
+		auto check = [&](size_t first, size_t count)
+		{
+			failed[0] |= not matchesScalar< Rgba8888, Rgb888	  >(convert		, rgba , first, count);
+			failed[1] |= not matchesScalar< Rgb888	, Rgba8888	  >(convert		, rgb  , first, count);
+			failed[2] |= not matchesScalar< Rgba8888, Monochrome8 >(convert		, rgba , first, count);
+			failed[3] |= not matchesScalar< Rgba8888, RgbaHalf	  >(convert		, rgba , first, count);
+			failed[4] |= not matchesScalar< RgbaHalf, Rgba8888	  >(convert		, halfs, first, count);
+			failed[5] |= not matchesScalarInPlace					(				  rgba , first, count);
+			failed[6] |= not matchesScalar< Rgba8888, RgbaHalf	  >(srgbToLinear, rgba , first, count);
+			failed[7] |= not matchesScalar< RgbaHalf, Rgba8888	  >(linearToSrgb, halfs, first, count);
+		};
+
+		// Every tail after 16 and 32 pixel iterations, from an aligned and an unaligned first pixel
+		for (size_t first = 0; first < 2; ++first)
+		{
+			for (size_t count = 0; count <= 70; ++count)
+				check(first, count);
+
+			for (size_t count : longCounts)
+				check(first, count);
+		}
+
+		bool matches = true;
+
+		for (int i = 0; i < 8; ++i)
+		{
+			if (failed[i]) // ERROR condition
+			{
+				std::cerr << "The " << names[i] << " kernel doesn't match its scalar loop" << std::endl;
+				matches = false;
+			}
+		}
+
+		return matches;
+	}
+}
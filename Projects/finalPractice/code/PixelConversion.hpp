@@ -0,0 +1,121 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef PIXELCONVERSION_HEADER
+#define PIXELCONVERSION_HEADER
+
+
+
+#include "Color.hpp"
+
+
+
+#include <cstddef>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// PixelConversion holds the kernels that convert arrays of pixels between color formats. Every kernel
+	/// processes as many pixels as it can with AVX2 (when the compiler targets it) and SSE2, and finishes the
+	/// remaining ones with a scalar loop, which is also the reference the vectorized paths must match exactly.
+	/// Defining PIXELCONVERSION_NO_SIMD builds the scalar loops only.
+	/// </summary>
+	class PixelConversion
+	{
+		public:
+
+			/// <summary>
+			/// Drops the alpha component of RGBA pixels.
+			/// </summary>
+			///
+			/// <param name="source">The pixels to convert.</param>
+			/// <param name="target">Receives the converted pixels.</param>
+			/// <param name="count">Number of pixels.</param>
+			static void convert(const Rgba8888 * source, Rgb888 * target, size_t count);
+
+			/// <summary>
+			/// Expands RGB pixels to RGBA with an opaque alpha.
+			/// </summary>
+			///
+			/// <param name="source">The pixels to convert.</param>
+			/// <param name="target">Receives the converted pixels.</param>
+			/// <param name="count">Number of pixels.</param>
+			static void convert(const Rgb888 * source, Rgba8888 * target, size_t count);
+
+			/// <summary>
+			/// Computes the luminance of RGBA pixels with the Rec. 709 weights (in 8-bit fixed point).
+			/// </summary>
+			///
+			/// <param name="source">The pixels to convert.</param>
+			/// <param name="target">Receives the luminance of every pixel.</param>
+			/// <param name="count">Number of pixels.</param>
+			static void convert(const Rgba8888 * source, Monochrome8 * target, size_t count);
+
+			/// <summary>
+			/// Converts 8-bit normalized components to half floats in the [0, 1] range (no color space change).
+			/// </summary>
+			///
+			/// <param name="source">The pixels to convert.</param>
+			/// <param name="target">Receives the converted pixels.</param>
+			/// <param name="count">Number of pixels.</param>
+			static void convert(const Rgba8888 * source, RgbaHalf * target, size_t count);
+
+			/// <summary>
+			/// Converts half float components to 8-bit normalized ones, clamping them to the [0, 1] range
+			/// (no color space change).
+			/// </summary>
+			///
+			/// <param name="source">The pixels to convert.</param>
+			/// <param name="target">Receives the converted pixels.</param>
+			/// <param name="count">Number of pixels.</param>
+			static void convert(const RgbaHalf * source, Rgba8888 * target, size_t count);
+
+			/// <summary>
+			/// Multiplies the color components of RGBA pixels by their alpha (rounded to nearest).
+			/// </summary>
+			///
+			/// <param name="colors">The pixels to premultiply, in place.</param>
+			/// <param name="count">Number of pixels.</param>
+			static void premultiplyAlpha(Rgba8888 * colors, size_t count);
+
+			/// <summary>
+			/// Decodes sRGB pixels to linear light half floats (the alpha is normalized without decoding).
+			/// </summary>
+			///
+			/// <param name="source">The sRGB pixels.</param>
+			/// <param name="target">Receives the linear pixels.</param>
+			/// <param name="count">Number of pixels.</param>
+			static void srgbToLinear(const Rgba8888 * source, RgbaHalf * target, size_t count);
+
+			/// <summary>
+			/// Encodes linear light half floats to sRGB pixels, clamping them to the [0, 1] range (the alpha is
+			/// normalized without encoding).
+			/// </summary>
+			///
+			/// <param name="source">The linear pixels.</param>
+			/// <param name="target">Receives the sRGB pixels.</param>
+			/// <param name="count">Number of pixels.</param>
+			static void linearToSrgb(const RgbaHalf * source, Rgba8888 * target, size_t count);
+
+			/// <summary>
+			/// Checks that every kernel gives the same bytes as its scalar loop, on counts that leave every possible
+			/// tail after the vectorized pixels and on unaligned pixels. It is meant for debug builds (main asserts it).
+			/// </summary>
+			///
+			/// <returns>True if every kernel matches, false otherwise (the kernels that don't are reported).</returns>
+			static bool verify();
+	};
+}
+
+
+
+#endif
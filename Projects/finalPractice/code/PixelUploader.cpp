@@ -0,0 +1,152 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "PixelUploader.hpp"
+
+
+
+#include <cstring>
+
+
+
+namespace finalPractice
+{
+	PixelUploader::PixelUploader() :
+		nextSlot(0)
+	{
+		for (Slot & slot : slots)
+		{
+			glGenBuffers(1, &slot.pboID);
+
+			slot.capacity = 0;
+			slot.fence    = nullptr;
+		}
+	}
+
+	PixelUploader::~PixelUploader()
+	{
+		for (Slot & slot : slots)
+		{
+			if (slot.fence)
+				glDeleteSync(slot.fence);
+
+			glDeleteBuffers(1, &slot.pboID);
+		}
+	}
+
+
+
+	std::shared_ptr< PixelUploader > PixelUploader::acquire()
+	{
+		static std::weak_ptr< PixelUploader > shared;
+
+		auto uploader = shared.lock();
+
+		if (not uploader)
+		{
+			uploader = std::make_shared< PixelUploader >();
+			shared   = uploader;
+		}
+
+		return uploader;
+	}
+
+
+
+	void PixelUploader::upload(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void * pixels, size_t size)
+	{
+		Slot * slot = stage(pixels, size);
+
+		// With a PBO bound the last argument is an offset inside it
+		glTexImage2D(target, level, internalFormat, width, height, 0, format, type, slot ? nullptr : pixels);
+
+		finish(slot);
+	}
+
+	void PixelUploader::uploadCompressed(GLenum target, GLint level, GLenum internalFormat, GLsizei width, GLsizei height, const void * data, size_t size)
+	{
+		Slot * slot = stage(data, size);
+
+		glCompressedTexImage2D(target, level, internalFormat, width, height, 0, GLsizei(size), slot ? nullptr : data);
+
+		finish(slot);
+	}
+
+	void PixelUploader::uploadLayer(GLenum target, GLint level, GLint layer, GLsizei width, GLsizei height, GLenum format, GLenum type, const void * pixels, size_t size)
+	{
+		Slot * slot = stage(pixels, size);
+
+		glTexSubImage3D(target, level, 0, 0, layer, width, height, 1, format, type, slot ? nullptr : pixels);
+
+		finish(slot);
+	}
+
+
+
+	PixelUploader::Slot * PixelUploader::stage(const void * data, size_t size)
+	{
+		Slot & slot = slots[nextSlot];
+
+		nextSlot = (nextSlot + 1) % ringSize;
+
+		// The previous upload of this slot must be finished before its buffer is written again
+		waitFor(slot);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pboID);
+
+		if (size > slot.capacity)
+		{
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+
+			slot.capacity = size;
+		}
+
+		// The fence already guarantees the GPU isn't reading the buffer, so the map doesn't have to synchronize
+		void * mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+		if (mapped)
+		{
+			std::memcpy(mapped, data, size);
+
+			if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+				return &slot;
+		}
+
+		// ERROR condition: the buffer couldn't be mapped (or its contents were lost), upload from client memory
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		return nullptr;
+	}
+
+	void PixelUploader::finish(Slot * slot)
+	{
+		if (not slot)
+			return;
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+
+
+	void PixelUploader::waitFor(Slot& slot)
+	{
+		if (not slot.fence)
+			return;
+
+		// Flush the commands the first time so the fence is guaranteed to be signaled eventually
+		GLbitfield flags   = GL_SYNC_FLUSH_COMMANDS_BIT;
+		GLuint64   timeout = 1000000;										// 1 ms
+
+		while (glClientWaitSync(slot.fence, flags, timeout) == GL_TIMEOUT_EXPIRED)
+			flags = 0;
+
+		glDeleteSync(slot.fence);
+
+		slot.fence = nullptr;
+	}
+}
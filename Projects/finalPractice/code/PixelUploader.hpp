@@ -0,0 +1,159 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef PIXELUPLOADER_HEADER
+#define PIXELUPLOADER_HEADER
+
+
+
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+#include <memory>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// PixelUploader streams texture uploads through a ring of pixel buffer objects. The pixels are copied into
+	/// a mapped PBO and the texture is filled from it, so the driver can transfer them asynchronously instead of
+	/// copying them from client memory inside glTexImage2D. A fence after every upload tells when the GPU has
+	/// consumed the PBO, which is the only moment a slot of the ring is waited on before it is reused.
+	/// </summary>
+	class PixelUploader
+	{
+		public:
+
+			static const size_t ringSize = 4;					///< Number of pixel buffer objects in the ring.
+
+		private:
+
+			/// <summary>
+			/// A pixel buffer object of the ring and the fence of its last upload.
+			/// </summary>
+			struct Slot
+			{
+				GLuint				  pboID;					///< ID of the pixel buffer object.
+				size_t			   capacity;					///< Size of the buffer in bytes.
+				GLsync				  fence;					///< Fence signaled when the GPU finished the last upload (nullptr if none).
+			};
+
+		private:
+
+			Slot			 slots[ringSize];					///< The ring of pixel buffer objects.
+			size_t			 nextSlot;							///< Slot used by the next upload.
+
+		public:
+
+			/// <summary>
+			/// Creates the pixel buffer objects of the ring (their storage is allocated on first use).
+			/// </summary>
+			PixelUploader();
+
+			/// <summary>
+			/// Destructor that deletes the fences and the pixel buffer objects.
+			/// </summary>
+			~PixelUploader();
+
+		private:
+
+			// Delete the copy constructor and copy assignment operator to prevent copying
+			PixelUploader(const PixelUploader&) = delete;
+			PixelUploader& operator = (const PixelUploader&) = delete;
+
+		public:
+
+			/// <summary>
+			/// Returns the uploader shared by every texture, creating it on first use. It is released when the
+			/// last texture holding it is destroyed (which happens while the OpenGL context is still alive).
+			/// </summary>
+			///
+			/// <returns>A shared pointer to the uploader.</returns>
+			static std::shared_ptr< PixelUploader > acquire();
+
+			/// <summary>
+			/// Copies the pixels into the next pixel buffer object of the ring and fills a level of the texture
+			/// currently bound to target from it, without waiting for the transfer.
+			/// </summary>
+			///
+			/// <param name="target">Texture target (GL_TEXTURE_2D or a face of a cube map).</param>
+			/// <param name="level">Mip level to fill.</param>
+			/// <param name="internalFormat">Internal format of the texture.</param>
+			/// <param name="width">Width of the image in pixels.</param>
+			/// <param name="height">Height of the image in pixels.</param>
+			/// <param name="format">Format of the pixels.</param>
+			/// <param name="type">Type of the pixel components.</param>
+			/// <param name="pixels">The pixels to upload.</param>
+			/// <param name="size">Size of the pixels in bytes.</param>
+			void	 upload(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void * pixels, size_t size);
+
+			/// <summary>
+			/// Copies block compressed data into the next pixel buffer object of the ring and fills a level of the
+			/// texture currently bound to target from it with glCompressedTexImage2D.
+			/// </summary>
+			///
+			/// <param name="target">Texture target (GL_TEXTURE_2D or a face of a cube map).</param>
+			/// <param name="level">Mip level to fill.</param>
+			/// <param name="internalFormat">Compressed internal format of the texture.</param>
+			/// <param name="width">Width of the level in pixels.</param>
+			/// <param name="height">Height of the level in pixels.</param>
+			/// <param name="data">The compressed blocks to upload.</param>
+			/// <param name="size">Size of the compressed blocks in bytes.</param>
+			void	 uploadCompressed(GLenum target, GLint level, GLenum internalFormat, GLsizei width, GLsizei height, const void * data, size_t size);
+
+			/// <summary>
+			/// Copies the pixels of a layer into the next pixel buffer object of the ring and fills that layer of a
+			/// level of the array texture currently bound to target with glTexSubImage3D (the storage of the
+			/// level must have been allocated with glTexImage3D).
+			/// </summary>
+			///
+			/// <param name="target">Texture target (GL_TEXTURE_2D_ARRAY).</param>
+			/// <param name="level">Mip level to fill.</param>
+			/// <param name="layer">Layer to fill.</param>
+			/// <param name="width">Width of the level in pixels.</param>
+			/// <param name="height">Height of the level in pixels.</param>
+			/// <param name="format">Format of the pixels.</param>
+			/// <param name="type">Type of the pixel components.</param>
+			/// <param name="pixels">The pixels to upload.</param>
+			/// <param name="size">Size of the pixels in bytes.</param>
+			void	 uploadLayer(GLenum target, GLint level, GLint layer, GLsizei width, GLsizei height, GLenum format, GLenum type, const void * pixels, size_t size);
+
+		private:
+
+			/// <summary>
+			/// Copies data into the next slot of the ring, leaving its pixel buffer object bound.
+			/// </summary>
+			///
+			/// <param name="data">The data to copy.</param>
+			/// <param name="size">Size of the data in bytes.</param>
+			///
+			/// <returns>The slot holding the data, or nullptr if it couldn't be mapped (the upload reads client memory then).</returns>
+			Slot *	 stage(const void * data, size_t size);
+
+			/// <summary>
+			/// Unbinds the pixel buffer object after an upload has been issued and inserts the fence of the slot.
+			/// </summary>
+			///
+			/// <param name="slot">The slot returned by stage.</param>
+			void	 finish(Slot * slot);
+
+			/// <summary>
+			/// Waits until the GPU has consumed the last upload of a slot and deletes its fence.
+			/// </summary>
+			///
+			/// <param name="slot">The slot to wait for.</param>
+			static void waitFor(Slot& slot);
+	};
+}
+
+
+
+#endif
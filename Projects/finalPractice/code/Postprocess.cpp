@@ -1,4 +1,3 @@
-
 /*
     Public Domain Code
 
@@ -9,6 +8,7 @@
 
 
 
+#include <algorithm>
 #include <cassert>
 #include <glad/glad.h>
 
@@ -20,18 +20,17 @@ namespace finalPractice
 
         "#version 330\n"
         ""
-        "layout (location = 0) in vec3 vertex_coordinates;"
-        "layout (location = 1) in vec2 vertex_texture_uv;"
-        ""
         "out vec2 texture_uv;"
         ""
         "void main()"
         "{"
-        "   gl_Position = vec4(vertex_coordinates, 1.0);"
-        "   texture_uv  = vertex_texture_uv;"
+        "   vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;"   // (-1, -1), (3, -1) and (-1, 3) cover the screen
+        ""
+        "   gl_Position = vec4(corner, 0.0, 1.0);"
+        "   texture_uv  = corner * 0.5 + 0.5;"
         "}";
 
-    const std::string Postprocess::postprocessFragmentShaderCode =
+    const std::string Postprocess::sepiaShaderCode =
 
         "#version 330\n"
         ""
@@ -47,120 +46,190 @@ namespace finalPractice
         "    fragment_color = vec4(vec3(i, i, i) * vec3(1.0, 0.75, 0.5), 1.0);"
         "}";
 
-    
+    const std::string Postprocess::vignetteShaderCode =
+
+        "#version 330\n"
+        ""
+        "uniform sampler2D sampler2d;"
+        "uniform vec2      texel_size;"
+        ""
+        "in  vec2 texture_uv;"
+        "out vec4 fragment_color;"
+        ""
+        "void main()"
+        "{"
+        "    vec2  offset   = (texture_uv - 0.5) * vec2(texel_size.y / texel_size.x, 1.0);"   // Round whatever the aspect ratio of the window
+        "    float vignette = smoothstep(0.95, 0.35, length(offset));"
+        ""
+        "    fragment_color = vec4(texture(sampler2d, texture_uv).rgb * mix(0.55, 1.0, vignette), 1.0);"
+        "}";
+
+
 
     Postprocess::Postprocess(int _windowWidth, int _windowHeight) :
-        shader(postprocessVertexShaderCode, postprocessFragmentShaderCode),
         windowWidth (_windowWidth),
         windowHeight(_windowHeight)
     {
         buildFramebuffer();
+
+        resize(windowWidth, windowHeight);
     }
 
     Postprocess::~Postprocess()
     {
-        glDeleteVertexArrays(1, &framebufferQuadVAO);
-        glDeleteBuffers     (2, framebufferQuadVBOs);
+        glDeleteFramebuffers (1, &sceneFramebufferID);
+        glDeleteFramebuffers (2, pingPongFramebufferIDs);
+        glDeleteTextures     (1, &sceneTextureID);
+        glDeleteTextures     (2, pingPongTextureIDs);
+        glDeleteRenderbuffers(1, &depthbufferID);
+        glDeleteVertexArrays (1, &framebufferQuadVAO);
+    }
+
+
+
+    unsigned Postprocess::addEffect(const std::string & fragmentShaderCode, bool enabled)
+    {
+        Effect effect;
+
+        effect.shader      = std::make_unique< Shader >(postprocessVertexShaderCode, fragmentShaderCode);
+        effect.texelSizeID = glGetUniformLocation(effect.shader->getID(), "texel_size");
+        effect.enabled     = enabled;
+
+        effects.push_back(std::move(effect));
+
+        return unsigned(effects.size() - 1);
     }
 
 
 
     void Postprocess::buildFramebuffer()
     {
-        // Framebuffer creation
-        glGenFramebuffers(1, &framebufferID);
-        glBindFramebuffer(GL_FRAMEBUFFER, framebufferID);
-
-        //Frambuffer's texture creation
-        glGenTextures(1, &outTextureID);
-        glBindTexture(GL_TEXTURE_2D, outTextureID);
-
-        glTexImage2D
-        (
-            GL_TEXTURE_2D,
-            0,
-            GL_RGB,
-            framebufferWidth,
-            framebufferHeight,
-            0,
-            GL_RGB,
-            GL_UNSIGNED_BYTE,
-            0
-        );
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        // Framebuffers creation
+        glGenFramebuffers(1, &sceneFramebufferID);
+        glGenFramebuffers(2, pingPongFramebufferIDs);
+
+        // Framebuffers' textures creation (their storage is allocated by resize)
+        GLuint textureIDs[3];
+
+        glGenTextures(3, textureIDs);
+
+        sceneTextureID        = textureIDs[0];
+        pingPongTextureIDs[0] = textureIDs[1];
+        pingPongTextureIDs[1] = textureIDs[2];
+
+        for (GLuint textureID : textureIDs)
+        {
+            glBindTexture(GL_TEXTURE_2D, textureID);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
 
         // Z-buffer creation
         glGenRenderbuffers(1, &depthbufferID);
-        glBindRenderbuffer(GL_RENDERBUFFER, depthbufferID);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, framebufferWidth, framebufferHeight);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthbufferID);
-
-        // Framebuffer configuration
-        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, outTextureID, 0);
 
-        const GLenum draw_buffer = GL_COLOR_ATTACHMENT0;
+        // The passes draw a triangle generated from the vertex index, but a vertex array has to be bound to draw it
+        glGenVertexArrays(1, &framebufferQuadVAO);
+    }
 
-        glDrawBuffers(1, &draw_buffer);
+    void Postprocess::resize(int _windowWidth, int _windowHeight)
+    {
+        // A minimized window has no pixels, but the targets must stay complete
+        windowWidth  = std::max(_windowWidth , 1);
+        windowHeight = std::max(_windowHeight, 1);
 
-        assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+        // Half float colors keep the values above 1 and the precision of the dark ones from pass to pass
+        GLuint textureIDs[]     = { sceneTextureID,     pingPongTextureIDs[0],     pingPongTextureIDs[1]     };
+        GLuint framebufferIDs[] = { sceneFramebufferID, pingPongFramebufferIDs[0], pingPongFramebufferIDs[1] };
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthbufferID);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, windowWidth, windowHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
-        // Quad's mesh creation for rendering
-        static const GLfloat quadPositions[] =
-        {
-            +1.0f, -1.0f, 0.0f,
-            +1.0f, +1.0f, 0.0f,
-            -1.0f, +1.0f, 0.0f,
-            -1.0f, +1.0f, 0.0f,
-            -1.0f, -1.0f, 0.0f,
-            +1.0f, -1.0f, 0.0f,
-        };
-
-        static const GLfloat quadTextureUVs[] =
+        for (int i = 0; i < 3; ++i)
         {
-            +1.0f,  0.0f,
-            +1.0f, +1.0f,
-             0.0f, +1.0f,
-             0.0f, +1.0f,
-             0.0f,  0.0f,
-             1.0f,  0.0f,
-        };
+            glBindTexture(GL_TEXTURE_2D, textureIDs[i]);
+            glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA16F, windowWidth, windowHeight, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
 
-        glGenVertexArrays(1, &framebufferQuadVAO);
-        glGenBuffers(2, framebufferQuadVBOs);
+            // Framebuffer configuration (only the scene needs a depth buffer)
+            glBindFramebuffer(GL_FRAMEBUFFER, framebufferIDs[i]);
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, textureIDs[i], 0);
 
-        glBindVertexArray(framebufferQuadVAO);
+            if (i == 0)
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthbufferID);
 
-        glBindBuffer(GL_ARRAY_BUFFER, framebufferQuadVBOs[0]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(quadPositions), quadPositions, GL_STATIC_DRAW);
+            const GLenum draw_buffer = GL_COLOR_ATTACHMENT0;
 
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+            glDrawBuffers(1, &draw_buffer);
 
-        glBindBuffer(GL_ARRAY_BUFFER, framebufferQuadVBOs[1]);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(quadTextureUVs), quadTextureUVs, GL_STATIC_DRAW);
+            assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
 
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    void Postprocess::bindFramebuffer()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebufferID);
     }
 
     void Postprocess::renderFramebuffer()
     {
         glViewport(0, 0, windowWidth, windowHeight);
 
-        // Activates window's framebuffer
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        size_t last = effects.size();
 
-        glUseProgram(shader.getID());
+        while (last > 0 && not effects[last - 1].enabled)
+            --last;
+
+        // Without effects the colors of the scene are only copied into the window
+        if (last == 0)
+        {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFramebufferID);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            glBlitFramebuffer(0, 0, windowWidth, windowHeight, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            return;
+        }
 
-        // Activates texture's framebuffer and renders the window
-        glBindTexture(GL_TEXTURE_2D, outTextureID);
+        // Every pass covers the whole target, so nothing needs to be cleared or tested
+        glDisable(GL_DEPTH_TEST);
 
         glBindVertexArray(framebufferQuadVAO);
 
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        GLuint source = sceneTextureID;
+        int    target = 0;
+
+        for (size_t i = 0; i < last; ++i)
+        {
+            Effect & effect = effects[i];
+
+            if (not effect.enabled)
+                continue;
+
+            // The last effect writes into the window, the others into the ping-pong target the previous one didn't write
+            glBindFramebuffer(GL_FRAMEBUFFER, i + 1 == last ? 0 : pingPongFramebufferIDs[target]);
+
+            effect.shader->use();
+
+            glUniform2f(effect.texelSizeID, 1.f / float(windowWidth), 1.f / float(windowHeight));
+
+            glBindTexture(GL_TEXTURE_2D, source);
+
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            source = pingPongTextureIDs[target];
+            target = 1 - target;
+        }
+
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glEnable(GL_DEPTH_TEST);
     }
 }
@@ -1,4 +1,3 @@
-
 /*
 	Public Domain Code
 
@@ -18,7 +17,9 @@
 
 
 
+#include <memory>
 #include <string>
+#include <vector>
 
 
 
@@ -26,37 +27,52 @@ namespace finalPractice
 {
 	/// <summary>
 	/// Postprocess is responsible for applying post-processing effects to a rendered image.
-	/// It utilizes a framebuffer for offscreen rendering, applies a shader to the texture,
-	/// and renders the processed texture onto the screen.
+	/// The scene is rendered into a half float target with the size of the window, and every enabled effect
+	/// reads the output of the previous one and writes into one of two ping-pong targets, except the last one,
+	/// which writes into the window. Each effect is a single full-screen pass with a fixed number of samples
+	/// per pixel, and the targets are only allocated again when the window is resized.
 	/// </summary>
 	class Postprocess
 	{
+	public:
+
+		static const std::string    sepiaShaderCode;			///< Fragment shader of an effect that tints the image in sepia tones.
+		static const std::string vignetteShaderCode;			///< Fragment shader of an effect that darkens the corners of the image.
+
 	private:
 
-		Shader shader;											///< Shader used for applying post-processing effects to a texture.
+		/// <summary>
+		/// A post-processing effect: a full-screen pass that can be turned off without being removed.
+		/// </summary>
+		struct Effect
+		{
+			std::unique_ptr< Shader > shader;					///< Shader of the pass.
+			GLint			 texelSizeID;						///< Location of the size of a texel in the shader.
+			bool				 enabled;						///< Whether the pass is applied.
+		};
+
+		static const std::string postprocessVertexShaderCode;	///< Vertex shader code used for every pass (a triangle that covers the screen).
 
-		static const std::string   postprocessVertexShaderCode; ///< Vertex shader code used for post-processing.
-		static const std::string postprocessFragmentShaderCode; ///< Fragment shader code used for post-processing (applies a color effect).
+		std::vector< Effect > effects;							///< Effects in the order they are applied.
 
-		static const GLsizei framebufferWidth  = 256;			///< Width of the framebuffer used for offscreen rendering.
-		static const GLsizei framebufferHeight = 256;			///< Height of the framebuffer used for offscreen rendering.
+		GLuint    sceneFramebufferID;							///< ID for the framebuffer the scene is rendered into.
+		GLuint		  sceneTextureID;							///< ID for the half float texture with the colors of the scene.
+		GLuint		   depthbufferID;							///< ID for the depth buffer of the scene.
 
-		GLuint          framebufferID;							///< ID for the framebuffer object.
-		GLuint           outTextureID;							///< ID for the texture that stores the output of the framebuffer.
-		GLuint          depthbufferID;							///< ID for the depth buffer used in the framebuffer.
+		GLuint pingPongFramebufferIDs[2];						///< IDs for the framebuffers the effects write into, one after the other.
+		GLuint	   pingPongTextureIDs[2];						///< IDs for the half float textures of the ping-pong framebuffers.
 
-		GLuint     framebufferQuadVAO;							///< ID for the VAO of the quad used for rendering the post-processed texture.
-		GLuint framebufferQuadVBOs[2];							///< VBOs for the quad's vertex positions and texture coordinates.
+		GLuint		framebufferQuadVAO;							///< ID for the VAO of the full-screen triangle (without buffers).
 
-		int               windowWidth;							///< Width of the window (for rendering the final output).
-		int              windowHeight;							///< Height of the window (for rendering the final output).
+		int				   windowWidth;							///< Width of the window (and of every target).
+		int				  windowHeight;							///< Height of the window (and of every target).
 
 	public:
-		
+
 		/// <summary>
 		/// Constructor that initializes the postprocessing effect with the given window dimensions.
 		/// </summary>
-		/// 
+		///
 		/// <param name="windowWidth">Width of the window.</param>
 		/// <param name="windowHeight">Height of the window.</param>
 		Postprocess(int windowWidth, int windowHeight);
@@ -66,16 +82,66 @@ namespace finalPractice
 		/// </summary>
 		~Postprocess();
 
+	private:
+
+		// Delete the copy constructor and copy assignment operator to prevent copying
+		Postprocess(const Postprocess&) = delete;
+		Postprocess& operator = (const Postprocess&) = delete;
+
+	public:
+
 		/// <summary>
-		/// Initializes the framebuffer and associated textures.
+		/// Adds an effect at the end of the chain. Its fragment shader reads the image from "sampler2d" at
+		/// "texture_uv" (and may use "texel_size" for its neighbors) and writes "fragment_color".
 		/// </summary>
-		void buildFramebuffer();
+		///
+		/// <param name="fragmentShaderCode">Source code of the fragment shader of the effect.</param>
+		/// <param name="enabled">Whether the effect is applied from the start.</param>
+		///
+		/// <returns>The index of the effect.</returns>
+		unsigned addEffect(const std::string & fragmentShaderCode, bool enabled = true);
+
+		/// <summary>
+		/// Turns an effect on or off.
+		/// </summary>
+		///
+		/// <param name="effect">The index of the effect.</param>
+		/// <param name="enabled">Whether the effect is applied.</param>
+		void setEffectEnabled(unsigned effect, bool enabled) { effects[effect].enabled = enabled; }
 
 		/// <summary>
-		/// Renders the post-processed image to the screen.
+		/// Tells whether an effect is applied.
+		/// </summary>
+		///
+		/// <param name="effect">The index of the effect.</param>
+		///
+		/// <returns>True if the effect is applied.</returns>
+		bool isEffectEnabled(unsigned effect) const { return effects[effect].enabled; }
+
+		/// <summary>
+		/// Allocates the targets again with the size of the window.
+		/// </summary>
+		///
+		/// <param name="windowWidth">Width of the window.</param>
+		/// <param name="windowHeight">Height of the window.</param>
+		void resize(int windowWidth, int windowHeight);
+
+		/// <summary>
+		/// Binds the framebuffer the scene has to be rendered into.
+		/// </summary>
+		void bindFramebuffer();
+
+		/// <summary>
+		/// Applies the enabled effects to the rendered scene and writes the result into the window.
 		/// </summary>
 		void renderFramebuffer();
 
+	private:
+
+		/// <summary>
+		/// Creates the framebuffers, their textures and the depth buffer (without storage).
+		/// </summary>
+		void buildFramebuffer();
 	};
 }
 
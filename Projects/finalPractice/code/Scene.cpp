@@ -9,24 +9,63 @@
 
 
 
+#include <cmath>
+
+
+
 namespace finalPractice
 {
+	// The scene meshes use the quantized vertex layout (half the vertex memory of the float one) and are sorted to reduce overdraw
+	static const MeshData::ImportSettings meshSettings(MeshData::defaultImportFlags, GL_UNSIGNED_INT, true, true, 3);
+
+	// Files loaded by the scene
+	static const std::string tableMeshPath      = "../../binaries/assets/table.fbx";
+	static const std::string tableTexturePath   = "../../binaries/assets/table_textureAlbedo.png";
+	static const std::string beerMugMeshPath    = "../../binaries/assets/beerMug.fbx";
+	static const std::string beerMugTexturePath = "../../binaries/assets/beerMug_textureAlbedo.png";
+	static const std::string chairMeshPath      = "../../binaries/assets/chair.fbx";
+	static const std::string chairTexturePath   = "../../binaries/assets/chair_textureAlbedo.png";
+	static const std::string fishBowlMeshPath   = "../../binaries/assets/fishBowl.fbx";
+	static const std::string crystalMeshPath    = "../../binaries/assets/crystal.fbx";
+	static const std::string crystalTexturePath = "../../binaries/assets/crystal_textureAlbedo.png";
+	static const std::string heightMapPath      = "../../binaries/assets/height_map.png";
+	static const std::string skyboxPath         = "../../binaries/assets/skybox_";
+	static const std::string atmospherePath     = "../../binaries/assets/atmosphere.lut";
+
+
+
+	bool Scene::cubeMapSky = false;
+
+
+
 	Scene::Scene(int width, int height) :
-		table      ("../../binaries/assets/table.fbx"  , "../../binaries/assets/table_textureAlbedo.png",   1.f ),
-		beerMug01  ("../../binaries/assets/beerMug.fbx", "../../binaries/assets/beerMug_textureAlbedo.png", 1.f),
-		beerMug02  ("../../binaries/assets/beerMug.fbx", "../../binaries/assets/beerMug_textureAlbedo.png", 1.f),
-		beerMug03  ("../../binaries/assets/beerMug.fbx", "../../binaries/assets/beerMug_textureAlbedo.png", 1.f),
-		chair01    ("../../binaries/assets/chair.fbx", "../../binaries/assets/chair_textureAlbedo.png", 1.f),
-		chair02    ("../../binaries/assets/chair.fbx"  , "../../binaries/assets/chair_textureAlbedo.png",   1.f ),
-		fishBowl   ("../../binaries/assets/fishBowl.fbx", .5f),
-		crystal    ("../../binaries/assets/crystal.fbx", "../../binaries/assets/crystal_textureAlbedo.png",  .8f),
-		terrain    (20.f, 20.f, 100, 100, "../../binaries/assets/height_map.png"),
-		skybox     ("../../binaries/assets/skybox_"),
-		postprocess(width, height)
+		propMaterials(std::make_shared< MaterialSet >(std::vector< std::string >{ tableTexturePath, beerMugTexturePath, chairTexturePath })),
+		table      (tableMeshPath   , propMaterials, tableTexturePath  , 1.f, false, meshSettings),
+		beerMugs   (beerMugMeshPath , propMaterials, beerMugTexturePath, 1.f, true , meshSettings),
+		chairs     (chairMeshPath   , propMaterials, chairTexturePath  , 1.f, true , meshSettings),
+		fishBowl   (fishBowlMeshPath, .5f, false, meshSettings),
+		crystal    (crystalMeshPath , crystalTexturePath, .8f, false, meshSettings),
+		terrain    (20.f, 20.f, 100, 100, heightMapPath),
+		skybox     (cubeMapSky ? std::make_unique< Skybox >(skyboxPath) : std::make_unique< Skybox >(*Atmosphere::load(atmospherePath))),
+		postprocess(width, height),
+		timeOfDay  (15.5f)
 	{
 		glEnable(GL_CULL_FACE);
 		glEnable(GL_DEPTH_TEST);
 
+		// Placements of the repeated meshes (each mesh is drawn with a single instanced call)
+		beerMugs.addInstance(glm::vec3(  .5f,  -.39f, 0.f) , -1.57f, glm::vec3(1.f, 0.f, 0.f), glm::vec3(1.f , 1.f , 1.f ));
+		beerMugs.addInstance(glm::vec3( -.4f,  -.39f,  .4f), -1.57f, glm::vec3(1.f, 0.f, 0.f), glm::vec3(1.f , 1.f , 1.f ));
+		beerMugs.addInstance(glm::vec3( -.3f,  -.33f, -.8f),  0.f  , glm::vec3(1.f, 0.f, 0.f), glm::vec3(1.f , 1.f , 1.f ));
+		chairs  .addInstance(glm::vec3(-1.f , -2.05f, 1.f) ,  2.5f , glm::vec3(0.f, 1.f, 0.f), glm::vec3(2.2f, 2.2f, 2.2f));
+		chairs  .addInstance(glm::vec3( 1.f , -2.05f, 1.f) , -2.5f , glm::vec3(0.f, 1.f, 0.f), glm::vec3(2.2f, 2.2f, 2.2f));
+
+		skybox->setTimeOfDay(timeOfDay);
+
+		// Post-processing chain, applied in this order
+		sepiaEffect = postprocess.addEffect(Postprocess::sepiaShaderCode, false);
+		postprocess.addEffect(Postprocess::vignetteShaderCode);
+
 		resize(width, height);
 
 		pointerPressed = false;
@@ -34,6 +73,34 @@ namespace finalPractice
 
 
 
+	void Scene::prefetchAssets()
+	{
+		// Meshes first, they take the longest to import
+		MeshCache::prefetch(tableMeshPath   , meshSettings);
+		MeshCache::prefetch(beerMugMeshPath , meshSettings);
+		MeshCache::prefetch(chairMeshPath   , meshSettings);
+		MeshCache::prefetch(fishBowlMeshPath, meshSettings);
+		MeshCache::prefetch(crystalMeshPath , meshSettings);
+
+		Texture::prefetchImage(tableTexturePath  , Texture::ALBEDO);
+		Texture::prefetchImage(beerMugTexturePath, Texture::ALBEDO);
+		Texture::prefetchImage(chairTexturePath  , Texture::ALBEDO);
+		Texture::prefetchImage(crystalTexturePath, Texture::ALBEDO);
+
+		// The terrain streams the tiles of its cooked height map instead of decoding the image
+		if (not VirtualHeightMap::hasCookedFile(heightMapPath))
+			Texture::prefetchImage(heightMapPath, Texture::HEIGHTMAP);
+
+		// The atmosphere computes or reads its tables in the constructor instead
+		if (cubeMapSky)
+		{
+			for (char side = '0'; side < '6'; ++side)
+				Texture::prefetchImage(skyboxPath + side + ".png", Texture::CUBEMAP);
+		}
+	}
+
+
+
 	void Scene::update()
 	{
 		// Camera's behaviour update
@@ -61,26 +128,44 @@ namespace finalPractice
 
 	void Scene::render()
 	{
+		// The scene is rendered into the half float target of the post-processing chain
+		postprocess.bindFramebuffer();
+
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		// Objects outside the view frustum are skipped before any GL call
+		Frustum frustum(camera);
+
 		// Render the meshes
-		table    .render(camera, glm::vec3( 0.f , -2.f  , 0.f) ,  0.f  , glm::vec3(1.f, 1.f, 1.f), glm::vec3(0.5f, 0.5f, 0.5f));
-		beerMug01.render(camera, glm::vec3(  .5f,  -.39f, 0.f) , -1.57f, glm::vec3(1.f, 0.f, 0.f), glm::vec3(1.f , 1.f , 1.f ));
-		beerMug02.render(camera, glm::vec3( -.4f,  -.39f,  .4f), -1.57f, glm::vec3(1.f, 0.f, 0.f), glm::vec3(1.f , 1.f , 1.f ));
-		beerMug03.render(camera, glm::vec3( -.3f,  -.33f, -.8f),  0.f  , glm::vec3(1.f, 0.f, 0.f), glm::vec3(1.f , 1.f , 1.f ));
-		chair01  .render(camera, glm::vec3(-1.f , -2.05f, 1.f) ,  2.5f , glm::vec3(0.f, 1.f, 0.f), glm::vec3(2.2f, 2.2f, 2.2f));
-		chair02  .render(camera, glm::vec3( 1.f , -2.05f, 1.f) , -2.5f , glm::vec3(0.f, 1.f, 0.f), glm::vec3(2.2f, 2.2f, 2.2f));
+		table    .render(camera, frustum, glm::vec3( 0.f , -2.f  , 0.f) ,  0.f  , glm::vec3(1.f, 1.f, 1.f), glm::vec3(0.5f, 0.5f, 0.5f));
+		beerMugs .render(camera, frustum);
+		chairs   .render(camera, frustum);
+
+		// Render the rest of the scene's components (the skybox fills the pixels the opaque ones left empty)
+		terrain.render(camera, frustum);
+		skybox->render(camera);
 		
-		// Transparency meshes
-		fishBowl.render(camera, glm::vec3(0.f, -.22f, 0.f), -1.57f, glm::vec3(1.f, 0.f, 0.f), glm::vec3(2.f, 2.f, 2.f));
-		crystal .render(camera, glm::vec3(0.f, crystal.getPosY(), 0.f),  crystal.getAngle(), glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.2f, 0.2f, 0.2f));
+		// Transparency meshes, blended over the skybox too
+		fishBowl.render(camera, frustum, glm::vec3(0.f, -.22f, 0.f), -1.57f, glm::vec3(1.f, 0.f, 0.f), glm::vec3(2.f, 2.f, 2.f));
+		crystal .render(camera, frustum, glm::vec3(0.f, crystal.getPosY(), 0.f),  crystal.getAngle(), glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.2f, 0.2f, 0.2f));
+
+		// Apply the post-processing effects and write the result into the window
+		postprocess.renderFramebuffer();
+	}
+
+	void Scene::toggleSepia()
+	{
+		postprocess.setEffectEnabled(sepiaEffect, not postprocess.isEffectEnabled(sepiaEffect));
+	}
+
+	void Scene::advanceTimeOfDay(float hours)
+	{
+		timeOfDay = std::fmod(timeOfDay + hours, 24.f);
 
-		// Render the rest of the scene's components
-		terrain.render(camera);
-		skybox .render(camera);
+		if (timeOfDay < 0.f)
+			timeOfDay += 24.f;
 
-		// Render a postprocess (not working)
-		//postprocess.renderFramebuffer();
+		skybox->setTimeOfDay(timeOfDay);
 	}
 
 
@@ -94,16 +179,14 @@ namespace finalPractice
 
 		// Resize meshes
 		table    .resize(newWidth, newHeight);
-		beerMug01.resize(newWidth, newHeight);
-		beerMug02.resize(newWidth, newHeight);
-		beerMug03.resize(newWidth, newHeight);
-		chair01  .resize(newWidth, newHeight);
-		chair02  .resize(newWidth, newHeight);
+		beerMugs .resize(newWidth, newHeight);
+		chairs   .resize(newWidth, newHeight);
 		fishBowl .resize(newWidth, newHeight);
 		crystal  .resize(newWidth, newHeight);
 
 		// Resize the rest of the scene's components
-		terrain.resize(newWidth, newHeight);
+		terrain    .resize(newWidth, newHeight);
+		postprocess.resize(newWidth, newHeight);
 
 		glViewport(0, 0, width, height);
 	}
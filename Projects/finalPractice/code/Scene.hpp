@@ -15,6 +15,7 @@
 
 
 #include "Camera.hpp"
+#include "MaterialSet.hpp"
 #include "MeshLoader.hpp"
 #include "Postprocess.hpp"
 #include "Skybox.hpp"
@@ -34,23 +35,27 @@ namespace finalPractice
 
 		Camera           camera;								///< The camera used for the scene's view.
 
+		std::shared_ptr< MaterialSet > propMaterials;			///< Albedo maps of the table, the beer mugs and the chairs packed in one array texture.
+
 		MeshLoader        table;								///< Mesh loader for the table model.
-		MeshLoader    beerMug01;								///< Mesh loader for the beer mug model.
-		MeshLoader    beerMug02;								///< Mesh loader for the beer mug model.
-		MeshLoader    beerMug03;								///< Mesh loader for the beer mug model.
-		MeshLoader      chair01;								///< Mesh loader for the chair model.
-		MeshLoader      chair02;								///< Mesh loader for the chair model.
+		MeshLoader     beerMugs;								///< Mesh loader for the beer mug model (every mug drawn in one instanced call).
+		MeshLoader       chairs;								///< Mesh loader for the chair model (every chair drawn in one instanced call).
 		MeshLoader     fishBowl;								///< Mesh loader for the fishbowl model.
 		MeshLoader      crystal;								///< Mesh loader for the crystal model.
 
-		Skybox           skybox;								///< The skybox for the scene.
+		static bool  cubeMapSky;								///< Whether the sky is the cube map instead of the atmosphere.
+
+		std::unique_ptr< Skybox > skybox;						///< The skybox for the scene.
 		Terrain         terrain;								///< The terrain for the scene.
 
 		Postprocess postprocess;								///< Post-processing effects for the scene.
+		unsigned    sepiaEffect;								///< Index of the sepia effect in the post-processing chain.
 
 		int               width;								///< Width of the scene's window.
 		int              height;								///< Height of the scene's window.
 
+		float         timeOfDay;								///< Hour of the day that places the sun of the atmosphere.
+
 		float      angleAroundX;								///< Rotation angle around the X-axis.
 		float      angleAroundY;								///< Rotation angle around the Y-axis.
 		float       angleDeltaX;								///< Delta for X-axis rotation during interaction.
@@ -73,6 +78,21 @@ namespace finalPractice
 		/// <param name="height">Height of the window.</param>
 		Scene(int width, int height);
 
+		/// <summary>
+		/// Starts reading, parsing and decoding the files of the scene on the worker threads, so the
+		/// constructor only has to wait for them and upload the results. It makes no GL calls, so it can
+		/// be called before the OpenGL context is created.
+		/// </summary>
+		static void prefetchAssets();
+
+		/// <summary>
+		/// Chooses the cube map sky of the previous versions instead of the atmosphere. It has to be called
+		/// before prefetchAssets and before the scene is created.
+		/// </summary>
+		/// 
+		/// <param name="enabled">True to use the cube map.</param>
+		static void setCubeMapSky(bool enabled) { cubeMapSky = enabled; }
+
 		/// <summary>
 		/// Updates the scene (handles camera movement and object updates).
 		/// </summary>
@@ -83,6 +103,18 @@ namespace finalPractice
 		/// </summary>
 		void render();
 
+		/// <summary>
+		/// Moves the time of day forward, and the sun of the atmosphere with it.
+		/// </summary>
+		/// 
+		/// <param name="hours">Hours to advance (the time wraps around at 24).</param>
+		void advanceTimeOfDay(float hours);
+
+		/// <summary>
+		/// Turns the sepia post-processing effect on or off.
+		/// </summary>
+		void toggleSepia();
+
 	public:
 
 		/// <summary>
@@ -10,6 +10,7 @@
 
 
 #include <cassert>
+#include <cmath>
 #include <gtc/type_ptr.hpp>
 #include <iostream>
 
@@ -17,109 +18,195 @@
 
 namespace finalPractice
 {
-	const GLfloat Skybox::coordinates[] =
-	{
-		-5.0f, +5.0f, -5.0f, // 0
-		-5.0f, -5.0f, -5.0f, // 1
-		+5.0f, -5.0f, -5.0f, // 2
-		+5.0f, -5.0f, -5.0f, // 3
-		+5.0f, +5.0f, -5.0f, // 4
-		-5.0f, +5.0f, -5.0f, // 5
-		-5.0f, -5.0f, +5.0f, // 6
-		-5.0f, -5.0f, -5.0f, // 7
-		-5.0f, +5.0f, -5.0f, // 8
-		-5.0f, +5.0f, -5.0f, // 9
-		-5.0f, +5.0f, +5.0f, // 10
-		-5.0f, -5.0f, +5.0f, // 11
-		+5.0f, -5.0f, -5.0f, // 12
-		+5.0f, -5.0f, +5.0f, // 13
-		+5.0f, +5.0f, +5.0f, // 14
-		+5.0f, +5.0f, +5.0f, // 15
-		+5.0f, +5.0f, -5.0f, // 16
-		+5.0f, -5.0f, -5.0f, // 17
-		-5.0f, -5.0f, +5.0f, // 18
-		-5.0f, +5.0f, +5.0f, // 19
-		+5.0f, +5.0f, +5.0f, // 20
-		+5.0f, +5.0f, +5.0f, // 21
-		+5.0f, -5.0f, +5.0f, // 22
-		-5.0f, -5.0f, +5.0f, // 23
-		-5.0f, +5.0f, -5.0f, // 24
-		+5.0f, +5.0f, -5.0f, // 25
-		+5.0f, +5.0f, +5.0f, // 26
-		+5.0f, +5.0f, +5.0f, // 27
-		-5.0f, +5.0f, +5.0f, // 28
-		-5.0f, +5.0f, -5.0f, // 29
-		-5.0f, -5.0f, -5.0f, // 30
-		-5.0f, -5.0f, +5.0f, // 31
-		+5.0f, -5.0f, -5.0f, // 32
-		+5.0f, -5.0f, -5.0f, // 33
-		-5.0f, -5.0f, +5.0f, // 34
-		+5.0f, -5.0f, +5.0f, // 35
-	};
-
 	const std::string Skybox::vertexShaderCode =
 
 		"#version 330\n"
 		""
-		"uniform mat4 model_view_matrix;"
-		"uniform mat4 projection_matrix;"
+		"uniform mat4 inverse_view_projection;"					// Inverse of the projection and the rotation of the view (in the orientation of the sky)
 		""
-		"layout (location = 0) in vec3 vertex_coordinates;"
-		""
-		"out vec3 texture_coordinates;"
+		"out vec3 view_direction;"
 		""
 		"void main()"
 		"{"
-		"   texture_coordinates = vec3(vertex_coordinates.x, -vertex_coordinates.y, vertex_coordinates.z);"
-		"   gl_Position = projection_matrix * model_view_matrix * vec4(vertex_coordinates, 1.0);"
+		"   vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;"	// (-1, -1), (3, -1) and (-1, 3) cover the screen
+		""
+		"   view_direction = (inverse_view_projection * vec4(corner, 1.0, 1.0)).xyz;"	// Linear across the screen, so it can be interpolated
+		"   gl_Position = vec4(corner, 1.0, 1.0);"										// On the far plane
 		"}";
 
 	const std::string Skybox::fragmentShaderCode =
 
 		"#version 330\n"
 		""
-		"in  vec3 texture_coordinates;"
-		"out vec4      fragment_color;"
+		"in  vec3 view_direction;"
+		"out vec4 fragment_color;"
 		""
 		"uniform samplerCube sampler;"
 		""
 		"void main()"
 		"{"
-		"    fragment_color = texture(sampler, texture_coordinates);"
+		"    fragment_color = texture(sampler, vec3(view_direction.x, -view_direction.y, view_direction.z));"
+		"}";
+
+	const std::string Skybox::atmosphereShaderCode =
+
+		"#version 330\n"
+		""
+		"in  vec3 view_direction;"
+		"out vec4 fragment_color;"
+		""
+		"uniform sampler2D transmittance;"						// Transmittance to the top of the atmosphere by zenith angle and altitude
+		"uniform sampler3D rayleigh;"							// Single scattering by view elevation, azimuth from the sun and sun elevation
+		"uniform sampler3D mie;"
+		"uniform vec3      sun_direction;"
+		"uniform float     ground_radius;"
+		"uniform float     top_radius;"
+		"uniform float     viewer_radius;"
+		""
+		"const float pi                 = 3.14159265;"
+		"const float sun_intensity      = 25.0;"
+		"const float sun_angular_radius = 0.0093;"
+		"const float mie_g              = 0.8;"
+		""
+		"float elevation_coordinate(float elevation)"			// Inverse of the mapping of the tables, with more texels near the horizon
+		"{"
+		"    return 0.5 + 0.5 * sign(elevation) * sqrt(abs(elevation) / (pi * 0.5));"
+		"}"
+		""
+		"vec3 lookup_transmittance(float r, float mu)"
+		"{"
+		"    float horizon      = sqrt(top_radius * top_radius - ground_radius * ground_radius);"
+		"    float rho          = sqrt(max(r * r - ground_radius * ground_radius, 0.0));"
+		"    float to_top       = -r * mu + sqrt(max(r * r * (mu * mu - 1.0) + top_radius * top_radius, 0.0));"
+		"    float min_distance = top_radius - r;"
+		"    float max_distance = rho + horizon;"
+		"    vec2  unit         = vec2((to_top - min_distance) / (max_distance - min_distance), rho / horizon);"
+		"    vec2  texture_size = vec2(textureSize(transmittance, 0));"
+		""
+		"    return texture(transmittance, 0.5 / texture_size + unit * (1.0 - 1.0 / texture_size)).rgb;"
+		"}"
+		""
+		"void main()"
+		"{"
+		"    vec3  view = normalize(view_direction);"
+		"    float nu   = dot(view, sun_direction);"
+		""
+		"    vec2  view_horizontal = view.xz;"
+		"    vec2  sun_horizontal  = sun_direction.xz;"
+		"    float azimuth = length(view_horizontal) * length(sun_horizontal) > 1e-4"
+		"                  ? acos(clamp(dot(normalize(view_horizontal), normalize(sun_horizontal)), -1.0, 1.0))"
+		"                  : 0.0;"
+		""
+		"    vec3 coordinates = vec3(elevation_coordinate(asin(clamp(view.y, -1.0, 1.0))), azimuth / pi, elevation_coordinate(asin(clamp(sun_direction.y, -1.0, 1.0))));"
+		""
+		"    float rayleigh_phase = 3.0 / (16.0 * pi) * (1.0 + nu * nu);"
+		"    float mie_phase      = 3.0 / (8.0 * pi) * (1.0 - mie_g * mie_g) * (1.0 + nu * nu) / ((2.0 + mie_g * mie_g) * pow(1.0 + mie_g * mie_g - 2.0 * mie_g * nu, 1.5));"
+		""
+		"    vec3 radiance = (texture(rayleigh, coordinates).rgb * rayleigh_phase + texture(mie, coordinates).rgb * mie_phase) * sun_intensity;"
+		""
+		"    bool hits_ground = view.y < 0.0 && viewer_radius * viewer_radius * (view.y * view.y - 1.0) + ground_radius * ground_radius >= 0.0;"
+		""
+		"    if (nu > cos(sun_angular_radius) && !hits_ground)"		// Disk of the sun, dimmed and reddened by the air in front of it
+		"        radiance += lookup_transmittance(viewer_radius, view.y) * sun_intensity * 20.0;"
+		""
+		"    fragment_color = vec4(pow(1.0 - exp(-radiance), vec3(1.0 / 2.2)), 1.0);"	// Exponential tone mapping and gamma
 		"}";
 
 
 
 	Skybox::Skybox(const std::string & texturePath) :
-		shader(vertexShaderCode, fragmentShaderCode)
+		shader(vertexShaderCode, fragmentShaderCode),
+		atmosphereTextures{ 0, 0, 0 },
+		orientation(glm::rotate(glm::mat4(1.f), .6f, glm::vec3(0.f, 1.f, 0.f))),
+		sunDirection(0.f, 1.f, 0.f)
 	{
 		// Load the cube map texture
 		texture.setID(texture.createTextureCubeMap< Rgba8888 >(texturePath));
 		assert(texture.isOk());
 
 		// Get the location of uniform variables in the shader
-		modelViewMatrixID  = glGetUniformLocation(shader.getID(), "model_view_matrix");
-		projectionMatrixID = glGetUniformLocation(shader.getID(), "projection_matrix");
-		
-		// Generate buffers and arrays for the skybox
-		glGenBuffers     (1, &vboID);
+		inverseViewProjectionID = glGetUniformLocation(shader.getID(), "inverse_view_projection");
+		sunDirectionID			= -1;
+
+		// The triangle is generated from the vertex index, but a vertex array has to be bound to draw it
 		glGenVertexArrays(1, &vaoID);
+	}
 
-		glBindVertexArray(vaoID);
+	Skybox::Skybox(const Atmosphere & atmosphere) :
+		shader(vertexShaderCode, atmosphereShaderCode),
+		orientation(1.f)
+	{
+		const ColorBuffer< RgbaHalf > & transmittance = atmosphere.getTransmittance();
+
+		glGenTextures(3, atmosphereTextures);
+
+		// Transmittance table
+		glActiveTexture(GL_TEXTURE0 + transmittanceUnit);
+		glBindTexture  (GL_TEXTURE_2D, atmosphereTextures[0]);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, GLsizei(transmittance.getWidth()), GLsizei(transmittance.getHeight()), 0, GL_RGBA, GL_HALF_FLOAT, transmittance.colors());
+
+		// Scattering tables, whose slices are stored one after the other
+		const ColorBuffer< RgbaHalf > * scattering[] = { &atmosphere.getRayleigh(), &atmosphere.getMie() };
+		const GLint						units	  [] = { rayleighUnit, mieUnit };
+
+		for (int i = 0; i < 2; ++i)
+		{
+			glActiveTexture(GL_TEXTURE0 + units[i]);
+			glBindTexture  (GL_TEXTURE_3D, atmosphereTextures[i + 1]);
+
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+			glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, Atmosphere::scatteringWidth, Atmosphere::scatteringHeight, Atmosphere::scatteringDepth, 0, GL_RGBA, GL_HALF_FLOAT, scattering[i]->colors());
+		}
+
+		glActiveTexture(GL_TEXTURE0);
+
+		shader.use();
+
+		// Get the location of uniform variables in the shader
+		inverseViewProjectionID = glGetUniformLocation(shader.getID(), "inverse_view_projection");
+		sunDirectionID			= glGetUniformLocation(shader.getID(), "sun_direction");
 
-		glBindBuffer(GL_ARRAY_BUFFER, vboID);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(coordinates), coordinates, GL_STATIC_DRAW);
+		// Set the texture units and the radii of the atmosphere
+		glUniform1i(glGetUniformLocation(shader.getID(), "transmittance"), transmittanceUnit);
+		glUniform1i(glGetUniformLocation(shader.getID(), "rayleigh"		), rayleighUnit);
+		glUniform1i(glGetUniformLocation(shader.getID(), "mie"			), mieUnit);
 
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		atmosphere.configureShader(shader.getID());
 
-		glBindVertexArray(0);
+		setTimeOfDay(12.f);
+
+		// The triangle is generated from the vertex index, but a vertex array has to be bound to draw it
+		glGenVertexArrays(1, &vaoID);
 	}
 
 	Skybox::~Skybox()
 	{
 		glDeleteVertexArrays(1, &vaoID);
-		glDeleteBuffers		(1, &vboID);
+
+		if (atmosphereTextures[0] != 0)
+			glDeleteTextures(3, atmosphereTextures);
+	}
+
+
+
+	void Skybox::setTimeOfDay(float hours)
+	{
+		// The sun turns around a tilted axis: it rises along +x, sets along -x and leans towards -z at noon
+		const float tilt  = glm::radians(40.f);
+		float		angle = (hours - 6.f) / 12.f * glm::pi< float >();
+
+		sunDirection = glm::normalize(glm::vec3(std::cos(angle), std::sin(angle) * std::cos(tilt), -std::sin(angle) * std::sin(tilt)));
 	}
 
 
@@ -128,30 +215,38 @@ namespace finalPractice
 	{
 		shader.use();
 
-		texture.bind();
+		if (atmosphereTextures[0] != 0)
+		{
+			glActiveTexture(GL_TEXTURE0 + transmittanceUnit);
+			glBindTexture  (GL_TEXTURE_2D, atmosphereTextures[0]);
+			glActiveTexture(GL_TEXTURE0 + rayleighUnit);
+			glBindTexture  (GL_TEXTURE_3D, atmosphereTextures[1]);
+			glActiveTexture(GL_TEXTURE0 + mieUnit);
+			glBindTexture  (GL_TEXTURE_3D, atmosphereTextures[2]);
+			glActiveTexture(GL_TEXTURE0);
+
+			glUniform3fv(sunDirectionID, 1, glm::value_ptr(sunDirection));
+		}
+		else
+			texture.bind();
 
-		// Get the inverse of the camera's transform matrix and the projection matrix
-		glm::mat4   modelViewMatrix  = camera.getTransformMatrixInverse();
-		const glm::mat4 & projectionMatrix = camera.getProjectionMatrix();
+		// Only the rotation of the view matters for a sky at an infinite distance
+		glm::mat4 viewMatrix = glm::mat4(glm::mat3(camera.getTransformMatrixInverse() * orientation));
 
-		modelViewMatrix = glm::rotate   (modelViewMatrix, .6f, glm::vec3(0.f, 1.f, 0.f));
-		modelViewMatrix = glm::translate(modelViewMatrix,      glm::vec3(-15.f, 0.f, 20.f));
-		modelViewMatrix = glm::scale    (modelViewMatrix,      glm::vec3( 5.f, 5.f,  5.f));
+		glm::mat4 inverseViewProjection = glm::inverse(camera.getProjectionMatrix() * viewMatrix);
 
 		// Set the uniform variables in the shader
-		glUniformMatrix4fv( modelViewMatrixID, 1, GL_FALSE, glm::value_ptr(modelViewMatrix));
-		glUniformMatrix4fv(projectionMatrixID, 1, GL_FALSE, glm::value_ptr(camera.getProjectionMatrix()));
+		glUniformMatrix4fv(inverseViewProjectionID, 1, GL_FALSE, glm::value_ptr(inverseViewProjection));
 
-		// Disable depth writing (skybox should not affect depth buffer)
+		// The triangle is on the far plane, so it only passes the depth test where nothing was drawn
+		glDepthFunc       (GL_LEQUAL);
 		glDepthMask       (GL_FALSE);
 
-		// Bind the vertex array and render the skybox
 		glBindVertexArray (vaoID);
-		glDrawArrays      (GL_TRIANGLES, 0, 36);
+		glDrawArrays      (GL_TRIANGLES, 0, 3);
+		glBindVertexArray (0);
 
-		// Re-enable depth writing
 		glDepthMask       (GL_TRUE);
-
-		glBindVertexArray (0);
+		glDepthFunc       (GL_LESS);
 	}
 }
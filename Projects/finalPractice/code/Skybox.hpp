@@ -14,6 +14,7 @@
 
 
 
+#include "Atmosphere.hpp"
 #include "Camera.hpp"
 #include "Shader.hpp"
 #include "Texture.hpp"
@@ -24,26 +25,36 @@ namespace finalPractice
 {
 	/// <summary>
 	/// The Skybox class represents a 3D environment that can be rendered as a background.
-	/// It utilizes a cube map texture and shaders to render the skybox.
+	/// It samples either a cube map texture or the precomputed tables of an Atmosphere (a sky lit by a sun
+	/// that moves with the time of day), and renders a single triangle that covers the screen on the far
+	/// plane, so it must be rendered after the opaque objects and only fills the pixels they left empty.
 	/// </summary>
 	class Skybox
 	{
 		private:
 
-			static const GLfloat          coordinates[];			///< Coordinates for the vertices of the skybox cube.
 			static const std::string   vertexShaderCode;			///< Source code for the vertex shader.
-			static const std::string fragmentShaderCode;			///< Source code for the fragment shader.
+			static const std::string fragmentShaderCode;			///< Source code for the fragment shader of the cube map.
+			static const std::string atmosphereShaderCode;			///< Source code for the fragment shader of the atmosphere.
+
+			static const GLint transmittanceUnit = 0;				///< Texture unit of the transmittance table.
+			static const GLint		rayleighUnit = 4;				///< Texture unit of the Rayleigh scattering table.
+			static const GLint			 mieUnit = 5;				///< Texture unit of the Mie scattering table.
 
 			Shader				shader;								///< Shader used for rendering the skybox.
-			Texture			   texture;								///< Texture of the skybox, typically a cube map.
+			Texture			   texture;								///< Texture of the skybox, typically a cube map (not loaded for an atmosphere).
+
+			GLuint atmosphereTextures[3];							///< Transmittance, Rayleigh and Mie tables of the atmosphere (0 for a cube map).
+
+			glm::mat4	   orientation;							///< Rotation of the sky around the vertical axis.
+			glm::vec3	  sunDirection;							///< Direction towards the sun (only used by the atmosphere).
 
 		private:
 
-			GLuint				 vboID;								///< Vertex Buffer Object ID.
-			GLuint				 vaoID;								///< Vertex Array Object ID.
+			GLuint				 vaoID;								///< Vertex Array Object ID (without buffers).
 
-			GLint    modelViewMatrixID;								///< Location of the model-view matrix in the shader.
-			GLint   projectionMatrixID;								///< Location of the projection matrix in the shader.
+			GLint inverseViewProjectionID;							///< Location of the inverse view-projection matrix in the shader.
+			GLint		   sunDirectionID;							///< Location of the sun direction in the shader (-1 for a cube map).
 
 		public:
 
@@ -53,16 +64,38 @@ namespace finalPractice
 			/// 
 			/// <param name="texturePath">The path to the texture file for the skybox cube map.</param>
 			Skybox(const std::string & texturePath);
+
+			/// <summary>
+			/// Constructor that initializes the skybox by uploading the tables of an atmosphere, which can be
+			/// released afterwards.
+			/// </summary>
+			/// 
+			/// <param name="atmosphere">The atmosphere with its precomputed tables.</param>
+			Skybox(const Atmosphere & atmosphere);
 			
 			/// <summary>
 			/// Destructor that cleans up OpenGL resources used by the skybox.
 			/// </summary>
 		   ~Skybox();
 
+		private:
+
+			// Delete the copy constructor and copy assignment operator to prevent copying
+			Skybox(const Skybox&) = delete;
+			Skybox& operator = (const Skybox&) = delete;
+
 		public:
 
 			/// <summary>
-			/// Renders the skybox using the provided camera.
+			/// Moves the sun of the atmosphere to an hour of the day: it rises in the east at 6, is highest at
+			/// 12 and sets in the west at 18 (it has no effect on a cube map).
+			/// </summary>
+			/// 
+			/// <param name="hours">The hour of the day, in [0, 24).</param>
+			void setTimeOfDay(float hours);
+
+			/// <summary>
+			/// Renders the skybox using the provided camera where the depth buffer is still clear.
 			/// </summary>
 			/// 
 			/// <param name="camera">The camera that provides the view and projection matrices for rendering.</param>
@@ -9,11 +9,16 @@
 
 
 
+#include "NormalMapGenerator.hpp"
+
+
+
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <glm.hpp>
 #include <gtc/matrix_transform.hpp>
 #include <gtc/type_ptr.hpp>
-#include <half.hpp>
 #include <vector>
 
 
@@ -27,173 +32,554 @@ namespace finalPractice
 		"uniform mat4 model_view_matrix;"
 		"uniform mat4 projection_matrix;"
 		""
-		"layout (location = 0) in vec2 vertex_xz;"
-		"layout (location = 1) in vec2 vertex_uv;"
+		"layout (location = 0) in uvec3 patch_vertex;"				// Column and row in the patch, and 1 for the vertices of the skirt
+		"layout (location = 1) in uvec3 chunk_placement;"			// First column and row of the chunk in the finest grid, and its slices per patch slice
 		""
-		"uniform sampler2D sampler;"
+		"uniform vec2       grid_size;"								// Slices of the finest grid
+		"uniform vec2  terrain_origin;"								// Model space x and z where the texture coordinates are 0
+		"uniform vec2    terrain_size;"
 		"uniform float     max_height;"
+		"uniform float    skirt_depth;"
 		""
-		"out float intensity;"
+		"\n#ifdef VIRTUAL_HEIGHT_MAP\n"
+		"uniform usampler2D     indirection;"						// Layer and level of the page of every tile of the finest level
+		"uniform sampler2DArray pages;"
+		"uniform vec2           level_size;"						// Size of the finest level in texels
+		"uniform float          tile_size;"
+		""
+		"float sample_height(vec2 uv)"
+		"{"
+		"   vec2  texel  = clamp(uv * level_size - 0.5, vec2(0.0), level_size - 1.0);"
+		"   vec2  tile   = floor(texel / tile_size);"
+		"   uvec2 entry  = texelFetch(indirection, ivec2(tile), 0).xy;"
+		"   float scale  = exp2(float(entry.y));"
+		"   vec2  size   = max(floor(level_size / scale), vec2(1.0));"
+		"   vec2  page   = min(floor(tile / scale), ceil(size / tile_size) - 1.0);"
+		"   vec2  local  = clamp(uv * size - 0.5, vec2(0.0), size - 1.0) - page * tile_size;"
+		"   return texture(pages, vec3((local + 1.5) / (tile_size + 2.0), float(entry.x))).r;"	// Pages have a border of one texel
+		"}"
+		"\n#else\n"
+		"uniform sampler2D sampler;"
+		""
+		"float sample_height(vec2 uv)"
+		"{"
+		"   return texture(sampler, uv).r;"
+		"}"
+		"\n#endif\n"
+		""
+		"out vec2 uv;"
+		"out vec4 position;"
 		""
 		"void main()"
 		"{"
-		"   float sample = texture (sampler, vertex_uv).r;"
-		"   intensity    = sample * 0.75 + 0.25;"
-		"   float height = sample * max_height;"
-		"   vec4  xyzw   = vec4(vertex_xz.x, height, vertex_xz.y, 1.0);"
-		"   gl_Position  = projection_matrix * model_view_matrix * xyzw;"
+		"   uv           = vec2(chunk_placement.xy + patch_vertex.xy * chunk_placement.z) / grid_size;"	// Exact where neighbors meet
+		"   vec2  xz     = terrain_origin + uv * terrain_size;"
+		"   float height = sample_height(uv) * max_height - float(patch_vertex.z) * skirt_depth;"
+		"   position     = model_view_matrix * vec4(xz.x, height, xz.y, 1.0);"
+		"   gl_Position  = projection_matrix * position;"
 		"}";
 
 	const std::string Terrain::fragmentShaderCode =
 
 		"#version 330\n"
 		""
-		"in  float intensity;"
-		"out vec4  fragment_color;"
+		"struct Light"
+		"{"
+		"    vec4 position;"
+		"    vec3 color;"
+		"};"
+		""
+		"uniform Light light;"
+		"uniform float ambient_intensity;"
+		"uniform float diffuse_intensity;"
+		""
+		"uniform vec3      material_color;"
+		"uniform mat4   model_view_matrix;"
+		"uniform sampler2D     normal_map;"						// X and Z components of the normals in model space
+		""
+		"in  vec2 uv;"
+		"in  vec4 position;"
+		"out vec4 fragment_color;"
 		""
 		"void main()"
 		"{"
-		"    fragment_color = vec4(intensity, intensity, intensity, 1.0);"
+		"    vec2  xz     = texture(normal_map, uv).rg;"
+		"    vec3  normal = vec3(xz.x, sqrt(max(1.0 - dot(xz, xz), 0.0)), xz.y);"
+		"    vec4  view_normal     = model_view_matrix * vec4(normal, 0.0);"		// The terrain is scaled uniformly
+		"    vec4  light_direction = light.position - position;"
+		"    float light_intensity = diffuse_intensity * max(dot(normalize(view_normal.xyz), normalize(light_direction.xyz)), 0.0);"
+		""
+		"    fragment_color = vec4(material_color * ambient_intensity + diffuse_intensity * light_intensity * light.color * material_color, 1.0);"
 		"}";
 
 
 
+	const float     Terrain::maxHeight       = 5.f;
+	const unsigned  Terrain::leafChunkSlices = 16;
+	const float     Terrain::maxScreenError  = 2.f;
+	const glm::vec3 Terrain::materialColor   = glm::vec3(.8f, .8f, .8f);
+
+	// Largest height field kept on the CPU, a cooked height map uses the finest level of its pyramid that fits
+	static const size_t maxHeightFieldSamples = 4096 * 4096;
+
+
+
+	// Opens the cooked file of a height map, or returns nullptr when it has none (or it is invalid)
+	static std::unique_ptr< VirtualHeightMap > openVirtualHeightMap(const std::string& texturePath)
+	{
+		if (not VirtualHeightMap::hasCookedFile(texturePath))
+			return nullptr;
+
+		auto heightMap = std::make_unique< VirtualHeightMap >(texturePath);
+
+		return heightMap->isOk() ? std::move(heightMap) : nullptr;
+	}
+
+	// Inserts preprocessor definitions right after the #version line of a shader
+	static std::string addDefines(const std::string & shaderCode, const std::string & defines)
+	{
+		size_t versionEnd = shaderCode.find('\n') + 1;
+
+		return shaderCode.substr(0, versionEnd) + defines + shaderCode.substr(versionEnd);
+	}
+
+
+
 	Terrain::Terrain(float width, float depth, unsigned xSlices, unsigned zSlices, const std::string& texturePath) :
-		shader(vertexShaderCode, fragmentShaderCode)
+		virtualHeightMap(openVirtualHeightMap(texturePath)),
+		shader(virtualHeightMap ? addDefines(vertexShaderCode, "#define VIRTUAL_HEIGHT_MAP\n") : vertexShaderCode, fragmentShaderCode)
 	{
 		shader.use();
 
-		numVertex = xSlices * zSlices;
+		modelMatrix = glm::mat4(1);
+
+		modelMatrix = glm::rotate   (modelMatrix, .6f, glm::vec3(0.f, 1.f, 0.f));
+		modelMatrix = glm::translate(modelMatrix,      glm::vec3(-15.f, -3.6f  , 20.f));
+		modelMatrix = glm::scale    (modelMatrix,      glm::vec3( 2.5f,  2.5f ,  2.5f));
+
+		inverseModelMatrix = glm::inverse(modelMatrix);
+
+		// The grid covers the width and depth and the height map displaces it up to maxHeight
+		boundsMin = glm::vec3(-width * .5f, 0.f      , -depth * .5f);
+		boundsMax = glm::vec3( width * .5f, maxHeight,  depth * .5f);
+
+		// The cooked height map is streamed page by page, otherwise the whole image is loaded in a texture
+		if (virtualHeightMap)
+		{
+			virtualHeightMap->configureShader(shader.getID());
+
+			// The height field is assembled from the tiles of the finest level that fits in memory
+			unsigned level = 0;
+
+			while (level + 1 < virtualHeightMap->getLevelCount() && virtualHeightMap->getLevelTexelCount(level) > maxHeightFieldSamples)
+				++level;
+
+			heightField = std::make_unique< HeightField >(virtualHeightMap->readLevel(level), boundsMin, boundsMax);
+		}
+		else
+		{
+			texture.setID(texture.createTexture2D< Monochrome8 >(texturePath, Texture::TypeTexture2D::HEIGHTMAP));
+			assert(texture.isOk());
+
+			// The height field adopts the samples the texture was created from, the image is only decoded once
+			ColorBuffer< Monochrome8 > heights = texture.takeHeightSamples();
+
+			if (heights.getWidth() > 0)
+				heightField = std::make_unique< HeightField >(std::move(heights), boundsMin, boundsMax);
+		}
+
+		// The chunks are built once the height field can bound them
+		buildChunks(width, depth, xSlices, zSlices);
+
+		createNormalMap(texturePath);
+
+		// Get the location of shader uniforms
+		modelViewMatrixID  = glGetUniformLocation(shader.getID(), "model_view_matrix");
+		projectionMatrixID = glGetUniformLocation(shader.getID(), "projection_matrix");
+		skirtDepthID       = glGetUniformLocation(shader.getID(), "skirt_depth");
+
+		// Set max height and skirt depth uniforms
+		glUniform1f(glGetUniformLocation(shader.getID(), "max_height"), maxHeight);
+		glUniform1f(skirtDepthID, skirtDepth);
+
+		// Set the material, the normal map unit and the lighting the terrain shares with the meshes
+		glUniform3f(glGetUniformLocation(shader.getID(), "material_color"), materialColor.r, materialColor.g, materialColor.b);
+		glUniform1i(glGetUniformLocation(shader.getID(), "normal_map"), normalMapUnit);
+
+		lighting.configureLight(shader.getID());
+
+		// Resize the terrain based on the default window size
+		resize(1024, 576);
+	}
+
+	Terrain::~Terrain()
+	{
+		glDeleteTextures(1, &normalMapID);
+		glDeleteVertexArrays(1, &vaoID);
+		glDeleteBuffers(VBO_COUNT, vboIDs);
+	}
+
 
-		coordinates.resize(numVertex * 2);
-		textureUVs .resize(numVertex * 2);
-		index      .resize(xSlices * zSlices * 6);
-		
-		float x = -width * .5f;
-		float z = -depth * .5f;
-		float u = 0.f;
-		float v = 0.f;
 
-		float xStep = width / float(xSlices);
-		float zStep = depth / float(zSlices);
-		float uStep =   1.f / float(xSlices);
-		float vStep =   1.f / float(zSlices);
+	void Terrain::buildChunks(float width, float depth, unsigned xSlices, unsigned zSlices)
+	{
+		// Every level halves the size of the chunks, until those of the last one have at most leafChunkSlices slices per side
+		unsigned levelCount = 1;
+
+		while (std::max(xSlices, zSlices) > leafChunkSlices << (levelCount - 1))
+			++levelCount;
 
-		int coordinateIndex = 0;
+		unsigned leavesPerSide = 1u << (levelCount - 1);
+		unsigned patchX        = (std::max(xSlices, 1u) + leavesPerSide - 1) / leavesPerSide;
+		unsigned patchZ        = (std::max(zSlices, 1u) + leavesPerSide - 1) / leavesPerSide;
+		unsigned gridX         = patchX * leavesPerSide;						// Slices of the finest grid
+		unsigned gridZ         = patchZ * leavesPerSide;
 
-		// Fill the vertex coordinates and texture UVs
-		for (unsigned i = 0; i < zSlices; ++i, z += zStep, v += vStep)
+		// Heights of the vertices of the finest grid, the reference the error of every chunk is measured against
+		std::vector< glm::vec2 > gridPositions(size_t(gridX + 1) * (gridZ + 1));
+		std::vector< float     > gridHeights  (gridPositions.size(), 0.f);
+
+		for (unsigned j = 0; j <= gridZ; ++j)
 		{
-			for (unsigned j = 0; j < xSlices; ++j, coordinateIndex += 2, x += xStep, u += uStep)
+			for (unsigned i = 0; i <= gridX; ++i)
+				gridPositions[size_t(j) * (gridX + 1) + i] = glm::vec2(-width * .5f + width * float(i) / float(gridX), -depth * .5f + depth * float(j) / float(gridZ));
+		}
+
+		if (heightField)
+			heightField->getHeights(gridPositions.data(), gridHeights.data(), gridPositions.size());
+
+		// The skirt duplicates the vertices of the edges of the patch, going around it
+		std::vector< unsigned > perimeter;
+
+		for (unsigned a = 0; a < patchX; ++a) perimeter.push_back(                         a);
+		for (unsigned b = 0; b < patchZ; ++b) perimeter.push_back( b           * (patchX + 1) + patchX);
+		for (unsigned a = patchX; a > 0; --a) perimeter.push_back( patchZ      * (patchX + 1) + a);
+		for (unsigned b = patchZ; b > 0; --b) perimeter.push_back( b           * (patchX + 1));
+
+		unsigned gridVertexCount  = (patchX + 1) * (patchZ + 1);
+		unsigned chunkVertexCount = gridVertexCount + unsigned(perimeter.size());
+
+		// Every chunk is drawn with the same indices, offset to its first vertex
+		std::vector< GLushort > index;
+
+		for (unsigned b = 0; b < patchZ; ++b)
+		{
+			for (unsigned a = 0; a < patchX; ++a)
 			{
-				coordinates[coordinateIndex + 0] = half_float::half(x);
-				coordinates[coordinateIndex + 1] = half_float::half(z);
-				textureUVs [coordinateIndex + 0] = half_float::half(u);
-				textureUVs [coordinateIndex + 1] = half_float::half(v);
+				GLushort bottomLeft  = GLushort( b      * (patchX + 1) +  a);
+				GLushort bottomRight = GLushort( b      * (patchX + 1) + (a + 1));
+				GLushort topLeft     = GLushort((b + 1) * (patchX + 1) +  a);
+				GLushort topRight    = GLushort((b + 1) * (patchX + 1) + (a + 1));
+
+				index.insert(index.end(), { bottomLeft,  topLeft, bottomRight });
+				index.insert(index.end(), { bottomRight, topLeft, topRight    });
 			}
+		}
 
-			x += xStep = -xStep;
-			u += uStep = -uStep;
+		for (unsigned k = 0; k < perimeter.size(); ++k)
+		{
+			unsigned next = (k + 1) % unsigned(perimeter.size());
+
+			GLushort edge      = GLushort(perimeter[k]);
+			GLushort nextEdge  = GLushort(perimeter[next]);
+			GLushort skirt     = GLushort(gridVertexCount + k);
+			GLushort nextSkirt = GLushort(gridVertexCount + next);
+
+			index.insert(index.end(), { edge,     skirt, nextEdge  });
+			index.insert(index.end(), { nextEdge, skirt, nextSkirt });
 		}
 
-		int indexIndex = 0;
+		patchIndexCount = GLsizei(index.size());
+
+		// Column, row and skirt flag of every vertex of the patch, the vertices of the skirt repeat those of the edges
+		std::vector< GLubyte > patchVertices;
+
+		for (unsigned v = 0; v < chunkVertexCount; ++v)
+		{
+			unsigned patchVertex = v < gridVertexCount ? v : perimeter[v - gridVertexCount];
+
+			patchVertices.insert(patchVertices.end(), { GLubyte(patchVertex % (patchX + 1)), GLubyte(patchVertex / (patchX + 1)), GLubyte(v < gridVertexCount ? 0 : 1), 0 });
+		}
 
-		// Fill the triangles index
-		for (unsigned i = 0; i < zSlices; ++i)
+		// The quadtree is built level by level, so the four children of every chunk are stored together
+		struct Cell
 		{
-			for (unsigned j = 0; j < xSlices; ++j)
+			unsigned level;
+			unsigned x;
+			unsigned z;
+		};
+
+		std::vector< Cell > cells{ Cell{ 0, 0, 0 } };
+
+		chunks.assign(1, Chunk{});
+
+		for (size_t c = 0; c < cells.size(); ++c)
+		{
+			Cell cell = cells[c];
+
+			if (cell.level + 1 == levelCount)
+				continue;
+
+			chunks[c].children = unsigned(chunks.size());
+
+			for (unsigned child = 0; child < 4; ++child)
+			{
+				cells .push_back(Cell{ cell.level + 1, cell.x * 2 + child % 2, cell.z * 2 + child / 2 });
+				chunks.push_back(Chunk{});
+			}
+		}
+
+		for (size_t c = 0; c < chunks.size(); ++c)
+		{
+			Chunk & chunk = chunks[c];
+
+			// A slice of the chunk spans stride slices of the finest grid
+			unsigned stride = leavesPerSide >> cells[c].level;
+			unsigned firstI = cells[c].x * patchX * stride;
+			unsigned firstJ = cells[c].z * patchZ * stride;
+
+			auto gridIndex = [&] (unsigned a, unsigned b) { return size_t(firstJ + b * stride) * (gridX + 1) + firstI + a * stride; };
+
+			chunk.placement = glm::uvec3(firstI, firstJ, stride);
+
+			// Error against the finest grid, with the heights of the chunk interpolated across its triangles
+			float lowest  = gridHeights[gridIndex(0, 0)];
+			float highest = lowest;
+
+			chunk.error = 0.f;
+
+			for (unsigned j = firstJ; j <= firstJ + patchZ * stride; ++j)
+			{
+				for (unsigned i = firstI; i <= firstI + patchX * stride; ++i)
+				{
+					float height = gridHeights[size_t(j) * (gridX + 1) + i];
+
+					lowest  = std::min(lowest , height);
+					highest = std::max(highest, height);
+
+					unsigned a  = std::min((i - firstI) / stride, patchX - 1);
+					unsigned b  = std::min((j - firstJ) / stride, patchZ - 1);
+					float    fx = float(i - firstI - a * stride) / float(stride);
+					float    fz = float(j - firstJ - b * stride) / float(stride);
+
+					float bottomLeft  = gridHeights[gridIndex(a    , b    )];
+					float bottomRight = gridHeights[gridIndex(a + 1, b    )];
+					float topLeft     = gridHeights[gridIndex(a    , b + 1)];
+					float topRight    = gridHeights[gridIndex(a + 1, b + 1)];
+
+					// The diagonal of every quad goes from its top left to its bottom right corner
+					float interpolated = fx + fz <= 1.f
+						? bottomLeft + fx * (bottomRight - bottomLeft) + fz * (topLeft - bottomLeft)
+						: topRight   + (1.f - fx) * (topLeft - topRight) + (1.f - fz) * (bottomRight - topRight);
+
+					chunk.error = std::max(chunk.error, std::abs(interpolated - height));
+				}
+			}
+
+			chunk.boundsMin = glm::vec3(gridPositions[gridIndex(0, 0)].x, lowest, gridPositions[gridIndex(0, 0)].y);
+			chunk.boundsMax = glm::vec3(gridPositions[gridIndex(patchX, patchZ)].x, highest, gridPositions[gridIndex(patchX, patchZ)].y);
+		}
+
+		// A chunk is never more accurate than its children, so a coarser level is never chosen over a finer one by mistake
+		for (size_t c = chunks.size(); c-- > 0; )
+		{
+			if (chunks[c].children)
 			{
-				GLuint bottomLeft  =  i      * (xSlices + 1) +  j;
-				GLuint bottomRight =  i      * (xSlices + 1) + (j + 1);
-				GLuint topLeft     = (i + 1) * (xSlices + 1) +  j;
-				GLuint topRight    = (i + 1) * (xSlices + 1) + (j + 1);
-
-				// Primer tringulo
-				index[indexIndex++] = bottomLeft;
-				index[indexIndex++] = topLeft;
-				index[indexIndex++] = bottomRight;
-
-				// Segundo tringulo
-				index[indexIndex++] = bottomRight;
-				index[indexIndex++] = topLeft;
-				index[indexIndex++] = topRight;
+				for (unsigned child = 0; child < 4; ++child)
+					chunks[c].error = std::max(chunks[c].error, chunks[chunks[c].children + child].error);
 			}
 		}
 
+		// The gap between two neighbors is at most the sum of their errors, which the skirts cover whatever their levels
+		skirtDepth = 2.f * chunks.front().error + maxHeight / 255.f;
+
+		for (Chunk & chunk : chunks)
+			chunk.boundsMin.y -= skirtDepth;
+
 		glGenBuffers(VBO_COUNT, vboIDs);
 		glGenVertexArrays(1, &vaoID);
 
 		glBindVertexArray(vaoID);
 
-		// TERRAIN COORDINATES
-		glBindBuffer(GL_ARRAY_BUFFER, vboIDs[VBO_COORDINATES]);
-		glBufferData(GL_ARRAY_BUFFER, coordinates.size() * sizeof(half_float::half), coordinates.data(), GL_STATIC_DRAW);
+		// PATCH VERTICES (the integer attributes reach the shader unconverted)
+		glBindBuffer(GL_ARRAY_BUFFER, vboIDs[VBO_PATCH]);
+		glBufferData(GL_ARRAY_BUFFER, patchVertices.size() * sizeof(GLubyte), patchVertices.data(), GL_STATIC_DRAW);
 
 		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 2, GL_HALF_FLOAT, GL_FALSE, 0, 0);
+		glVertexAttribIPointer(0, 3, GL_UNSIGNED_BYTE, 4 * sizeof(GLubyte), 0);
 
-		// TERRAIN TEXTURE UVS
-		glBindBuffer(GL_ARRAY_BUFFER, vboIDs[VBO_TEXTURE_UVS]);
-		glBufferData(GL_ARRAY_BUFFER, textureUVs.size() * sizeof(half_float::half), textureUVs.data(), GL_STATIC_DRAW);
+		// CHUNK PLACEMENTS (one per instance, rewritten every frame with the chunks that are drawn)
+		glBindBuffer(GL_ARRAY_BUFFER, vboIDs[VBO_PLACEMENTS]);
+		glBufferData(GL_ARRAY_BUFFER, chunks.size() * sizeof(glm::uvec3), nullptr, GL_STREAM_DRAW);
 
 		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, 0, 0);
+		glVertexAttribIPointer(1, 3, GL_UNSIGNED_INT, sizeof(glm::uvec3), 0);
+		glVertexAttribDivisor(1, 1);
 
-		// TERRAIN TRIANGLES INDEX
+		// PATCH TRIANGLES INDEX
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboIDs[EBO_INDEX]);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, index.size() * sizeof(GLuint), index.data(), GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, index.size() * sizeof(GLushort), index.data(), GL_STATIC_DRAW);
 
 		glBindVertexArray(0);
 
-		// Get the location of shader uniforms
-		modelViewMatrixID  = glGetUniformLocation(shader.getID(), "model_view_matrix");
-		projectionMatrixID = glGetUniformLocation(shader.getID(), "projection_matrix");
+		// The shader places the patch of every chunk from its placement in the finest grid
+		glUniform2f(glGetUniformLocation(shader.getID(), "grid_size"     ), float(gridX), float(gridZ));
+		glUniform2f(glGetUniformLocation(shader.getID(), "terrain_origin"), boundsMin.x, boundsMin.z);
+		glUniform2f(glGetUniformLocation(shader.getID(), "terrain_size"  ), boundsMax.x - boundsMin.x, boundsMax.z - boundsMin.z);
 
-		// Set max height uniform
-		glUniform1f(glGetUniformLocation(shader.getID(), "max_height"), 5.f);
+		visibleChunks.reserve(chunks.size());
+	}
 
+	void Terrain::createNormalMap(const std::string& texturePath)
+	{
+		// Without a height field the terrain is flat, and so are its normals
+		ColorBuffer< NormalXz88 > normals(1, 1);
 
+		if (heightField)
+		{
+			const ColorBuffer< Monochrome8 > & samples = heightField->getSamples();
 
-		texture.setID(texture.createTexture2D< Monochrome8 >(texturePath, Texture::TypeTexture2D::HEIGHTMAP));
-		assert(texture.isOk());
+			glm::vec2 texelSize((boundsMax.x - boundsMin.x) / float(samples.getWidth()), (boundsMax.z - boundsMin.z) / float(samples.getHeight()));
 
-		// Resize the terrain based on the default window size
-		resize(1024, 576);
-	}
+			normals = NormalMapGenerator::load(texturePath, samples, texelSize, maxHeight / 255.f);
+		}
 
-	Terrain::~Terrain()
-	{
-		glDeleteVertexArrays(1, &vaoID);
-		glDeleteBuffers(VBO_COUNT, vboIDs);
-	}
+		glGenTextures(1, &normalMapID);
+		glActiveTexture(GL_TEXTURE0 + normalMapUnit);
+		glBindTexture(GL_TEXTURE_2D, normalMapID);
 
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+		// Rows of 2 bytes per texel aren't always a multiple of 4 bytes
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8_SNORM, GLsizei(normals.getWidth()), GLsizei(normals.getHeight()), 0, GL_RG, GL_BYTE, normals.colors());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-	void Terrain::render(const Camera & camera)
-	{
-		shader.use();
+		// MipmapGenerator filters colors, the averaged normals are normalized again in the shader
+		glGenerateMipmap(GL_TEXTURE_2D);
 
-		glm::mat4 modelViewMatrix(1);
+		glActiveTexture(GL_TEXTURE0);
+	}
 
-		modelViewMatrix = glm::rotate   (modelViewMatrix, .6f, glm::vec3(0.f, 1.f, 0.f));
-		modelViewMatrix = glm::translate(modelViewMatrix,      glm::vec3(-15.f, -3.6f  , 20.f));
-		modelViewMatrix = glm::scale    (modelViewMatrix,      glm::vec3( 2.5f,  2.5f ,  2.5f));
+	void Terrain::render(const Camera & camera, const Frustum & frustum)
+	{
+		// Skip the terrain before any GL call when it is out of view
+		if (not frustum.isVisible(chunks.front().boundsMin, chunks.front().boundsMax, modelMatrix))
+			return;
 
-		modelViewMatrix = camera.getTransformMatrixInverse() * modelViewMatrix;
+		shader.use();
+
+		glm::mat4 modelViewMatrix = camera.getTransformMatrixInverse() * modelMatrix;
 
 		glUniformMatrix4fv(modelViewMatrixID,  1, GL_FALSE, glm::value_ptr(modelViewMatrix));
 		glUniformMatrix4fv(projectionMatrixID, 1, GL_FALSE, glm::value_ptr(camera.getProjectionMatrix()));
 
-		texture.bind();
+		// Position of the camera in model space, for the streaming and the level of the chunks
+		glm::vec4 viewer = inverseModelMatrix * glm::vec4(glm::vec3(camera.getLocation()), 1.f);
+
+		if (virtualHeightMap)
+		{
+			// Stream the pages around the viewer, whose position is taken to the texture coordinates of the terrain
+			glm::vec2 uv = (glm::vec2(viewer.x, viewer.z) - glm::vec2(boundsMin.x, boundsMin.z)) / (glm::vec2(boundsMax.x, boundsMax.z) - glm::vec2(boundsMin.x, boundsMin.z));
+
+			virtualHeightMap->update(uv);
+			virtualHeightMap->bind();
+		}
+		else
+			texture.bind();
+
+		glActiveTexture(GL_TEXTURE0 + normalMapUnit);
+		glBindTexture  (GL_TEXTURE_2D, normalMapID);
+		glActiveTexture(GL_TEXTURE0);
+
+		// The terrain is scaled uniformly, so the ratio of an error to its distance is the same in model space
+		float errorScale = viewportHeight / (2.f * std::tan(glm::radians(camera.getFov()) * .5f));
+
+		visibleChunks.clear();
+
+		selectChunks(chunks.front(), glm::vec3(viewer), errorScale, frustum);
+
+		// All the chunks are drawn at once, as instances of the patch
+		glBindBuffer(GL_ARRAY_BUFFER, vboIDs[VBO_PLACEMENTS]);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, visibleChunks.size() * sizeof(glm::uvec3), visibleChunks.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 		glBindVertexArray(vaoID);
-		//glDrawArrays(GL_LINE_STRIP, 0, numVertex);
-		glDrawElements(GL_TRIANGLES, static_cast< GLsizei >(index.size()), GL_UNSIGNED_INT, 0);
+		glDrawElementsInstanced(GL_TRIANGLES, patchIndexCount, GL_UNSIGNED_SHORT, 0, GLsizei(visibleChunks.size()));
 		glBindVertexArray(0);
 	}
 
+	void Terrain::selectChunks(const Chunk & chunk, const glm::vec3 & viewer, float errorScale, const Frustum & frustum)
+	{
+		// Skip the chunk (and its children) when it is out of view
+		if (not frustum.isVisible(chunk.boundsMin, chunk.boundsMax, modelMatrix))
+			return;
+
+		if (chunk.children)
+		{
+			// The distance is 0 inside the bounding box, where the children are always used
+			float distance = glm::distance(viewer, glm::clamp(viewer, chunk.boundsMin, chunk.boundsMax));
+
+			if (chunk.error * errorScale > maxScreenError * distance)
+			{
+				for (unsigned child = 0; child < 4; ++child)
+					selectChunks(chunks[chunk.children + child], viewer, errorScale, frustum);
+
+				return;
+			}
+		}
+
+		visibleChunks.push_back(chunk.placement);
+	}
+
+	float Terrain::getHeight(float x, float z) const
+	{
+		glm::vec4 position = inverseModelMatrix * glm::vec4(x, 0.f, z, 1.f);
+
+		// The terrain is only rotated around the vertical axis, so the height doesn't move the point horizontally
+		float height = heightField ? heightField->getHeight(position.x, position.z) : 0.f;
+
+		return (modelMatrix * glm::vec4(position.x, height, position.z, 1.f)).y;
+	}
+
+	void Terrain::snapToGround(glm::vec3 * positions, size_t count) const
+	{
+		std::vector< glm::vec2 > modelPositions(count);
+		std::vector< float     > heights       (count, 0.f);
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			glm::vec4 position = inverseModelMatrix * glm::vec4(positions[i], 1.f);
+
+			modelPositions[i] = glm::vec2(position.x, position.z);
+		}
+
+		if (heightField)
+			heightField->getHeights(modelPositions.data(), heights.data(), count);
+
+		for (size_t i = 0; i < count; ++i)
+			positions[i].y = (modelMatrix * glm::vec4(modelPositions[i].x, heights[i], modelPositions[i].y, 1.f)).y;
+	}
+
+	bool Terrain::intersectRay(const glm::vec3& origin, const glm::vec3& direction, float& distance, float maxDistance) const
+	{
+		if (not heightField)
+			return false;
+
+		// An affine transform keeps the distances along the ray as a fraction of the direction
+		glm::vec3 modelOrigin    = glm::vec3(inverseModelMatrix * glm::vec4(origin   , 1.f));
+		glm::vec3 modelDirection = glm::vec3(inverseModelMatrix * glm::vec4(direction, 0.f));
+
+		return heightField->intersectRay(modelOrigin, modelDirection, maxDistance, distance);
+	}
+
 	void Terrain::resize(int width, int height)
 	{
+		viewportHeight = float(height);
+
 		glm::mat4 projectionMatrix = glm::perspective(20.f, GLfloat(width) / height, 1.f, 500.f);
 
 		glUniformMatrix4fv(projectionMatrixID, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
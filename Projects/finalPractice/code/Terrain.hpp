@@ -17,12 +17,16 @@
 #include "Camera.hpp"
 #include "Color.hpp"
 #include "ColorBuffer.hpp"
+#include "Frustum.hpp"
+#include "HeightField.hpp"
+#include "Lighting.hpp"
 #include "Shader.hpp"
 #include "Texture.hpp"
+#include "VirtualHeightMap.hpp"
 
 
 
-#include <half.hpp>
+#include <memory>
 
 
 
@@ -30,7 +34,11 @@ namespace finalPractice
 {
 	/// <summary>
 	/// The Terrain class represents a 3D terrain mesh, typically used for landscapes.
-	/// It generates the terrain grid and renders it using shaders and textures.
+	/// It splits the terrain grid into a quadtree of chunks, where every level halves the size of the chunks
+	/// but keeps their number of vertices, and every frame draws the coarsest chunks whose error on screen is
+	/// small enough. Chunks out of the view frustum are skipped, and a skirt around every chunk hides the
+	/// cracks between neighbors of different levels. The ground is lit per fragment with a normal map computed
+	/// from the height map.
 	/// </summary>
 	class Terrain
 	{
@@ -41,36 +49,65 @@ namespace finalPractice
 		/// </summary>
 		enum
 		{
-			VBO_COORDINATES,								///< Vertex coordinates VBO
-			VBO_TEXTURE_UVS,								///< Texture coordinates (UVs)VBO.
-			EBO_INDEX,										///< Triangle index EBO
+			VBO_PATCH,										///< Patch vertices VBO
+			VBO_PLACEMENTS,									///< Chunk placements (per instance) VBO
+			EBO_INDEX,										///< Patch triangle index EBO
 			VBO_COUNT										///< Total number of VBOs
 		};
 
+		/// <summary>
+		/// A node of the quadtree, drawn as an instance of the patch shared by all of them.
+		/// </summary>
+		struct Chunk
+		{
+			glm::vec3 boundsMin;							///< Smallest corner of the bounding box of the chunk and its skirt (model space).
+			glm::vec3 boundsMax;							///< Largest corner of the bounding box of the chunk (model space).
+			float         error;							///< Largest height difference between the chunk and the finest grid (model space).
+			glm::uvec3	placement;							///< First column and row of the chunk in the finest grid, and its slices per patch slice.
+			unsigned   children;							///< Index of the first of its four children (0 for the leaves).
+		};
+
 	private:
 
 		static const std::string   vertexShaderCode;		///< Vertex shader code for terrain rendering.
 		static const std::string fragmentShaderCode;		///< Fragment shader code for terrain rendering.
 		static const std::string        texturePath;		///< Path to the terrain texture.
+		static const float                maxHeight;		///< Height of the terrain where the height map is white.
+		static const unsigned       leafChunkSlices;		///< Most slices per side of a chunk (the level count is chosen from it).
+		static const float           maxScreenError;		///< Largest error of a drawn chunk in pixels.
+		static const glm::vec3        materialColor;		///< Color of the ground lit by the light.
+		static const GLint            normalMapUnit = 3;	///< Texture unit of the normal map (the height map uses unit 0).
 
-		std::vector<half_float::half> coordinates;			///< Coordinates of the terrain vertex.
-		std::vector<half_float::half> textureUVs;			///< UV texture coordinates.
-		std::vector<GLuint> index;							///< Index for the terrain triangles.
+		std::vector< Chunk > chunks;						///< The quadtree, the root first and the four children of every chunk together.
+		std::vector< glm::uvec3 > visibleChunks;			///< Placements of the chunks drawn this frame (reserved for all of them).
+
+		std::unique_ptr< VirtualHeightMap > virtualHeightMap; ///< Paged height map streamed around the viewer (nullptr when the height map isn't cooked).
+		std::unique_ptr< HeightField >		 heightField;	///< CPU copy of the height map for height queries and ray intersections.
 
 		Shader             shader;							///< Shader used to render the terrain.
-		Texture           texture;							///< Texture for the terrain.
+		Texture           texture;							///< Texture for the terrain (when it has no virtual height map).
+		Lighting         lighting;							///< Lighting setup shared with the meshes.
 
 	private:
 
 		GLuint  vboIDs[VBO_COUNT];							///< Vertex Buffer Object IDs.
 		GLuint              vaoID;							///< Vertex Array Object ID.
+		GLuint        normalMapID;							///< Normal map computed from the height map.
+
+		GLsizei   patchIndexCount;							///< Number of indices of the patch every chunk is drawn with.
+		float          skirtDepth;							///< How far below its edges the skirt of a chunk goes (model space).
+		float      viewportHeight;							///< Height of the window in pixels.
 
-		GLsizei         numVertex;							///< Number of vertices in the terrain.
+		glm::mat4     modelMatrix;							///< Placement of the terrain in the world.
+		glm::mat4 inverseModelMatrix;						///< Transforms world positions to the model space of the terrain.
+		glm::vec3       boundsMin;							///< Smallest corner of the bounding box of the terrain (model space).
+		glm::vec3       boundsMax;							///< Largest corner of the bounding box of the terrain (model space).
 
 	private:
 
 		GLint	modelViewMatrixID;							///< Location of the model-view matrix in the shader.
 		GLint  projectionMatrixID;							///< Location of the projection matrix in the shader.
+		GLint        skirtDepthID;							///< Location of the skirt depth in the shader.
 
 	public:
 
@@ -80,9 +117,9 @@ namespace finalPractice
 		/// 
 		/// <param name="width">Width of the terrain.</param>
 		/// <param name="depth">Depth of the terrain.</param>
-		/// <param name="xSlices">Number of slices in the X direction.</param>
-		/// <param name="zSlices">Number of slices in the Z direction.</param>
-		/// <param name="texturePath">Path to the texture file used for the terrain.</param>
+		/// <param name="xSlices">Number of slices in the X direction at the finest level (rounded up so every chunk has the same number).</param>
+		/// <param name="zSlices">Number of slices in the Z direction at the finest level (rounded up so every chunk has the same number).</param>
+		/// <param name="texturePath">Path to the texture file used for the terrain (its cooked ".vhm" file is streamed instead when there is one).</param>
 		Terrain(float width, float depth, unsigned xSlices, unsigned zSlices, const std::string& texturePath);
 
 		/// <summary>
@@ -93,11 +130,43 @@ namespace finalPractice
 
 
 		/// <summary>
-		/// Renders the terrain using the provided camera for transformations.
+		/// Renders the chunks of the terrain that are in the view frustum, each at the coarsest level whose
+		/// error on screen doesn't exceed maxScreenError.
 		/// </summary>
 		/// 
 		/// <param name="camera">The camera used for the model-view and projection matrices.</param>
-		void render(const Camera& camera);
+		/// <param name="frustum">The view frustum of the camera.</param>
+		void render(const Camera& camera, const Frustum& frustum);
+
+		/// <summary>
+		/// Returns the height of the ground at a point of the world.
+		/// </summary>
+		/// 
+		/// <param name="x">X coordinate of the point in world space.</param>
+		/// <param name="z">Z coordinate of the point in world space.</param>
+		/// 
+		/// <returns>The world Y coordinate of the ground (that of the lowest ground if the height map couldn't be loaded).</returns>
+		float getHeight(float x, float z) const;
+
+		/// <summary>
+		/// Moves many points of the world vertically onto the ground at once (e.g. to place objects on the terrain).
+		/// </summary>
+		/// 
+		/// <param name="positions">The points in world space, their Y coordinate is replaced.</param>
+		/// <param name="count">Number of points.</param>
+		void snapToGround(glm::vec3 * positions, size_t count) const;
+
+		/// <summary>
+		/// Finds the first point where a ray of the world hits the ground (e.g. for picking or camera collisions).
+		/// </summary>
+		/// 
+		/// <param name="origin">Origin of the ray in world space.</param>
+		/// <param name="direction">Direction of the ray in world space (normalized, so that distances are in world units).</param>
+		/// <param name="distance">Receives the distance to the hit along the ray.</param>
+		/// <param name="maxDistance">Farthest distance to search.</param>
+		/// 
+		/// <returns>True if the ray hits the ground within maxDistance, false otherwise.</returns>
+		bool intersectRay(const glm::vec3& origin, const glm::vec3& direction, float& distance, float maxDistance = 1e30f) const;
 
 		/// <summary>
 		/// Resizes the terrain projection matrix when the window size changes.
@@ -106,6 +175,37 @@ namespace finalPractice
 		/// <param name="width">New window width.</param>
 		/// <param name="height">New window height.</param>
 		void resize(int width, int height);
+
+	private:
+
+		/// <summary>
+		/// Builds the chunks of the quadtree and uploads the patch they are all drawn with (the vertices and
+		/// indices are only kept in memory while they are built).
+		/// </summary>
+		/// 
+		/// <param name="width">Width of the terrain.</param>
+		/// <param name="depth">Depth of the terrain.</param>
+		/// <param name="xSlices">Number of slices in the X direction at the finest level.</param>
+		/// <param name="zSlices">Number of slices in the Z direction at the finest level.</param>
+		void buildChunks(float width, float depth, unsigned xSlices, unsigned zSlices);
+
+		/// <summary>
+		/// Creates the normal map texture from the height field (read from its cache next to the height map
+		/// when it is up to date).
+		/// </summary>
+		/// 
+		/// <param name="texturePath">Path to the height map.</param>
+		void createNormalMap(const std::string& texturePath);
+
+		/// <summary>
+		/// Adds a chunk to the visible chunks when its error is small enough on screen, or its children otherwise.
+		/// </summary>
+		/// 
+		/// <param name="chunk">The chunk.</param>
+		/// <param name="viewer">Position of the camera in model space.</param>
+		/// <param name="errorScale">Pixels per model unit of error at a distance of one model unit.</param>
+		/// <param name="frustum">The view frustum of the camera.</param>
+		void selectChunks(const Chunk & chunk, const glm::vec3 & viewer, float errorScale, const Frustum & frustum);
 	};
 }
 
@@ -9,22 +9,52 @@
 
 
 
+#include "ThreadPool.hpp"
+
+
+
+#include <algorithm>
+#include <iostream>
 #include <SOIL2.h>
+#include <vector>
+
+
+
+// Block compressed formats that OpenGL 3.3 only exposes through extensions
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM    0x8E8C
+#endif
 
 
 
 namespace finalPractice
 {
+	std::map< Texture::ImageKey, std::shared_future< std::shared_ptr< Texture::DecodedImage > > > Texture::pendingImages;
+
+
+
 	Texture::Texture()
 	{
 		ID                 = -1;
 		textureIsLoaded = false;
+		resident        = false;
 		type =			NO_TYPE;
 	}
 
 	Texture::~Texture()
 	{
 		if (textureIsLoaded)
+			TextureManager::remove(this);
+
+		if (resident)
 			glDeleteTextures(1, &ID);
 	}
 
@@ -37,15 +67,442 @@ namespace finalPractice
 
 
 
+	void Texture::prefetchImage(const std::string& imagePath, TypeTexture2D texture2DType)
+	{
+		ImageKey key(imagePath, getImageChannels(texture2DType));
+
+		if (pendingImages.count(key) > 0)
+			return;
+
+		// Albedo and cubemap textures are created from their compressed file when it exists
+		if (texture2DType != HEIGHTMAP && TextureCompressor::hasCompressedFile(imagePath))
+			return;
+
+		pendingImages[key] = ThreadPool::getShared().submit([key] () { return decodeImage(key.first, key.second); }).share();
+	}
+
+
+
+	void Texture::track(size_t size)
+	{
+		textureIsLoaded = true;
+		resident        = true;
+
+		TextureManager::add(this, size);
+	}
+
+	void Texture::evict()
+	{
+		TextureManager::remove(this);
+
+		glDeleteTextures(1, &ID);
+
+		resident = false;
+	}
+
+	size_t Texture::getImageSize(const DecodedImage& image, size_t texelSize)
+	{
+		size_t size = size_t(image.width) * size_t(image.height) * texelSize;
+
+		for (const ColorBuffer< Rgba8888 > & level : image.mipLevels)
+			size += size_t(level.getWidth()) * size_t(level.getHeight()) * sizeof(Rgba8888);
+
+		return size;
+	}
+
+
+
+	int Texture::getImageChannels(TypeTexture2D texture2DType)
+	{
+		return texture2DType == HEIGHTMAP ? SOIL_LOAD_L : SOIL_LOAD_RGBA;
+	}
+
+	std::shared_ptr< Texture::DecodedImage > Texture::decodeImage(const std::string& imagePath, int channels)
+	{
+		int imageWidth    = 0;
+		int imageHeight   = 0;
+		int imageChannels = 0;
+
+		uint8_t* loadedPixels = SOIL_load_image
+		(
+			imagePath.c_str(),
+			&imageWidth,
+			&imageHeight,
+			&imageChannels,
+			channels
+		);
+
+		auto image = std::make_shared< DecodedImage >(DecodedImage{ imageWidth, imageHeight, { loadedPixels, SOIL_free_image_data }, {} });
+
+		if (loadedPixels && channels == SOIL_LOAD_RGBA)
+			image->mipLevels = MipmapGenerator::generate(reinterpret_cast< const Rgba8888 * >(loadedPixels), unsigned(imageWidth), unsigned(imageHeight), MipmapGenerator::KAISER, true);
+
+		return image;
+	}
+
+	std::shared_ptr< Texture::DecodedImage > Texture::takeImage(const std::string& imagePath, TypeTexture2D texture2DType)
+	{
+		ImageKey key(imagePath, getImageChannels(texture2DType));
+
+		auto prefetched = pendingImages.find(key);
+
+		if (prefetched == pendingImages.end())
+			return decodeImage(imagePath, key.second);
+
+		// Waits for the worker if it hasn't finished yet
+		auto decoded = prefetched->second.get();
+
+		pendingImages.erase(prefetched);
+
+		return decoded;
+	}
+
+	void Texture::uploadImage(GLenum target, const DecodedImage& image)
+	{
+		if (not uploader)
+			uploader = PixelUploader::acquire();
+
+		uploader->upload(target, 0, GL_RGBA, image.width, image.height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels.get(), size_t(image.width) * size_t(image.height) * sizeof(Rgba8888));
+
+		for (size_t i = 0; i < image.mipLevels.size(); ++i)
+		{
+			const ColorBuffer< Rgba8888 > & level = image.mipLevels[i];
+
+			uploader->upload
+			(
+				target,
+				GLint(i + 1),
+				GL_RGBA,
+				GLsizei(level.getWidth()),
+				GLsizei(level.getHeight()),
+				GL_RGBA,
+				GL_UNSIGNED_BYTE,
+				level.colors(),
+				size_t(level.getWidth()) * size_t(level.getHeight()) * sizeof(Rgba8888)
+			);
+		}
+	}
+
+
+
+	bool Texture::isFormatSupported(TextureCompressor::Format format)
+	{
+		// The list of extensions is read once from the current context
+		static const std::vector< std::string > extensions = []()
+		{
+			std::vector< std::string > names;
+
+			GLint count = 0;
+
+			glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+			for (GLint i = 0; i < count; ++i)
+				names.emplace_back(reinterpret_cast< const char * >(glGetStringi(GL_EXTENSIONS, GLuint(i))));
+
+			return names;
+		}();
+
+		auto hasExtension = [](const char * name) { return std::find(extensions.begin(), extensions.end(), name) != extensions.end(); };
+
+		switch (format)
+		{
+			case TextureCompressor::BC1:
+			case TextureCompressor::BC3: return hasExtension("GL_EXT_texture_compression_s3tc");
+			case TextureCompressor::BC5:
+			case TextureCompressor::RGBA8: return true;
+			case TextureCompressor::BC7: return hasExtension("GL_ARB_texture_compression_bptc");
+		}
+
+		return false;
+	}
+
+	std::unique_ptr< MappedFile > Texture::mapCompressed(const std::string& imagePath, TextureCompressor::DdsImage& image)
+	{
+		if (not TextureCompressor::hasCompressedFile(imagePath))
+			return nullptr;
+
+		std::string compressedPath = TextureCompressor::getCompressedPath(imagePath);
+
+		auto file = std::make_unique< MappedFile >(compressedPath);
+
+		if (not file->isOk() || not TextureCompressor::parseDds(file->getData(), file->getSize(), image)) // ERROR condition
+		{
+			std::cerr << "Compressed texture " << compressedPath << " is invalid, decoding the source instead" << std::endl;
+			return nullptr;
+		}
+
+		if (not isFormatSupported(image.format))
+		{
+			std::cerr << "Compressed texture " << compressedPath << " uses a format the GPU doesn't support, decoding the source instead" << std::endl;
+			return nullptr;
+		}
+
+		return file;
+	}
+
+	void Texture::uploadCompressed(GLenum target, const MappedFile& file, const TextureCompressor::DdsImage& image)
+	{
+		static const GLenum internalFormats[] =
+		{
+			GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,							// BC1
+			GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,							// BC3
+			GL_COMPRESSED_RG_RGTC2,										// BC5
+			GL_COMPRESSED_RGBA_BPTC_UNORM,								// BC7
+			GL_RGBA8,													// RGBA8
+		};
+
+		if (not uploader)
+			uploader = PixelUploader::acquire();
+
+		const uint8_t * level = file.getData() + image.dataOffset;
+
+		for (unsigned i = 0; i < image.levelCount; ++i)
+		{
+			unsigned width  = std::max(image.width  >> i, 1u);
+			unsigned height = std::max(image.height >> i, 1u);
+			size_t   size   = TextureCompressor::getLevelSize(image.format, width, height);
+
+			if (image.format == TextureCompressor::RGBA8)
+				uploader->upload(target, GLint(i), GL_RGBA8, GLsizei(width), GLsizei(height), GL_RGBA, GL_UNSIGNED_BYTE, level, size);
+			else
+				uploader->uploadCompressed(target, GLint(i), internalFormats[image.format], GLsizei(width), GLsizei(height), level, size);
+
+			level += size;
+		}
+	}
+
+	GLuint Texture::createCompressedTexture2D(const std::string& texturePath)
+	{
+		TextureCompressor::DdsImage image;
+
+		auto file = mapCompressed(texturePath, image);
+
+		if (not file)
+			return -1;
+
+		GLuint textureID;
+
+		glGenTextures(1, &textureID);
+		glBindTexture(GL_TEXTURE_2D, textureID);
+
+		// Set texture parameters (only the levels stored in the file exist)
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, image.levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(image.levelCount) - 1);
+
+		uploadCompressed(GL_TEXTURE_2D, *file, image);
+
+		// The levels fill the file after its header
+		track(file->getSize() - image.dataOffset);
+		type = TEXTURE2D;
+
+		return textureID;
+	}
+
+	GLuint Texture::createCompressedTextureCubeMap(const std::string& texturePath)
+	{
+		std::unique_ptr< MappedFile > files[6];
+		TextureCompressor::DdsImage   images[6];
+
+		// Every side must have a compressed file with the same format, size and levels
+		for (size_t i = 0; i < 6; ++i)
+		{
+			files[i] = mapCompressed(texturePath + char('0' + i) + ".png", images[i]);
+
+			if (not files[i])
+				return -1;
+
+			if (images[i].format != images[0].format || images[i].width != images[0].width || images[i].height != images[0].height || images[i].levelCount != images[0].levelCount)
+				return -1;
+		}
+
+		GLuint textureID;
+
+		glGenTextures(1, &textureID);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+
+		// Set texture parameters (only the levels stored in the files exist)
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, images[0].levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, GLint(images[0].levelCount) - 1);
+
+		// Same order of sides as createTextureCubeMap
+		static const GLenum textureTarget[] =
+		{
+			GL_TEXTURE_CUBE_MAP_NEGATIVE_Z,
+			GL_TEXTURE_CUBE_MAP_NEGATIVE_X,
+			GL_TEXTURE_CUBE_MAP_POSITIVE_Z,
+			GL_TEXTURE_CUBE_MAP_POSITIVE_X,
+			GL_TEXTURE_CUBE_MAP_POSITIVE_Y,
+			GL_TEXTURE_CUBE_MAP_NEGATIVE_Y,
+		};
+
+		for (size_t i = 0; i < 6; ++i)
+			uploadCompressed(textureTarget[i], *files[i], images[i]);
+
+		track(6 * (files[0]->getSize() - images[0].dataOffset));
+		type = TEXTURECUBEMAP;
+
+		return textureID;
+	}
+
+
+
+	GLuint Texture::createTextureArray(const std::vector< std::string >& texturePaths)
+	{
+		if (texturePaths.empty())
+			return -1;
+
+		if (not reload)
+			reload = [this, texturePaths] () { return createTextureArray(texturePaths); };
+
+		// Decode the images in parallel (images already prefetched are not decoded again)
+		for (const std::string & texturePath : texturePaths)
+			prefetchImage(texturePath, ALBEDO);
+
+		std::vector< std::shared_ptr< DecodedImage > > layers;
+
+		unsigned width  = 0;
+		unsigned height = 0;
+
+		for (const std::string & texturePath : texturePaths)
+		{
+			layers.push_back(takeImage(texturePath, ALBEDO));
+
+			if (not layers.back()->pixels) // ERROR condition
+			{
+				std::cerr << "Texture " << texturePath << " couldn't be decoded for the texture array" << std::endl;
+				return -1;
+			}
+
+			width  = std::max(width , unsigned(layers.back()->width ));
+			height = std::max(height, unsigned(layers.back()->height));
+		}
+
+		// Every layer must have the same size, the smaller images are resampled and their mip chain generated again
+		std::vector< ColorBuffer< Rgba8888 > > resampled;
+
+		resampled.reserve(layers.size());
+
+		for (auto & layer : layers)
+		{
+			if (unsigned(layer->width) == width && unsigned(layer->height) == height)
+				continue;
+
+			resampled.push_back(MipmapGenerator::resize(reinterpret_cast< const Rgba8888 * >(layer->pixels.get()), unsigned(layer->width), unsigned(layer->height), width, height, MipmapGenerator::KAISER, true));
+
+			layer->mipLevels = MipmapGenerator::generate(resampled.back(), MipmapGenerator::KAISER, true);
+		}
+
+		unsigned levelCount = MipmapGenerator::getLevelCount(width, height);
+		size_t   layerSize  = 0;
+
+		for (unsigned i = 0; i < levelCount; ++i)
+			layerSize += size_t(std::max(width >> i, 1u)) * size_t(std::max(height >> i, 1u)) * sizeof(Rgba8888);
+
+		GLuint textureID;
+
+		glGenTextures(1, &textureID);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+
+		// Set texture parameters
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, GLint(levelCount) - 1);
+
+		// Allocate every level for all the layers at once, they are filled layer by layer afterwards
+		for (unsigned i = 0; i < levelCount; ++i)
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, GLint(i), GL_RGBA8, GLsizei(std::max(width >> i, 1u)), GLsizei(std::max(height >> i, 1u)), GLsizei(layers.size()), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+		uploader = PixelUploader::acquire();
+
+		size_t resampledIndex = 0;
+
+		for (size_t layer = 0; layer < layers.size(); ++layer)
+		{
+			const DecodedImage & image = *layers[layer];
+
+			const void * pixels = unsigned(image.width) == width && unsigned(image.height) == height
+				? static_cast< const void * >(image.pixels.get())
+				: static_cast< const void * >(resampled[resampledIndex++].colors());
+
+			uploader->uploadLayer(GL_TEXTURE_2D_ARRAY, 0, GLint(layer), GLsizei(width), GLsizei(height), GL_RGBA, GL_UNSIGNED_BYTE, pixels, size_t(width) * size_t(height) * sizeof(Rgba8888));
+
+			for (size_t i = 0; i < image.mipLevels.size(); ++i)
+			{
+				const ColorBuffer< Rgba8888 > & level = image.mipLevels[i];
+
+				uploader->uploadLayer
+				(
+					GL_TEXTURE_2D_ARRAY,
+					GLint(i + 1),
+					GLint(layer),
+					GLsizei(level.getWidth()),
+					GLsizei(level.getHeight()),
+					GL_RGBA,
+					GL_UNSIGNED_BYTE,
+					level.colors(),
+					size_t(level.getWidth()) * size_t(level.getHeight()) * sizeof(Rgba8888)
+				);
+			}
+		}
+
+		track(layers.size() * layerSize);
+		type = TEXTUREARRAY;
+
+		return textureID;
+	}
+
+
+
 	bool Texture::isOk() const
 	{
 		return textureIsLoaded;
 	}
 
-	bool Texture::bind() const
+	bool Texture::makeResident()
+	{
+		if (not textureIsLoaded)
+			return false;
+
+		if (resident)
+		{
+			TextureManager::touch(this);
+			return false;
+		}
+
+		GLuint reloadedID = reload();
+
+		if (reloadedID == GLuint(-1)) // ERROR condition
+		{
+			std::cerr << "Evicted texture couldn't be reloaded" << std::endl;
+
+			textureIsLoaded = false;
+			return false;
+		}
+
+		ID = reloadedID;
+
+		return true;
+	}
+
+	bool Texture::bind()
 	{
 		if (textureIsLoaded)
 		{
+			makeResident();
+
+			if (not resident)
+				return false;
+
 			switch (type)
 			{
 			case TEXTURE2D:
@@ -53,11 +510,18 @@ namespace finalPractice
 				glBindTexture(GL_TEXTURE_2D, ID);
 				break;
 			}
-			case CUBEMAP:
+			case TEXTURECUBEMAP:
 			{
 				glBindTexture(GL_TEXTURE_CUBE_MAP, ID);
 				break;
 			}
+			case TEXTUREARRAY:
+			{
+				glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+				break;
+			}
+			default:
+				break;
 			}
 
 			return true;
@@ -65,4 +529,16 @@ namespace finalPractice
 
 		return false;
 	}
+
+	ColorBuffer< Monochrome8 > Texture::takeHeightSamples()
+	{
+		if (not heightImage)
+			return ColorBuffer< Monochrome8 >(0, 0);
+
+		// The buffer adopts the decoded pixels, which are freed with the same function they would have been
+		auto image   = std::move(heightImage);
+		auto deleter = image->pixels.get_deleter();
+
+		return ColorBuffer< Monochrome8 >(unsigned(image->width), unsigned(image->height), image->pixels.release(), deleter);
+	}
 }
@@ -16,30 +16,42 @@
 
 #include "Color.hpp"
 #include "ColorBuffer.hpp"
+#include "MappedFile.hpp"
+#include "MipmapGenerator.hpp"
+#include "PixelUploader.hpp"
+#include "TextureCompressor.hpp"
+#include "TextureManager.hpp"
 
 
 
+#include <functional>
+#include <future>
 #include <glad/glad.h>
+#include <map>
 #include <memory>
 #include <SOIL2.h>
 #include <string>
+#include <utility>
+#include <vector>
 
 
 
 namespace finalPractice
 {
 	/// <summary>
-	/// The Texture class represents a 2D or cubemap texture that can be used in OpenGL applications.
+	/// The Texture class represents a 2D, cubemap or 2D array texture that can be used in OpenGL applications.
 	/// It provides methods for loading textures from files and binding them to OpenGL.
 	/// </summary>
 	class Texture
 	{
+		friend class TextureManager;
+
 	private:
 
 		/// <summary>
 		/// Enumeration for texture types.
 		/// </summary>
-		enum TypeTexture { NO_TYPE, TEXTURE2D, TEXTURECUBEMAP };
+		enum TypeTexture { NO_TYPE, TEXTURE2D, TEXTURECUBEMAP, TEXTUREARRAY };
 
 	public:
 
@@ -48,12 +60,36 @@ namespace finalPractice
 		/// </summary>
 		enum TypeTexture2D { ALBEDO, NORMAL, HEIGHTMAP, CUBEMAP };
 
+	private:
+
+		/// <summary>
+		/// Pixels of an image file decoded by SOIL2 (freed with SOIL_free_image_data) plus the rest of its mip chain.
+		/// </summary>
+		struct DecodedImage
+		{
+			int					  width;						///< Width of the image in pixels.
+			int					 height;						///< Height of the image in pixels.
+			std::unique_ptr< uint8_t, void (*)(uint8_t *) > pixels; ///< Decoded pixels (nullptr if the file couldn't be decoded).
+			std::vector< ColorBuffer< Rgba8888 > > mipLevels;	///< Levels after the first one, generated with the image (RGBA images only).
+		};
+
+		using ImageKey = std::pair< std::string, int >;		///< Image file path plus the number of channels it is decoded to.
+
+		static std::map< ImageKey, std::shared_future< std::shared_ptr< DecodedImage > > > pendingImages; ///< Images being decoded by the thread pool.
+
 	private:
 
 		GLuint                   ID;						///< The OpenGL texture ID.
 		bool        textureIsLoaded;						///< Flag indicating whether the texture was successfully loaded.
+		bool               resident;						///< Flag indicating whether the texture is in video memory (false once evicted).
+
+		std::function< GLuint () > reload;					///< Creates the texture again from its files after it has been evicted.
+
+		TypeTexture            type;						///< The type of the texture (2D, cubemap or array).
+
+		std::shared_ptr< PixelUploader > uploader;			///< Ring of pixel buffer objects the texture is uploaded through.
 
-		TypeTexture            type;						///< The type of the texture (2D or cubemap).
+		std::shared_ptr< DecodedImage > heightImage;		///< Samples of the first upload of a height map, kept until they are taken.
 
 	public:
 
@@ -65,7 +101,7 @@ namespace finalPractice
 
 		/// <summary>
 		/// Destructor for the Texture class.
-		/// Deletes the texture from OpenGL if it has been loaded.
+		/// Deletes the texture from OpenGL if it is resident and stops its tracking by the TextureManager.
 		/// </summary>
 		~Texture();
 
@@ -84,6 +120,17 @@ namespace finalPractice
 		/// <param name="id">The OpenGL texture ID.</param>
 		void setID(GLuint id);
 
+	public:
+
+		/// <summary>
+		/// Starts decoding an image file on the shared thread pool, so the texture created later from it only
+		/// has to be uploaded. Must be called from the thread that creates the textures.
+		/// </summary>
+		/// 
+		/// <param name="imagePath">The file path of the image.</param>
+		/// <param name="texture2DType">The type of the texture the image will be used for (it decides the channels).</param>
+		static void prefetchImage(const std::string& imagePath, TypeTexture2D texture2DType);
+
 	public:
 
 		/// <summary>
@@ -94,80 +141,151 @@ namespace finalPractice
 		bool isOk() const;
 
 		/// <summary>
-		/// Binds the texture to OpenGL.
+		/// Marks the texture as the most recently used one and, if the TextureManager evicted it, loads it again
+		/// from its files (which stalls until they are decoded and uploaded).
+		/// </summary>
+		/// 
+		/// <returns>True if the texture had to be reloaded (it has a new ID that must be bound again), false otherwise.</returns>
+		bool makeResident();
+
+		/// <summary>
+		/// Binds the texture to OpenGL, reloading it first if it was evicted.
 		/// </summary>
 		/// 
 		/// <returns>True if the texture was successfully bound, false otherwise.</returns>
-		bool bind() const;
+		bool bind();
+
+		/// <summary>
+		/// Takes the samples the height map texture was created from, so the CPU copy of the height map
+		/// doesn't have to decode the image again. They are only kept from the first upload.
+		/// </summary>
+		/// 
+		/// <returns>The samples, one byte each, or an empty buffer if they were already taken or this isn't a height map.</returns>
+		ColorBuffer< Monochrome8 > takeHeightSamples();
 
 	private:
 
 		/// <summary>
-		/// Loads an image from a file into a ColorBuffer object.
+		/// Marks the texture as loaded and resident and starts its tracking by the TextureManager, which may
+		/// evict other textures to make room for it.
 		/// </summary>
 		/// 
-		/// <typeparam name="COLOR_FORMAT">The color format for the buffer.</typeparam>
+		/// <param name="size">Bytes used by the texture and its mip levels.</param>
+		void track(size_t size);
+
+		/// <summary>
+		/// Deletes the OpenGL texture to free its memory (called by the TextureManager), it is reloaded the next time it is bound.
+		/// </summary>
+		void evict();
+
+		/// <summary>
+		/// Gets the memory used by a decoded image and its mip chain once uploaded.
+		/// </summary>
 		/// 
-		/// <param name="imagePath">The file path of the image to load.</param>
+		/// <param name="image">The decoded image.</param>
+		/// <param name="texelSize">Bytes per texel of the texture.</param>
 		/// 
-		/// <returns>A unique pointer to the loaded ColorBuffer object, or nullptr if loading failed.</returns>
-		template< typename COLOR_FORMAT >
-		std::unique_ptr< ColorBuffer< COLOR_FORMAT > > loadImage(const std::string& imagePath, TypeTexture2D texture2DType)
-		{
-			{
-				int imageWidth    = 0;
-				int imageHeight   = 0;
-				int imageChannels = 0;
+		/// <returns>The size in bytes of every level.</returns>
+		static size_t getImageSize(const DecodedImage& image, size_t texelSize);
 
-				uint8_t* loadedPixels;
+		/// <summary>
+		/// Gets the number of channels an image is decoded to for a type of texture.
+		/// </summary>
+		/// 
+		/// <param name="texture2DType">The type of the texture.</param>
+		/// 
+		/// <returns>SOIL_LOAD_L for height maps and SOIL_LOAD_RGBA for everything else.</returns>
+		static int getImageChannels(TypeTexture2D texture2DType);
 
-				if (texture2DType == HEIGHTMAP)
-				{
-					loadedPixels = SOIL_load_image
-					(
-						imagePath.c_str(),
-						&imageWidth,
-						&imageHeight,
-						&imageChannels,
-						SOIL_LOAD_L
-					);
-				}
-				else
-				{
-					loadedPixels = SOIL_load_image
-					(
-						imagePath.c_str(),
-						&imageWidth,
-						&imageHeight,
-						&imageChannels,
-						SOIL_LOAD_RGBA
-					);
-				}
+		/// <summary>
+		/// Decodes an image file without any GL call (it can run on any thread). The mip chain of RGBA images is
+		/// generated as well, filtered in linear light.
+		/// </summary>
+		/// 
+		/// <param name="imagePath">The file path of the image.</param>
+		/// <param name="channels">The number of channels to decode the image to.</param>
+		/// 
+		/// <returns>The decoded image.</returns>
+		static std::shared_ptr< DecodedImage > decodeImage(const std::string& imagePath, int channels);
 
-				if (loadedPixels)
-				{
-					auto image = std::make_unique< ColorBuffer< COLOR_FORMAT > >(imageWidth, imageHeight);
+		/// <summary>
+		/// Returns the decoded image of a file, waiting for its prefetch if there is one or decoding it otherwise.
+		/// </summary>
+		/// 
+		/// <param name="imagePath">The file path of the image.</param>
+		/// <param name="texture2DType">The type of the texture the image is used for.</param>
+		/// 
+		/// <returns>The decoded image.</returns>
+		static std::shared_ptr< DecodedImage > takeImage(const std::string& imagePath, TypeTexture2D texture2DType);
 
-					// Copy the pixel data into the color buffer
-					std::copy_n
-					(
-						loadedPixels,
-						size_t(imageWidth) * size_t(imageHeight) * sizeof(COLOR_FORMAT),
-						reinterpret_cast<uint8_t*>(image->colors())
-					);
+		/// <summary>
+		/// Uploads a decoded RGBA image and its mip chain to the texture bound to target.
+		/// </summary>
+		/// 
+		/// <param name="target">Texture target (GL_TEXTURE_2D or a face of a cube map).</param>
+		/// <param name="image">The decoded image.</param>
+		void uploadImage(GLenum target, const DecodedImage& image);
 
-					// Free the image data after copying
-					SOIL_free_image_data(loadedPixels);
+		/// <summary>
+		/// Checks whether the GPU can sample a block compressed format (BC1 and BC3 need the S3TC extension and
+		/// BC7 the BPTC one, BC5 and RGBA8 are core in OpenGL 3.3).
+		/// </summary>
+		/// 
+		/// <param name="format">The block compressed format.</param>
+		/// 
+		/// <returns>True if textures with the format can be created, false otherwise.</returns>
+		static bool isFormatSupported(TextureCompressor::Format format);
 
-					return image;
-				}
+		/// <summary>
+		/// Maps the compressed file of an image when there is an up to date one in a format the GPU supports.
+		/// </summary>
+		/// 
+		/// <param name="imagePath">The file path of the source image.</param>
+		/// <param name="image">Receives the format, size and levels of the compressed image.</param>
+		/// 
+		/// <returns>The mapped file, or nullptr if the image has to be decoded instead.</returns>
+		static std::unique_ptr< MappedFile > mapCompressed(const std::string& imagePath, TextureCompressor::DdsImage& image);
 
-				return nullptr;
-			}
-		}
+		/// <summary>
+		/// Uploads every level of a compressed image, straight from the mapped file, to the texture bound to target.
+		/// </summary>
+		/// 
+		/// <param name="target">Texture target (GL_TEXTURE_2D or a face of a cube map).</param>
+		/// <param name="file">The mapped compressed file.</param>
+		/// <param name="image">The format, size and levels of the compressed image.</param>
+		void uploadCompressed(GLenum target, const MappedFile& file, const TextureCompressor::DdsImage& image);
+
+		/// <summary>
+		/// Creates a 2D texture from the compressed file of an image, with the mip levels stored in it.
+		/// </summary>
+		/// 
+		/// <param name="texturePath">The file path of the source image.</param>
+		/// 
+		/// <returns>The OpenGL texture ID on success, or -1 if there is no usable compressed file.</returns>
+		GLuint createCompressedTexture2D(const std::string& texturePath);
+
+		/// <summary>
+		/// Creates a cubemap texture from the compressed files of its six sides, with the mip levels stored in them.
+		/// </summary>
+		/// 
+		/// <param name="texturePath">The file path for the cubemap texture images.</param>
+		/// 
+		/// <returns>The OpenGL texture ID on success, or -1 if any side has no usable compressed file.</returns>
+		GLuint createCompressedTextureCubeMap(const std::string& texturePath);
 
 	public:
 
+		/// <summary>
+		/// Creates a 2D array texture with one layer per albedo image, so meshes using any of them can be drawn
+		/// without binding another texture. Every layer has the size of the largest image (smaller ones are
+		/// resampled) and its own mip chain, so the layers never bleed into each other when minified.
+		/// </summary>
+		/// 
+		/// <param name="texturePaths">The file paths of the images, in layer order.</param>
+		/// 
+		/// <returns>The OpenGL texture ID on success, or -1 if any image couldn't be decoded.</returns>
+		GLuint createTextureArray(const std::vector< std::string >& texturePaths);
+
 		/// <summary>
 		/// Creates a 2D texture from an image file and uploads it to OpenGL.
 		/// </summary>
@@ -181,9 +299,21 @@ namespace finalPractice
 		template< typename COLOR_FORMAT >
 		GLuint createTexture2D(const std::string& texturePath, TypeTexture2D texture2DType)
 		{
-			auto image = loadImage< COLOR_FORMAT >(texturePath, texture2DType);
+			if (not reload)
+				reload = [this, texturePath, texture2DType] () { return createTexture2D< COLOR_FORMAT >(texturePath, texture2DType); };
 
-			if (image)
+			// Use the compressed file when there is one, it needs no decoding and has its mip levels already
+			if (texture2DType == ALBEDO)
+			{
+				GLuint textureID = createCompressedTexture2D(texturePath);
+
+				if (textureID != GLuint(-1))
+					return textureID;
+			}
+
+			auto image = takeImage(texturePath, texture2DType);
+
+			if (image->pixels)
 			{
 				GLuint textureID;
 
@@ -194,44 +324,44 @@ namespace finalPractice
 				// Set texture parameters
 				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-				// Upload the texture based on its type
+				uploader = PixelUploader::acquire();
+
+				// Upload the texture based on its type (the decoded pixels are staged in a pixel buffer object)
 				if (texture2DType == ALBEDO)
 				{
-					glTexImage2D
-					(
-						GL_TEXTURE_2D,
-						0,
-						GL_RGBA,
-						image->getWidth(),
-						image->getHeight(),
-						0,
-						GL_RGBA,
-						GL_UNSIGNED_BYTE,
-						image->colors()
-					);
+					// The mip chain was generated along with the image, no glGenerateMipmap stall
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, image->mipLevels.empty() ? GL_LINEAR : GL_LINEAR_MIPMAP_LINEAR);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(image->mipLevels.size()));
+
+					uploadImage(GL_TEXTURE_2D, *image);
 				}
 				else if (texture2DType == HEIGHTMAP)
 				{
-					glTexImage2D
+					// Height maps are only sampled by the vertex shader, which always reads the first level
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+					uploader->upload
 					(
 						GL_TEXTURE_2D,
 						0,
 						GL_R8,
-						image->getWidth(),
-						image->getHeight(),
-						0,
+						image->width,
+						image->height,
 						GL_RED,
 						GL_UNSIGNED_BYTE,
-						image->colors()
+						image->pixels.get(),
+						size_t(image->width) * size_t(image->height) * sizeof(COLOR_FORMAT)
 					);
-				}
 
-				glGenerateMipmap(GL_TEXTURE_2D);
+					// The first upload keeps the samples for the CPU copy, reloads after an eviction don't
+					if (not textureIsLoaded)
+						heightImage = image;
+				}
 
-				textureIsLoaded = true;
+				track(getImageSize(*image, sizeof(COLOR_FORMAT)));
 				type = TEXTURE2D;
 
 				return textureID;
@@ -252,14 +382,26 @@ namespace finalPractice
 		template< typename COLOR_FORMAT >
 		GLuint createTextureCubeMap(const std::string& texturePath)
 		{
-			std::vector< std::unique_ptr< ColorBuffer< COLOR_FORMAT > > > textureSides(6);
+			if (not reload)
+				reload = [this, texturePath] () { return createTextureCubeMap< COLOR_FORMAT >(texturePath); };
+
+			GLuint compressedID = createCompressedTextureCubeMap(texturePath);
+
+			if (compressedID != GLuint(-1))
+				return compressedID;
+
+			std::vector< std::shared_ptr< DecodedImage > > textureSides(6);
+
+			// Decode the six sides in parallel (sides already prefetched are not decoded again)
+			for (size_t i = 0; i < 6; ++i)
+				prefetchImage(texturePath + char('0' + i) + ".png", CUBEMAP);
 
 			// Load each side of the cubemap
 			for (size_t i = 0; i < 6; ++i)
 			{
-				textureSides[i] = loadImage< COLOR_FORMAT >(texturePath + char('0' + i) + ".png", CUBEMAP);
+				textureSides[i] = takeImage(texturePath + char('0' + i) + ".png", CUBEMAP);
 
-				if (!textureSides[i])
+				if (!textureSides[i]->pixels)
 					return -1;
 			}
 
@@ -272,10 +414,11 @@ namespace finalPractice
 
 			// Set texture parameters
 			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, textureSides[0]->mipLevels.empty() ? GL_LINEAR : GL_LINEAR_MIPMAP_LINEAR);
 			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, GLint(textureSides[0]->mipLevels.size()));
 
 			// Texture targets for the 6 cubemap faces
 			static const GLenum textureTarget[] =
@@ -288,26 +431,13 @@ namespace finalPractice
 				GL_TEXTURE_CUBE_MAP_NEGATIVE_Y,
 			};
 
-			// Upload each side of the cubemap
+			uploader = PixelUploader::acquire();
+
+			// Upload each side of the cubemap with its mip chain (the decoded pixels are staged in a pixel buffer object)
 			for (size_t i = 0; i < 6; ++i)
-			{
-				ColorBuffer< COLOR_FORMAT >& texture = *textureSides[i];
-
-				glTexImage2D
-				(
-					textureTarget[i],
-					0,
-					GL_RGBA,
-					texture.getWidth(),
-					texture.getHeight(),
-					0,
-					GL_RGBA,
-					GL_UNSIGNED_BYTE,
-					texture.colors()
-				);
-			}
+				uploadImage(textureTarget[i], *textureSides[i]);
 
-			textureIsLoaded = true;
+			track(6 * getImageSize(*textureSides[0], sizeof(Rgba8888)));
 			type = TEXTURECUBEMAP;
 
 			return textureID;
@@ -0,0 +1,634 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "TextureCompressor.hpp"
+
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <SOIL2.h>
+
+
+
+namespace finalPractice
+{
+	const char TextureCompressor::ddsMagic[4] = { 'D', 'D', 'S', ' ' };
+
+	static_assert(sizeof(TextureCompressor::DdsPixelFormat) ==  32, "DDS pixel format must be 32 bytes");
+	static_assert(sizeof(TextureCompressor::DdsHeader     ) == 124, "DDS header must be 124 bytes");
+	static_assert(sizeof(TextureCompressor::DdsHeaderDx10 ) ==  20, "DDS DX10 header must be 20 bytes");
+
+	// Values of the DDS headers
+	static const uint32_t ddsFlagsTexture   = 0x1 | 0x2 | 0x4 | 0x1000;					// CAPS, HEIGHT, WIDTH, PIXELFORMAT
+	static const uint32_t ddsFlagMipMapCount = 0x20000;
+	static const uint32_t ddsFlagPitch       = 0x8;
+	static const uint32_t ddsFlagLinearSize  = 0x80000;
+	static const uint32_t ddpfFourCC         = 0x4;
+	static const uint32_t ddsCapsTexture     = 0x1000;
+	static const uint32_t ddsCapsMipMap      = 0x400000 | 0x8;								// MIPMAP, COMPLEX
+	static const uint32_t dx10Texture2D      = 3;
+
+	// DXGI_FORMAT values of the formats in the DX10 header
+	static const uint32_t dxgiFormats[] = { 71, 77, 83, 98, 28 };							// BC1_UNORM, BC3_UNORM, BC5_UNORM, BC7_UNORM, R8G8B8A8_UNORM
+
+	// Interpolation weights of the 4-bit BC7 indices
+	static const int bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+
+
+	static uint32_t makeFourCC(char a, char b, char c, char d)
+	{
+		return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+	}
+
+	// Finds the mean and the principal axis (power iteration on the covariance matrix) of the texels of a block
+	static void findPrincipalAxis(const float points[16][4], int channels, float mean[4], float axis[4])
+	{
+		float covariance[4][4] = {};
+
+		for (int c = 0; c < 4; ++c)
+		{
+			mean[c] = 0.f;
+
+			for (int i = 0; i < 16; ++i)
+				mean[c] += points[i][c];
+
+			mean[c] /= 16.f;
+		}
+
+		for (int i = 0; i < 16; ++i)
+			for (int r = 0; r < channels; ++r)
+				for (int c = 0; c < channels; ++c)
+					covariance[r][c] += (points[i][r] - mean[r]) * (points[i][c] - mean[c]);
+
+		for (int c = 0; c < 4; ++c)
+			axis[c] = c < channels ? 1.f : 0.f;
+
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[4] = {};
+			float length  = 0.f;
+
+			for (int r = 0; r < channels; ++r)
+			{
+				for (int c = 0; c < channels; ++c)
+					next[r] += covariance[r][c] * axis[c];
+
+				length = std::max(length, std::abs(next[r]));
+			}
+
+			if (length == 0.f)
+				break;													// Every texel has the same color
+
+			for (int c = 0; c < channels; ++c)
+				axis[c] = next[c] / length;
+		}
+	}
+
+	// Finds the extreme points of the texels of a block along its principal axis
+	static void findEndpoints(const float points[16][4], int channels, float start[4], float end[4])
+	{
+		float mean[4], axis[4];
+
+		findPrincipalAxis(points, channels, mean, axis);
+
+		float minimum = std::numeric_limits< float >::max();
+		float maximum = std::numeric_limits< float >::lowest();
+
+		for (int i = 0; i < 16; ++i)
+		{
+			float t = 0.f;
+
+			for (int c = 0; c < channels; ++c)
+				t += (points[i][c] - mean[c]) * axis[c];
+
+			minimum = std::min(minimum, t);
+			maximum = std::max(maximum, t);
+		}
+
+		float axisLength = 0.f;
+
+		for (int c = 0; c < channels; ++c)
+			axisLength += axis[c] * axis[c];
+
+		if (axisLength > 0.f)
+		{
+			minimum /= axisLength;
+			maximum /= axisLength;
+		}
+
+		for (int c = 0; c < 4; ++c)
+		{
+			start[c] = std::clamp(mean[c] + axis[c] * minimum, 0.f, 255.f);
+			end  [c] = std::clamp(mean[c] + axis[c] * maximum, 0.f, 255.f);
+		}
+	}
+
+	static uint16_t packRgb565(const float color[4])
+	{
+		unsigned r = unsigned(std::lround(color[0] * 31.f / 255.f));
+		unsigned g = unsigned(std::lround(color[1] * 63.f / 255.f));
+		unsigned b = unsigned(std::lround(color[2] * 31.f / 255.f));
+
+		return uint16_t(r << 11 | g << 5 | b);
+	}
+
+	static void unpackRgb565(uint16_t packed, int color[3])
+	{
+		int r = (packed >> 11) & 31;
+		int g = (packed >>  5) & 63;
+		int b =  packed        & 31;
+
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	// Frees an image decoded by SOIL2 once a ColorBuffer has adopted it
+	static void freeImage(Rgba8888 * colors)
+	{
+		SOIL_free_image_data(reinterpret_cast< unsigned char * >(colors));
+	}
+
+	// Writes fields of up to 32 bits into a block, least significant bit first
+	static void writeBits(uint8_t * output, unsigned& position, uint32_t value, unsigned bitCount)
+	{
+		for (unsigned i = 0; i < bitCount; ++i, ++position)
+		{
+			if (value & (1u << i))
+				output[position >> 3] |= uint8_t(1u << (position & 7));
+		}
+	}
+
+
+
+	bool TextureCompressor::compress(const std::string& imagePath, Format format, MipmapGenerator::Filter filter)
+	{
+		int width    = 0;
+		int height   = 0;
+		int channels = 0;
+
+		uint8_t * pixels = SOIL_load_image(imagePath.c_str(), &width, &height, &channels, SOIL_LOAD_RGBA);
+
+		if (not pixels) // ERROR condition
+		{
+			std::cerr << "Couldn't load image " << imagePath << std::endl;
+			return false;
+		}
+
+		// The buffer adopts the decoded pixels instead of copying them
+		ColorBuffer< Rgba8888 > image(width, height, reinterpret_cast< Rgba8888 * >(pixels), freeImage);
+
+		// Encode every level down to 1x1 (BC5 holds normals, which aren't sRGB colors)
+		std::vector< std::vector< uint8_t > > levels;
+
+		levels.push_back(compressImage(image, format));
+
+		for (const ColorBuffer< Rgba8888 > & level : MipmapGenerator::generate(image, filter, format != BC5))
+			levels.push_back(compressImage(level, format));
+
+		DdsHeader     header      = {};
+		DdsHeaderDx10 header10    = {};
+
+		header.size              = sizeof(DdsHeader);
+		header.flags             = ddsFlagsTexture | ddsFlagMipMapCount | (format == RGBA8 ? ddsFlagPitch : ddsFlagLinearSize);
+		header.width             = uint32_t(width);
+		header.height            = uint32_t(height);
+		header.pitchOrLinearSize = uint32_t(format == RGBA8 ? width * sizeof(Rgba8888) : levels.front().size());
+		header.mipMapCount       = uint32_t(levels.size());
+		header.pixelFormat.size   = sizeof(DdsPixelFormat);
+		header.pixelFormat.flags  = ddpfFourCC;
+		header.pixelFormat.fourCC = makeFourCC('D', 'X', '1', '0');
+		header.caps[0]            = ddsCapsTexture | (levels.size() > 1 ? ddsCapsMipMap : 0);
+
+		header10.dxgiFormat        = dxgiFormats[format];
+		header10.resourceDimension = dx10Texture2D;
+		header10.arraySize         = 1;
+
+		std::string   compressedPath = getCompressedPath(imagePath);
+		std::ofstream file(compressedPath, std::ios::binary | std::ios::trunc);
+
+		if (not file) // ERROR condition
+		{
+			std::cerr << "Couldn't write compressed texture " << compressedPath << std::endl;
+			return false;
+		}
+
+		file.write(ddsMagic, sizeof(ddsMagic));
+		file.write(reinterpret_cast< const char * >(&header  ), sizeof(header  ));
+		file.write(reinterpret_cast< const char * >(&header10), sizeof(header10));
+
+		for (const std::vector< uint8_t > & level : levels)
+			file.write(reinterpret_cast< const char * >(level.data()), std::streamsize(level.size()));
+
+		return bool(file);
+	}
+
+	std::vector< uint8_t > TextureCompressor::compressImage(const ColorBuffer< Rgba8888 >& image, Format format)
+	{
+		unsigned width  = image.getWidth ();
+		unsigned height = image.getHeight();
+
+		if (format == RGBA8)
+		{
+			const uint8_t * texels = reinterpret_cast< const uint8_t * >(image.colors());
+
+			return std::vector< uint8_t >(texels, texels + getLevelSize(format, width, height));
+		}
+
+		size_t blockSize = getBlockSize(format);
+
+		std::vector< uint8_t > blocks(getLevelSize(format, width, height), 0);
+
+		uint8_t * output = blocks.data();
+
+		for (unsigned blockY = 0; blockY < height; blockY += 4)
+		{
+			for (unsigned blockX = 0; blockX < width; blockX += 4, output += blockSize)
+			{
+				Rgba8888 block[16];
+
+				// Gather the texels of the block, repeating the last column and row at the borders
+				for (unsigned y = 0; y < 4; ++y)
+				{
+					for (unsigned x = 0; x < 4; ++x)
+					{
+						unsigned imageX = std::min(blockX + x, width  - 1);
+						unsigned imageY = std::min(blockY + y, height - 1);
+
+						block[y * 4 + x] = image.get(imageY * width + imageX);
+					}
+				}
+
+				uint8_t channel[2][16];
+
+				switch (format)
+				{
+					case BC1:
+					{
+						encodeBC1(block, output);
+						break;
+					}
+
+					case BC3:
+					{
+						for (int i = 0; i < 16; ++i)
+							channel[0][i] = block[i].components[Rgba8888::ALPHA];
+
+						encodeBC4(channel[0], output);
+						encodeBC1(block, output + 8);
+						break;
+					}
+
+					case BC5:
+					{
+						for (int i = 0; i < 16; ++i)
+						{
+							channel[0][i] = block[i].components[Rgba8888::RED  ];
+							channel[1][i] = block[i].components[Rgba8888::GREEN];
+						}
+
+						encodeBC4(channel[0], output);
+						encodeBC4(channel[1], output + 8);
+						break;
+					}
+
+					case BC7:
+					{
+						encodeBC7(block, output);
+						break;
+					}
+
+					case RGBA8:
+						break;											// Copied as it is above
+				}
+			}
+		}
+
+		return blocks;
+	}
+
+	bool TextureCompressor::parseDds(const uint8_t * data, size_t size, DdsImage& image)
+	{
+		if (size < sizeof(ddsMagic) + sizeof(DdsHeader) || std::memcmp(data, ddsMagic, sizeof(ddsMagic)) != 0)
+			return false;
+
+		DdsHeader header;
+
+		std::memcpy(&header, data + sizeof(ddsMagic), sizeof(header));
+
+		if (header.size != sizeof(DdsHeader) || not (header.pixelFormat.flags & ddpfFourCC) || header.width == 0 || header.height == 0)
+			return false;
+
+		image.width      = header.width;
+		image.height     = header.height;
+		image.levelCount = (header.flags & ddsFlagMipMapCount) ? std::max(header.mipMapCount, 1u) : 1u;
+		image.dataOffset = sizeof(ddsMagic) + sizeof(DdsHeader);
+
+		// More levels than the full chain would shift the size past its bits and upload levels that don't exist
+		if (image.levelCount > MipmapGenerator::getLevelCount(image.width, image.height))
+			return false;
+
+		uint32_t fourCC = header.pixelFormat.fourCC;
+
+		if      (fourCC == makeFourCC('D', 'X', 'T', '1'))
+			image.format = BC1;
+		else if (fourCC == makeFourCC('D', 'X', 'T', '5'))
+			image.format = BC3;
+		else if (fourCC == makeFourCC('A', 'T', 'I', '2') || fourCC == makeFourCC('B', 'C', '5', 'U'))
+			image.format = BC5;
+		else if (fourCC == makeFourCC('D', 'X', '1', '0'))
+		{
+			if (size < image.dataOffset + sizeof(DdsHeaderDx10))
+				return false;
+
+			DdsHeaderDx10 header10;
+
+			std::memcpy(&header10, data + image.dataOffset, sizeof(header10));
+
+			image.dataOffset += sizeof(DdsHeaderDx10);
+
+			if (header10.resourceDimension != dx10Texture2D || header10.arraySize != 1)
+				return false;
+
+			auto known = std::find(std::begin(dxgiFormats), std::end(dxgiFormats), header10.dxgiFormat);
+
+			if (known == std::end(dxgiFormats))
+				return false;
+
+			image.format = Format(known - std::begin(dxgiFormats));
+		}
+		else
+			return false;
+
+		// Every level must be inside the file
+		size_t dataSize = 0;
+
+		for (unsigned level = 0; level < image.levelCount; ++level)
+			dataSize += getLevelSize(image.format, std::max(image.width >> level, 1u), std::max(image.height >> level, 1u));
+
+		return image.dataOffset + dataSize <= size;
+	}
+
+	std::string TextureCompressor::getCompressedPath(const std::string& imagePath)
+	{
+		size_t extension = imagePath.find_last_of('.');
+		size_t separator = imagePath.find_last_of("/\\");
+
+		if (extension == std::string::npos || (separator != std::string::npos && extension < separator))
+			return imagePath + ".dds";
+
+		return imagePath.substr(0, extension) + ".dds";
+	}
+
+	bool TextureCompressor::hasCompressedFile(const std::string& imagePath)
+	{
+		std::error_code sourceError, compressedError;
+
+		auto sourceTime     = std::filesystem::last_write_time(imagePath,                    sourceError    );
+		auto compressedTime = std::filesystem::last_write_time(getCompressedPath(imagePath), compressedError);
+
+		// A compressed file older than its source has to be compressed again
+		return not compressedError && (sourceError || sourceTime <= compressedTime);
+	}
+
+	size_t TextureCompressor::getBlockSize(Format format)
+	{
+		return format == BC1 ? 8 : format == RGBA8 ? 16 * sizeof(Rgba8888) : 16;
+	}
+
+	size_t TextureCompressor::getLevelSize(Format format, unsigned width, unsigned height)
+	{
+		// Uncompressed levels aren't padded to whole blocks
+		if (format == RGBA8)
+			return size_t(width) * size_t(height) * sizeof(Rgba8888);
+
+		return size_t((width + 3) / 4) * size_t((height + 3) / 4) * getBlockSize(format);
+	}
+
+
+
+	void TextureCompressor::encodeBC1(const Rgba8888 block[16], uint8_t * output)
+	{
+		float points[16][4];
+
+		for (int i = 0; i < 16; ++i)
+			for (int c = 0; c < 4; ++c)
+				points[i][c] = float(block[i].components[c]);
+
+		float start[4], end[4];
+
+		findEndpoints(points, 3, start, end);
+
+		uint16_t color0 = packRgb565(end  );
+		uint16_t color1 = packRgb565(start);
+
+		// color0 > color1 selects the four color mode (no transparent texels)
+		if (color0 < color1)
+			std::swap(color0, color1);
+
+		uint32_t indices = 0;
+
+		if (color0 != color1)
+		{
+			int palette[4][3];
+
+			unpackRgb565(color0, palette[0]);
+			unpackRgb565(color1, palette[1]);
+
+			for (int c = 0; c < 3; ++c)
+			{
+				palette[2][c] = (2 * palette[0][c] +     palette[1][c]) / 3;
+				palette[3][c] = (    palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+
+			for (int i = 0; i < 16; ++i)
+			{
+				int bestError = std::numeric_limits< int >::max();
+				int bestIndex = 0;
+
+				for (int index = 0; index < 4; ++index)
+				{
+					int error = 0;
+
+					for (int c = 0; c < 3; ++c)
+					{
+						int difference = int(block[i].components[c]) - palette[index][c];
+
+						error += difference * difference;
+					}
+
+					if (error < bestError)
+					{
+						bestError = error;
+						bestIndex = index;
+					}
+				}
+
+				indices |= uint32_t(bestIndex) << (2 * i);
+			}
+		}
+
+		output[0] = uint8_t(color0     ); output[1] = uint8_t(color0 >> 8);
+		output[2] = uint8_t(color1     ); output[3] = uint8_t(color1 >> 8);
+		output[4] = uint8_t(indices    ); output[5] = uint8_t(indices >>  8);
+		output[6] = uint8_t(indices >> 16); output[7] = uint8_t(indices >> 24);
+	}
+
+	void TextureCompressor::encodeBC4(const uint8_t values[16], uint8_t * output)
+	{
+		uint8_t minimum = *std::min_element(values, values + 16);
+		uint8_t maximum = *std::max_element(values, values + 16);
+
+		std::memset(output, 0, 8);
+
+		output[0] = maximum;
+		output[1] = minimum;
+
+		if (maximum == minimum)
+			return;														// Every index selects the first endpoint
+
+		// maximum > minimum selects the eight value mode: both endpoints and six interpolated values
+		int palette[8] = { maximum, minimum };
+
+		for (int k = 1; k < 7; ++k)
+			palette[k + 1] = ((7 - k) * maximum + k * minimum) / 7;
+
+		unsigned position = 16;
+
+		for (int i = 0; i < 16; ++i)
+		{
+			int bestError = std::numeric_limits< int >::max();
+			int bestIndex = 0;
+
+			for (int index = 0; index < 8; ++index)
+			{
+				int error = std::abs(int(values[i]) - palette[index]);
+
+				if (error < bestError)
+				{
+					bestError = error;
+					bestIndex = index;
+				}
+			}
+
+			writeBits(output, position, uint32_t(bestIndex), 3);
+		}
+	}
+
+	void TextureCompressor::encodeBC7(const Rgba8888 block[16], uint8_t * output)
+	{
+		float points[16][4];
+
+		for (int i = 0; i < 16; ++i)
+			for (int c = 0; c < 4; ++c)
+				points[i][c] = float(block[i].components[c]);
+
+		float start[4], end[4];
+
+		findEndpoints(points, 4, start, end);
+
+		// Try the four combinations of p-bits (the lowest bit shared by the four channels of an endpoint)
+		int      bestEndpoints[2][4] = {};
+		int      bestPBits[2]        = {};
+		uint8_t  bestIndices[16]     = {};
+		int64_t  bestError           = std::numeric_limits< int64_t >::max();
+
+		for (int pBits = 0; pBits < 4; ++pBits)
+		{
+			int pBit[2] = { pBits & 1, pBits >> 1 };
+			int endpoints[2][4];
+			int values[2][4];
+
+			for (int c = 0; c < 4; ++c)
+			{
+				endpoints[0][c] = std::clamp(int(std::lround((start[c] - pBit[0]) * .5f)), 0, 127);
+				endpoints[1][c] = std::clamp(int(std::lround((end  [c] - pBit[1]) * .5f)), 0, 127);
+				values   [0][c] = endpoints[0][c] << 1 | pBit[0];
+				values   [1][c] = endpoints[1][c] << 1 | pBit[1];
+			}
+
+			int palette[16][4];
+
+			for (int index = 0; index < 16; ++index)
+				for (int c = 0; c < 4; ++c)
+					palette[index][c] = ((64 - bc7Weights[index]) * values[0][c] + bc7Weights[index] * values[1][c] + 32) >> 6;
+
+			uint8_t indices[16];
+			int64_t totalError = 0;
+
+			for (int i = 0; i < 16; ++i)
+			{
+				int bestTexelError = std::numeric_limits< int >::max();
+
+				for (int index = 0; index < 16; ++index)
+				{
+					int error = 0;
+
+					for (int c = 0; c < 4; ++c)
+					{
+						int difference = int(block[i].components[c]) - palette[index][c];
+
+						error += difference * difference;
+					}
+
+					if (error < bestTexelError)
+					{
+						bestTexelError = error;
+						indices[i]     = uint8_t(index);
+					}
+				}
+
+				totalError += bestTexelError;
+			}
+
+			if (totalError < bestError)
+			{
+				bestError = totalError;
+
+				std::memcpy(bestEndpoints, endpoints, sizeof(endpoints));
+				std::memcpy(bestPBits,     pBit,      sizeof(pBit));
+				std::memcpy(bestIndices,   indices,   sizeof(indices));
+			}
+		}
+
+		// The highest bit of the first index is implicit (0): swap the endpoints when it would be set
+		if (bestIndices[0] & 8)
+		{
+			for (int c = 0; c < 4; ++c)
+				std::swap(bestEndpoints[0][c], bestEndpoints[1][c]);
+
+			std::swap(bestPBits[0], bestPBits[1]);
+
+			for (uint8_t & index : bestIndices)
+				index = uint8_t(15 - index);
+		}
+
+		std::memset(output, 0, 16);
+
+		unsigned position = 0;
+
+		writeBits(output, position, 1u << 6, 7);								// Mode 6
+
+		for (int c = 0; c < 4; ++c)
+		{
+			writeBits(output, position, uint32_t(bestEndpoints[0][c]), 7);
+			writeBits(output, position, uint32_t(bestEndpoints[1][c]), 7);
+		}
+
+		writeBits(output, position, uint32_t(bestPBits[0]), 1);
+		writeBits(output, position, uint32_t(bestPBits[1]), 1);
+
+		for (int i = 0; i < 16; ++i)
+			writeBits(output, position, bestIndices[i], i == 0 ? 3 : 4);
+	}
+}
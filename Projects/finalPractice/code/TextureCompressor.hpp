@@ -0,0 +1,214 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef TEXTURECOMPRESSOR_HEADER
+#define TEXTURECOMPRESSOR_HEADER
+
+
+
+#include "Color.hpp"
+#include "ColorBuffer.hpp"
+#include "MipmapGenerator.hpp"
+
+
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// TextureCompressor encodes images into GPU block compressed formats (BC1, BC3, BC5 and BC7) and stores
+	/// them with their whole mip chain in DDS files, which Texture uploads with glCompressedTexImage2D instead
+	/// of decoding the source image. Every block of 4x4 texels is encoded independently. Images can also be
+	/// stored uncompressed (RGBA8) with just their mip chain baked.
+	/// </summary>
+	class TextureCompressor
+	{
+		public:
+
+			/// <summary>
+			/// Block compressed formats.
+			/// </summary>
+			enum Format : uint32_t
+			{
+				BC1,											///< RGB in 8 bytes per block (4 bits per texel), opaque.
+				BC3,											///< RGBA in 16 bytes per block: BC1 colors plus interpolated alpha.
+				BC5,											///< Two channels (RG) in 16 bytes per block, used for normal maps.
+				BC7,											///< RGBA in 16 bytes per block with the best quality of the four.
+				RGBA8											///< Uncompressed RGBA with 8 bits per component, only the mip chain is baked.
+			};
+
+			/// <summary>
+			/// Pixel format part of the DDS header.
+			/// </summary>
+			struct DdsPixelFormat
+			{
+				uint32_t				   size;				///< Size of the structure (32).
+				uint32_t				  flags;				///< DDPF_FOURCC for compressed formats.
+				uint32_t				 fourCC;				///< Compressed format ("DXT1", "DXT5", "ATI2" or "DX10").
+				uint32_t		   rgbBitCount;					///< Unused by compressed formats.
+				uint32_t			   masks[4];				///< Unused by compressed formats.
+			};
+
+			/// <summary>
+			/// Header following the "DDS " magic at the start of a DDS file.
+			/// </summary>
+			struct DdsHeader
+			{
+				uint32_t				   size;				///< Size of the structure (124).
+				uint32_t				  flags;				///< Fields of the header that are valid.
+				uint32_t				 height;				///< Height of the first level in pixels.
+				uint32_t				  width;				///< Width of the first level in pixels.
+				uint32_t		 pitchOrLinearSize;				///< Size in bytes of the first level.
+				uint32_t				  depth;				///< Unused by 2D textures.
+				uint32_t		   mipMapCount;					///< Number of levels stored in the file.
+				uint32_t		   reserved1[11];				///< Unused.
+				DdsPixelFormat	   pixelFormat;					///< Format of the texels.
+				uint32_t				caps[4];				///< Surface capabilities.
+				uint32_t			  reserved2;				///< Unused.
+			};
+
+			/// <summary>
+			/// Extended header that follows DdsHeader when its fourCC is "DX10".
+			/// </summary>
+			struct DdsHeaderDx10
+			{
+				uint32_t			 dxgiFormat;				///< DXGI_FORMAT of the texels.
+				uint32_t	  resourceDimension;				///< 3 for 2D textures.
+				uint32_t			  miscFlag;					///< Unused by 2D textures.
+				uint32_t			 arraySize;					///< Number of textures (1).
+				uint32_t			 miscFlags2;				///< Alpha mode.
+			};
+
+			/// <summary>
+			/// Description of the compressed image stored in a DDS file.
+			/// </summary>
+			struct DdsImage
+			{
+				Format					 format;				///< Block compressed format of the levels.
+				unsigned				  width;				///< Width of the first level in pixels.
+				unsigned				 height;				///< Height of the first level in pixels.
+				unsigned			 levelCount;				///< Number of levels stored (each half the size of the previous one).
+				size_t			     dataOffset;				///< Offset of the first level inside the file, the others follow it.
+			};
+
+			static const char ddsMagic[4];						///< Identifier at the start of a DDS file ("DDS ").
+
+		public:
+
+			/// <summary>
+			/// Compresses an image file with all its mip levels and writes the result next to it (same name with
+			/// the ".dds" extension). The levels of color formats are filtered in linear light.
+			/// </summary>
+			///
+			/// <param name="imagePath">The path of the image to be compressed.</param>
+			/// <param name="format">The block compressed format.</param>
+			/// <param name="filter">The filter used to generate the mip chain.</param>
+			///
+			/// <returns>True if the compressed file was written, false otherwise.</returns>
+			static bool compress(const std::string& imagePath, Format format, MipmapGenerator::Filter filter);
+
+			/// <summary>
+			/// Encodes an image into blocks. The texels of the incomplete blocks at the right and bottom borders are
+			/// repeated from the last column and row.
+			/// </summary>
+			///
+			/// <param name="image">The image to be encoded.</param>
+			/// <param name="format">The block compressed format.</param>
+			///
+			/// <returns>The encoded blocks, row by row.</returns>
+			static std::vector< uint8_t > compressImage(const ColorBuffer< Rgba8888 >& image, Format format);
+
+			/// <summary>
+			/// Reads the headers of a DDS file and checks that its levels are inside it.
+			/// </summary>
+			///
+			/// <param name="data">The contents of the file.</param>
+			/// <param name="size">Size of the file in bytes.</param>
+			/// <param name="image">Receives the description of the compressed image.</param>
+			///
+			/// <returns>True if the file is a supported 2D block compressed DDS, false otherwise.</returns>
+			static bool parseDds(const uint8_t * data, size_t size, DdsImage& image);
+
+			/// <summary>
+			/// Returns the path of the compressed file of an image (same name with the ".dds" extension).
+			/// </summary>
+			///
+			/// <param name="imagePath">The path of the source image.</param>
+			///
+			/// <returns>The path of the compressed file.</returns>
+			static std::string getCompressedPath(const std::string& imagePath);
+
+			/// <summary>
+			/// Checks whether an image has a compressed file that is newer than the image itself.
+			/// </summary>
+			///
+			/// <param name="imagePath">The path of the source image.</param>
+			///
+			/// <returns>True if the compressed file can be used instead of the image, false otherwise.</returns>
+			static bool hasCompressedFile(const std::string& imagePath);
+
+			/// <summary>
+			/// Returns the size in bytes of a block of 4x4 texels.
+			/// </summary>
+			///
+			/// <param name="format">The block compressed format.</param>
+			///
+			/// <returns>8 for BC1, 16 for the other block compressed formats and 64 for RGBA8.</returns>
+			static size_t getBlockSize(Format format);
+
+			/// <summary>
+			/// Returns the size in bytes of a compressed level.
+			/// </summary>
+			///
+			/// <param name="format">The block compressed format.</param>
+			/// <param name="width">Width of the level in pixels.</param>
+			/// <param name="height">Height of the level in pixels.</param>
+			///
+			/// <returns>The size of the blocks that cover the level.</returns>
+			static size_t getLevelSize(Format format, unsigned width, unsigned height);
+
+		public:
+
+			/// <summary>
+			/// Encodes the colors of a block into BC1 (two RGB565 endpoints along the principal axis of the colors).
+			/// </summary>
+			///
+			/// <param name="block">The 16 texels of the block, row by row.</param>
+			/// <param name="output">Receives the 8 bytes of the block.</param>
+			static void encodeBC1(const Rgba8888 block[16], uint8_t * output);
+
+			/// <summary>
+			/// Encodes one channel of a block into BC4 (two 8-bit endpoints and 3-bit indices), the alpha part of
+			/// BC3 and each half of BC5.
+			/// </summary>
+			///
+			/// <param name="values">The 16 values of the channel, row by row.</param>
+			/// <param name="output">Receives the 8 bytes of the block.</param>
+			static void encodeBC4(const uint8_t values[16], uint8_t * output);
+
+			/// <summary>
+			/// Encodes a block into BC7 mode 6 (one RGBA subset with 7-bit endpoints, p-bits and 4-bit indices).
+			/// </summary>
+			///
+			/// <param name="block">The 16 texels of the block, row by row.</param>
+			/// <param name="output">Receives the 16 bytes of the block.</param>
+			static void encodeBC7(const Rgba8888 block[16], uint8_t * output);
+	};
+}
+
+
+
+#endif
@@ -0,0 +1,91 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "TextureManager.hpp"
+
+
+
+#include "Texture.hpp"
+
+
+
+#include <iterator>
+#include <limits>
+
+
+
+namespace finalPractice
+{
+	size_t TextureManager::budget       = std::numeric_limits< size_t >::max();
+	size_t TextureManager::residentSize = 0;
+
+	std::list< Texture * > TextureManager::leastRecentlyUsed;
+	std::unordered_map< const Texture *, TextureManager::Entry > TextureManager::entries;
+
+
+
+	void TextureManager::setBudget(size_t bytes)
+	{
+		budget = bytes;
+
+		evictOverBudget(nullptr);
+	}
+
+
+
+	void TextureManager::add(Texture * texture, size_t size)
+	{
+		// A texture created again replaces its previous entry
+		remove(texture);
+
+		leastRecentlyUsed.push_front(texture);
+
+		entries[texture] = Entry{ size, leastRecentlyUsed.begin() };
+
+		residentSize += size;
+
+		evictOverBudget(texture);
+	}
+
+	void TextureManager::remove(const Texture * texture)
+	{
+		auto entry = entries.find(texture);
+
+		if (entry == entries.end())
+			return;
+
+		residentSize -= entry->second.size;
+
+		leastRecentlyUsed.erase(entry->second.position);
+		entries.erase(entry);
+	}
+
+	void TextureManager::touch(const Texture * texture)
+	{
+		auto entry = entries.find(texture);
+
+		if (entry != entries.end())
+			leastRecentlyUsed.splice(leastRecentlyUsed.begin(), leastRecentlyUsed, entry->second.position);
+	}
+
+	void TextureManager::evictOverBudget(const Texture * keep)
+	{
+		auto candidate = leastRecentlyUsed.end();
+
+		while (residentSize > budget && candidate != leastRecentlyUsed.begin())
+		{
+			Texture * texture = *--candidate;
+
+			if (texture == keep)
+				continue;
+
+			// The iterator of the evicted texture is erased, so continue from the one after it
+			candidate = std::next(candidate);
+
+			texture->evict();
+		}
+	}
+}
@@ -0,0 +1,112 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef TEXTUREMANAGER_HEADER
+#define TEXTUREMANAGER_HEADER
+
+
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+
+
+
+namespace finalPractice
+{
+	class Texture;
+
+	/// <summary>
+	/// TextureManager keeps track of the video memory used by the resident textures (mip levels included) and
+	/// keeps it under a budget: when a texture is created or reloaded and the budget is exceeded, the textures
+	/// that were bound least recently are evicted. An evicted texture is reloaded from its files (the compressed
+	/// one when there is one) the next time it is bound.
+	/// </summary>
+	class TextureManager
+	{
+		friend class Texture;
+
+		private:
+
+			/// <summary>
+			/// Memory used by a resident texture plus its position in the least recently used list.
+			/// </summary>
+			struct Entry
+			{
+				size_t							   size;		///< Bytes used by the texture and its mip levels.
+				std::list< Texture * >::iterator position;		///< Position of the texture in leastRecentlyUsed.
+			};
+
+			static size_t									  budget;	///< Maximum number of bytes the resident textures may use.
+			static size_t								residentSize;	///< Number of bytes used by the resident textures.
+
+			static std::list< Texture * >			leastRecentlyUsed;	///< Resident textures, the most recently bound first.
+			static std::unordered_map< const Texture *, Entry > entries; ///< Entry of every resident texture.
+
+		public:
+
+			/// <summary>
+			/// Sets the budget of video memory for the textures, evicting the least recently bound ones if it is
+			/// exceeded already (no limit by default).
+			/// </summary>
+			///
+			/// <param name="bytes">Maximum number of bytes the resident textures may use.</param>
+			static void setBudget(size_t bytes);
+
+			/// <summary>
+			/// Returns the budget of video memory for the textures.
+			/// </summary>
+			///
+			/// <returns>Maximum number of bytes the resident textures may use.</returns>
+			static size_t getBudget() { return budget; }
+
+			/// <summary>
+			/// Returns the video memory used by the resident textures.
+			/// </summary>
+			///
+			/// <returns>Number of bytes used by the resident textures and their mip levels.</returns>
+			static size_t getResidentSize() { return residentSize; }
+
+		private:
+
+			/// <summary>
+			/// Starts tracking a texture that has just been uploaded and evicts other textures if the budget is exceeded.
+			/// </summary>
+			///
+			/// <param name="texture">The uploaded texture.</param>
+			/// <param name="size">Bytes used by the texture and its mip levels.</param>
+			static void add(Texture * texture, size_t size);
+
+			/// <summary>
+			/// Stops tracking a texture (it is being deleted or evicted).
+			/// </summary>
+			///
+			/// <param name="texture">The texture.</param>
+			static void remove(const Texture * texture);
+
+			/// <summary>
+			/// Marks a resident texture as the most recently bound one.
+			/// </summary>
+			///
+			/// <param name="texture">The texture being bound.</param>
+			static void touch(const Texture * texture);
+
+			/// <summary>
+			/// Evicts the least recently bound textures until the resident ones fit in the budget.
+			/// </summary>
+			///
+			/// <param name="keep">A texture that must stay resident (the one being uploaded), or nullptr.</param>
+			static void evictOverBudget(const Texture * keep);
+	};
+}
+
+
+
+#endif
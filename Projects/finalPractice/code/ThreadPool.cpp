@@ -0,0 +1,73 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "ThreadPool.hpp"
+
+
+
+#include <algorithm>
+
+
+
+namespace finalPractice
+{
+	ThreadPool::ThreadPool(unsigned threadCount) :
+		stopping(false)
+	{
+		threadCount = std::max(threadCount, 1u);
+
+		for (unsigned i = 0; i < threadCount; ++i)
+			workers.emplace_back(&ThreadPool::work, this);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard< std::mutex > lock(mutex);
+
+			stopping = true;
+		}
+
+		jobsAvailable.notify_all();
+
+		for (std::thread & worker : workers)
+			worker.join();
+	}
+
+
+
+	ThreadPool & ThreadPool::getShared()
+	{
+		// hardware_concurrency() may return 0 when the number of cores is unknown
+		static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+
+		return pool;
+	}
+
+
+
+	void ThreadPool::work()
+	{
+		for (;;)
+		{
+			std::function< void() > job;
+
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+
+				jobsAvailable.wait(lock, [this] () { return stopping || not jobs.empty(); });
+
+				if (jobs.empty())
+					return;													// Stopping and nothing left to do
+
+				job = std::move(jobs.front());
+				jobs.pop();
+			}
+
+			job();
+		}
+	}
+}
@@ -0,0 +1,116 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef THREADPOOL_HEADER
+#define THREADPOOL_HEADER
+
+
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// ThreadPool runs jobs on a fixed set of worker threads. It is used to load assets (file I/O, Assimp
+	/// parsing, image decoding) on the other cores while the thread that owns the OpenGL context only does
+	/// the final uploads. Jobs must not make GL calls.
+	/// </summary>
+	class ThreadPool
+	{
+		private:
+
+			std::vector< std::thread >			  workers;		///< Worker threads.
+			std::queue< std::function< void() > >	 jobs;		///< Jobs waiting for a free worker.
+
+			std::mutex							    mutex;		///< Protects the job queue and the stopping flag.
+			std::condition_variable		   jobsAvailable;		///< Wakes up the workers when a job is queued or the pool stops.
+			bool								 stopping;		///< Flag indicating whether the workers must finish.
+
+		public:
+
+			/// <summary>
+			/// Starts the worker threads.
+			/// </summary>
+			///
+			/// <param name="threadCount">Number of worker threads (at least one is started).</param>
+			ThreadPool(unsigned threadCount);
+
+			/// <summary>
+			/// Destructor that runs the jobs still queued and joins the worker threads.
+			/// </summary>
+			~ThreadPool();
+
+		private:
+
+			// Delete the copy constructor and copy assignment operator to prevent copying
+			ThreadPool(const ThreadPool&) = delete;
+			ThreadPool& operator = (const ThreadPool&) = delete;
+
+		public:
+
+			/// <summary>
+			/// Returns the pool shared by the whole program, with one worker per core except the one of the
+			/// main thread.
+			/// </summary>
+			///
+			/// <returns>The shared thread pool.</returns>
+			static ThreadPool & getShared();
+
+			/// <summary>
+			/// Queues a job to be run by a worker thread.
+			/// </summary>
+			///
+			/// <typeparam name="FUNCTION">Type of the callable object.</typeparam>
+			///
+			/// <param name="function">The job (it must not make GL calls).</param>
+			///
+			/// <returns>A future that receives the result of the job (or the exception it throws).</returns>
+			template< typename FUNCTION >
+			auto submit(FUNCTION&& function) -> std::future< typename std::invoke_result< FUNCTION >::type >
+			{
+				using Result = typename std::invoke_result< FUNCTION >::type;
+
+				// std::function needs a copyable callable, so the task is shared
+				auto task   = std::make_shared< std::packaged_task< Result() > >(std::forward< FUNCTION >(function));
+				auto result = task->get_future();
+
+				{
+					std::lock_guard< std::mutex > lock(mutex);
+
+					jobs.emplace([task] () { (*task)(); });
+				}
+
+				jobsAvailable.notify_one();
+
+				return result;
+			}
+
+		private:
+
+			/// <summary>
+			/// Loop of every worker thread: runs queued jobs until the pool stops and the queue is empty.
+			/// </summary>
+			void work();
+	};
+}
+
+
+
+#endif
@@ -0,0 +1,447 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#include "VirtualHeightMap.hpp"
+
+
+
+#include "ColorBuffer.hpp"
+#include "MipmapGenerator.hpp"
+
+
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <SOIL2.h>
+
+
+
+namespace finalPractice
+{
+	const char VirtualHeightMap::magic[4] = { 'V', 'H', 'M', '1' };
+
+
+
+	// Frees the pixels decoded by SOIL2 once the color buffer that adopted them is destroyed
+	static void freeImage(Rgba8888 * colors)
+	{
+		SOIL_free_image_data(reinterpret_cast< unsigned char * >(colors));
+	}
+
+	// Number of tiles needed to cover a size in texels
+	static unsigned getTileCount(unsigned size, unsigned tileSize)
+	{
+		return (size + tileSize - 1) / tileSize;
+	}
+
+
+
+	VirtualHeightMap::VirtualHeightMap(const std::string& imagePath, unsigned _pageCapacity, float _detailDistance) :
+		file(getCookedPath(imagePath)),
+		tileSize(0),
+		pageSize(0),
+		pagesID(0),
+		indirectionID(0),
+		pageCapacity(std::min(std::max(_pageCapacity, 1u), 256u)),
+		detailDistance(_detailDistance),
+		updateCount(0)
+	{
+		if (not file.isOk() || not parseFile()) // ERROR condition
+		{
+			std::cerr << "Cooked height map " << getCookedPath(imagePath) << " is invalid" << std::endl;
+
+			levels.clear();
+			return;
+		}
+
+		GLsizei pageWidth = GLsizei(tileSize + 2);
+
+		// Pages are sampled with bilinear filtering, their border holds the texels of the neighbouring tiles
+		glGenTextures(1, &pagesID);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, pagesID);
+
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, pageWidth, pageWidth, GLsizei(pageCapacity), 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+
+		// Integer texture read with texelFetch, one texel per tile of the finest level
+		glGenTextures(1, &indirectionID);
+		glBindTexture(GL_TEXTURE_2D, indirectionID);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+		// Every tile starts with the coarsest level, whose only page stays in the first layer
+		unsigned coarsest = unsigned(levels.size() - 1);
+
+		indirection.assign(size_t(levels[0].tilesX) * levels[0].tilesZ * 2, 0);
+
+		for (size_t i = 0; i < indirection.size(); i += 2)
+			indirection[i + 1] = uint8_t(coarsest);
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8UI, GLsizei(levels[0].tilesX), GLsizei(levels[0].tilesZ), 0, GL_RG_INTEGER, GL_UNSIGNED_BYTE, indirection.data());
+
+		layerPages   .assign(pageCapacity, noPage);
+		layerLastUsed.assign(pageCapacity, 0);
+
+		uploader = PixelUploader::acquire();
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, pagesID);
+
+		uploadPage(getPageKey(coarsest, 0, 0), 0);
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+
+	VirtualHeightMap::~VirtualHeightMap()
+	{
+		if (pagesID != 0)
+			glDeleteTextures(1, &pagesID);
+
+		if (indirectionID != 0)
+			glDeleteTextures(1, &indirectionID);
+	}
+
+
+
+	bool VirtualHeightMap::cook(const std::string& imagePath, unsigned tileSize)
+	{
+		if (tileSize < 4) // ERROR condition
+		{
+			std::cerr << "Tiles of " << tileSize << " texels are too small" << std::endl;
+			return false;
+		}
+
+		int width    = 0;
+		int height   = 0;
+		int channels = 0;
+
+		uint8_t * pixels = SOIL_load_image(imagePath.c_str(), &width, &height, &channels, SOIL_LOAD_RGBA);
+
+		if (not pixels) // ERROR condition
+		{
+			std::cerr << "Couldn't load height map " << imagePath << std::endl;
+			return false;
+		}
+
+		// The buffer adopts the decoded pixels instead of copying them
+		ColorBuffer< Rgba8888 > image(width, height, reinterpret_cast< Rgba8888 * >(pixels), freeImage);
+
+		// Heights are linear, so the pyramid is averaged without gamma correction
+		std::vector< ColorBuffer< Rgba8888 > > pyramid = MipmapGenerator::generate(image, MipmapGenerator::BOX, false);
+
+		std::string   cookedPath = getCookedPath(imagePath);
+		std::ofstream file(cookedPath, std::ios::binary | std::ios::trunc);
+
+		if (not file) // ERROR condition
+		{
+			std::cerr << "Couldn't write cooked height map " << cookedPath << std::endl;
+			return false;
+		}
+
+		Header header;
+
+		std::memcpy(header.magic, magic, sizeof(magic));
+
+		header.width      = uint32_t(width);
+		header.height     = uint32_t(height);
+		header.tileSize   = uint32_t(tileSize);
+		header.levelCount = 1;
+
+		// The pyramid stops at the first level that fits in a single tile
+		while (std::max(std::max(width >> (header.levelCount - 1), 1), std::max(height >> (header.levelCount - 1), 1)) > int(tileSize))
+			++header.levelCount;
+
+		file.write(reinterpret_cast< const char * >(&header), sizeof(header));
+
+		std::vector< uint8_t > page(size_t(tileSize + 2) * (tileSize + 2));
+
+		for (unsigned level = 0; level < header.levelCount; ++level)
+		{
+			const ColorBuffer< Rgba8888 > & levelImage = level == 0 ? image : pyramid[level - 1];
+
+			int levelWidth  = int(levelImage.getWidth ());
+			int levelHeight = int(levelImage.getHeight());
+
+			for (unsigned tileZ = 0; tileZ < getTileCount(unsigned(levelHeight), tileSize); ++tileZ)
+			{
+				for (unsigned tileX = 0; tileX < getTileCount(unsigned(levelWidth), tileSize); ++tileX)
+				{
+					// A border of one texel on every side, clamped at the edges of the level
+					for (int y = 0; y < int(tileSize) + 2; ++y)
+					{
+						int sourceY = std::min(std::max(int(tileZ * tileSize) + y - 1, 0), levelHeight - 1);
+
+						for (int x = 0; x < int(tileSize) + 2; ++x)
+						{
+							int sourceX = std::min(std::max(int(tileX * tileSize) + x - 1, 0), levelWidth - 1);
+
+							page[size_t(y) * (tileSize + 2) + x] = levelImage.get(unsigned(sourceY * levelWidth + sourceX)).components[Rgba8888::RED];
+						}
+					}
+
+					file.write(reinterpret_cast< const char * >(page.data()), std::streamsize(page.size()));
+				}
+			}
+		}
+
+		return bool(file);
+	}
+
+	std::string VirtualHeightMap::getCookedPath(const std::string& imagePath)
+	{
+		size_t extension = imagePath.find_last_of('.');
+		size_t separator = imagePath.find_last_of("/\\");
+
+		if (extension == std::string::npos || (separator != std::string::npos && extension < separator))
+			return imagePath + ".vhm";
+
+		return imagePath.substr(0, extension) + ".vhm";
+	}
+
+	bool VirtualHeightMap::hasCookedFile(const std::string& imagePath)
+	{
+		std::error_code sourceError, cookedError;
+
+		auto sourceTime = std::filesystem::last_write_time(imagePath,                sourceError);
+		auto cookedTime = std::filesystem::last_write_time(getCookedPath(imagePath), cookedError);
+
+		// A cooked file older than its source has to be cooked again
+		return not cookedError && (sourceError || sourceTime <= cookedTime);
+	}
+
+
+
+	void VirtualHeightMap::update(glm::vec2 viewerUV)
+	{
+		if (not isOk())
+			return;
+
+		++updateCount;
+
+		const Level & finest   = levels[0];
+		unsigned      coarsest = unsigned(levels.size() - 1);
+
+		std::vector< uint8_t  > wantedLevels(size_t(finest.tilesX) * finest.tilesZ);
+		std::vector< uint64_t > missingPages;
+
+		// Level wanted by every tile of the finest level, from its distance to the viewer in tiles
+		glm::vec2 tilesPerUV = glm::vec2(float(finest.width), float(finest.height)) / float(tileSize);
+
+		for (unsigned tileZ = 0; tileZ < finest.tilesZ; ++tileZ)
+		{
+			for (unsigned tileX = 0; tileX < finest.tilesX; ++tileX)
+			{
+				float distance = glm::length(glm::vec2(float(tileX) + .5f, float(tileZ) + .5f) - viewerUV * tilesPerUV);
+				float level    = distance > detailDistance ? std::floor(std::log2(distance / detailDistance)) + 1.f : 0.f;
+
+				unsigned wanted = unsigned(std::min(level, float(coarsest)));
+				uint64_t key    = getCoveringPage(wanted, tileX, tileZ);
+
+				wantedLevels[size_t(tileZ) * finest.tilesX + tileX] = uint8_t(wanted);
+
+				auto resident = residentPages.find(key);
+
+				if (resident != residentPages.end())
+					layerLastUsed[resident->second] = updateCount;
+				else
+					missingPages.push_back(key);
+			}
+		}
+
+		// Coarser pages first, each of them fills in for a larger region (neighbouring tiles share the coarse pages)
+		std::sort(missingPages.begin(), missingPages.end(), [] (uint64_t a, uint64_t b) { return (a >> 48) != (b >> 48) ? (a >> 48) > (b >> 48) : a < b; });
+
+		missingPages.erase(std::unique(missingPages.begin(), missingPages.end()), missingPages.end());
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		if (not missingPages.empty())
+			glBindTexture(GL_TEXTURE_2D_ARRAY, pagesID);
+
+		for (size_t i = 0; i < missingPages.size() && i < pagesPerUpdate; ++i)
+		{
+			// Reuse the layer used least recently, except for the coarsest page and the pages needed now
+			unsigned layer = 0;
+
+			for (unsigned candidate = 1; candidate < pageCapacity; ++candidate)
+			{
+				if (layerLastUsed[candidate] == updateCount)
+					continue;
+
+				if (layer == 0 || layerLastUsed[candidate] < layerLastUsed[layer])
+					layer = candidate;
+			}
+
+			if (layer == 0)
+				break;
+
+			if (layerPages[layer] != noPage)
+				residentPages.erase(layerPages[layer]);
+
+			uploadPage(missingPages[i], layer);
+
+			layerLastUsed[layer] = updateCount;
+		}
+
+		// Every tile samples the finest resident page at or above the level it wants
+		bool indirectionChanged = false;
+
+		for (unsigned tileZ = 0; tileZ < finest.tilesZ; ++tileZ)
+		{
+			for (unsigned tileX = 0; tileX < finest.tilesX; ++tileX)
+			{
+				size_t tile = size_t(tileZ) * finest.tilesX + tileX;
+
+				for (unsigned level = wantedLevels[tile]; level <= coarsest; ++level)
+				{
+					auto resident = residentPages.find(getCoveringPage(level, tileX, tileZ));
+
+					if (resident == residentPages.end())
+						continue;
+
+					if (indirection[tile * 2] != resident->second || indirection[tile * 2 + 1] != level)
+					{
+						indirection[tile * 2 + 0] = uint8_t(resident->second);
+						indirection[tile * 2 + 1] = uint8_t(level);
+
+						indirectionChanged = true;
+					}
+
+					break;
+				}
+			}
+		}
+
+		if (indirectionChanged)
+		{
+			glBindTexture  (GL_TEXTURE_2D, indirectionID);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GLsizei(finest.tilesX), GLsizei(finest.tilesZ), GL_RG_INTEGER, GL_UNSIGNED_BYTE, indirection.data());
+		}
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+
+	ColorBuffer< Monochrome8 > VirtualHeightMap::readLevel(unsigned level) const
+	{
+		const Level & source = levels[level];
+
+		ColorBuffer< Monochrome8 > heights(source.width, source.height, ColorBuffer< Monochrome8 >::UNINITIALIZED);
+
+		for (unsigned tileZ = 0; tileZ < source.tilesZ; ++tileZ)
+		{
+			for (unsigned tileX = 0; tileX < source.tilesX; ++tileX)
+			{
+				const uint8_t * page = file.getData() + source.offset + (size_t(tileZ) * source.tilesX + tileX) * pageSize;
+
+				// The last tiles of a row or column may be partially outside the level
+				unsigned width  = std::min(tileSize, source.width  - tileX * tileSize);
+				unsigned height = std::min(tileSize, source.height - tileZ * tileSize);
+
+				for (unsigned y = 0; y < height; ++y)
+				{
+					const uint8_t * row = page + size_t(y + 1) * (tileSize + 2) + 1;		// Skip the border
+
+					std::memcpy(heights.colors() + size_t(tileZ * tileSize + y) * source.width + tileX * tileSize, row, width);
+				}
+			}
+		}
+
+		return heights;
+	}
+
+	void VirtualHeightMap::bind() const
+	{
+		glActiveTexture(GL_TEXTURE0 + indirectionUnit);
+		glBindTexture  (GL_TEXTURE_2D, indirectionID);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture  (GL_TEXTURE_2D_ARRAY, pagesID);
+	}
+
+	void VirtualHeightMap::configureShader(GLuint shaderID) const
+	{
+		glUniform1i(glGetUniformLocation(shaderID, "pages"      ), 0);
+		glUniform1i(glGetUniformLocation(shaderID, "indirection"), indirectionUnit);
+		glUniform2f(glGetUniformLocation(shaderID, "level_size" ), float(levels[0].width), float(levels[0].height));
+		glUniform1f(glGetUniformLocation(shaderID, "tile_size"  ), float(tileSize));
+	}
+
+
+
+	bool VirtualHeightMap::parseFile()
+	{
+		if (file.getSize() < sizeof(Header))
+			return false;
+
+		Header header;
+
+		std::memcpy(&header, file.getData(), sizeof(header));
+
+		if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.width == 0 || header.height == 0 || header.tileSize < 4 || header.levelCount == 0 || header.levelCount > 24)
+			return false;
+
+		tileSize = header.tileSize;
+		pageSize = size_t(tileSize + 2) * (tileSize + 2);
+
+		size_t offset = sizeof(Header);
+
+		for (unsigned i = 0; i < header.levelCount; ++i)
+		{
+			Level level;
+
+			level.width  = std::max(header.width  >> i, 1u);
+			level.height = std::max(header.height >> i, 1u);
+			level.tilesX = getTileCount(level.width , tileSize);
+			level.tilesZ = getTileCount(level.height, tileSize);
+			level.offset = offset;
+
+			offset += size_t(level.tilesX) * level.tilesZ * pageSize;
+
+			levels.push_back(level);
+		}
+
+		// The last level must fit in a single tile
+		return offset <= file.getSize() && levels.back().tilesX == 1 && levels.back().tilesZ == 1;
+	}
+
+	uint64_t VirtualHeightMap::getCoveringPage(unsigned level, unsigned tileX, unsigned tileZ) const
+	{
+		// Odd sizes round the coarser levels down, so the last tile column or row may be missing there
+		unsigned x = std::min(tileX >> level, levels[level].tilesX - 1);
+		unsigned z = std::min(tileZ >> level, levels[level].tilesZ - 1);
+
+		return getPageKey(level, x, z);
+	}
+
+	void VirtualHeightMap::uploadPage(uint64_t key, unsigned layer)
+	{
+		const Level & level = levels[key >> 48];
+
+		unsigned x = unsigned(key        & 0xFFFFFF);
+		unsigned z = unsigned(key >> 24  & 0xFFFFFF);
+
+		const uint8_t * page = file.getData() + level.offset + (size_t(z) * level.tilesX + x) * pageSize;
+
+		uploader->uploadLayer(GL_TEXTURE_2D_ARRAY, 0, GLint(layer), GLsizei(tileSize + 2), GLsizei(tileSize + 2), GL_RED, GL_UNSIGNED_BYTE, page, pageSize);
+
+		layerPages[layer] = key;
+		residentPages[key] = layer;
+	}
+}
@@ -0,0 +1,254 @@
+/*
+	Public Domain Code
+
+	Author: Xavier Canals
+*/
+
+#pragma once
+
+
+
+#ifndef VIRTUALHEIGHTMAP_HEADER
+#define VIRTUALHEIGHTMAP_HEADER
+
+
+
+#include "Color.hpp"
+#include "ColorBuffer.hpp"
+#include "MappedFile.hpp"
+#include "PixelUploader.hpp"
+
+
+
+#include <cstdint>
+#include <glad/glad.h>
+#include <glm.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+
+namespace finalPractice
+{
+	/// <summary>
+	/// VirtualHeightMap pages a height map of any size into a small, fixed amount of video memory. The height
+	/// map is cooked offline into square tiles for every level of its mip pyramid (".vhm" file next to the
+	/// image). At runtime the tiles near the viewer are streamed from the mapped file at full resolution and the
+	/// distant regions use coarser tiles: the resident tiles (pages) are layers of an array texture, and an
+	/// indirection texture with one texel per tile of the finest level tells the vertex shader which page and
+	/// level to sample there.
+	/// </summary>
+	class VirtualHeightMap
+	{
+		public:
+
+			static const unsigned defaultTileSize = 128;		///< Texels per side of a tile, without its border.
+			static const GLint   indirectionUnit  =   2;		///< Texture unit of the indirection texture (the pages use unit 0).
+
+		private:
+
+			/// <summary>
+			/// Header at the start of a cooked file, followed by the tiles of every level row by row (the finest level first).
+			/// </summary>
+			struct Header
+			{
+				char	   magic[4];								///< Identifier of the file ("VHM1").
+				uint32_t	  width;								///< Width of the finest level in texels.
+				uint32_t	 height;								///< Height of the finest level in texels.
+				uint32_t   tileSize;								///< Texels per side of a tile, without its border.
+				uint32_t levelCount;								///< Number of levels (the last one fits in a single tile).
+			};
+
+			/// <summary>
+			/// Size and tiles of a level of the pyramid.
+			/// </summary>
+			struct Level
+			{
+				unsigned  width;									///< Width of the level in texels.
+				unsigned height;									///< Height of the level in texels.
+				unsigned tilesX;									///< Number of tile columns.
+				unsigned tilesZ;									///< Number of tile rows.
+				size_t	 offset;									///< Offset of the first tile of the level inside the file.
+			};
+
+			static const char		  magic[4];					///< Identifier at the start of a cooked file.
+			static const unsigned pagesPerUpdate = 4;			///< Maximum number of pages uploaded by every update.
+			static const uint64_t	    noPage = ~uint64_t(0);	///< Key of a layer of the page texture that holds no page.
+
+			MappedFile					 file;					///< The mapped cooked file the pages are read from.
+			std::vector< Level >	   levels;					///< Levels of the pyramid, the finest first.
+			unsigned				 tileSize;					///< Texels per side of a tile, without its border.
+			size_t				  pageSize;						///< Bytes of a tile with its border.
+
+			GLuint					  pagesID;					///< Array texture holding a resident page per layer.
+			GLuint				indirectionID;					///< Layer and level of the page used by every tile of the finest level.
+			unsigned			 pageCapacity;					///< Number of layers of the page texture.
+			float			   detailDistance;					///< Distance (in tiles of the finest level) up to which the finest level is used.
+
+			std::vector< uint64_t >			  layerPages;		///< Key of the page held by every layer.
+			std::vector< unsigned >		   layerLastUsed;		///< Last update that needed the page of every layer.
+			std::unordered_map< uint64_t, unsigned > residentPages; ///< Layer of every resident page, by key.
+			std::vector< uint8_t >			 indirection;		///< Copy of the indirection texture (layer and level per tile).
+			unsigned						 updateCount;		///< Number of updates done.
+
+			std::shared_ptr< PixelUploader >    uploader;		///< Ring of pixel buffer objects the pages are uploaded through.
+
+		public:
+
+			/// <summary>
+			/// Maps the cooked file of a height map and uploads the page of its coarsest level, which always
+			/// stays resident so every region has something to sample.
+			/// </summary>
+			///
+			/// <param name="imagePath">The file path of the source height map.</param>
+			/// <param name="_pageCapacity">Number of pages that can be resident at once (256 at most).</param>
+			/// <param name="_detailDistance">Distance (in tiles of the finest level) up to which the finest level is used,
+			/// every level after it is used up to twice the distance of the previous one.</param>
+			VirtualHeightMap(const std::string& imagePath, unsigned _pageCapacity = 64, float _detailDistance = 2.f);
+
+			/// <summary>
+			/// Destructor that deletes the page and indirection textures.
+			/// </summary>
+			~VirtualHeightMap();
+
+		private:
+
+			// Delete the copy constructor and copy assignment operator to prevent copying
+			VirtualHeightMap(const VirtualHeightMap&) = delete;
+			VirtualHeightMap& operator = (const VirtualHeightMap&) = delete;
+
+		public:
+
+			/// <summary>
+			/// Splits a height map into the tiles of every level of its pyramid and writes them next to it
+			/// (same name with the ".vhm" extension).
+			/// </summary>
+			///
+			/// <param name="imagePath">The file path of the height map.</param>
+			/// <param name="tileSize">Texels per side of a tile.</param>
+			///
+			/// <returns>True if the cooked file was written, false otherwise.</returns>
+			static bool cook(const std::string& imagePath, unsigned tileSize = defaultTileSize);
+
+			/// <summary>
+			/// Returns the path of the cooked file of a height map.
+			/// </summary>
+			///
+			/// <param name="imagePath">The file path of the height map.</param>
+			///
+			/// <returns>The same path with the ".vhm" extension.</returns>
+			static std::string getCookedPath(const std::string& imagePath);
+
+			/// <summary>
+			/// Checks whether a height map has a cooked file at least as recent as the image.
+			/// </summary>
+			///
+			/// <param name="imagePath">The file path of the height map.</param>
+			///
+			/// <returns>True if the cooked file can be used, false otherwise.</returns>
+			static bool hasCookedFile(const std::string& imagePath);
+
+		public:
+
+			/// <summary>
+			/// Checks whether the cooked file was valid and the textures were created.
+			/// </summary>
+			///
+			/// <returns>True if the height map can be sampled, false otherwise.</returns>
+			bool isOk() const { return not levels.empty(); }
+
+			/// <summary>
+			/// Returns the number of levels of the pyramid.
+			/// </summary>
+			///
+			/// <returns>The number of levels, the finest first.</returns>
+			unsigned getLevelCount() const { return unsigned(levels.size()); }
+
+			/// <summary>
+			/// Returns the number of texels of a level of the pyramid.
+			/// </summary>
+			///
+			/// <param name="level">The level.</param>
+			///
+			/// <returns>The width times the height of the level.</returns>
+			size_t getLevelTexelCount(unsigned level) const { return size_t(levels[level].width) * levels[level].height; }
+
+			/// <summary>
+			/// Assembles a whole level of the pyramid from its tiles in the mapped file (no decoding involved).
+			/// </summary>
+			///
+			/// <param name="level">The level.</param>
+			///
+			/// <returns>The heights of the level, row by row.</returns>
+			ColorBuffer< Monochrome8 > readLevel(unsigned level) const;
+
+			/// <summary>
+			/// Chooses the level every region needs from its distance to the viewer, streams in up to a few of
+			/// the missing pages (evicting the ones used least recently) and updates the indirection texture.
+			/// Regions whose page isn't resident yet use the finest resident level above it.
+			/// </summary>
+			///
+			/// <param name="viewerUV">Position of the viewer in texture coordinates of the height map.</param>
+			void update(glm::vec2 viewerUV);
+
+			/// <summary>
+			/// Binds the page texture to texture unit 0 and the indirection texture to its own unit.
+			/// </summary>
+			void bind() const;
+
+			/// <summary>
+			/// Sets the uniforms the shader function that samples the height map needs (the shader must be in use).
+			/// </summary>
+			///
+			/// <param name="shaderID">The ID of the shader program.</param>
+			void configureShader(GLuint shaderID) const;
+
+		private:
+
+			/// <summary>
+			/// Reads the header of the mapped file and computes the size and offset of every level.
+			/// </summary>
+			///
+			/// <returns>True if the file is a valid cooked height map, false otherwise.</returns>
+			bool parseFile();
+
+			/// <summary>
+			/// Builds the key that identifies a page.
+			/// </summary>
+			///
+			/// <param name="level">Level of the page.</param>
+			/// <param name="x">Column of the tile in its level.</param>
+			/// <param name="z">Row of the tile in its level.</param>
+			///
+			/// <returns>The key of the page.</returns>
+			static uint64_t getPageKey(unsigned level, unsigned x, unsigned z)
+			{
+				return uint64_t(level) << 48 | uint64_t(z) << 24 | uint64_t(x);
+			}
+
+			/// <summary>
+			/// Returns the key of the page of a level that covers a tile of the finest level.
+			/// </summary>
+			///
+			/// <param name="level">Level of the page.</param>
+			/// <param name="tileX">Column of the tile in the finest level.</param>
+			/// <param name="tileZ">Row of the tile in the finest level.</param>
+			///
+			/// <returns>The key of the page.</returns>
+			uint64_t getCoveringPage(unsigned level, unsigned tileX, unsigned tileZ) const;
+
+			/// <summary>
+			/// Copies a page from the mapped file into a layer of the page texture.
+			/// </summary>
+			///
+			/// <param name="key">The key of the page.</param>
+			/// <param name="layer">The layer of the page texture.</param>
+			void uploadPage(uint64_t key, unsigned layer);
+	};
+}
+
+
+
+#endif
@@ -9,23 +9,241 @@
 
 
 
+#include "MeshData.hpp"
+#include "PixelConversion.hpp"
 #include "Scene.hpp"
+#include "TextureCompressor.hpp"
+#include "TextureManager.hpp"
+#include "VirtualHeightMap.hpp"
 #include "Window.hpp"
 
 
 
+#include <cassert>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+
+
+using finalPractice::MeshData;
+using finalPractice::MipmapGenerator;
+using finalPractice::PixelConversion;
 using finalPractice::Scene;
+using finalPractice::TextureCompressor;
+using finalPractice::TextureManager;
+using finalPractice::VirtualHeightMap;
 using finalPractice::Window;
 
 
 
-int main(int, char* [])
+/// <summary>
+/// Reads a decimal number of a command line option without throwing on text that isn't one.
+/// </summary>
+/// 
+/// <param name="text">The text of the option.</param>
+/// <param name="maximum">The largest value accepted.</param>
+/// <param name="value">Receives the number when it could be read.</param>
+/// 
+/// <returns>True if the whole text is a number between 0 and maximum.</returns>
+static bool parseUnsigned(const char * text, unsigned long maximum, unsigned long & value)
+{
+	// strtoul accepts a sign and wraps negative numbers around
+	if (text[0] < '0' || text[0] > '9')
+		return false;
+
+	char * end = nullptr;
+
+	errno = 0;
+
+	unsigned long parsed = std::strtoul(text, &end, 10);
+
+	if (*end != '\0' || errno == ERANGE || parsed > maximum)
+		return false;
+
+	value = parsed;
+
+	return true;
+}
+
+
+
+int main(int argc, char* argv[])
 {
+	/// <summary>
+	/// Debug builds check that the vectorized pixel conversion kernels still match their scalar loops.
+	/// </summary>
+	assert(PixelConversion::verify());
+
+	/// <summary>
+	/// Offline cook step: "--cook [--index16] [--quantized] [--overdraw] [--lods N] mesh.fbx ..." writes the cooked ".mesh" file next to every given mesh and exits.
+	/// With --index16 meshes are limited to 16-bit indices and split into chunks when they need more.
+	/// With --quantized the vertices are stored with the quantized layout and with --overdraw the triangles are sorted to reduce overdraw.
+	/// With --lods N a chain of N simplified levels of detail is generated for every mesh.
+	/// </summary>
+	if (argc > 1 && std::string(argv[1]) == "--cook")
+	{
+		MeshData::ImportSettings settings;
+
+		int failures = 0;
+
+		for (int i = 2; i < argc; ++i)
+		{
+			if (std::string(argv[i]) == "--index16")
+			{
+				settings.maxIndexType = GL_UNSIGNED_SHORT;
+				continue;
+			}
+
+			if (std::string(argv[i]) == "--quantized")
+			{
+				settings.quantized = true;
+				continue;
+			}
+
+			if (std::string(argv[i]) == "--overdraw")
+			{
+				settings.sortOverdraw = true;
+				continue;
+			}
+
+			if (std::string(argv[i]) == "--lods" && i + 1 < argc)
+			{
+				unsigned long lodCount;
+
+				if (not parseUnsigned(argv[++i], UINT_MAX, lodCount)) // ERROR condition
+				{
+					std::cerr << "Couldn't read the number of levels of detail " << argv[i] << std::endl;
+					failures += 1;
+					continue;
+				}
+
+				settings.lodCount = unsigned(lodCount);
+				continue;
+			}
+
+			bool cooked = MeshData::cook(argv[i], settings);
+
+			std::cout << (cooked ? "Cooked " : "Couldn't cook ") << argv[i] << std::endl;
+
+			failures += cooked ? 0 : 1;
+		}
+
+		return failures;
+	}
+
+	/// <summary>
+	/// Offline compression step: "--compress [--bc1|--bc3|--bc5|--bc7|--rgba8] [--box] image.png ..." writes the block compressed ".dds" file, with its whole mip chain, next to every given image and exits.
+	/// The format flag applies to the images that follow it (BC7 by default, --rgba8 only bakes the mip chain without compressing it).
+	/// The mip chain is filtered with a Kaiser filter unless --box is given.
+	/// </summary>
+	if (argc > 1 && std::string(argv[1]) == "--compress")
+	{
+		TextureCompressor::Format format = TextureCompressor::BC7;
+		MipmapGenerator::Filter   filter = MipmapGenerator::KAISER;
+
+		int failures = 0;
+
+		for (int i = 2; i < argc; ++i)
+		{
+			std::string argument(argv[i]);
+
+			if (argument == "--bc1") { format = TextureCompressor::BC1; continue; }
+			if (argument == "--bc3") { format = TextureCompressor::BC3; continue; }
+			if (argument == "--bc5") { format = TextureCompressor::BC5; continue; }
+			if (argument == "--bc7") { format = TextureCompressor::BC7; continue; }
+			if (argument == "--rgba8") { format = TextureCompressor::RGBA8; continue; }
+			if (argument == "--box") { filter = MipmapGenerator::BOX; continue; }
+
+			bool compressed = TextureCompressor::compress(argument, format, filter);
+
+			std::cout << (compressed ? "Compressed " : "Couldn't compress ") << argument << std::endl;
+
+			failures += compressed ? 0 : 1;
+		}
+
+		return failures;
+	}
+
+	/// <summary>
+	/// Offline height map step: "--tile-heightmap [--tile N] height_map.png ..." writes the ".vhm" file with the tiles of every level of the
+	/// pyramid next to every given height map and exits. The terrain streams the tiles from that file instead of loading the whole image.
+	/// With --tile N the tiles of the height maps that follow it have N texels per side (128 by default).
+	/// </summary>
+	if (argc > 1 && std::string(argv[1]) == "--tile-heightmap")
+	{
+		unsigned tileSize = VirtualHeightMap::defaultTileSize;
+
+		int failures = 0;
+
+		for (int i = 2; i < argc; ++i)
+		{
+			if (std::string(argv[i]) == "--tile" && i + 1 < argc)
+			{
+				unsigned long parsedSize;
+
+				// An unreadable size is left to the tile size check of cook, which reports it and fails
+				tileSize = parseUnsigned(argv[++i], UINT_MAX, parsedSize) ? unsigned(parsedSize) : 0;
+				continue;
+			}
+
+			bool cooked = VirtualHeightMap::cook(argv[i], tileSize);
+
+			std::cout << (cooked ? "Tiled " : "Couldn't tile ") << argv[i] << std::endl;
+
+			failures += cooked ? 0 : 1;
+		}
+
+		return failures;
+	}
+
+
+
 	constexpr unsigned   viewportWidth = 1024; ///< Viewport width.
 	constexpr unsigned  viewportHeight =  576; ///< Viewport height.
 
 
 
+	/// <summary>
+	/// "--texture-budget MB" limits the video memory used by the textures: when it is exceeded the least recently
+	/// bound ones are evicted, and reloaded from their files when they are bound again.
+	/// </summary>
+	for (int i = 1; i + 1 < argc; ++i)
+	{
+		if (std::string(argv[i]) == "--texture-budget")
+		{
+			unsigned long budget;
+
+			if (not parseUnsigned(argv[i + 1], (unsigned long)(SIZE_MAX >> 20), budget)) // ERROR condition
+			{
+				std::cerr << "Couldn't read the texture budget " << argv[i + 1] << ", the textures have no budget" << std::endl;
+				continue;
+			}
+
+			TextureManager::setBudget(size_t(budget) << 20);
+		}
+	}
+
+	/// <summary>
+	/// "--cubemap-sky" draws the six images of the cube map as the sky instead of the atmosphere, whose sun
+	/// follows the time of day (the T key moves it half an hour forward).
+	/// </summary>
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::string(argv[i]) == "--cubemap-sky")
+			Scene::setCubeMapSky(true);
+	}
+
+	/// <summary>
+	/// Starts loading the scene files on the worker threads while the window and the OpenGL context are created.
+	/// </summary>
+	Scene::prefetchAssets();
+
+
+
 	/// <summary>
 	/// Creates a SDL window with the specified dimensions.
 	/// </summary>
@@ -100,6 +318,8 @@ int main(int, char* [])
 					if (event.key.keysym.sym == SDLK_s) scene.keys[1] = true;
 					if (event.key.keysym.sym == SDLK_a) scene.keys[2] = true;
 					if (event.key.keysym.sym == SDLK_d) scene.keys[3] = true;
+					if (event.key.keysym.sym == SDLK_t) scene.advanceTimeOfDay(.5f);
+					if (event.key.keysym.sym == SDLK_p && not event.key.repeat) scene.toggleSepia();
 					break;
 				}
 